@@ -0,0 +1,216 @@
+// Copyright (C) 2019 Sergey Kapustin <kapucin@gmail.com>
+
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+/** @file */
+
+#ifndef _btr_Crc_hpp_
+#define _btr_Crc_hpp_
+
+// SYSTEM INCLUDES
+#include <stddef.h>
+
+// PROJECT INCLUDES
+#include "devices/defines.hpp"
+
+namespace btr
+{
+
+//==================================================================================================
+// Lookup tables, generated at compile time
+
+struct Crc16Lut
+{
+  uint16_t v[256];
+};
+
+struct Crc32Lut
+{
+  uint32_t v[256];
+};
+
+/** v[k][i] is the CRC of byte i followed by k zero bytes. v[0] is the regular table. */
+struct Crc32Slice8Lut
+{
+  uint32_t v[8][256];
+};
+
+constexpr Crc16Lut makeCrc16Lut()
+{
+  Crc16Lut t = {};
+
+  for (uint16_t i = 0; i < 256; i++) {
+    uint16_t crc = i << 8;
+
+    for (uint8_t j = 0; j < 8; j++) {
+      crc = (crc & 0x8000 ? (crc << 1) ^ 0x1021 : crc << 1);
+    }
+    t.v[i] = crc;
+  }
+  return t;
+}
+
+constexpr Crc32Lut makeCrc32Lut()
+{
+  Crc32Lut t = {};
+
+  for (uint32_t i = 0; i < 256; i++) {
+    uint32_t crc = i;
+
+    for (uint8_t j = 0; j < 8; j++) {
+      crc = (crc & 1 ? (crc >> 1) ^ 0xEDB88320 : crc >> 1);
+    }
+    t.v[i] = crc;
+  }
+  return t;
+}
+
+constexpr Crc32Slice8Lut makeCrc32Slice8Lut()
+{
+  Crc32Slice8Lut t = {};
+  Crc32Lut base = makeCrc32Lut();
+
+  for (uint32_t i = 0; i < 256; i++) {
+    t.v[0][i] = base.v[i];
+  }
+
+  for (uint8_t k = 1; k < 8; k++) {
+    for (uint32_t i = 0; i < 256; i++) {
+      t.v[k][i] = (t.v[k - 1][i] >> 8) ^ t.v[0][t.v[k - 1][i] & 0xFF];
+    }
+  }
+  return t;
+}
+
+/**
+ * CRC kernels. All kernels of one width produce the same value, they differ in speed and memory:
+ *
+ *  Bitwise - no table, suits AVR where a table would take RAM
+ *  Table   - one 256-entry table, one lookup per byte
+ *  Slice8  - eight 256-entry tables (8 KB), eight bytes per iteration, for x86
+ *
+ * Usage: crc = K::finish(K::update(K::init(), data, bytes)), update() can be called repeatedly.
+ */
+
+//==================================================================================================
+// CRC-16/CCITT-FALSE: poly 0x1021, init 0xFFFF, not reflected, check value 0x29B1
+
+struct Crc16Bitwise
+{
+  typedef uint16_t ValueType;
+  static constexpr uint8_t SIZE = 2;
+
+  static uint16_t init()
+  {
+    return 0xFFFF;
+  }
+
+  static uint16_t update(uint16_t crc, const uint8_t* data, size_t bytes)
+  {
+    while (bytes--) {
+      crc ^= uint16_t(*data++) << 8;
+
+      for (uint8_t i = 0; i < 8; i++) {
+        crc = (crc & 0x8000 ? (crc << 1) ^ 0x1021 : crc << 1);
+      }
+    }
+    return crc;
+  }
+
+  static uint16_t finish(uint16_t crc)
+  {
+    return crc;
+  }
+};
+
+struct Crc16Table : public Crc16Bitwise
+{
+  static constexpr Crc16Lut TABLE = makeCrc16Lut();
+
+  static uint16_t update(uint16_t crc, const uint8_t* data, size_t bytes)
+  {
+    while (bytes--) {
+      crc = (crc << 8) ^ TABLE.v[((crc >> 8) ^ *data++) & 0xFF];
+    }
+    return crc;
+  }
+};
+
+//==================================================================================================
+// CRC-32 (IEEE 802.3): poly 0x04C11DB7 reflected, init and xor-out 0xFFFFFFFF,
+// check value 0xCBF43926
+
+struct Crc32Bitwise
+{
+  typedef uint32_t ValueType;
+  static constexpr uint8_t SIZE = 4;
+
+  static uint32_t init()
+  {
+    return 0xFFFFFFFF;
+  }
+
+  static uint32_t update(uint32_t crc, const uint8_t* data, size_t bytes)
+  {
+    while (bytes--) {
+      crc ^= *data++;
+
+      for (uint8_t i = 0; i < 8; i++) {
+        crc = (crc & 1 ? (crc >> 1) ^ 0xEDB88320 : crc >> 1);
+      }
+    }
+    return crc;
+  }
+
+  static uint32_t finish(uint32_t crc)
+  {
+    return crc ^ 0xFFFFFFFF;
+  }
+};
+
+struct Crc32Table : public Crc32Bitwise
+{
+  static constexpr Crc32Lut TABLE = makeCrc32Lut();
+
+  static uint32_t update(uint32_t crc, const uint8_t* data, size_t bytes)
+  {
+    while (bytes--) {
+      crc = (crc >> 8) ^ TABLE.v[(crc ^ *data++) & 0xFF];
+    }
+    return crc;
+  }
+};
+
+struct Crc32Slice8 : public Crc32Bitwise
+{
+  static constexpr Crc32Slice8Lut TABLES = makeCrc32Slice8Lut();
+
+  static uint32_t update(uint32_t crc, const uint8_t* data, size_t bytes)
+  {
+    const auto& t = TABLES.v;
+
+    for (; bytes >= 8; bytes -= 8, data += 8) {
+      // Assemble words byte by byte, so the code doesn't depend on alignment or endianness.
+      uint32_t one = crc
+        ^ (uint32_t(data[0]) | uint32_t(data[1]) << 8 | uint32_t(data[2]) << 16
+            | uint32_t(data[3]) << 24);
+      uint32_t two =
+        uint32_t(data[4]) | uint32_t(data[5]) << 8 | uint32_t(data[6]) << 16
+        | uint32_t(data[7]) << 24;
+
+      crc = t[7][one & 0xFF] ^ t[6][(one >> 8) & 0xFF] ^ t[5][(one >> 16) & 0xFF] ^ t[4][one >> 24]
+        ^ t[3][two & 0xFF] ^ t[2][(two >> 8) & 0xFF] ^ t[1][(two >> 16) & 0xFF] ^ t[0][two >> 24];
+    }
+
+    while (bytes--) {
+      crc = (crc >> 8) ^ t[0][(crc ^ *data++) & 0xFF];
+    }
+    return crc;
+  }
+};
+
+} // namespace btr
+
+#endif // _btr_Crc_hpp_
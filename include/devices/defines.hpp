@@ -12,6 +12,9 @@
 // SYSTEM INCLUDES
 #define _STDC_FORMAT_MACROS
 #include <inttypes.h>
+#if BTR_ESP32 > 0
+#include <driver/i2c_master.h>
+#endif
 
 namespace btr
 {
@@ -46,11 +49,11 @@ namespace btr
 #endif // #if BTR_ESP32 > 0 || BTR_STM32 > 0 || BTR_AVR > 0 || BTR_X86 > 0
 #endif // #ifndef BTR_TIME_ENABLED 
 
-#if BTR_ESP32 > 0 || BTR_STM32 > 0 || BTR_AVR > 0
+#if BTR_ESP32 > 0 || BTR_STM32 > 0 || BTR_AVR > 0 || BTR_X86 > 0
 #define MILLIS()                (Time::millis())
 #define SEC()                   (Time::sec())
 #define TIME_DIFF(a,b)          (Time::diff(a, b))
-#endif // #if BTR_ESP32 > 0 || BTR_STM32 > 0 || BTR_AVR > 0
+#endif // #if BTR_ESP32 > 0 || BTR_STM32 > 0 || BTR_AVR > 0 || BTR_X86 > 0
 
 /** Check if timeout is greater than 0, if so, check if time window has expired. */
 #define IS_TIMEOUT(timeout_ms, start_ms) \
@@ -198,14 +201,13 @@ uint32_t* status();
 // ESP32
 
 #elif BTR_ESP32 > 0
-#include <driver/i2c_master.h>
 
 /** Default clock doesn't work well when power management is enabled. Change it to fix */
 #ifndef BTR_I2C_CLK_SRC 
 #define BTR_I2C_CLK_SRC             I2C_CLK_SRC_DEFAULT // I2C_CLK_SRC_APB
 #endif
-#ifndef BTR_I2C_MASTER_PORT         0
-#define BTR_I2C_MASTER_PORT 
+#ifndef BTR_I2C_MASTER_PORT
+#define BTR_I2C_MASTER_PORT         0
 #endif
 #ifndef BTR_I2C_MASTER_SCL_IO       
 #define BTR_I2C_MASTER_SCL_IO       12 // Default 22
@@ -216,6 +218,15 @@ uint32_t* status();
 #ifndef BTR_I2C_GLITCH_IGNORE_COUNT
 #define BTR_I2C_GLITCH_IGNORE_COUNT 7
 #endif
+/** The number of device handles kept on the bus, see I2CDeviceCache. */
+#ifndef BTR_I2C_DEVICE_CACHE_SIZE
+#define BTR_I2C_DEVICE_CACHE_SIZE   4
+#endif
+
+/** Define I2C write operation. */
+#define BTR_I2C_WRITE               0
+/** Define I2C read operation. */
+#define BTR_I2C_READ                1
 
 //--------------------------------------------------------------------------------------------------
 // STM32
@@ -266,6 +277,27 @@ uint32_t* status();
 #define BTR_I2C_SCAN_MAX            128
 #endif
 
+/** Run transfers from the event and error interrupts through I2CEngine instead of polling the
+ * status flags, STM32 only. */
+#ifndef BTR_I2C_IRQ_ENABLED
+#define BTR_I2C_IRQ_ENABLED         0
+#endif
+
+/** Transfer through Linux i2c-dev instead of the simulated bus (I2CSim), x86 Linux only. */
+#ifndef BTR_I2C_LINUX_DEV_ENABLED
+#define BTR_I2C_LINUX_DEV_ENABLED   0
+#endif
+
+#if BTR_I2C_LINUX_DEV_ENABLED > 0
+#if BTR_X86 == 0 || !defined(__linux__)
+#error "BTR_I2C_LINUX_DEV_ENABLED requires x86 Linux"
+#endif
+/** i2c-dev device file, formatted with the I2C device ID. */
+#ifndef BTR_I2C_DEV_PATH
+#define BTR_I2C_DEV_PATH            "/dev/i2c-%u"
+#endif
+#endif // BTR_I2C_LINUX_DEV_ENABLED > 0
+
 #define BTR_I2C_WRITE_ADDR(addr)    (addr << 1)
 #define BTR_I2C_READ_ADDR(addr)     ((addr << 1) + 1)
 
@@ -358,6 +390,18 @@ typedef enum
 #define BTR_USART_TX_TIMEOUT_MS BTR_USART_IO_TIMEOUT_MS
 #endif
 
+/** Send through the port's DMA channel instead of a TX task, STM32 only. */
+#ifndef BTR_USART_DMA_TX_ENABLED
+#define BTR_USART_DMA_TX_ENABLED 0
+#endif
+
+/** Receive through the port's DMA channel in circular mode instead of a per-byte interrupt, STM32
+ * only. */
+#ifndef BTR_USART_DMA_RX_ENABLED
+#define BTR_USART_DMA_RX_ENABLED 0
+#endif
+
+/** RX/TX ring sizes must be powers of two, see SpscRing. The rings hold one byte less. */
 #ifndef BTR_USART_RX_BUFF_SIZE
 #define BTR_USART_RX_BUFF_SIZE  64
 #endif
@@ -367,6 +411,18 @@ typedef enum
 #ifndef BTR_USART_IR_BUFF_SIZE
 #define BTR_USART_IR_BUFF_SIZE  16
 #endif
+/** USB CDC RX/TX ring sizes, powers of two. Keep them several packets long, so the host isn't
+ * held off (NAK) while a packet waits for room. */
+#ifndef BTR_USB_RX_BUFF_SIZE
+#define BTR_USB_RX_BUFF_SIZE    256
+#endif
+#ifndef BTR_USB_TX_BUFF_SIZE
+#define BTR_USB_TX_BUFF_SIZE    256
+#endif
+/** Bulk endpoint packet size, 64 on a full-speed device. */
+#ifndef BTR_USB_PACKET_SIZE
+#define BTR_USB_PACKET_SIZE     64
+#endif
 /** USB doesn't work with lower values like 64 bytes. Keep it at 128. */
 //#ifndef BTR_USART_CR_BUFF_SIZE
 #define BTR_USART_CR_BUFF_SIZE  128
@@ -376,6 +432,15 @@ typedef enum
 #define BTR_USART_USE_2X        1
 #endif
 
+/** On x86 Linux, allow baud rates without a termios.h constant, e.g. 250000, via termios2. */
+#ifndef BTR_USART_ARBITRARY_BAUD
+#if BTR_X86 > 0 && defined(__linux__)
+#define BTR_USART_ARBITRARY_BAUD 1
+#else
+#define BTR_USART_ARBITRARY_BAUD 0
+#endif
+#endif
+
 #ifndef BTR_USART0_BAUD
 #define BTR_USART0_BAUD         115200
 #endif
@@ -454,6 +519,11 @@ typedef enum
 #define BTR_USART3_CTS          0
 #endif
 
+/** Largest payload of a FramedLink frame, sets the size of its encode and decode buffers. */
+#ifndef BTR_FRAMED_LINK_MTU
+#define BTR_FRAMED_LINK_MTU     256
+#endif
+
 #define BTR_USART_CONFIG(parity, stop_bits, data_bits) \
   ( (parity == ParityType::NONE ? 0 : (parity == ParityType::EVEN ? 32 : 48)) \
     + (stop_bits == StopBitsType::ONE ? 0 : 8) + (2 * (data_bits - 5)) )
@@ -494,6 +564,25 @@ typedef enum
 #ifndef BTR_VL53L0X_LIMIT_MCPS_MAX
 #define BTR_VL53L0X_LIMIT_MCPS_MAX  511.99
 #endif
+/**
+ * Use only fixed-point math, i.e. the signal rate limit in Q9.7 without the float API, so that
+ * targets without an FPU don't link soft-float.
+ */
+#ifndef BTR_VL53L0X_FIXED_POINT_ENABLED
+#define BTR_VL53L0X_FIXED_POINT_ENABLED 0
+#endif
+/** The maximum number of bytes that VL53L0X::writeOps() writes in one transaction. */
+#ifndef BTR_VL53L0X_BURST_MAX
+#define BTR_VL53L0X_BURST_MAX       16
+#endif
+/** The maximum number of sensors in VL53L0XArray. */
+#ifndef BTR_VL53L0X_ARRAY_SIZE
+#define BTR_VL53L0X_ARRAY_SIZE      8
+#endif
+/** VL53L0XArray gives sensors consecutive addresses from this one on. */
+#ifndef BTR_VL53L0X_ARRAY_ADDR
+#define BTR_VL53L0X_ARRAY_ADDR      0x30
+#endif
 
 /** Decode VCSEL (vertical cavity surface emitting laser) pulse period in PCLKs from register. */
 #define BTR_VL53L0X_DECODE_VCSEL(val) (((val) + 1) << 1)
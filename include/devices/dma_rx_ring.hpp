@@ -0,0 +1,341 @@
+// Copyright (C) 2019 Sergey Kapustin <kapucin@gmail.com>
+
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+/** @file */
+
+#ifndef _btr_DmaRxRing_hpp_
+#define _btr_DmaRxRing_hpp_
+
+// SYSTEM INCLUDES
+#include <stddef.h>
+#include <string.h>
+
+// PROJECT INCLUDES
+#include "devices/defines.hpp"
+
+namespace btr
+{
+
+/**
+ * The class is a receive ring that a DMA channel in circular mode fills continuously. The CPU
+ * doesn't see bytes one by one: interrupts at line idle, half transfer and transfer complete call
+ * publish() with the channel's remaining count, which makes everything received so far available
+ * to the reader. Half and complete transfer interrupts guarantee a publication at least every N/2
+ * bytes, so the distance between two publications is never ambiguous.
+ *
+ * The consumer side matches SpscRing: size(), popN(), popWait(), peek(), consume(), clear().
+ * reset() restarts the ring along with the DMA channel.
+ *
+ * DMA doesn't stop when the reader falls behind. When the unread data exceeds N - 1 bytes,
+ * publish() reports an overflow and the reader drops everything buffered on its next call. Since
+ * the channel may be up to N/2 bytes past the last publication, the reader should drain the ring
+ * once capacity() bytes are in, and full() tells the interrupt side to wake it.
+ *
+ * @tparam N - buffer size, power of two up to 32768 so it fits the 16-bit DMA counter
+ */
+template<size_t N>
+class DmaRxRing
+{
+public:
+
+  static_assert(N >= 4 && (N & (N - 1)) == 0, "DmaRxRing size must be a power of two");
+  static_assert(N <= 32768, "DmaRxRing size must fit 16-bit DMA counter");
+
+// LIFECYCLE
+
+  DmaRxRing();
+
+// OPERATIONS
+
+  /**
+   * @return the memory for the DMA channel, it has bufferSize() bytes
+   */
+  uint8_t* buffer();
+
+  /**
+   * @return the number of bytes for the DMA channel's counter
+   */
+  static constexpr size_t bufferSize();
+
+  /**
+   * @return the number of unread bytes the reader should take at most, N/2
+   */
+  static constexpr size_t capacity();
+
+  /**
+   * Interrupt side: make the bytes written by the DMA channel so far available.
+   *
+   * @param remaining - the channel's remaining count, N at the start of each lap
+   * @return true if the reader fell behind and data was lost
+   */
+  bool publish(uint16_t remaining);
+
+  /**
+   * Consumer: remove up to n bytes with at most two copies.
+   *
+   * @param dst - receives the bytes
+   * @param n - number of bytes
+   * @return the number of bytes removed
+   */
+  size_t popN(uint8_t* dst, size_t n);
+
+  /**
+   * Consumer: remove n bytes, blocking while none are available. @see SpscRing::popWait
+   *
+   * @param dst - receives the bytes
+   * @param n - number of bytes
+   * @param wait - callable bool(size_t missing) that blocks until the interrupt signals or a
+   *  time-out expires, and returns false on time-out
+   * @return the number of bytes removed, less than n on time-out
+   */
+  template<typename Wait>
+  size_t popWait(uint8_t* dst, size_t n, Wait wait);
+
+  /**
+   * Consumer: get the contiguous run of bytes at the front of the ring without removing them.
+   *
+   * @param data - receives a pointer to the first byte
+   * @return the number of contiguous bytes
+   */
+  size_t peek(const uint8_t** data);
+
+  /**
+   * Consumer: remove n bytes returned by peek().
+   *
+   * @param n - number of bytes
+   */
+  void consume(size_t n);
+
+  /**
+   * Consumer: remove all bytes.
+   */
+  void clear();
+
+  /**
+   * Forget all bytes and positions, so the next publish() counts from the start of the buffer.
+   * Call it while the DMA channel is stopped, before it is restarted at buffer().
+   */
+  void reset();
+
+// ATTRIBUTES
+
+  /**
+   * @return the number of unread bytes
+   */
+  size_t size() const;
+
+  /**
+   * @return true if there are no unread bytes
+   */
+  bool empty() const;
+
+  /**
+   * @return true if capacity() bytes are unread and the reader should drain the ring
+   */
+  bool full() const;
+
+private:
+
+// OPERATIONS
+
+  /**
+   * Consumer: drop buffered data after an overflow.
+   */
+  void resync();
+
+// ATTRIBUTES
+
+  static constexpr uint16_t MASK = N - 1;
+
+  /** Total bytes published, written by the interrupt side only. */
+  uint32_t written_;
+  /** Total bytes read, written by the consumer only. */
+  uint32_t read_;
+  /** DMA write position at the last publication. */
+  uint16_t dma_pos_;
+  bool overflow_;
+  uint8_t buff_[N];
+};
+
+/////////////////////////////////////////////// INLINE /////////////////////////////////////////////
+
+/////////////////////////////////////////////// PUBLIC /////////////////////////////////////////////
+
+//============================================= LIFECYCLE ==========================================
+
+template<size_t N>
+inline DmaRxRing<N>::DmaRxRing()
+  :
+    written_(0),
+    read_(0),
+    dma_pos_(0),
+    overflow_(false),
+    buff_()
+{
+}
+
+//============================================= OPERATIONS =========================================
+
+template<size_t N>
+inline uint8_t* DmaRxRing<N>::buffer()
+{
+  return buff_;
+}
+
+// static
+template<size_t N>
+inline constexpr size_t DmaRxRing<N>::bufferSize()
+{
+  return N;
+}
+
+// static
+template<size_t N>
+inline constexpr size_t DmaRxRing<N>::capacity()
+{
+  return N / 2;
+}
+
+template<size_t N>
+inline bool DmaRxRing<N>::publish(uint16_t remaining)
+{
+  uint16_t pos = (N - remaining) & MASK;
+  uint16_t bytes = (pos - dma_pos_) & MASK;
+  dma_pos_ = pos;
+
+  if (0 == bytes) {
+    return false;
+  }
+
+  uint32_t written = written_ + bytes;
+  __atomic_store_n(&written_, written, __ATOMIC_RELEASE);
+
+  if (written - __atomic_load_n(&read_, __ATOMIC_ACQUIRE) > MASK) {
+    __atomic_store_n(&overflow_, true, __ATOMIC_RELEASE);
+    return true;
+  }
+  return false;
+}
+
+template<size_t N>
+inline size_t DmaRxRing<N>::popN(uint8_t* dst, size_t n)
+{
+  resync();
+
+  uint32_t read = read_;
+  size_t used = __atomic_load_n(&written_, __ATOMIC_ACQUIRE) - read;
+
+  if (n > used) {
+    n = used;
+  }
+
+  size_t tail = read & MASK;
+  size_t first = N - tail;
+
+  if (first > n) {
+    first = n;
+  }
+
+  memcpy(dst, buff_ + tail, first);
+  memcpy(dst + first, buff_, n - first);
+  __atomic_store_n(&read_, read + n, __ATOMIC_RELEASE);
+  return n;
+}
+
+template<size_t N>
+template<typename Wait>
+inline size_t DmaRxRing<N>::popWait(uint8_t* dst, size_t n, Wait wait)
+{
+  size_t done = 0;
+
+  while (done < n) {
+    done += popN(dst + done, n - done);
+
+    if (done == n) {
+      break;
+    }
+
+    // Stop on a time-out without progress only.
+    if (false == wait(n - done) && empty()) {
+      break;
+    }
+  }
+  return done;
+}
+
+template<size_t N>
+inline size_t DmaRxRing<N>::peek(const uint8_t** data)
+{
+  resync();
+
+  size_t used = __atomic_load_n(&written_, __ATOMIC_ACQUIRE) - read_;
+  size_t tail = read_ & MASK;
+
+  *data = buff_ + tail;
+  return (used < N - tail ? used : N - tail);
+}
+
+template<size_t N>
+inline void DmaRxRing<N>::consume(size_t n)
+{
+  __atomic_store_n(&read_, uint32_t(read_ + n), __ATOMIC_RELEASE);
+}
+
+template<size_t N>
+inline void DmaRxRing<N>::clear()
+{
+  __atomic_store_n(&read_, __atomic_load_n(&written_, __ATOMIC_ACQUIRE), __ATOMIC_RELEASE);
+}
+
+template<size_t N>
+inline void DmaRxRing<N>::reset()
+{
+  dma_pos_ = 0;
+  __atomic_store_n(&written_, 0, __ATOMIC_RELAXED);
+  __atomic_store_n(&read_, 0, __ATOMIC_RELAXED);
+  __atomic_store_n(&overflow_, false, __ATOMIC_RELEASE);
+}
+
+//============================================= ATTRIBUTES =========================================
+
+template<size_t N>
+inline size_t DmaRxRing<N>::size() const
+{
+  if (__atomic_load_n(&overflow_, __ATOMIC_ACQUIRE)) {
+    return 0;
+  }
+  return __atomic_load_n(&written_, __ATOMIC_ACQUIRE) - __atomic_load_n(&read_, __ATOMIC_ACQUIRE);
+}
+
+template<size_t N>
+inline bool DmaRxRing<N>::empty() const
+{
+  return (0 == size());
+}
+
+template<size_t N>
+inline bool DmaRxRing<N>::full() const
+{
+  return (size() >= capacity());
+}
+
+/////////////////////////////////////////////// PRIVATE ////////////////////////////////////////////
+
+//============================================= OPERATIONS =========================================
+
+template<size_t N>
+inline void DmaRxRing<N>::resync()
+{
+  if (__atomic_load_n(&overflow_, __ATOMIC_ACQUIRE)) {
+    // Clear the flag first, so an overflow reported after the drop isn't lost.
+    __atomic_store_n(&overflow_, false, __ATOMIC_RELAXED);
+    clear();
+  }
+}
+
+} // namespace btr
+
+#endif // _btr_DmaRxRing_hpp_
@@ -0,0 +1,231 @@
+// Copyright (C) 2019 Sergey Kapustin <kapucin@gmail.com>
+
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+/** @file */
+
+#ifndef _btr_DmaTxEngine_hpp_
+#define _btr_DmaTxEngine_hpp_
+
+// SYSTEM INCLUDES
+#include <stddef.h>
+
+// PROJECT INCLUDES
+#include "devices/defines.hpp"
+
+namespace btr
+{
+
+/**
+ * The class drives a transmit DMA channel from a byte ring, e.g. SpscRing. Data stays in the ring
+ * while the channel sends it, and each transfer covers the whole contiguous run at the front of
+ * the ring, so a write that wraps around goes out in two transfers.
+ *
+ * States: idle, or busy with one transfer in flight. write() queues data and starts a transfer if
+ * idle. onComplete(), called from the transfer-complete interrupt, releases the sent bytes and
+ * starts the next transfer or goes idle. The ring consumer is whoever owns the busy flag, so
+ * peek() and consume() never run concurrently.
+ *
+ * The hardware is behind Hal, which has to provide:
+ *
+ *  void startDma(const uint8_t* data, uint16_t bytes) - start a memory-to-peripheral transfer
+ *
+ * @tparam Hal - DMA channel
+ * @tparam Ring - SpscRing<uint8_t, N>
+ */
+template<typename Hal, typename Ring>
+class DmaTxEngine
+{
+public:
+
+// LIFECYCLE
+
+  /**
+   * Ctor.
+   *
+   * @param hal - DMA channel, it must outlive this instance
+   * @param ring - transmit data, it must outlive this instance
+   */
+  DmaTxEngine(Hal* hal, Ring* ring);
+
+// OPERATIONS
+
+  /**
+   * Queue as much data as fits and start a transfer if the channel is idle.
+   *
+   * @param data - data buffer
+   * @param bytes - number of bytes
+   * @return the number of bytes queued
+   */
+  size_t write(const uint8_t* data, size_t bytes);
+
+  /**
+   * Queue all data, blocking while the ring is full.
+   *
+   * @param data - data buffer
+   * @param bytes - number of bytes
+   * @param wait - callable bool() that blocks until a transfer completes or a time-out expires,
+   *  and returns false on time-out. It must not miss a completion signalled before it blocks
+   * @return the number of bytes queued, less than bytes if no transfer completed within a
+   *  time-out
+   */
+  template<typename Wait>
+  size_t writeWait(const uint8_t* data, size_t bytes, Wait wait);
+
+  /**
+   * Handle the end of a transfer. Call from the transfer-complete interrupt only.
+   */
+  void onComplete();
+
+// ATTRIBUTES
+
+  /**
+   * @return true if a transfer is in flight
+   */
+  bool busy() const;
+
+  /**
+   * @return the number of bytes queued or in flight
+   */
+  size_t pending() const;
+
+private:
+
+// OPERATIONS
+
+  /**
+   * Take the busy flag if the channel is idle and start a transfer.
+   */
+  void kick();
+
+  /**
+   * Start a transfer of the run at the front of the ring, or go idle if the ring is empty.
+   * Called by the owner of the busy flag.
+   */
+  void startNext();
+
+// ATTRIBUTES
+
+  Hal* hal_;
+  Ring* ring_;
+  /** Bytes of the transfer in flight. */
+  uint16_t in_flight_;
+  bool busy_;
+};
+
+/////////////////////////////////////////////// INLINE /////////////////////////////////////////////
+
+/////////////////////////////////////////////// PUBLIC /////////////////////////////////////////////
+
+//============================================= LIFECYCLE ==========================================
+
+template<typename Hal, typename Ring>
+inline DmaTxEngine<Hal, Ring>::DmaTxEngine(Hal* hal, Ring* ring)
+  :
+    hal_(hal),
+    ring_(ring),
+    in_flight_(0),
+    busy_(false)
+{
+}
+
+//============================================= OPERATIONS =========================================
+
+template<typename Hal, typename Ring>
+inline size_t DmaTxEngine<Hal, Ring>::write(const uint8_t* data, size_t bytes)
+{
+  size_t n = ring_->pushN(data, bytes);
+
+  if (n > 0) {
+    // Publish the data before checking busy_, see startNext().
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    kick();
+  }
+  return n;
+}
+
+template<typename Hal, typename Ring>
+template<typename Wait>
+inline size_t DmaTxEngine<Hal, Ring>::writeWait(const uint8_t* data, size_t bytes, Wait wait)
+{
+  size_t done = 0;
+
+  while (done < bytes) {
+    done += write(data + done, bytes - done);
+
+    if (done == bytes) {
+      break;
+    }
+
+    // Stop on a time-out without progress only.
+    if (false == wait() && ring_->full()) {
+      break;
+    }
+  }
+  return done;
+}
+
+template<typename Hal, typename Ring>
+inline void DmaTxEngine<Hal, Ring>::onComplete()
+{
+  ring_->consume(in_flight_);
+  in_flight_ = 0;
+  startNext();
+}
+
+//============================================= ATTRIBUTES =========================================
+
+template<typename Hal, typename Ring>
+inline bool DmaTxEngine<Hal, Ring>::busy() const
+{
+  return __atomic_load_n(&busy_, __ATOMIC_ACQUIRE);
+}
+
+template<typename Hal, typename Ring>
+inline size_t DmaTxEngine<Hal, Ring>::pending() const
+{
+  return ring_->size();
+}
+
+/////////////////////////////////////////////// PRIVATE ////////////////////////////////////////////
+
+//============================================= OPERATIONS =========================================
+
+template<typename Hal, typename Ring>
+inline void DmaTxEngine<Hal, Ring>::kick()
+{
+  bool idle = false;
+
+  if (__atomic_compare_exchange_n(
+        &busy_, &idle, true, false, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED)) {
+    startNext();
+  }
+}
+
+template<typename Hal, typename Ring>
+inline void DmaTxEngine<Hal, Ring>::startNext()
+{
+  const uint8_t* data = nullptr;
+  size_t bytes = ring_->peek(&data);
+
+  if (0 == bytes) {
+    __atomic_store_n(&busy_, false, __ATOMIC_SEQ_CST);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+    // write() may have queued data and seen busy_ still set. Either it sees busy_ cleared now,
+    // or this sees its data.
+    if (false == ring_->empty()) {
+      kick();
+    }
+    return;
+  }
+
+  in_flight_ = (bytes > 0xFFFF ? 0xFFFF : bytes);
+  hal_->startDma(data, in_flight_);
+}
+
+} // namespace btr
+
+#endif // _btr_DmaTxEngine_hpp_
@@ -0,0 +1,485 @@
+// Copyright (C) 2019 Sergey Kapustin <kapucin@gmail.com>
+
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+/** @file */
+
+#ifndef _btr_FramedLink_hpp_
+#define _btr_FramedLink_hpp_
+
+// SYSTEM INCLUDES
+#include <stddef.h>
+#include <string.h>
+
+// PROJECT INCLUDES
+#include "devices/defines.hpp"
+#include "devices/crc.hpp"
+
+namespace btr
+{
+
+//==================================================================================================
+// Transport results
+
+/**
+ * Bytes transferred by a transport that packs error bits above the lower 16 bits, e.g. Usart.
+ * Errors don't discard the bytes that made it through.
+ */
+inline int32_t ioBytes(uint32_t rc)
+{
+  return rc & 0xFFFF;
+}
+
+/**
+ * Bytes transferred by a transport that returns -1 on error, e.g. UsartTermios.
+ */
+inline int32_t ioBytes(int rc)
+{
+  return rc;
+}
+
+//==================================================================================================
+// Codecs
+
+/**
+ * Consistent Overhead Byte Stuffing. A frame has no zero bytes inside and is enclosed in 0x00
+ * delimiters. Overhead is one byte per 254 bytes of data plus the delimiters.
+ */
+struct Cobs
+{
+  static constexpr uint8_t DELIMITER = 0x00;
+
+  /**
+   * @return the largest encoded size of data, including both delimiters
+   */
+  static constexpr size_t maxEncoded(size_t bytes)
+  {
+    return bytes + bytes / 254 + 3;
+  }
+
+  /** Encodes one frame incrementally into a buffer of maxEncoded() bytes. */
+  class Encoder
+  {
+  public:
+
+    /**
+     * The leading delimiter terminates any line noise received before the frame, so the noise
+     * can't corrupt the frame.
+     */
+    explicit Encoder(uint8_t* dst)
+      :
+        dst_(dst),
+        code_pos_(1),
+        pos_(2),
+        code_(1)
+    {
+      dst_[0] = DELIMITER;
+    }
+
+    void put(const uint8_t* data, size_t bytes)
+    {
+      for (size_t i = 0; i < bytes; i++) {
+        if (data[i] == 0) {
+          closeBlock();
+        } else {
+          dst_[pos_++] = data[i];
+
+          if (++code_ == 0xFF) {
+            closeBlock();
+          }
+        }
+      }
+    }
+
+    /**
+     * @return the size of the frame including the delimiters
+     */
+    size_t finish()
+    {
+      dst_[code_pos_] = code_;
+      dst_[pos_++] = DELIMITER;
+      return pos_;
+    }
+
+  private:
+
+    void closeBlock()
+    {
+      dst_[code_pos_] = code_;
+      code_pos_ = pos_++;
+      code_ = 1;
+    }
+
+    uint8_t* dst_;
+    size_t code_pos_;
+    size_t pos_;
+    uint8_t code_;
+  };
+
+  /**
+   * Decode in place. The output is never longer than the input.
+   *
+   * @param buff - encoded frame without the delimiters
+   * @param bytes - encoded size
+   * @return decoded size or -1 if the frame is malformed
+   */
+  static int32_t decode(uint8_t* buff, size_t bytes)
+  {
+    size_t r = 0;
+    size_t w = 0;
+
+    while (r < bytes) {
+      uint8_t code = buff[r++];
+
+      if (code == 0 || r + code - 1 > bytes) {
+        return -1;
+      }
+
+      for (uint8_t i = 1; i < code; i++) {
+        buff[w++] = buff[r++];
+      }
+
+      if (code < 0xFF && r < bytes) {
+        buff[w++] = 0;
+      }
+    }
+    return w;
+  }
+};
+
+/**
+ * Serial Line IP framing (RFC 1055). Frames start and end with END, so line noise before a frame
+ * is terminated as an empty or corrupt frame. Worst-case overhead is 100%.
+ */
+struct Slip
+{
+  static constexpr uint8_t DELIMITER = 0xC0;
+  static constexpr uint8_t ESC = 0xDB;
+  static constexpr uint8_t ESC_END = 0xDC;
+  static constexpr uint8_t ESC_ESC = 0xDD;
+
+  /**
+   * @return the largest encoded size of data, including both delimiters
+   */
+  static constexpr size_t maxEncoded(size_t bytes)
+  {
+    return 2 * bytes + 2;
+  }
+
+  /** Encodes one frame incrementally into a buffer of maxEncoded() bytes. */
+  class Encoder
+  {
+  public:
+
+    explicit Encoder(uint8_t* dst)
+      :
+        dst_(dst),
+        pos_(0)
+    {
+      dst_[pos_++] = DELIMITER;
+    }
+
+    void put(const uint8_t* data, size_t bytes)
+    {
+      for (size_t i = 0; i < bytes; i++) {
+        switch (data[i]) {
+          case DELIMITER:
+            dst_[pos_++] = ESC;
+            dst_[pos_++] = ESC_END;
+            break;
+          case ESC:
+            dst_[pos_++] = ESC;
+            dst_[pos_++] = ESC_ESC;
+            break;
+          default:
+            dst_[pos_++] = data[i];
+        }
+      }
+    }
+
+    /**
+     * @return the size of the frame including the delimiters
+     */
+    size_t finish()
+    {
+      dst_[pos_++] = DELIMITER;
+      return pos_;
+    }
+
+  private:
+
+    uint8_t* dst_;
+    size_t pos_;
+  };
+
+  /**
+   * Decode in place. The output is never longer than the input.
+   *
+   * @param buff - encoded frame without the delimiters
+   * @param bytes - encoded size
+   * @return decoded size or -1 if the frame is malformed
+   */
+  static int32_t decode(uint8_t* buff, size_t bytes)
+  {
+    size_t w = 0;
+
+    for (size_t r = 0; r < bytes; r++) {
+      if (buff[r] != ESC) {
+        buff[w++] = buff[r];
+      } else if (++r < bytes && buff[r] == ESC_END) {
+        buff[w++] = DELIMITER;
+      } else if (r < bytes && buff[r] == ESC_ESC) {
+        buff[w++] = ESC;
+      } else {
+        return -1;
+      }
+    }
+    return w;
+  }
+};
+
+//==================================================================================================
+
+/**
+ * The class sends and receives CRC-checked frames over a byte stream. Transport is any class with
+ * Usart-like send(buff, bytes), recv(buff, bytes) and available(), e.g. Usart or UsartTermios.
+ *
+ * Received bytes are decoded in place in the receive buffer, and recv() returns a pointer to the
+ * payload there. Frames that fail decoding or CRC are dropped and counted, the link resynchronizes
+ * on the next delimiter.
+ *
+ * @tparam Transport - byte stream
+ * @tparam Codec - Cobs or Slip
+ * @tparam Crc - one of the kernels in crc.hpp, e.g. Crc16Bitwise on AVR, Crc32Slice8 on x86
+ * @tparam MTU - largest payload
+ */
+template<typename Transport, typename Codec = Cobs, typename Crc = Crc16Table,
+  uint16_t MTU = BTR_FRAMED_LINK_MTU>
+class FramedLink
+{
+public:
+
+  /** Frame counters. */
+  struct Stats
+  {
+    uint32_t frames;
+    uint32_t codec_errors;
+    uint32_t crc_errors;
+    uint32_t overflows;
+  };
+
+  /** The size of an encoded frame with the largest payload. */
+  static constexpr size_t FRAME_SIZE = Codec::maxEncoded(MTU + Crc::SIZE);
+
+// LIFECYCLE
+
+  /**
+   * Ctor.
+   *
+   * @param transport - open byte stream, it must outlive this instance
+   */
+  explicit FramedLink(Transport* transport);
+
+// OPERATIONS
+
+  /**
+   * Encode and send a frame.
+   *
+   * @param payload - data
+   * @param bytes - payload size, up to MTU
+   * @return bits from 16 up to 24 contain error code(s), lower 16 bits contain the payload size
+   */
+  uint32_t send(const uint8_t* payload, uint16_t bytes);
+
+  /**
+   * Receive the next valid frame. A partially received frame stays buffered, so the call can be
+   * repeated after a time-out.
+   *
+   * @param payload - receives a pointer to the payload in the receive buffer. It is valid until
+   *  the next call to recv() or reset()
+   * @return bits from 16 up to 24 contain error code(s), lower 16 bits contain the payload size.
+   *  BTR_DEV_ENODATA if the transport timed out before a complete frame arrived
+   */
+  uint32_t recv(const uint8_t** payload);
+
+  /**
+   * Drop buffered receive data.
+   */
+  void reset();
+
+// ATTRIBUTES
+
+  /**
+   * @return frame counters
+   */
+  const Stats& stats() const;
+
+private:
+
+// OPERATIONS
+
+  /**
+   * Move unscanned data after the last returned frame to the start of the buffer.
+   */
+  void compact();
+
+// ATTRIBUTES
+
+  Transport* transport_;
+  Stats stats_;
+  /** Bytes in rx_buff_. */
+  size_t rx_len_;
+  /** Bytes of rx_buff_ already searched for a delimiter. */
+  size_t rx_scan_;
+  /** Bytes of rx_buff_ taken by the last returned frame. */
+  size_t rx_consumed_;
+  uint8_t tx_buff_[FRAME_SIZE];
+  uint8_t rx_buff_[FRAME_SIZE];
+};
+
+/////////////////////////////////////////////// INLINE /////////////////////////////////////////////
+
+/////////////////////////////////////////////// PUBLIC /////////////////////////////////////////////
+
+//============================================= LIFECYCLE ==========================================
+
+template<typename Transport, typename Codec, typename Crc, uint16_t MTU>
+inline FramedLink<Transport, Codec, Crc, MTU>::FramedLink(Transport* transport)
+  :
+    transport_(transport),
+    stats_(),
+    rx_len_(0),
+    rx_scan_(0),
+    rx_consumed_(0)
+{
+}
+
+//============================================= OPERATIONS =========================================
+
+template<typename Transport, typename Codec, typename Crc, uint16_t MTU>
+inline uint32_t FramedLink<Transport, Codec, Crc, MTU>::send(const uint8_t* payload, uint16_t bytes)
+{
+  if (bytes > MTU) {
+    return BTR_DEV_EOVERFLOW;
+  }
+
+  typename Crc::ValueType crc = Crc::finish(Crc::update(Crc::init(), payload, bytes));
+  uint8_t crc_bytes[Crc::SIZE];
+
+  for (uint8_t i = 0; i < Crc::SIZE; i++) {
+    crc_bytes[i] = uint8_t(crc >> (8 * i));
+  }
+
+  typename Codec::Encoder encoder(tx_buff_);
+  encoder.put(payload, bytes);
+  encoder.put(crc_bytes, Crc::SIZE);
+  size_t frame_size = encoder.finish();
+
+  int32_t sent = ioBytes(transport_->send((const char*) tx_buff_, uint32_t(frame_size)));
+
+  if (sent != int32_t(frame_size)) {
+    return BTR_DEV_ESENDBYTE;
+  }
+  return bytes;
+}
+
+template<typename Transport, typename Codec, typename Crc, uint16_t MTU>
+inline uint32_t FramedLink<Transport, Codec, Crc, MTU>::recv(const uint8_t** payload)
+{
+  compact();
+
+  while (true) {
+    while (rx_scan_ < rx_len_) {
+      if (rx_buff_[rx_scan_++] != Codec::DELIMITER) {
+        continue;
+      }
+
+      // The frame starts at the beginning of the buffer since the buffer is compacted after each
+      // frame.
+      int32_t bytes = Codec::decode(rx_buff_, rx_scan_ - 1);
+      rx_consumed_ = rx_scan_;
+
+      if (bytes < 0) {
+        stats_.codec_errors++;
+      } else if (bytes > 0 && bytes < Crc::SIZE) {
+        stats_.codec_errors++;
+      } else if (bytes > 0) {
+        bytes -= Crc::SIZE;
+        typename Crc::ValueType crc = Crc::finish(Crc::update(Crc::init(), rx_buff_, bytes));
+        typename Crc::ValueType rx_crc = 0;
+
+        for (uint8_t i = 0; i < Crc::SIZE; i++) {
+          rx_crc |= typename Crc::ValueType(rx_buff_[bytes + i]) << (8 * i);
+        }
+
+        if (crc == rx_crc) {
+          stats_.frames++;
+          *payload = rx_buff_;
+          return bytes;
+        }
+        stats_.crc_errors++;
+      }
+
+      // Skip a bad or empty frame and continue with the data after it.
+      compact();
+    }
+
+    if (rx_len_ == FRAME_SIZE) {
+      // No delimiter within the largest frame, drop the data and resync on the next delimiter.
+      stats_.overflows++;
+      rx_len_ = rx_scan_ = 0;
+    }
+
+    // Take whatever is already queued, or wait for one byte.
+    int available = transport_->available();
+    size_t space = FRAME_SIZE - rx_len_;
+    size_t bytes = 1;
+
+    if (available > 0) {
+      bytes = (size_t(available) < space ? size_t(available) : space);
+    }
+
+    int32_t received = ioBytes(transport_->recv((char*) rx_buff_ + rx_len_, uint32_t(bytes)));
+
+    if (received <= 0) {
+      return BTR_DEV_ENODATA;
+    }
+    rx_len_ += received;
+  }
+}
+
+template<typename Transport, typename Codec, typename Crc, uint16_t MTU>
+inline void FramedLink<Transport, Codec, Crc, MTU>::reset()
+{
+  rx_len_ = rx_scan_ = rx_consumed_ = 0;
+}
+
+//============================================= ATTRIBUTES =========================================
+
+template<typename Transport, typename Codec, typename Crc, uint16_t MTU>
+inline const typename FramedLink<Transport, Codec, Crc, MTU>::Stats&
+FramedLink<Transport, Codec, Crc, MTU>::stats() const
+{
+  return stats_;
+}
+
+/////////////////////////////////////////////// PRIVATE ////////////////////////////////////////////
+
+//============================================= OPERATIONS =========================================
+
+template<typename Transport, typename Codec, typename Crc, uint16_t MTU>
+inline void FramedLink<Transport, Codec, Crc, MTU>::compact()
+{
+  if (rx_consumed_ > 0) {
+    rx_len_ -= rx_consumed_;
+    rx_scan_ -= rx_consumed_;
+    memmove(rx_buff_, rx_buff_ + rx_consumed_, rx_len_);
+    rx_consumed_ = 0;
+  }
+}
+
+} // namespace btr
+
+#endif // _btr_FramedLink_hpp_
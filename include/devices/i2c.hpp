@@ -14,12 +14,21 @@
 // PROJECT INCLUDES
 #include "devices/defines.hpp"
 #include "utility/value_codec.hpp"
+#if BTR_STM32 > 0 && BTR_I2C_IRQ_ENABLED > 0
+#include "devices/i2c_engine.hpp"
+#elif BTR_ESP32 > 0
+#include "devices/i2c_device_cache.hpp"
+#elif BTR_X86 > 0 && BTR_I2C_LINUX_DEV_ENABLED == 0
+#include "devices/x86/i2c_sim.hpp"
+#endif
 
 namespace btr
 {
 
 /**
- * The class implements I2C protocol handling for AVR/STM32 platforms.
+ * The class implements I2C protocol handling for AVR/STM32/ESP32 platforms. On x86, transfers go
+ * to device models on a simulated bus, @see sim(), or with BTR_I2C_LINUX_DEV_ENABLED, to Linux
+ * i2c-dev.
  */
 class I2C
 {
@@ -31,7 +40,7 @@ public:
    * Construct new object with a given device ID.
    *
    * @param dev_id - device ID. On AVR it can be any numeric value. On STM32, it's one of
-   *  I2C1 or I2C2.
+   *  I2C1 or I2C2. With Linux i2c-dev, it's N of /dev/i2c-N.
    */
   I2C(uint32_t dev_id);
 
@@ -134,8 +143,96 @@ public:
    */
   uint32_t read(uint8_t addr, uint8_t* buff, uint8_t count, bool stop_comm = true);
 
+  /**
+   * Write bytes, e.g. a register address, then read from the same device after a repeated start,
+   * with no stop condition in between.
+   *
+   * @param addr - slave address
+   * @param wbuff - the bytes to write
+   * @param wcount - the number of bytes in wbuff
+   * @param rbuff - buffer to store the data in
+   * @param rcount - number of bytes to read
+   * @return status code as described in defines.hpp
+   */
+  uint32_t writeRead(
+      uint8_t addr, const uint8_t* wbuff, uint8_t wcount, uint8_t* rbuff, uint8_t rcount);
+
+#if BTR_STM32 > 0 && BTR_I2C_IRQ_ENABLED > 0
+  /**
+   * Queue a transaction and return immediately. The transaction's callback runs from the I2C
+   * interrupt once it completes.
+   *
+   * @param t - transaction, it must stay valid until done is set
+   * @return status code as described in defines.hpp
+   */
+  uint32_t submit(I2CTransaction* t);
+
+  /**
+   * Queue a transaction and block the calling task until it completes. Other tasks run meanwhile.
+   * The transaction's callback is replaced.
+   *
+   * @param t - transaction
+   * @param timeout - maximum time in milliseconds, the transaction is aborted after that
+   * @return status code as described in defines.hpp, lower 16 bits contain the number of bytes
+   *  sent and received
+   */
+  uint32_t transfer(I2CTransaction* t, uint32_t timeout = BTR_I2C_IO_TIMEOUT_MS);
+
+  /**
+   * Handle the event interrupt.
+   */
+  void onEvent();
+
+  /**
+   * Handle the error interrupt.
+   */
+  void onError();
+#endif
+
+#if BTR_X86 > 0 && BTR_I2C_LINUX_DEV_ENABLED == 0
+  /**
+   * Provide the simulated bus, to attach device models and read bus statistics.
+   *
+   * @return the bus
+   */
+  I2CSim* sim();
+#endif
+
 private:
 
+#if BTR_STM32 > 0 && BTR_I2C_IRQ_ENABLED > 0
+  /** Registers of the peripheral, used by I2CEngine. */
+  struct Hal
+  {
+    uint16_t sr1();
+    uint16_t sr2();
+    void clearSr1(uint16_t bits);
+    uint8_t readDr();
+    void writeDr(uint8_t value);
+    void start();
+    void stop();
+    void setAck(bool on);
+    void setPos(bool on);
+    void enableBufferIrq(bool on);
+    void reset();
+    void lock();
+    void unlock();
+
+    I2C* owner;
+  };
+#elif BTR_ESP32 > 0
+  /** Adds and removes devices on the bus, used by I2CDeviceCache. */
+  struct Bus
+  {
+    typedef i2c_master_dev_handle_t Handle;
+
+    Handle addDevice(uint8_t addr);
+    void removeDevice(Handle handle);
+
+    I2C* owner;
+  };
+#endif
+
 // OPERATIONS
 
   /**
@@ -193,11 +290,25 @@ private:
 
 #if BTR_ESP32 > 0
   i2c_master_bus_handle_t bus_handle_;
+  /** The device of the current transfer, owned by devices_. */
   i2c_master_dev_handle_t dev_handle_;
+  Bus bus_;
+  I2CDeviceCache<Bus, BTR_I2C_DEVICE_CACHE_SIZE> devices_;
 #else
   /** This device's port identifier (I2C1, I2C2 in STM32); it is not I2C address. */
   uint32_t bus_handle_;
 #endif
+#if BTR_STM32 > 0 && BTR_I2C_IRQ_ENABLED > 0
+  Hal hal_;
+  /** Runs submitted transactions from the interrupts. */
+  I2CEngine<Hal> engine_;
+#endif
+#if BTR_X86 > 0 && BTR_I2C_LINUX_DEV_ENABLED > 0
+  /** i2c-dev file descriptor, -1 if the device is closed. */
+  int fd_;
+#elif BTR_X86 > 0
+  I2CSim sim_;
+#endif
 
   /** Temporary buffer to read/write a byte to. */
   uint8_t buff_[sizeof(uint64_t)];
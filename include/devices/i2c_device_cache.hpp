@@ -0,0 +1,163 @@
+// Copyright (C) 2019 Sergey Kapustin <kapucin@gmail.com>
+
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+/** @file */
+
+#ifndef _btr_I2CDeviceCache_hpp_
+#define _btr_I2CDeviceCache_hpp_
+
+// SYSTEM INCLUDES
+#include <stddef.h>
+
+// PROJECT INCLUDES
+#include "devices/defines.hpp"
+
+namespace btr
+{
+
+/**
+ * The class keeps the driver handles of the last N slave addresses used on a bus, so a transfer
+ * doesn't add a device to the bus and remove it again each time, e.g. with ESP-IDF's
+ * i2c_master_bus_add_device() and i2c_master_bus_rm_device(). When the table is full, the least
+ * recently used handle is removed.
+ *
+ * The bus is behind Bus, which has to provide:
+ *
+ *  typedef ... Handle - device handle, nullptr if there is none
+ *  Handle addDevice(uint8_t addr) - add a device with a 7-bit address, nullptr on failure
+ *  void removeDevice(Handle handle) - remove a device
+ *
+ * @tparam Bus - I2C bus driver
+ * @tparam N - the number of handles to keep
+ */
+template<typename Bus, uint8_t N>
+class I2CDeviceCache
+{
+public:
+
+  typedef typename Bus::Handle Handle;
+
+// LIFECYCLE
+
+  /**
+   * Ctor.
+   *
+   * @param bus - bus driver, it must outlive this instance
+   */
+  explicit I2CDeviceCache(Bus* bus);
+
+// OPERATIONS
+
+  /**
+   * Provide the handle of a device, add the device to the bus if it isn't in the table.
+   *
+   * @param addr - 7-bit slave address
+   * @return handle, nullptr if the bus couldn't add the device
+   */
+  Handle get(uint8_t addr);
+
+  /**
+   * Remove all devices from the bus, e.g. before the bus is deleted.
+   */
+  void clear();
+
+// ATTRIBUTES
+
+  /**
+   * @return the number of devices in the table
+   */
+  uint8_t size() const;
+
+private:
+
+  struct Entry
+  {
+    Handle handle;
+    /** Value of uses_ at the last get(). */
+    uint32_t used;
+    uint8_t addr;
+  };
+
+// ATTRIBUTES
+
+  Bus* bus_;
+  uint32_t uses_;
+  Entry entries_[N];
+};
+
+/////////////////////////////////////////////// INLINE /////////////////////////////////////////////
+
+/////////////////////////////////////////////// PUBLIC /////////////////////////////////////////////
+
+//============================================= LIFECYCLE ==========================================
+
+template<typename Bus, uint8_t N>
+inline I2CDeviceCache<Bus, N>::I2CDeviceCache(Bus* bus)
+  :
+    bus_(bus),
+    uses_(0),
+    entries_()
+{
+  static_assert(N > 0, "Cache must have at least one entry");
+}
+
+//============================================= OPERATIONS =========================================
+
+template<typename Bus, uint8_t N>
+inline typename I2CDeviceCache<Bus, N>::Handle I2CDeviceCache<Bus, N>::get(uint8_t addr)
+{
+  Entry* victim = &entries_[0];
+
+  for (Entry& e : entries_) {
+    if (nullptr != e.handle && addr == e.addr) {
+      e.used = ++uses_;
+      return e.handle;
+    }
+
+    // An empty entry first, the least recently used one otherwise.
+    if (nullptr != victim->handle && (nullptr == e.handle || e.used < victim->used)) {
+      victim = &e;
+    }
+  }
+
+  if (nullptr != victim->handle) {
+    bus_->removeDevice(victim->handle);
+    victim->handle = nullptr;
+  }
+
+  victim->handle = bus_->addDevice(addr);
+  victim->addr = addr;
+  victim->used = ++uses_;
+  return victim->handle;
+}
+
+template<typename Bus, uint8_t N>
+inline void I2CDeviceCache<Bus, N>::clear()
+{
+  for (Entry& e : entries_) {
+    if (nullptr != e.handle) {
+      bus_->removeDevice(e.handle);
+      e.handle = nullptr;
+    }
+  }
+}
+
+//============================================= ATTRIBUTES =========================================
+
+template<typename Bus, uint8_t N>
+inline uint8_t I2CDeviceCache<Bus, N>::size() const
+{
+  uint8_t n = 0;
+
+  for (const Entry& e : entries_) {
+    n += (nullptr != e.handle ? 1 : 0);
+  }
+  return n;
+}
+
+} // namespace btr
+
+#endif // _btr_I2CDeviceCache_hpp_
@@ -0,0 +1,485 @@
+// Copyright (C) 2019 Sergey Kapustin <kapucin@gmail.com>
+
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+/** @file */
+
+#ifndef _btr_I2CEngine_hpp_
+#define _btr_I2CEngine_hpp_
+
+// SYSTEM INCLUDES
+#include <stddef.h>
+
+// PROJECT INCLUDES
+#include "devices/defines.hpp"
+
+namespace btr
+{
+
+/**
+ * One I2C master transfer: an optional command (e.g. a register address) and write data, then,
+ * after a repeated start, optional read data. Without command, write and read data, the transfer
+ * only checks that the address is acknowledged.
+ *
+ * The transaction belongs to the engine from submit() until done is set, so it must stay valid and
+ * unchanged meanwhile.
+ */
+struct I2CTransaction
+{
+  /** Completion callback, called from the I2C interrupt. */
+  typedef void (*Callback)(I2CTransaction* t);
+
+  /** 7-bit slave address. */
+  uint8_t addr = 0;
+  /** Bytes sent before wr, e.g. an 8 or 16-bit register address. */
+  uint8_t cmd[2] = {};
+  uint8_t cmd_bytes = 0;
+  const uint8_t* wr = nullptr;
+  uint16_t wr_bytes = 0;
+  uint8_t* rd = nullptr;
+  uint16_t rd_bytes = 0;
+  Callback callback = nullptr;
+  /** Caller's data for the callback, e.g. a task to notify. */
+  void* arg = nullptr;
+  /** Status code as described in defines.hpp, lower 16 bits contain the number of bytes sent and
+   * received. Valid once done is set. */
+  volatile uint32_t status = 0;
+  volatile bool done = false;
+  /** Next transaction in the engine's queue. */
+  I2CTransaction* next = nullptr;
+};
+
+/**
+ * The class runs queued I2C master transactions from the event and error interrupts of an
+ * STM32F1-style I2C peripheral, so the submitting task sleeps instead of polling status flags
+ * during the transfer. The read sequences follow the reference manual (RM0008): a single byte
+ * NACKs before ADDR is cleared, two bytes use POS and BTF, longer reads take the last three bytes
+ * on BTF.
+ *
+ * The peripheral is behind Hal, which has to provide:
+ *
+ *  uint16_t sr1() - read SR1, bits are the SR1_* constants
+ *  uint16_t sr2() - read SR2, which clears ADDR after sr1()
+ *  void clearSr1(uint16_t bits) - clear error bits in SR1
+ *  uint8_t readDr() and void writeDr(uint8_t value) - data register
+ *  void start(), void stop() - request a (repeated) start or a stop condition
+ *  void setAck(bool on), void setPos(bool on) - CR1 ACK and POS bits
+ *  void enableBufferIrq(bool on) - CR2 ITBUFEN, TXE/RXNE interrupts. ITEVTEN and ITERREN stay on
+ *  void reset() - re-initialize the peripheral after a time-out
+ *  void lock(), void unlock() - keep the interrupts out, e.g. a FreeRTOS critical section
+ *
+ * submit() and abort() are called from tasks, onEvent() and onError() from the interrupts.
+ *
+ * @tparam Hal - I2C peripheral
+ */
+template<typename Hal>
+class I2CEngine
+{
+public:
+
+  /** SR1 bits. */
+  static constexpr uint16_t SR1_SB    = 0x0001;
+  static constexpr uint16_t SR1_ADDR  = 0x0002;
+  static constexpr uint16_t SR1_BTF   = 0x0004;
+  static constexpr uint16_t SR1_RXNE  = 0x0040;
+  static constexpr uint16_t SR1_TXE   = 0x0080;
+  static constexpr uint16_t SR1_BERR  = 0x0100;
+  static constexpr uint16_t SR1_ARLO  = 0x0200;
+  static constexpr uint16_t SR1_AF    = 0x0400;
+  static constexpr uint16_t SR1_OVR   = 0x0800;
+  static constexpr uint16_t SR1_ERRORS = SR1_BERR | SR1_ARLO | SR1_AF | SR1_OVR;
+
+// LIFECYCLE
+
+  /**
+   * Ctor.
+   *
+   * @param hal - I2C peripheral, it must outlive this instance
+   */
+  explicit I2CEngine(Hal* hal);
+
+// OPERATIONS
+
+  /**
+   * Queue a transaction, and start it if the bus is idle. The callback is called, and done is set,
+   * once it completes.
+   *
+   * @param t - transaction
+   * @return status code as described in defines.hpp
+   */
+  uint32_t submit(I2CTransaction* t);
+
+  /**
+   * Remove a transaction that didn't complete in time. If it is on the bus, the peripheral is
+   * reset and the next transaction starts. The callback isn't called.
+   *
+   * @param t - transaction
+   * @return true if the transaction was removed, false if it had completed
+   */
+  bool abort(I2CTransaction* t);
+
+  /**
+   * Handle the event interrupt.
+   */
+  void onEvent();
+
+  /**
+   * Handle the error interrupt.
+   */
+  void onError();
+
+// ATTRIBUTES
+
+  /**
+   * @return true if a transaction is on the bus or queued
+   */
+  bool busy() const;
+
+private:
+
+  typedef enum
+  {
+    IDLE,
+    WRITE,
+    READ
+  } PhaseType;
+
+// OPERATIONS
+
+  /**
+   * Start the transaction at the head of the queue.
+   */
+  void startHead();
+
+  /**
+   * Finish the transaction at the head of the queue and start the next one.
+   *
+   * @param status - status code, without the byte count
+   * @param notify - call the callback
+   */
+  void complete(uint32_t status, bool notify);
+
+  void onWriteEvent(I2CTransaction* t, uint16_t sr1);
+  void onReadEvent(I2CTransaction* t, uint16_t sr1);
+
+  /**
+   * @return the number of command and write bytes of the transaction
+   */
+  static uint16_t txBytes(const I2CTransaction* t);
+
+// ATTRIBUTES
+
+  Hal* hal_;
+  /** The transaction on the bus, then the ones waiting. */
+  I2CTransaction* volatile head_;
+  I2CTransaction* tail_;
+  PhaseType phase_;
+  uint16_t tx_idx_;
+  uint16_t rx_idx_;
+  /** A start condition is requested, events other than SB are stale. */
+  bool wait_start_;
+};
+
+/////////////////////////////////////////////// INLINE /////////////////////////////////////////////
+
+/////////////////////////////////////////////// PUBLIC /////////////////////////////////////////////
+
+//============================================= LIFECYCLE ==========================================
+
+template<typename Hal>
+inline I2CEngine<Hal>::I2CEngine(Hal* hal)
+  :
+    hal_(hal),
+    head_(nullptr),
+    tail_(nullptr),
+    phase_(IDLE),
+    tx_idx_(0),
+    rx_idx_(0),
+    wait_start_(false)
+{
+}
+
+//============================================= OPERATIONS =========================================
+
+template<typename Hal>
+inline uint32_t I2CEngine<Hal>::submit(I2CTransaction* t)
+{
+  if (nullptr == t || t->cmd_bytes > sizeof(t->cmd) ||
+      (t->wr_bytes > 0 && nullptr == t->wr) || (t->rd_bytes > 0 && nullptr == t->rd)) {
+    return BTR_DEV_EINVAL;
+  }
+
+  t->status = BTR_DEV_ENOERR;
+  t->done = false;
+  t->next = nullptr;
+
+  hal_->lock();
+
+  if (nullptr == head_) {
+    head_ = tail_ = t;
+    startHead();
+  } else {
+    tail_->next = t;
+    tail_ = t;
+  }
+
+  hal_->unlock();
+  return BTR_DEV_ENOERR;
+}
+
+template<typename Hal>
+inline bool I2CEngine<Hal>::abort(I2CTransaction* t)
+{
+  bool found = false;
+
+  hal_->lock();
+
+  if (t == head_) {
+    found = true;
+    hal_->reset();
+    complete(BTR_DEV_ETIMEOUT, false);
+  } else if (nullptr != head_) {
+    for (I2CTransaction* prev = head_; nullptr != prev->next; prev = prev->next) {
+      if (prev->next == t) {
+        found = true;
+        prev->next = t->next;
+
+        if (tail_ == t) {
+          tail_ = prev;
+        }
+
+        t->status = BTR_DEV_ETIMEOUT;
+        t->done = true;
+        break;
+      }
+    }
+  }
+
+  hal_->unlock();
+  return found;
+}
+
+template<typename Hal>
+inline void I2CEngine<Hal>::onEvent()
+{
+  I2CTransaction* t = head_;
+  uint16_t sr1 = hal_->sr1();
+
+  if (nullptr == t) {
+    return;
+  }
+
+  if (sr1 & SR1_SB) {
+    // Reading SR1, then writing DR clears SB.
+    wait_start_ = false;
+    hal_->writeDr(uint8_t(t->addr << 1) | (READ == phase_ ? 1 : 0));
+    return;
+  }
+
+  // BTF of the previous phase stays set until the start condition is on the bus.
+  if (wait_start_) {
+    return;
+  }
+
+  if (WRITE == phase_) {
+    onWriteEvent(t, sr1);
+  } else if (READ == phase_) {
+    onReadEvent(t, sr1);
+  }
+}
+
+template<typename Hal>
+inline void I2CEngine<Hal>::onError()
+{
+  uint16_t sr1 = hal_->sr1();
+
+  hal_->clearSr1(sr1 & SR1_ERRORS);
+
+  if (nullptr == head_ || 0 == (sr1 & SR1_ERRORS)) {
+    return;
+  }
+
+  // The master is already off the bus after an arbitration loss.
+  if (0 == (sr1 & SR1_ARLO)) {
+    hal_->stop();
+  }
+
+  hal_->setPos(false);
+  complete((sr1 & SR1_AF) ? BTR_DEV_ENOACK : BTR_DEV_EFAIL, true);
+}
+
+//============================================= ATTRIBUTES =========================================
+
+template<typename Hal>
+inline bool I2CEngine<Hal>::busy() const
+{
+  return (nullptr != head_);
+}
+
+/////////////////////////////////////////////// PRIVATE ////////////////////////////////////////////
+
+//============================================= OPERATIONS =========================================
+
+template<typename Hal>
+inline void I2CEngine<Hal>::startHead()
+{
+  I2CTransaction* t = head_;
+
+  tx_idx_ = 0;
+  rx_idx_ = 0;
+  phase_ = (txBytes(t) > 0 || 0 == t->rd_bytes ? WRITE : READ);
+  wait_start_ = true;
+  hal_->setPos(false);
+  hal_->enableBufferIrq(true);
+  hal_->start();
+}
+
+template<typename Hal>
+inline void I2CEngine<Hal>::complete(uint32_t status, bool notify)
+{
+  I2CTransaction* t = head_;
+
+  head_ = t->next;
+
+  if (nullptr == head_) {
+    tail_ = nullptr;
+  }
+
+  phase_ = IDLE;
+  wait_start_ = false;
+  t->status = status | uint16_t(tx_idx_ + rx_idx_);
+
+  if (nullptr != head_) {
+    startHead();
+  }
+
+  if (notify && nullptr != t->callback) {
+    t->callback(t);
+  }
+
+  // Last, the owner may reuse the transaction once it sees this.
+  t->done = true;
+}
+
+template<typename Hal>
+inline void I2CEngine<Hal>::onWriteEvent(I2CTransaction* t, uint16_t sr1)
+{
+  uint16_t total = txBytes(t);
+
+  if (sr1 & SR1_ADDR) {
+    // Reading SR1, then SR2 clears ADDR.
+    hal_->sr2();
+
+    if (0 == total) {
+      hal_->stop();
+      complete(BTR_DEV_ENOERR, true);
+    }
+    return;
+  }
+
+  if (tx_idx_ < total) {
+    if (sr1 & (SR1_TXE | SR1_BTF)) {
+      uint16_t i = tx_idx_++;
+      hal_->writeDr(i < t->cmd_bytes ? t->cmd[i] : t->wr[i - t->cmd_bytes]);
+
+      // The last byte is in, wait for BTF rather than TXE.
+      if (tx_idx_ == total) {
+        hal_->enableBufferIrq(false);
+      }
+    }
+    return;
+  }
+
+  if (sr1 & SR1_BTF) {
+    if (t->rd_bytes > 0) {
+      // Repeated start, the bus stays ours.
+      phase_ = READ;
+      wait_start_ = true;
+      hal_->enableBufferIrq(true);
+      hal_->start();
+    } else {
+      hal_->stop();
+      complete(BTR_DEV_ENOERR, true);
+    }
+  }
+}
+
+template<typename Hal>
+inline void I2CEngine<Hal>::onReadEvent(I2CTransaction* t, uint16_t sr1)
+{
+  uint16_t n = t->rd_bytes;
+
+  if (sr1 & SR1_ADDR) {
+    if (1 == n) {
+      // NACK the only byte and stop right after it.
+      hal_->setAck(false);
+      hal_->sr2();
+      hal_->stop();
+    } else if (2 == n) {
+      // NACK the second byte, take both on BTF.
+      hal_->setAck(false);
+      hal_->setPos(true);
+      hal_->sr2();
+      hal_->enableBufferIrq(false);
+    } else {
+      hal_->setAck(true);
+      hal_->sr2();
+
+      if (3 == n) {
+        hal_->enableBufferIrq(false);
+      }
+    }
+    return;
+  }
+
+  uint16_t remaining = n - rx_idx_;
+
+  if (1 == n) {
+    if (sr1 & SR1_RXNE) {
+      t->rd[rx_idx_++] = hal_->readDr();
+      complete(BTR_DEV_ENOERR, true);
+    }
+  } else if (2 == n) {
+    if (sr1 & SR1_BTF) {
+      hal_->stop();
+      t->rd[rx_idx_++] = hal_->readDr();
+      t->rd[rx_idx_++] = hal_->readDr();
+      hal_->setPos(false);
+      complete(BTR_DEV_ENOERR, true);
+    }
+  } else if (remaining > 3) {
+    if (sr1 & SR1_RXNE) {
+      t->rd[rx_idx_++] = hal_->readDr();
+
+      // Take the last three bytes on BTF.
+      if (3 == remaining - 1) {
+        hal_->enableBufferIrq(false);
+      }
+    }
+  } else if (sr1 & SR1_BTF) {
+    if (3 == remaining) {
+      // DR has N-2, the shift register N-1: NACK N, then read N-2.
+      hal_->setAck(false);
+      t->rd[rx_idx_++] = hal_->readDr();
+    } else {
+      // DR has N-1, the shift register N.
+      hal_->stop();
+      t->rd[rx_idx_++] = hal_->readDr();
+      t->rd[rx_idx_++] = hal_->readDr();
+      complete(BTR_DEV_ENOERR, true);
+    }
+  }
+}
+
+// static
+template<typename Hal>
+inline uint16_t I2CEngine<Hal>::txBytes(const I2CTransaction* t)
+{
+  return t->cmd_bytes + t->wr_bytes;
+}
+
+} // namespace btr
+
+#endif // _btr_I2CEngine_hpp_
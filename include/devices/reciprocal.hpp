@@ -0,0 +1,65 @@
+// Copyright (C) 2019 Sergey Kapustin <kapucin@gmail.com>
+
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+/** @file */
+
+#ifndef _btr_Reciprocal_hpp_
+#define _btr_Reciprocal_hpp_
+
+// SYSTEM INCLUDES
+#include <stdint.h>
+
+namespace btr
+{
+
+/**
+ * Unsigned 32-bit division by an invariant divisor as a multiplication and shifts, for targets
+ * without a hardware divider. The quotient is exact for every dividend.
+ *
+ * @see T. Granlund, P. Montgomery, "Division by Invariant Integers using Multiplication", 1994
+ */
+struct Reciprocal
+{
+  uint32_t m;
+  uint8_t sh1;
+  uint8_t sh2;
+};
+
+/**
+ * @param d - divisor, greater than 0
+ * @return reciprocal of d
+ */
+constexpr Reciprocal makeReciprocal(uint32_t d)
+{
+  // l = ceil(log2(d))
+  uint8_t l = 0;
+
+  while ((uint64_t(1) << l) < d) {
+    l++;
+  }
+
+  Reciprocal r = {
+    uint32_t(((uint64_t(1) << 32) * ((uint64_t(1) << l) - d)) / d + 1),
+    uint8_t(l < 1 ? l : 1),
+    uint8_t(l > 1 ? l - 1 : 0)
+  };
+  return r;
+}
+
+/**
+ * @param n - dividend
+ * @param r - reciprocal of the divisor
+ * @return n / divisor
+ */
+inline uint32_t divide(uint32_t n, const Reciprocal& r)
+{
+  uint32_t t = uint32_t((uint64_t(r.m) * n) >> 32);
+  return (t + ((n - t) >> r.sh1)) >> r.sh2;
+}
+
+} // namespace btr
+
+#endif // _btr_Reciprocal_hpp_
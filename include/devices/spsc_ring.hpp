@@ -0,0 +1,402 @@
+// Copyright (C) 2019 Sergey Kapustin <kapucin@gmail.com>
+
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+/** @file */
+
+#ifndef _btr_SpscRing_hpp_
+#define _btr_SpscRing_hpp_
+
+// SYSTEM INCLUDES
+#include <stddef.h>
+#include <string.h>
+#if BTR_AVR > 0
+#include <util/atomic.h>
+#endif
+
+// PROJECT INCLUDES
+#include "devices/defines.hpp"
+
+namespace btr
+{
+
+/** Index type of SpscRing, 8 bits up to 256 slots so AVR reads an index in one instruction. */
+template<bool Small>
+struct SpscRingIndex
+{
+  typedef uint8_t Type;
+};
+
+template<>
+struct SpscRingIndex<false>
+{
+  typedef uint16_t Type;
+};
+
+/**
+ * The class implements a lock-free single-producer, single-consumer ring buffer, e.g. for an ISR
+ * that fills a receive buffer and a task that drains it. One slot is kept empty to tell a full
+ * ring from an empty one, so the ring holds up to N - 1 elements.
+ *
+ * The producer writes the elements and then publishes head with release semantics, the consumer
+ * reads head with acquire semantics before it reads the elements, and the same goes for tail in
+ * the other direction. Only the producer calls push*(), only the consumer calls pop*(), peek(),
+ * consume() and clear(). size(), empty() and full() are safe on either side.
+ *
+ * @tparam T - trivially copyable element
+ * @tparam N - number of slots, power of two up to 65536
+ */
+template<typename T, size_t N>
+class SpscRing
+{
+public:
+
+  static_assert(N >= 2 && (N & (N - 1)) == 0, "SpscRing size must be a power of two");
+  static_assert(N <= 65536, "SpscRing size must fit 16-bit index");
+
+  typedef typename SpscRingIndex<(N <= 256)>::Type IndexType;
+
+// LIFECYCLE
+
+  SpscRing();
+
+// OPERATIONS
+
+  /**
+   * @return the largest number of elements the ring can hold
+   */
+  static constexpr size_t capacity();
+
+  /**
+   * Producer: append one element.
+   *
+   * @param value - element
+   * @return true on success, false if the ring is full
+   */
+  bool push(const T& value);
+
+  /**
+   * Producer: append up to n elements with at most two copies.
+   *
+   * @param src - elements
+   * @param n - number of elements
+   * @return the number of elements appended
+   */
+  size_t pushN(const T* src, size_t n);
+
+  /**
+   * Consumer: remove one element.
+   *
+   * @param value - receives the element
+   * @return true on success, false if the ring is empty
+   */
+  bool pop(T* value);
+
+  /**
+   * Consumer: remove up to n elements with at most two copies.
+   *
+   * @param dst - receives the elements
+   * @param n - number of elements
+   * @return the number of elements removed
+   */
+  size_t popN(T* dst, size_t n);
+
+  /**
+   * Consumer: remove n elements, blocking while the ring is empty. Returns as soon as n elements
+   * are removed.
+   *
+   * The producer should signal the consumer once size() reaches the number of missing elements
+   * or the ring is full, e.g. with a task notification from an ISR.
+   *
+   * @param dst - receives the elements
+   * @param n - number of elements
+   * @param wait - callable bool(size_t missing) that blocks until the producer signals or a
+   *  time-out expires, and returns false on time-out. It must not miss a signal sent before it
+   *  blocks. The call ends at a time-out during which no elements arrived
+   * @return the number of elements removed, less than n on time-out
+   */
+  template<typename Wait>
+  size_t popWait(T* dst, size_t n, Wait wait);
+
+  /**
+   * Consumer: get the contiguous run of elements at the front of the ring without removing them,
+   * e.g. to parse in place. When the data wraps around, the run ends at the end of the storage
+   * and the rest is returned after consume().
+   *
+   * @param data - receives a pointer to the first element
+   * @return the number of contiguous elements
+   */
+  size_t peek(const T** data) const;
+
+  /**
+   * Consumer: remove n elements returned by peek().
+   *
+   * @param n - number of elements, up to the value peek() returned
+   */
+  void consume(size_t n);
+
+  /**
+   * Consumer: remove all elements.
+   */
+  void clear();
+
+// ATTRIBUTES
+
+  /**
+   * @return the number of elements in the ring
+   */
+  size_t size() const;
+
+  /**
+   * @return true if the ring has no elements
+   */
+  bool empty() const;
+
+  /**
+   * @return true if push() would fail
+   */
+  bool full() const;
+
+private:
+
+// OPERATIONS
+
+  static IndexType load(const IndexType* index);
+  static IndexType loadAcquire(const IndexType* index);
+  static void storeRelease(IndexType* index, IndexType value);
+
+// ATTRIBUTES
+
+  static constexpr IndexType MASK = N - 1;
+
+  /** Next slot to write, written by the producer only. */
+  IndexType head_;
+  /** Next slot to read, written by the consumer only. */
+  IndexType tail_;
+  T buff_[N];
+};
+
+/////////////////////////////////////////////// INLINE /////////////////////////////////////////////
+
+/////////////////////////////////////////////// PUBLIC /////////////////////////////////////////////
+
+//============================================= LIFECYCLE ==========================================
+
+template<typename T, size_t N>
+inline SpscRing<T, N>::SpscRing()
+  :
+    head_(0),
+    tail_(0),
+    buff_()
+{
+}
+
+//============================================= OPERATIONS =========================================
+
+// static
+template<typename T, size_t N>
+inline constexpr size_t SpscRing<T, N>::capacity()
+{
+  return N - 1;
+}
+
+template<typename T, size_t N>
+inline bool SpscRing<T, N>::push(const T& value)
+{
+  IndexType head = load(&head_);
+  IndexType next = (head + 1) & MASK;
+
+  if (next == loadAcquire(&tail_)) {
+    return false;
+  }
+
+  buff_[head] = value;
+  storeRelease(&head_, next);
+  return true;
+}
+
+template<typename T, size_t N>
+inline size_t SpscRing<T, N>::pushN(const T* src, size_t n)
+{
+  IndexType head = load(&head_);
+  size_t space = (size_t(loadAcquire(&tail_)) - head - 1) & MASK;
+
+  if (n > space) {
+    n = space;
+  }
+
+  // Up to the end of the storage, then from the start
+  size_t first = N - head;
+
+  if (first > n) {
+    first = n;
+  }
+
+  memcpy(buff_ + head, src, first * sizeof(T));
+  memcpy(buff_, src + first, (n - first) * sizeof(T));
+  storeRelease(&head_, IndexType((head + n) & MASK));
+  return n;
+}
+
+template<typename T, size_t N>
+inline bool SpscRing<T, N>::pop(T* value)
+{
+  IndexType tail = load(&tail_);
+
+  if (tail == loadAcquire(&head_)) {
+    return false;
+  }
+
+  *value = buff_[tail];
+  storeRelease(&tail_, IndexType((tail + 1) & MASK));
+  return true;
+}
+
+template<typename T, size_t N>
+inline size_t SpscRing<T, N>::popN(T* dst, size_t n)
+{
+  IndexType tail = load(&tail_);
+  size_t used = (size_t(loadAcquire(&head_)) - tail) & MASK;
+
+  if (n > used) {
+    n = used;
+  }
+
+  size_t first = N - tail;
+
+  if (first > n) {
+    first = n;
+  }
+
+  memcpy(dst, buff_ + tail, first * sizeof(T));
+  memcpy(dst + first, buff_, (n - first) * sizeof(T));
+  storeRelease(&tail_, IndexType((tail + n) & MASK));
+  return n;
+}
+
+template<typename T, size_t N>
+template<typename Wait>
+inline size_t SpscRing<T, N>::popWait(T* dst, size_t n, Wait wait)
+{
+  size_t done = 0;
+
+  while (done < n) {
+    done += popN(dst + done, n - done);
+
+    if (done == n) {
+      break;
+    }
+
+    // Stop on a time-out without progress only.
+    if (false == wait(n - done) && empty()) {
+      break;
+    }
+  }
+  return done;
+}
+
+template<typename T, size_t N>
+inline size_t SpscRing<T, N>::peek(const T** data) const
+{
+  IndexType tail = load(&tail_);
+  IndexType head = loadAcquire(&head_);
+
+  *data = buff_ + tail;
+  return (head >= tail ? head - tail : N - tail);
+}
+
+template<typename T, size_t N>
+inline void SpscRing<T, N>::consume(size_t n)
+{
+  storeRelease(&tail_, IndexType((load(&tail_) + n) & MASK));
+}
+
+template<typename T, size_t N>
+inline void SpscRing<T, N>::clear()
+{
+  storeRelease(&tail_, loadAcquire(&head_));
+}
+
+//============================================= ATTRIBUTES =========================================
+
+template<typename T, size_t N>
+inline size_t SpscRing<T, N>::size() const
+{
+  return (size_t(loadAcquire(&head_)) - loadAcquire(&tail_)) & MASK;
+}
+
+template<typename T, size_t N>
+inline bool SpscRing<T, N>::empty() const
+{
+  return loadAcquire(&head_) == loadAcquire(&tail_);
+}
+
+template<typename T, size_t N>
+inline bool SpscRing<T, N>::full() const
+{
+  return ((loadAcquire(&head_) + 1) & MASK) == loadAcquire(&tail_);
+}
+
+/////////////////////////////////////////////// PRIVATE ////////////////////////////////////////////
+
+//============================================= OPERATIONS =========================================
+
+// AVR is single-core and in-order, so volatile access with a compiler barrier orders it. It has
+// no atomic 16-bit access though, so a wide index is accessed with interrupts disabled.
+
+// static
+template<typename T, size_t N>
+inline typename SpscRing<T, N>::IndexType SpscRing<T, N>::load(const IndexType* index)
+{
+#if BTR_AVR > 0
+  // Only the owner calls this, and nobody else writes the index.
+  return *index;
+#else
+  return __atomic_load_n(index, __ATOMIC_RELAXED);
+#endif
+}
+
+// static
+template<typename T, size_t N>
+inline typename SpscRing<T, N>::IndexType SpscRing<T, N>::loadAcquire(const IndexType* index)
+{
+#if BTR_AVR > 0
+  IndexType value;
+
+  if (sizeof(IndexType) > 1) {
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+      value = *(const volatile IndexType*) index;
+    }
+  } else {
+    value = *(const volatile IndexType*) index;
+    __asm__ __volatile__("" ::: "memory");
+  }
+  return value;
+#else
+  return __atomic_load_n(index, __ATOMIC_ACQUIRE);
+#endif
+}
+
+// static
+template<typename T, size_t N>
+inline void SpscRing<T, N>::storeRelease(IndexType* index, IndexType value)
+{
+#if BTR_AVR > 0
+  if (sizeof(IndexType) > 1) {
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+      *(volatile IndexType*) index = value;
+    }
+  } else {
+    __asm__ __volatile__("" ::: "memory");
+    *(volatile IndexType*) index = value;
+  }
+#else
+  __atomic_store_n(index, value, __ATOMIC_RELEASE);
+#endif
+}
+
+} // namespace btr
+
+#endif // _btr_SpscRing_hpp_
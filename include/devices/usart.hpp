@@ -12,6 +12,12 @@
 // SYSTEM INCLUDES
 #if BTR_X86 > 0
 #include <boost/asio.hpp>
+#include <sys/uio.h>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <vector>
 namespace bio = boost::asio;
 #elif BTR_STM32 > 0
 #include <libopencm3/stm32/rcc.h>
@@ -19,11 +25,16 @@ namespace bio = boost::asio;
 #include <libopencm3/stm32/usart.h>
 #include <libopencm3/cm3/nvic.h>
 #include <FreeRTOS.h>
-#include <queue.h>
+#include <task.h>
 #endif
 
 // PROJECT INCLUDES
 #include "devices/defines.hpp"
+#include "devices/spsc_ring.hpp"
+#if BTR_STM32 > 0
+#include "devices/dma_tx_engine.hpp"
+#include "devices/dma_rx_ring.hpp"
+#endif
 
 namespace btr
 {
@@ -37,16 +48,56 @@ class Usart
 {
 public:
 
+#if BTR_X86 > 0
+  /**
+   * Completion handler of an asynchronous operation.
+   *
+   * @param error - 0 on success, ETIMEDOUT if the operation timed out, errno value otherwise
+   * @param bytes - the number of bytes transferred
+   */
+  typedef std::function<void(int error, size_t bytes)> Handler;
+
+  /** Error of a bulk transfer. errno holds the system error code. */
+  typedef enum
+  {
+    IO_OK,
+    IO_TIMEOUT,
+    IO_NOT_OPEN,
+    IO_BUSY,
+    IO_FAILED
+  } IoErrorType;
+
+  /** Result of a bulk transfer. */
+  struct IoResult
+  {
+    /** The number of bytes transferred, also when the transfer failed part way. */
+    size_t bytes;
+    IoErrorType error;
+  };
+#endif
+
 // LIFECYCLE
 
 #if BTR_X86 > 0
   /**
-   * Create an instance and initialize data members.
+   * Create an instance and initialize data members. Each send()/recv() runs a private event loop
+   * until the operation completes or times out. Nothing runs the loop between calls, so
+   * asynchronous operations complete right away with EOPNOTSUPP.
    */
   Usart();
 
   /**
-   * Call close()
+   * Create an instance that queues operations onto a caller-supplied event loop, e.g. the one of
+   * UsartService. The loop must outlive this instance. Blocking send()/recv() wait until the queued
+   * operation completes, so they fail with EDEADLK when called from the loop thread.
+   *
+   * @param io_service - long-lived event loop shared by any number of ports
+   */
+  Usart(bio::io_service& io_service);
+
+  /**
+   * Call close(). On the thread of a shared loop, operations still queued there are dropped
+   * without calling their handlers.
    */
   ~Usart();
 
@@ -156,13 +207,129 @@ public:
    */
   uint32_t recv(char* buff, uint16_t bytes, uint32_t timeout = BTR_USART_RX_TIMEOUT_MS);
 
+#if BTR_X86 > 0
+  /**
+   * Send several buffers as one contiguous stream, e.g. a frame header, payload and checksum,
+   * without copying them into a staging buffer first.
+   *
+   * @param iov - buffers to send
+   * @param iovcnt - the number of buffers
+   * @param timeout - maximum time in milliseconds for the whole operation
+   * @return the number of bytes submitted, errno is set on failure
+   */
+  uint32_t sendv(
+      const struct iovec* iov, int iovcnt, uint32_t timeout = BTR_USART_TX_TIMEOUT_MS);
+
+  /**
+   * Send a buffer of any size in one call, e.g. a firmware image. Unlike send(), the byte count
+   * is not limited to 16 bits and the time-out applies to periods without progress, so the
+   * transfer can take as long as the link needs.
+   *
+   * @param buff - data buffer
+   * @param bytes - number of bytes
+   * @param idle_timeout - maximum time in milliseconds to wait for the port to accept more data
+   * @return the number of bytes submitted and the error
+   */
+  IoResult sendBulk(
+      const char* buff, size_t bytes, uint32_t idle_timeout = BTR_USART_TX_TIMEOUT_MS);
+
+  /**
+   * Receive a buffer of any size in one call, e.g. a log dump. @see sendBulk
+   *
+   * @param buff - buffer to store received data
+   * @param bytes - the number of bytes to receive
+   * @param idle_timeout - maximum time in milliseconds to wait for more data to arrive
+   * @return the number of bytes received and the error
+   */
+  IoResult recvBulk(
+      char* buff, size_t bytes, uint32_t idle_timeout = BTR_USART_RX_TIMEOUT_MS);
+
+  /**
+   * Queue a send of a number of bytes from the buffer and return immediately. The handler runs on
+   * the thread of the event loop passed to Usart(io_service). Only one send can be pending at a
+   * time, another one completes with EBUSY. An instance with a private event loop calls the
+   * handler right away with EOPNOTSUPP.
+   *
+   * @param buff - data buffer, it must stay valid until the handler runs
+   * @param bytes - number of bytes
+   * @param handler - completion handler
+   * @param timeout - maximum time in milliseconds for the whole operation
+   */
+  void asyncSend(
+      const char* buff, uint16_t bytes, Handler handler, uint32_t timeout = BTR_USART_TX_TIMEOUT_MS);
+
+  /**
+   * Queue a send of several buffers. @see asyncSend
+   *
+   * @param iov - buffers to send, the array and the buffers must stay valid until the handler runs
+   * @param iovcnt - the number of buffers
+   * @param handler - completion handler
+   * @param timeout - maximum time in milliseconds for the whole operation
+   */
+  void asyncSendv(
+      const struct iovec* iov, int iovcnt, Handler handler,
+      uint32_t timeout = BTR_USART_TX_TIMEOUT_MS);
+
+  /**
+   * Queue a receive of a number of bytes into the buffer and return immediately. The handler runs
+   * on the thread of the event loop passed to Usart(io_service). Only one receive can be pending
+   * at a time, another one completes with EBUSY. An instance with a private event loop calls the
+   * handler right away with EOPNOTSUPP.
+   *
+   * @param buff - buffer to store received data, it must stay valid until the handler runs
+   * @param bytes - the number of bytes to receive
+   * @param handler - completion handler
+   * @param timeout - maximum time in milliseconds for the whole operation
+   */
+  void asyncRecv(
+      char* buff, uint16_t bytes, Handler handler, uint32_t timeout = BTR_USART_RX_TIMEOUT_MS);
+#endif
+
 // ATTRIBUTES
 
+#if BTR_STM32 > 0 && BTR_USART_DMA_TX_ENABLED > 0
+  /** DMA channel wired to the port's TX request, used by DmaTxEngine. */
+  struct DmaHal
+  {
+    void startDma(const uint8_t* data, uint16_t bytes);
+
+    uint32_t usart;
+    uint8_t channel;
+    uint8_t irq;
+  };
+#endif
+
 #if BTR_X86 > 0
+  /** State of a pending asynchronous operation in one direction. */
+  struct AsyncOpr
+  {
+    AsyncOpr(bio::io_service& io_service);
+
+    bio::deadline_timer timer;
+    Handler handler;
+    /** Remaining part of the buffers to transfer. */
+    std::vector<bio::mutable_buffer> buffs;
+    size_t bytes;
+    size_t transferred;
+    /** If not 0, the timer limits the time without progress rather than the whole operation. */
+    uint32_t idle_timeout;
+    /** Sequence number of the operation, stale timer expirations are ignored. */
+    uint32_t seq;
+    /** The number of queued operation and timer handlers that refer to this operation. */
+    uint32_t pending;
+    bool expired;
+  };
+
   bio::io_service     io_service_;
+  /** Points to io_service_ or to a caller-supplied event loop. */
+  bio::io_service*    service_;
   bio::serial_port    serial_port_;
-  bio::deadline_timer timer_;
-  uint16_t            bytes_transferred_;
+  AsyncOpr            tx_opr_;
+  AsyncOpr            rx_opr_;
+  std::mutex          opr_mutex_;
+  std::condition_variable opr_cv_;
+  /** Handlers hold a weak reference, those still queued when the instance is gone do nothing. */
+  std::shared_ptr<bool> alive_;
 #elif BTR_AVR > 0
   volatile uint8_t* ubrr_h_;
   volatile uint8_t* ubrr_l_;
@@ -180,37 +347,40 @@ public:
   uint16_t rx_;
   uint16_t cts_;
   uint16_t rts_;
-  QueueHandle_t tx_q_;
+  /** Task blocked in recv(), notified by the RX interrupt. */
+  TaskHandle_t volatile rx_task_;
+  /** Bytes the blocked task waits for, the interrupt notifies it once they are in rx_ring_. */
+  volatile uint16_t rx_wanted_;
+  /** Task that drains tx_ring_, notified by send(). */
+  TaskHandle_t tx_task_;
+#if BTR_USART_DMA_TX_ENABLED > 0
+  DmaHal dma_hal_;
+  /** Sends tx_ring_ instead of tx_task_. */
+  DmaTxEngine<DmaHal, SpscRing<uint8_t, BTR_USART_TX_BUFF_SIZE>> dma_tx_;
+  /** Task blocked in send(), notified by the DMA interrupt. */
+  TaskHandle_t volatile tx_waiter_;
+#endif
+#if BTR_USART_DMA_RX_ENABLED > 0
+  /** DMA channel wired to the port's RX request and its interrupt. */
+  uint8_t dma_rx_channel_;
+  uint8_t dma_rx_irq_;
+#endif
 #endif
 
   volatile uint16_t rx_error_;
   bool enable_flush_;
 
 #if BTR_STM32 > 0 || BTR_AVR > 0
-
-#if BTR_USART_RX_BUFF_SIZE > 256
-  volatile uint16_t rx_head_;
-  volatile uint16_t rx_tail_;
+#if BTR_STM32 > 0 && BTR_USART_DMA_RX_ENABLED > 0
+  /** Filled by the DMA channel, published by the IDLE and DMA interrupts, drained by recv(). */
+  DmaRxRing<BTR_USART_RX_BUFF_SIZE> rx_ring_;
 #else
-  volatile uint8_t rx_head_;
-  volatile uint8_t rx_tail_;
-#endif // BTR_USART_RX_BUFF_SIZE > 256
-
-  uint8_t rx_buff_[BTR_USART_RX_BUFF_SIZE];
+  /** Filled by the RX interrupt, drained by recv(). */
+  SpscRing<uint8_t, BTR_USART_RX_BUFF_SIZE> rx_ring_;
+#endif
+  /** Filled by send(), drained by the TX interrupt on AVR, by the TX task or DMA on STM32. */
+  SpscRing<uint8_t, BTR_USART_TX_BUFF_SIZE> tx_ring_;
 #endif // BTR_STM32 > 0 || BTR_AVR > 0
-
-#if BTR_AVR > 0
-
-#if BTR_USART_TX_BUFF_SIZE > 256
-  volatile uint16_t tx_head_;
-  volatile uint16_t tx_tail_;
-#else
-  volatile uint8_t tx_head_;
-  volatile uint8_t tx_tail_;
-#endif // BTR_USART_TX_BUFF_SIZE > 256
-
-  uint8_t tx_buff_[BTR_USART_TX_BUFF_SIZE];
-#endif // BTR_AVR > 0
 };
 
 } // namespace btr
@@ -0,0 +1,265 @@
+// Copyright (C) 2019 Sergey Kapustin <kapucin@gmail.com>
+
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+/** @file */
+
+#ifndef _btr_UsbCdcPipe_hpp_
+#define _btr_UsbCdcPipe_hpp_
+
+// SYSTEM INCLUDES
+#include <stddef.h>
+
+// PROJECT INCLUDES
+#include "devices/defines.hpp"
+
+namespace btr
+{
+
+/**
+ * The class moves the data of a USB CDC bulk endpoint pair between the endpoints and byte rings,
+ * e.g. SpscRing, a whole packet at a time.
+ *
+ * OUT (host to device): onPacketReceived() reads the packet and appends it to the receive ring
+ * with one bulk copy. If the ring has no room for a whole packet, the OUT endpoint is set to NAK,
+ * which holds the host off instead of dropping data, and poll() releases it once the reader has
+ * drained the ring.
+ *
+ * IN (device to host): each packet takes up to PACKET bytes from the transmit ring. A packet
+ * shorter than PACKET ends a transfer on the host. When the data ends exactly on a packet
+ * boundary, a zero-length packet (ZLP) follows, so the host doesn't wait for more.
+ *
+ * All calls must come from one context, e.g. the task that runs usbd_poll() and, from it, the
+ * endpoint callbacks. The hardware is behind Hal, which has to provide:
+ *
+ *  bool writePacket(const uint8_t* data, uint16_t bytes) - queue an IN packet, bytes may be 0.
+ *    Returns false if the endpoint is busy
+ *  uint16_t readPacket(uint8_t* data, uint16_t bytes) - read the OUT packet
+ *  void setOutNak(bool nak) - keep the OUT endpoint NAKing after the next read, or release it
+ *
+ * @tparam Hal - endpoints
+ * @tparam TxRing - SpscRing<uint8_t, N> with data to send
+ * @tparam RxRing - SpscRing<uint8_t, N> for received data
+ * @tparam PACKET - bulk endpoint packet size
+ */
+template<typename Hal, typename TxRing, typename RxRing, uint16_t PACKET = BTR_USB_PACKET_SIZE>
+class UsbCdcPipe
+{
+public:
+
+// LIFECYCLE
+
+  /**
+   * Ctor.
+   *
+   * @param hal - endpoints, it must outlive this instance
+   * @param tx_ring - data to send, it must outlive this instance
+   * @param rx_ring - received data, it must outlive this instance
+   */
+  UsbCdcPipe(Hal* hal, TxRing* tx_ring, RxRing* rx_ring);
+
+// OPERATIONS
+
+  /**
+   * Handle a packet on the OUT endpoint.
+   */
+  void onPacketReceived();
+
+  /**
+   * Handle the end of an IN packet.
+   */
+  void onPacketSent();
+
+  /**
+   * Move data held back by a full receive ring and start sending queued data. Call when the
+   * rings may have changed, e.g. on each pass of the USB task.
+   *
+   * @return the number of bytes moved into the receive ring, a waiting reader needs a wake-up
+   */
+  uint16_t poll();
+
+  /**
+   * Drop the state of a transfer, e.g. after a USB reset or a new configuration.
+   */
+  void reset();
+
+// ATTRIBUTES
+
+  /**
+   * @return true if the OUT endpoint NAKs because the receive ring is full
+   */
+  bool rxPaused() const;
+
+  /**
+   * @return true if an IN packet is in flight
+   */
+  bool txBusy() const;
+
+private:
+
+// OPERATIONS
+
+  /**
+   * Move the held OUT packet into the receive ring as far as it fits.
+   *
+   * @return the number of bytes moved
+   */
+  uint16_t drainRx();
+
+  /**
+   * Send the next IN packet, a ZLP if the last one was full and nothing follows.
+   */
+  void sendNext();
+
+// ATTRIBUTES
+
+  Hal* hal_;
+  TxRing* tx_ring_;
+  RxRing* rx_ring_;
+  /** Bytes of the OUT packet not yet in the receive ring, starting at rx_offset_. */
+  uint16_t rx_held_;
+  uint16_t rx_offset_;
+  /** Bytes staged in tx_buff_ that the endpoint didn't accept yet. */
+  uint16_t tx_staged_;
+  bool rx_paused_;
+  bool tx_busy_;
+  /** The last IN packet was full, so a transfer that ends here needs a ZLP. */
+  bool tx_zlp_;
+  uint8_t rx_buff_[PACKET];
+  uint8_t tx_buff_[PACKET];
+};
+
+/////////////////////////////////////////////// INLINE /////////////////////////////////////////////
+
+/////////////////////////////////////////////// PUBLIC /////////////////////////////////////////////
+
+//============================================= LIFECYCLE ==========================================
+
+template<typename Hal, typename TxRing, typename RxRing, uint16_t PACKET>
+inline UsbCdcPipe<Hal, TxRing, RxRing, PACKET>::UsbCdcPipe(
+    Hal* hal, TxRing* tx_ring, RxRing* rx_ring)
+  :
+    hal_(hal),
+    tx_ring_(tx_ring),
+    rx_ring_(rx_ring),
+    rx_held_(0),
+    rx_offset_(0),
+    tx_staged_(0),
+    rx_paused_(false),
+    tx_busy_(false),
+    tx_zlp_(false),
+    rx_buff_(),
+    tx_buff_()
+{
+}
+
+//============================================= OPERATIONS =========================================
+
+template<typename Hal, typename TxRing, typename RxRing, uint16_t PACKET>
+inline void UsbCdcPipe<Hal, TxRing, RxRing, PACKET>::onPacketReceived()
+{
+  // Only one packet is held at a time, the endpoint NAKs until it's drained.
+  if (rx_held_ > 0) {
+    return;
+  }
+
+  // NAK has to be set before the read, which re-arms the endpoint otherwise.
+  if (false == rx_paused_ && rx_ring_->capacity() - rx_ring_->size() < PACKET) {
+    hal_->setOutNak(true);
+    rx_paused_ = true;
+  }
+
+  rx_offset_ = 0;
+  rx_held_ = hal_->readPacket(rx_buff_, PACKET);
+  drainRx();
+}
+
+template<typename Hal, typename TxRing, typename RxRing, uint16_t PACKET>
+inline void UsbCdcPipe<Hal, TxRing, RxRing, PACKET>::onPacketSent()
+{
+  tx_busy_ = false;
+  sendNext();
+}
+
+template<typename Hal, typename TxRing, typename RxRing, uint16_t PACKET>
+inline uint16_t UsbCdcPipe<Hal, TxRing, RxRing, PACKET>::poll()
+{
+  uint16_t drained = drainRx();
+
+  if (rx_paused_ && 0 == rx_held_ && rx_ring_->capacity() - rx_ring_->size() >= PACKET) {
+    rx_paused_ = false;
+    hal_->setOutNak(false);
+  }
+
+  if (false == tx_busy_) {
+    sendNext();
+  }
+  return drained;
+}
+
+template<typename Hal, typename TxRing, typename RxRing, uint16_t PACKET>
+inline void UsbCdcPipe<Hal, TxRing, RxRing, PACKET>::reset()
+{
+  rx_held_ = 0;
+  rx_offset_ = 0;
+  tx_staged_ = 0;
+  rx_paused_ = false;
+  tx_busy_ = false;
+  tx_zlp_ = false;
+}
+
+//============================================= ATTRIBUTES =========================================
+
+template<typename Hal, typename TxRing, typename RxRing, uint16_t PACKET>
+inline bool UsbCdcPipe<Hal, TxRing, RxRing, PACKET>::rxPaused() const
+{
+  return rx_paused_;
+}
+
+template<typename Hal, typename TxRing, typename RxRing, uint16_t PACKET>
+inline bool UsbCdcPipe<Hal, TxRing, RxRing, PACKET>::txBusy() const
+{
+  return tx_busy_;
+}
+
+/////////////////////////////////////////////// PRIVATE ////////////////////////////////////////////
+
+//============================================= OPERATIONS =========================================
+
+template<typename Hal, typename TxRing, typename RxRing, uint16_t PACKET>
+inline uint16_t UsbCdcPipe<Hal, TxRing, RxRing, PACKET>::drainRx()
+{
+  uint16_t n = 0;
+
+  if (rx_held_ > 0) {
+    n = rx_ring_->pushN(rx_buff_ + rx_offset_, rx_held_);
+    rx_offset_ += n;
+    rx_held_ -= n;
+  }
+  return n;
+}
+
+template<typename Hal, typename TxRing, typename RxRing, uint16_t PACKET>
+inline void UsbCdcPipe<Hal, TxRing, RxRing, PACKET>::sendNext()
+{
+  if (0 == tx_staged_) {
+    tx_staged_ = tx_ring_->popN(tx_buff_, PACKET);
+
+    // Nothing to send, unless a full packet needs a ZLP to end the transfer.
+    if (0 == tx_staged_ && false == tx_zlp_) {
+      return;
+    }
+  }
+
+  if (hal_->writePacket(tx_buff_, tx_staged_)) {
+    tx_busy_ = true;
+    tx_zlp_ = (PACKET == tx_staged_);
+    tx_staged_ = 0;
+  }
+}
+
+} // namespace btr
+
+#endif // _btr_UsbCdcPipe_hpp_
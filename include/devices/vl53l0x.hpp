@@ -118,6 +118,45 @@ public:
     VcselPeriodFinalRange
   };
 
+  /** Register write of a register sequence. Page is the value of register 0xFF to write it at. */
+  struct RegOp
+  {
+    uint8_t page;
+    uint8_t reg;
+    uint8_t value;
+  };
+
+  /** Default tuning settings (DefaultTuningSettings in the ST API), which init() writes. */
+  static const RegOp TUNING_OPS[];
+  static const uint16_t TUNING_OPS_COUNT;
+
+  /** Progress of initialization, @see initStep(). */
+  enum InitStatus {
+    INIT_PENDING,
+    INIT_DONE,
+    INIT_ERROR
+  };
+
+  /**
+   * Per-sensor data that init() reads and measures, to be stored, e.g. in flash, and restored on
+   * the next boot with init(const Calibration&). Only valid for the sensor it was taken from.
+   */
+  struct Calibration
+  {
+    uint8_t version;
+    uint8_t stop_var;
+    /** Reference SPAD count, bit 7 set for aperture SPADs. */
+    uint8_t spad_info;
+    /** Reference SPAD map as written to GLOBAL_CONFIG_SPAD_ENABLES_REF_0 through _5. */
+    uint8_t spad_map[6];
+    /** VHV settings and phase calibration from the reference calibration. */
+    uint8_t vhv_settings;
+    uint8_t phase_cal;
+    uint8_t reserved;
+    /** CRC-16 of the fields above. */
+    uint16_t crc;
+  };
+
 // LIFECYCLE
 
   /**
@@ -139,6 +178,57 @@ public:
    */
   int init(bool io_2v8 = true);
 
+  /**
+   * Initialize VL53L0X device with calibration data from getCalibration(), instead of reading SPAD
+   * info and running reference calibration. If the data isn't valid, do init(io_2v8).
+   *
+   * @param cal - calibration data
+   * @param io_2v8 - @see init()
+   * @return 0 if initialized, -1 otherwise
+   */
+  int init(const Calibration& cal, bool io_2v8 = true);
+
+  /**
+   * Provide calibration data of the initialized sensor. VHV settings and phase calibration are
+   * read from the sensor, which must not be ranging.
+   *
+   * @param cal - calibration data
+   * @return true if the sensor is initialized and cal is set
+   */
+  bool getCalibration(Calibration* cal);
+
+  /**
+   * Check the version and CRC of calibration data.
+   *
+   * @param cal - calibration data
+   * @return true if valid
+   */
+  static bool isValid(const Calibration& cal);
+
+  /**
+   * Start initialization without blocking, @see init(). initStep() does the work.
+   *
+   * @param io_2v8 - @see init()
+   */
+  void startInit(bool io_2v8 = true);
+
+  /**
+   * Start initialization with calibration data without blocking, @see init(const Calibration&).
+   *
+   * @param cal - calibration data
+   * @param io_2v8 - @see init()
+   */
+  void startInit(const Calibration& cal, bool io_2v8 = true);
+
+  /**
+   * Run initialization up to the next wait for the sensor, i.e. for SPAD info or a reference
+   * calibration, or check once if the wait is over. Other sensors on the bus can be served between
+   * the calls.
+   *
+   * @return INIT_PENDING until initialization is done or fails, INIT_ERROR if it wasn't started
+   */
+  InitStatus initStep();
+
   /**
    * Set new I2C slave address and write the target register.
    *
@@ -146,6 +236,12 @@ public:
    */
   void setAddress(uint8_t new_addr);
 
+  /**
+   * Talk to the sensor at BTR_VL53L0X_ADDR_DFLT again, e.g. after it was reset through XSHUT,
+   * without writing to it.
+   */
+  void resetAddress();
+
   /**
    * @return slave address
    */
@@ -217,6 +313,18 @@ public:
    */
   void readMulti(uint8_t reg, uint8_t* dst, uint8_t count);
 
+  /**
+   * Write a register sequence in as few transactions as possible. Consecutive operations on
+   * consecutive registers of the same page are written in one transaction, the register address
+   * increments after each byte. 0xFF is written only when the page changes. The page is 0 after
+   * the sequence.
+   *
+   * @param ops - operations, none of them on register 0xFF
+   * @param count - the number of operations
+   */
+  void writeOps(const RegOp* ops, uint16_t count);
+
+#if BTR_VL53L0X_FIXED_POINT_ENABLED == 0
   /**
    * Set the return signal rate limit check value in units of MCPS (mega counts per second).
    *
@@ -236,6 +344,41 @@ public:
    * @return signal rate limit check value in MCPS.
    */
   float getSignalRateLimit();
+#endif
+
+  /**
+   * Set the return signal rate limit check value, @see setSignalRateLimit(), in Q9.7 fixed point
+   * (9 integer bits, 7 fractional bits) as the sensor stores it.
+   *
+   * @param limit_q7 - the limit in MCPS * 128
+   * @return true if limit is applied, false otherwise
+   */
+  bool setSignalRateLimitQ7(uint16_t limit_q7);
+
+  /**
+   * @return signal rate limit check value in MCPS * 128
+   */
+  uint16_t getSignalRateLimitQ7();
+
+  /**
+   * Convert sequence step timeout from MCLKs to microseconds with given VCSEL period in PCLKs.
+   * The divisions are multiplications by reciprocals, precomputed for the VCSEL periods that
+   * setVcselPulsePeriod() accepts.
+   *
+   * @param timeout_period_mclks
+   * @param vcsel_period_pclks
+   * @return microseconds
+   */
+  static uint32_t timeoutMclksToMicroseconds(uint16_t timeout_period_mclks, uint8_t vcsel_period_pclks);
+
+  /**
+   * Convert sequence step timeout from microseconds to MCLKs with given VCSEL period in PCLKs.
+   *
+   * @param timeout_period_us
+   * @param vcsel_period_pclks
+   * @return mclks
+   */
+  static uint32_t timeoutMicrosecondsToMclks(uint32_t timeout_period_us, uint8_t vcsel_period_pclks);
 
   /**
    * Set the measurement timing budget, which is the time allowed for one measurement.
@@ -294,11 +437,42 @@ public:
   void stopContinuous();
 
   /**
-   * Provide range while sensor performs continuous mesaurements.
+   * Provide range while sensor performs continuous mesaurements. Wait for a sample with
+   * tryReadRange().
    * @return range in millimeters or UINT16_MAX on timeout
    */
   uint16_t readRangeContinuousMillimeters();
 
+  /**
+   * Use the GPIO1 interrupt, which init() configures to signal a new sample (active low), to learn
+   * when a sample is ready, instead of reading the interrupt status over I2C. onDataReady() has to
+   * be called from the pin's falling-edge interrupt.
+   *
+   * @param callback - optional function that onDataReady() calls, e.g. to wake a task
+   * @param arg - callback argument
+   */
+  void enableDataReadyIrq(void (*callback)(void* arg) = nullptr, void* arg = nullptr);
+
+  /**
+   * Mark a sample ready. The function doesn't use I2C and can be called from an interrupt.
+   */
+  void onDataReady();
+
+  /**
+   * Check if a sample is ready. Without enableDataReadyIrq(), it reads the interrupt status once.
+   *
+   * @return true if a sample is ready
+   */
+  bool dataReady();
+
+  /**
+   * Read a sample if one is ready, without waiting, and clear the sensor's interrupt.
+   *
+   * @param mm - range in millimeters
+   * @return true if a sample was read
+   */
+  bool tryReadRange(uint16_t* mm);
+
   /**
    * Performs a single-shot range measurement.
    * @return range in millimeters or UINT16_MAX on timeout
@@ -331,17 +505,86 @@ private:
     uint32_t final_range_us;
   };
 
+  /**
+   * Copy of the registers that sequence step enables, VCSEL periods and timeouts are decoded from.
+   * Writes through the driver update it, init() and resetAddress() invalidate it.
+   */
+  struct Shadow
+  {
+    bool valid;
+    uint8_t sequence_config;
+    /** PRE_RANGE_CONFIG_VCSEL_PERIOD and PRE_RANGE_CONFIG_TIMEOUT_MACROP_HI/LO. */
+    uint8_t pre_range[3];
+    uint8_t msrc_timeout;
+    /** FINAL_RANGE_CONFIG_VCSEL_PERIOD and FINAL_RANGE_CONFIG_TIMEOUT_MACROP_HI/LO. */
+    uint8_t final_range[3];
+  };
+
 // OPERATIONS
 
+  /** Steps of initialization. */
+  enum InitState {
+    INIT_STATE_IDLE,
+    INIT_STATE_BEGIN,
+    INIT_STATE_SPAD_WAIT,
+    INIT_STATE_CONFIG,
+    INIT_STATE_VHV_WAIT,
+    INIT_STATE_PHASE_WAIT,
+    INIT_STATE_DONE,
+    INIT_STATE_ERROR
+  };
+
+  /**
+   * Run initStep() until initialization is done or fails.
+   *
+   * @return 0 if initialized, -1 otherwise
+   */
+  int finishInit();
+
+  /**
+   * Fail initialization if the current wait has timed out.
+   *
+   * @return INIT_ERROR on time-out, INIT_PENDING otherwise
+   */
+  InitStatus initTimeout();
+
+  /**
+   * Set I/O mode, read the stop variable unless restoring calibration data, and set up limit
+   * checks.
+   */
+  void beginInit();
+
   /**
-   * Get reference SPAD (single photon avalanche diode) count and type, but only gets reference
-   * SPAD count and type.
+   * Apply the reference SPAD map, tuning settings, interrupt config and timing budget.
+   */
+  void configure();
+
+  /**
+   * Request reference SPAD (single photon avalanche diode) count and type. The sensor clears
+   * register 0x83 of page 7 until they are ready.
+   */
+  void requestSpadInfo();
+
+  /**
+   * Read reference SPAD count and type, and the reference SPAD map to enable.
+   */
+  void readSpadInfo();
+
+  /**
+   * Read the shadowed registers unless the shadow is valid.
+   */
+  void loadShadow();
+
+  /**
+   * Track the register page and update the shadow after a write. A failed write invalidates the
+   * shadow and leaves the page as it was.
    *
-   * @param count
-   * @param type_is_aperture
-   * @return spad info
+   * @param rc - status of the write
+   * @param reg - first register written
+   * @param data - bytes written
+   * @param count - the number of bytes
    */
-  bool getSpadInfo(uint8_t * count, bool * type_is_aperture);
+  void updateShadow(uint32_t rc, uint8_t reg, const uint8_t* data, uint8_t count);
 
   /**
    * Get sequence step enables.
@@ -378,22 +621,19 @@ private:
   static uint16_t encodeTimeout(uint16_t timeout_mclks);
 
   /**
-   * Convert sequence step timeout from MCLKs to microseconds with given VCSEL period in PCLKs.
+   * Read or write the reference calibration results (VL53L0X_ref_calibration_io() in the ST API).
    *
-   * @param timeout_period_mclks
-   * @param vcsel_period_pclks
-   * @return microseconds
+   * @param read - read if true, write otherwise
+   * @param vhv_settings - VHV settings
+   * @param phase_cal - phase calibration
    */
-  static uint32_t timeoutMclksToMicroseconds(uint16_t timeout_period_mclks, uint8_t vcsel_period_pclks);
+  void refCalibrationIo(bool read, uint8_t* vhv_settings, uint8_t* phase_cal);
 
   /**
-   * Convert sequence step timeout from microseconds to MCLKs with given VCSEL period in PCLKs.
-   *
-   * @param timeout_period_us
-   * @param vcsel_period_pclks
-   * @return mclks
+   * @param cal - calibration data
+   * @return CRC of the calibration data
    */
-  static uint32_t timeoutMicrosecondsToMclks(uint32_t timeout_period_us, uint8_t vcsel_period_pclks);
+  static uint16_t calibrationCrc(const Calibration& cal);
 
   /**
    * Perform calibration.
@@ -402,12 +642,47 @@ private:
    */
   bool performSingleRefCalibration(uint8_t vhv_init_byte);
 
+  /**
+   * Start a reference calibration.
+   *
+   * @param vhv_init_byte - 0x40 for VHV calibration, 0x00 for phase calibration
+   */
+  void startRefCalibration(uint8_t vhv_init_byte);
+
+  /**
+   * @return true if the reference calibration is done
+   */
+  bool refCalibrationDone();
+
+  /**
+   * Clear the interrupt of a finished reference calibration.
+   */
+  void stopRefCalibration();
+
 // ATTRIBUTES
 
   /** Slave address. */
   uint8_t addr_;
   uint8_t stop_var_;
+  /** Calibration data of the last init(), valid if version is set. */
+  Calibration cal_;
+  /** InitState. */
+  uint8_t init_state_;
+  bool init_io_2v8_;
+  /** Initialize from cal_. */
+  bool init_restore_;
+  /** Start of the current wait. */
+  uint32_t init_tm_;
   uint32_t timing_budget_us_;
+  /** Value of register 0xFF. */
+  uint8_t page_;
+  Shadow shadow_;
+  void (*ready_cb_)(void* arg);
+  void* ready_arg_;
+  /** Samples are signalled by onDataReady(). */
+  bool ready_irq_;
+  /** Set by onDataReady(), cleared when the sample is read. */
+  volatile bool data_ready_;
 };
 
 } // namespace btr
@@ -0,0 +1,140 @@
+// Copyright (C) 2019 Sergey Kapustin <kapucin@gmail.com>
+
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+/** @file */
+
+#ifndef _btr_VL53L0XArray_hpp_
+#define _btr_VL53L0XArray_hpp_
+
+// PROJECT INCLUDES
+#include "devices/defines.hpp"
+#include "devices/vl53l0x.hpp"
+
+#if BTR_VL53L0X_ARRAY_SIZE > 32
+#error "BTR_VL53L0X_ARRAY_SIZE is greater than 32"
+#endif
+
+namespace btr
+{
+
+/**
+ * The class runs several VL53L0X sensors on one bus. init() releases the sensors from shutdown
+ * (XSHUT) one at a time, gives each its own address and initializes them together. start() puts
+ * them in continuous mode, in timed mode with start times spread over the period, so the sensors
+ * range at the same time while their results come in at different times. poll() reads whichever
+ * sensors have a sample and publishes a snapshot once every sensor has a new one.
+ */
+class VL53L0XArray
+{
+public:
+
+  /**
+   * Drive the XSHUT pin of a sensor. Releasing a sensor returns after it has booted, t_BOOT is
+   * 1.2 ms.
+   *
+   * @param index - sensor index
+   * @param on - true to release the sensor (pin high), false to shut it down (pin low)
+   * @param arg - user argument
+   */
+  typedef void (*XshutFunc)(uint8_t index, bool on, void* arg);
+
+  /** A sample of every sensor. */
+  struct Snapshot
+  {
+    /** Ranges in millimeters. */
+    uint16_t mm[BTR_VL53L0X_ARRAY_SIZE];
+    /** MILLIS() when each range was read. */
+    uint32_t ms[BTR_VL53L0X_ARRAY_SIZE];
+    /** The number of snapshots published so far. */
+    uint32_t cycle;
+  };
+
+// LIFECYCLE
+
+  VL53L0XArray();
+  ~VL53L0XArray() = default;
+
+// OPERATIONS
+
+  /**
+   * Bring up sensors. Sensor i gets address BTR_VL53L0X_ARRAY_ADDR + i.
+   *
+   * @param count - the number of sensors, up to BTR_VL53L0X_ARRAY_SIZE
+   * @param xshut - XSHUT control, can be nullptr for one sensor
+   * @param arg - xshut argument
+   * @param io_2v8 - @see VL53L0X::init()
+   * @return 0 if all sensors are initialized, -1 otherwise
+   */
+  int init(uint8_t count, XshutFunc xshut, void* arg, bool io_2v8 = true);
+
+  /**
+   * Start continuous measurements. In timed mode, sensor i starts i * period / count ms after
+   * the first one, from poll().
+   *
+   * @param period - inter-measurement period in milliseconds, 0 for back-to-back mode
+   */
+  void start(uint32_t period = 0);
+
+  /**
+   * Stop continuous measurements.
+   */
+  void stop();
+
+  /**
+   * Start sensors that are due and read each sensor's sample if it has one, without waiting.
+   *
+   * @return true if a new snapshot is published
+   */
+  bool poll();
+
+// ATTRIBUTES
+
+  /**
+   * @return the last published snapshot
+   */
+  const Snapshot& snapshot() const;
+
+  /**
+   * @return the number of sensors
+   */
+  uint8_t count() const;
+
+  /**
+   * Provide a sensor, e.g. to set its timing budget or enable its data-ready interrupt.
+   *
+   * @param index - sensor index
+   * @return sensor
+   */
+  VL53L0X* sensor(uint8_t index);
+
+private:
+
+// OPERATIONS
+
+  /**
+   * Start sensors whose start time has come.
+   */
+  void startDue();
+
+// ATTRIBUTES
+
+  VL53L0X sensors_[BTR_VL53L0X_ARRAY_SIZE];
+  /** Published snapshot. */
+  Snapshot snapshot_;
+  /** Snapshot being filled. */
+  Snapshot next_;
+  /** Bit per sensor that has a sample in next_. */
+  uint32_t fresh_;
+  /** Bit per sensor that has been started. */
+  uint32_t started_;
+  uint32_t start_ms_;
+  uint32_t period_;
+  uint8_t count_;
+};
+
+} // namespace btr
+
+#endif // _btr_VL53L0XArray_hpp_
@@ -0,0 +1,246 @@
+// Copyright (C) 2019 Sergey Kapustin <kapucin@gmail.com>
+
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+/** @file */
+
+#ifndef _btr_I2CSim_hpp_
+#define _btr_I2CSim_hpp_
+
+// SYSTEM INCLUDES
+#include <stdint.h>
+
+// PROJECT INCLUDES
+#include "devices/defines.hpp"
+
+namespace btr
+{
+
+/**
+ * The class models an I2C slave with a map of 8-bit registers. The first byte written after the
+ * address selects a register, further bytes are written from there on, and reads return bytes
+ * from there on. The register pointer advances with each byte.
+ *
+ * Models of particular devices derive from it and override onRegWrite()/onRegRead() to react to
+ * register access, e.g. to start a measurement or to clear a status bit.
+ */
+class I2CSimDevice
+{
+public:
+
+// LIFECYCLE
+
+  /**
+   * Zero all registers.
+   */
+  I2CSimDevice();
+
+  virtual ~I2CSimDevice() = default;
+
+// OPERATIONS
+
+  /**
+   * Begin a transfer after the address is acknowledged.
+   *
+   * @param read - true if the master reads
+   */
+  void start(bool read);
+
+  /**
+   * Receive a byte from the master.
+   *
+   * @param value - the byte
+   * @return true to ACK the byte, false to NACK it
+   */
+  bool write(uint8_t value);
+
+  /**
+   * Send a byte to the master.
+   *
+   * @return the byte
+   */
+  uint8_t read();
+
+  /**
+   * Set a register without going through the bus, e.g. to prepare a test.
+   *
+   * @param reg - register address
+   * @param value - the value
+   */
+  void setReg(uint8_t reg, uint8_t value);
+
+  /**
+   * Set two registers to a 16-bit value, most significant byte first.
+   *
+   * @param reg - address of the first register
+   * @param value - the value
+   */
+  void setReg16(uint8_t reg, uint16_t value);
+
+// ATTRIBUTES
+
+  /**
+   * @param reg - register address
+   * @return register value, without going through the bus
+   */
+  uint8_t reg(uint8_t reg) const;
+
+  /**
+   * @param reg - address of the first register
+   * @return 16-bit value of two registers, most significant byte first
+   */
+  uint16_t reg16(uint8_t reg) const;
+
+protected:
+
+// OPERATIONS
+
+  /**
+   * Handle a register write from the bus. The default stores the value.
+   *
+   * @param reg - register address
+   * @param value - the value
+   * @return true to ACK the byte, false to NACK it
+   */
+  virtual bool onRegWrite(uint8_t reg, uint8_t value);
+
+  /**
+   * Handle a register read from the bus. The default returns the stored value.
+   *
+   * @param reg - register address
+   * @return the value
+   */
+  virtual uint8_t onRegRead(uint8_t reg);
+
+// ATTRIBUTES
+
+  uint8_t regs_[256];
+
+private:
+
+  /** Next register to access. */
+  uint8_t ptr_;
+  /** The next byte written selects a register. */
+  bool select_;
+};
+
+/**
+ * The class simulates an I2C bus with in-process slave device models. It keeps the time the
+ * transfers would take on a real bus at a given clock speed, using the I2C specification (UM10204)
+ * minimums for start, repeated start and stop conditions.
+ *
+ * x86 I2C routes its transfers here, @see I2C::sim(). The bus isn't thread-safe.
+ */
+class I2CSim
+{
+public:
+
+  /** Bus activity since the last resetStats(). */
+  struct Stats
+  {
+    uint32_t starts;
+    /** Starts while the bus was held, included in starts. */
+    uint32_t repeated_starts;
+    uint32_t stops;
+    /** Address and data bytes. */
+    uint32_t bytes;
+    /** Bytes, addresses included, that were not acknowledged. */
+    uint32_t nacks;
+    /** Bus time in nanoseconds. */
+    uint64_t bus_ns;
+  };
+
+// LIFECYCLE
+
+  /**
+   * Ctor.
+   *
+   * @param speed - bus clock in Hz
+   */
+  explicit I2CSim(uint32_t speed = BTR_I2C_SPEED);
+
+// OPERATIONS
+
+  /**
+   * Connect a device model to the bus.
+   *
+   * @param addr - 7-bit slave address
+   * @param dev - device model, it must outlive the attachment
+   */
+  void attach(uint8_t addr, I2CSimDevice* dev);
+
+  /**
+   * Disconnect the device at an address.
+   *
+   * @param addr - 7-bit slave address
+   */
+  void detach(uint8_t addr);
+
+  /**
+   * Generate a start or repeated start condition and send an address.
+   *
+   * @param addr - 7-bit slave address
+   * @param read - true for a read transfer
+   * @return true if a device acknowledged the address
+   */
+  bool start(uint8_t addr, bool read);
+
+  /**
+   * Send a byte to the addressed device.
+   *
+   * @param value - the byte
+   * @return true if the device acknowledged it
+   */
+  bool write(uint8_t value);
+
+  /**
+   * Receive a byte from the addressed device.
+   *
+   * @param ack - ACK the byte, NACK it if it's the last one
+   * @return the byte
+   */
+  uint8_t read(bool ack);
+
+  /**
+   * Generate a stop condition if the bus is held.
+   */
+  void stop();
+
+  /**
+   * Zero the statistics.
+   */
+  void resetStats();
+
+// ATTRIBUTES
+
+  /**
+   * @return bus activity
+   */
+  const Stats& stats() const;
+
+  /**
+   * @param addr - 7-bit slave address
+   * @return the device model at the address, nullptr if there is none
+   */
+  I2CSimDevice* device(uint8_t addr) const;
+
+private:
+
+// ATTRIBUTES
+
+  I2CSimDevice* devices_[128];
+  /** Device addressed by the current transfer. */
+  I2CSimDevice* active_;
+  bool held_;
+  uint32_t bit_ns_;
+  /** Start setup + hold, stop setup + bus free time. */
+  uint32_t start_ns_;
+  uint32_t stop_ns_;
+  Stats stats_;
+};
+
+} // namespace btr
+
+#endif // _btr_I2CSim_hpp_
@@ -11,6 +11,7 @@
 
 // SYSTEM INCLUDES
 #include <unistd.h>
+#include <string>
 #include <thread>
 #include <chrono>
 #include <sys/wait.h>
@@ -24,8 +25,7 @@ namespace btr
 #define PRG "socat"
 #define TTY_SIM_0 "/tmp/ttySIM0"
 #define TTY_SIM_1 "/tmp/ttySIM1"
-#define PTY0 "PTY,link=" TTY_SIM_0 ",raw,echo=0"
-#define PTY1 "PTY,link=" TTY_SIM_1 ",raw,echo=0"
+#define PTY_ADDR(link) (std::string("PTY,link=") + link + ",raw,echo=0")
 
 /**
  * The class opens send and receive interfaces to a serial port upon constructing an instance.
@@ -39,8 +39,11 @@ public:
 
   /**
    * Forks a child process.
+   *
+   * @param tty0 - path of the link to the first serial device
+   * @param tty1 - path of the link to the second serial device
    */
-  PseudoTTY();
+  PseudoTTY(const char* tty0 = TTY_SIM_0, const char* tty1 = TTY_SIM_1);
 
   /**
    * Terminates child process and reaps its PID
@@ -51,6 +54,8 @@ private:
 
 // ATTRIBUTES
 
+  std::string pty0_;
+  std::string pty1_;
   pid_t child_pid_;
 };
 
@@ -60,13 +65,16 @@ private:
 
 //============================================= LIFECYCLE ==========================================
 
-inline PseudoTTY::PseudoTTY()
+inline PseudoTTY::PseudoTTY(const char* tty0, const char* tty1)
+  :
+  pty0_(PTY_ADDR(tty0)),
+  pty1_(PTY_ADDR(tty1))
 {
   switch (child_pid_ = vfork()) {
     case -1:
       throw std::runtime_error("Failed to fork pseudo TTY");
     case 0: // child
-      execlp(PRG, PRG, PTY0, PTY1, (char*) NULL);
+      execlp(PRG, PRG, pty0_.c_str(), pty1_.c_str(), (char*) NULL);
       throw std::runtime_error("Failed to exec: " PRG);
     default: // parent
       std::this_thread::sleep_for(10ms);
@@ -0,0 +1,174 @@
+// Copyright (C) 2019 Sergey Kapustin <kapucin@gmail.com>
+
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+/** @file */
+
+#ifndef _btr_UsartReactor_hpp_
+#define _btr_UsartReactor_hpp_
+
+// SYSTEM INCLUDES
+#include <functional>
+#include <memory>
+#include <vector>
+
+// PROJECT INCLUDES
+#include "devices/defines.hpp"
+#include "devices/x86/usart_termios.hpp"
+
+namespace btr
+{
+
+/**
+ * The class multiplexes any number of UsartTermios ports on one thread using epoll. Registered
+ * ports are switched to non-blocking mode. Each port can have a deadline backed by timerfd with
+ * microsecond resolution.
+ */
+class UsartReactor
+{
+public:
+
+  /** Event bits passed to a handler. */
+  enum EventType
+  {
+    READABLE  = 0x01,
+    WRITABLE  = 0x02,
+    DEADLINE  = 0x04,
+    ERROR     = 0x08
+  };
+
+  /**
+   * Event handler.
+   *
+   * @param port - the port the events are for
+   * @param events - combination of EventType bits
+   */
+  typedef std::function<void(UsartTermios* port, uint32_t events)> Handler;
+
+// LIFECYCLE
+
+  /**
+   * Ctor.
+   */
+  UsartReactor();
+
+  /**
+   * Close the reactor.
+   */
+  ~UsartReactor();
+
+  UsartReactor(const UsartReactor&) = delete;
+  UsartReactor& operator=(const UsartReactor&) = delete;
+
+// OPERATIONS
+
+  /**
+   * Create epoll instance.
+   *
+   * @return 0 on success, -1 on failure
+   */
+  int open();
+
+  /**
+   * Remove all ports and release epoll instance. Called from a handler, the epoll instance is
+   * released when poll() returns.
+   */
+  void close();
+
+  /**
+   * Register an open port and switch it to non-blocking mode.
+   *
+   * @param port - the port
+   * @param events - READABLE and/or WRITABLE to watch for
+   * @param handler - event handler
+   * @return 0 on success, -1 on failure
+   */
+  int add(UsartTermios* port, uint32_t events, Handler handler);
+
+  /**
+   * Change the events watched for on a registered port.
+   *
+   * @param port - the port
+   * @param events - READABLE and/or WRITABLE to watch for
+   * @return 0 on success, -1 on failure
+   */
+  int modify(UsartTermios* port, uint32_t events);
+
+  /**
+   * Unregister a port and switch it back to blocking mode. Can be called from a handler.
+   *
+   * @param port - the port
+   * @return 0 on success, -1 on failure
+   */
+  int remove(UsartTermios* port);
+
+  /**
+   * Arm a one-shot deadline for a port. When it expires, the handler receives DEADLINE.
+   *
+   * @param port - the port
+   * @param timeout_us - time-out in microseconds, 0 disarms the deadline
+   * @return 0 on success, -1 on failure
+   */
+  int setDeadline(UsartTermios* port, uint32_t timeout_us);
+
+  /**
+   * Wait for events once and dispatch them to handlers.
+   *
+   * @param timeout_ms - maximum time to wait, -1 to wait indefinitely
+   * @return the number of dispatched events, or -1 on failure
+   */
+  int poll(int timeout_ms);
+
+  /**
+   * @return the number of registered ports
+   */
+  size_t size() const;
+
+private:
+
+  struct Entry;
+
+  /** epoll user data pointing to a port or to its deadline timer. */
+  struct Source
+  {
+    Entry* entry;
+    bool is_timer;
+  };
+
+  struct Entry
+  {
+    UsartTermios* port;
+    Handler handler;
+    int timer_fd;
+    bool removed;
+    Source port_source;
+    Source timer_source;
+  };
+
+// OPERATIONS
+
+  /**
+   * @return registered entry of the port or nullptr
+   */
+  Entry* find(UsartTermios* port);
+
+  /**
+   * Release entries removed while dispatching.
+   */
+  void purge();
+
+// ATTRIBUTES
+
+  int epoll_fd_;
+  bool dispatching_;
+  /** close() was called while dispatching. */
+  bool closing_;
+  std::vector<std::unique_ptr<Entry>> entries_;
+
+}; // class UsartReactor
+
+} // namespace btr
+
+#endif // _btr_UsartReactor_hpp_
@@ -0,0 +1,77 @@
+// Copyright (C) 2019 Sergey Kapustin <kapucin@gmail.com>
+
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+/** @file */
+
+#ifndef _btr_UsartService_hpp_
+#define _btr_UsartService_hpp_
+
+// SYSTEM INCLUDES
+#include <thread>
+#include <boost/asio.hpp>
+
+// PROJECT INCLUDES
+#include "devices/defines.hpp"
+
+namespace bio = boost::asio;
+
+namespace btr
+{
+
+/**
+ * The class owns a long-lived event loop that runs on a dedicated thread. Usart instances created
+ * with the loop queue their operations onto it instead of starting and stopping a loop per call.
+ */
+class UsartService
+{
+public:
+
+// LIFECYCLE
+
+  /**
+   * Start the event loop thread.
+   */
+  UsartService();
+
+  /**
+   * Stop the event loop and join the thread.
+   */
+  ~UsartService();
+
+  UsartService(const UsartService&) = delete;
+  UsartService& operator=(const UsartService&) = delete;
+
+// OPERATIONS
+
+  /**
+   * Provide a process-wide instance. The instance is created on first use.
+   *
+   * @return shared event loop service
+   */
+  static UsartService* instance();
+
+  /**
+   * @return the event loop to pass to Usart constructor
+   */
+  bio::io_service& ioService();
+
+  /**
+   * @return true if the calling thread is the event loop thread
+   */
+  bool isLoopThread() const;
+
+private:
+
+// ATTRIBUTES
+
+  bio::io_service       io_service_;
+  bio::io_service::work work_;
+  std::thread           thread_;
+};
+
+} // namespace btr
+
+#endif // _btr_UsartService_hpp_
@@ -10,6 +10,7 @@
 #define _btr_UsartTermios_hpp__
 
 // SYSTEM INCLUDES
+#include <sys/uio.h>
 
 // PROJECT INCLUDES
 #include "devices/defines.hpp"
@@ -43,7 +44,8 @@ public:
    * Configure USART parameters.
    *
    * @param port_name - serial IO port name (e.g., /dev/ttyS0)
-   * @param baud_rate - baud rate. It must be one of values specified by in termios.h
+   * @param baud_rate - baud rate. Values specified in termios.h, from 50 to 4000000, are set with
+   *  cfsetspeed, other values through termios2 if BTR_USART_ARBITRARY_BAUD is enabled
    *  @see http://man7.org/linux/man-pages/man3/termios.3.html
    * @param data_bits
    * @param parity - @see ParityType
@@ -65,6 +67,8 @@ public:
 
   /**
    * Initialize the device.
+   *
+   * @return 0 on success, -1 on failure. errno is EINVAL if the baud rate is 0 or can't be set.
    */
   int open();
 
@@ -74,11 +78,26 @@ public:
   void close();
 
   /**
-   * @param timeout - timeout in milliseconds
+   * @param timeout - timeout in milliseconds, rounded down to tenths of a second by VTIME. Use
+   *  recvTimed() for shorter deadlines.
    * @return 0 on success, -1 on failure
    */
   int setTimeout(uint32_t timeout);
 
+  /**
+   * Switch the port to non-blocking mode, where recv() returns -1 with errno EAGAIN if there is
+   * no data, instead of waiting for VTIME.
+   *
+   * @param enable - non-blocking if true, blocking otherwise
+   * @return 0 on success, -1 on failure
+   */
+  int setNonBlocking(bool enable);
+
+  /**
+   * @return file descriptor of the open port or -1
+   */
+  int handle() const;
+
   /**
    * Check if there is data in receive queue.
    *
@@ -124,6 +143,17 @@ public:
    */
   int send(const char* buff, uint32_t bytes, bool drain = false);
 
+  /**
+   * Send several buffers with one system call, e.g. a frame header, payload and checksum, without
+   * copying them into a staging buffer first.
+   *
+   * @param iov - buffers to send
+   * @param iovcnt - the number of buffers
+   * @param drain - block until all output has been transmitted
+   * @return bytes submitted or -1 on error
+   */
+  int sendv(const struct iovec* iov, int iovcnt, bool drain = false);
+
   /**
    * Receive a single character.
    *
@@ -140,18 +170,46 @@ public:
    */
   int recv(char* buff, uint32_t bytes);
 
+  /**
+   * Receive a number of bytes with microsecond deadlines, independent of VTIME granularity.
+   * Waits with ppoll, so it works with both blocking and non-blocking ports.
+   *
+   * @param buff - buffer to store received data
+   * @param bytes - the number of bytes to receive
+   * @param total_us - maximum time for the whole read, 0 for no limit
+   * @param inter_byte_us - maximum gap after a byte was received, 0 for no limit
+   * @return bytes received or -1 on error. errno is ETIMEDOUT if fewer bytes than requested
+   *  were received before a deadline, EIO if the peer hung up before then
+   */
+  int recvTimed(char* buff, uint32_t bytes, uint32_t total_us, uint32_t inter_byte_us = 0);
+
 private:
 
 // OPERATIONS
 
+  /**
+   * @return CLOCK_MONOTONIC time in microseconds
+   */
+  static uint64_t monotonicUs();
+
   /**
    * Convert numeric BAUD rate to termios-specific one.
    *
    * @param num - the number baud rate
-   * @return termios baud rate
+   * @return termios baud rate or -1 if there is no constant for the rate
    */
   static int getNativeBaud(int num);
 
+  /**
+   * Set a baud rate with termios2 and BOTHER. Implemented in a separate translation unit since
+   * asm/termbits.h conflicts with termios.h.
+   *
+   * @param fd - open port
+   * @param baud - baud rate
+   * @return 0 on success, -1 on failure
+   */
+  static int setArbitraryBaud(int fd, uint32_t baud);
+
 // ATTRIBUTES
 
   const char* port_name_;
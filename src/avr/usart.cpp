@@ -110,12 +110,9 @@ static btr::Usart usart_3(&UBRR3H, &UBRR3L, &UCSR3A, &UCSR3B, &UCSR3C, &UDR3);
 static void onRecv(btr::Usart* u)
 {
   u->rx_error_ = (*(u->ucsr_a_) & ((1 << FE) | (1 << DOR) | (1 << UPE)));
-  uint16_t head_next = (u->rx_head_ + 1) % BTR_USART_RX_BUFF_SIZE;
 
-  if (head_next != u->rx_tail_) {
-    u->rx_buff_[u->rx_head_] = *(u->udr_);
-    u->rx_head_ = head_next;
-  } else {
+  // Read UDR even if the ring is full to clear the interrupt.
+  if (false == u->rx_ring_.push(*(u->udr_))) {
     u->rx_error_ |= (BTR_DEV_EOVERFLOW >> 16);
   }
   LED_TOGGLE();
@@ -123,11 +120,14 @@ static void onRecv(btr::Usart* u)
 
 static void onSend(btr::Usart* u)
 {
-  uint8_t ch = u->tx_buff_[u->tx_tail_];
-  u->tx_tail_ = (u->tx_tail_ + 1) % BTR_USART_TX_BUFF_SIZE;
-  *(u->udr_) = ch;
+  uint8_t ch;
 
-  if (u->tx_head_ == u->tx_tail_) {
+  if (u->tx_ring_.pop(&ch)) {
+    *(u->udr_) = ch;
+  }
+
+  // send() sets UDRIE again after it pushes more data.
+  if (u->tx_ring_.empty()) {
     clear_bit(*(u->ucsr_b_), UDRIE);
   }
   LED_TOGGLE();
@@ -222,16 +222,9 @@ Usart::Usart(
     udr_(udr),
     rx_error_(0),
     enable_flush_(false),
-    rx_head_(0),
-    rx_tail_(0),
-    rx_buff_(),
-    tx_head_(0),
-    tx_tail_(0),
-    tx_buff_()
+    rx_ring_(),
+    tx_ring_()
 {
-  // Taint data.
-  rx_buff_[0] = 'U'; // hex 55
-  tx_buff_[0] = 'f'; // hex 66
   clear_bit(*ucsr_b_, TXEN);
   clear_bit(*ucsr_b_, RXEN);
   clear_bit(*ucsr_b_, RXCIE);
@@ -315,13 +308,12 @@ void Usart::close()
   clear_bit(*ucsr_b_, RXEN);
   clear_bit(*ucsr_b_, RXCIE);
   clear_bit(*ucsr_b_, UDRIE);
-  rx_head_ = rx_tail_;
+  rx_ring_.clear();
 }
 
 int Usart::available()
 {
-  uint16_t bytes = BTR_USART_RX_BUFF_SIZE + rx_head_ - rx_tail_;
-  return (bytes % BTR_USART_RX_BUFF_SIZE);
+  return rx_ring_.size();
 }
 
 int Usart::flush(DirectionType queue_selector)
@@ -350,10 +342,10 @@ uint32_t Usart::send(const char* buff, uint16_t bytes, uint32_t timeout)
   uint32_t delay = 0;
 
   while (bytes > 0) {
-    uint16_t head_next = (tx_head_ + 1) % BTR_USART_TX_BUFF_SIZE;
+    uint16_t n = tx_ring_.pushN((const uint8_t*) buff, bytes);
 
     // No room in tx buffer, wait until at least one character is drained from it.
-    while (head_next == tx_tail_) {
+    if (0 == n) {
       if (timeout > 0) {
         _delay_us(BTR_USART_TX_DELAY_US);
         delay += BTR_USART_TX_DELAY_US;
@@ -363,16 +355,15 @@ uint32_t Usart::send(const char* buff, uint16_t bytes, uint32_t timeout)
           return rc;
         }
       }
+      continue;
     }
 
-    tx_buff_[tx_head_] = *buff++;
-
     ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
-      tx_head_ = head_next;
       set_bit(*ucsr_b_, UDRIE);
     }
-    ++rc;
-    --bytes;
+    buff += n;
+    rc += n;
+    bytes -= n;
   }
   return rc;
 }
@@ -383,12 +374,13 @@ uint32_t Usart::recv(char* buff, uint16_t bytes, uint32_t timeout)
   uint32_t delay = 0;
 
   while (bytes > 0) {
-    if (rx_head_ != rx_tail_) {
-      *buff++ = rx_buff_[rx_tail_];  
-      rx_tail_ = (rx_tail_ + 1) % BTR_USART_RX_BUFF_SIZE;
+    uint16_t n = rx_ring_.popN((uint8_t*) buff, bytes);
+
+    if (n > 0) {
+      buff += n;
       delay = 0;
-      --bytes;
-      ++rc;
+      bytes -= n;
+      rc += n;
     } else {
       if (timeout > 0) {
         _delay_us(BTR_USART_RX_DELAY_US);
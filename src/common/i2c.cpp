@@ -22,12 +22,27 @@ I2C::I2C(uint32_t dev_id)
 #if BTR_ESP32 > 0
     bus_handle_(nullptr),
     dev_handle_(nullptr),
+    bus_{ this },
+    devices_(&bus_),
 #else
     bus_handle_(dev_id),
+#endif
+#if BTR_STM32 > 0 && BTR_I2C_IRQ_ENABLED > 0
+    hal_{ this },
+    engine_(&hal_),
+#endif
+#if BTR_X86 > 0 && BTR_I2C_LINUX_DEV_ENABLED > 0
+    fd_(-1),
+#elif BTR_X86 > 0
+    sim_(BTR_I2C_SPEED),
 #endif
     buff_(),
     open_(false)
 {
+#if BTR_ESP32 > 0
+  // The port is BTR_I2C_MASTER_PORT.
+  (void) dev_id;
+#endif
 }
 
 //============================================= OPERATIONS =========================================
@@ -37,22 +52,51 @@ bool I2C::isOpen()
   return open_;
 }
 
+uint32_t I2C::read(uint8_t addr, uint8_t reg, uint8_t* buff, uint8_t count)
+{
+  return writeRead(addr, &reg, 1, buff, count);
+}
+
+#if BTR_ESP32 == 0 && BTR_I2C_LINUX_DEV_ENABLED == 0
+// ESP32 and Linux i2c-dev transfer whole buffers through the driver, see esp32/i2c.cpp and
+// x86/i2c_dev.cpp.
+
 uint32_t I2C::scan()
 {
   if (isOpen()) {
     uint32_t rc = BTR_DEV_ENOERR;
     uint32_t count = 0;
 
+#if BTR_STM32 > 0 && BTR_I2C_IRQ_ENABLED > 0
+    for (uint8_t addr = 0; addr < BTR_I2C_SCAN_MAX; addr++) {
+      // Address only: ACK means a device, NACK means none there.
+      I2CTransaction t;
+      t.addr = addr;
+      rc = (transfer(&t) & 0xFFFF0000);
+
+      if (is_ok(rc)) {
+        ++count;
+      } else if (BTR_DEV_ENOACK == rc) {
+        rc = BTR_DEV_ENOERR;
+      } else {
+        break;
+      }
+    }
+#else
     for (uint8_t addr = 0; addr < BTR_I2C_SCAN_MAX; addr++) {
       rc = start(addr, BTR_I2C_READ);
 
+      // start() ends the transfer on NACK.
       if (is_ok(rc)) {
         ++count;
+        stop();
+      } else if (BTR_DEV_ENOACK == rc) {
+        rc = BTR_DEV_ENOERR;
       } else {
         break;
       }
-      stop();
     }
+#endif
     set_status(dev::status(), rc);
     return (rc | count);
   }
@@ -61,6 +105,20 @@ uint32_t I2C::scan()
 
 uint32_t I2C::write(uint8_t addr, uint8_t reg, const uint8_t* buff, uint8_t bytes)
 {
+#if BTR_STM32 > 0 && BTR_I2C_IRQ_ENABLED > 0
+  if (isOpen()) {
+    I2CTransaction t;
+    t.addr = addr;
+    t.cmd[0] = reg;
+    t.cmd_bytes = 1;
+    t.wr = buff;
+    t.wr_bytes = bytes;
+
+    uint32_t rc = transfer(&t);
+    set_status(dev::status(), rc & 0xFFFF0000);
+    return rc;
+  }
+#else
   if (isOpen()) {
     uint32_t rc = start(addr, BTR_I2C_WRITE);
     uint32_t count = 0;
@@ -85,32 +143,27 @@ uint32_t I2C::write(uint8_t addr, uint8_t reg, const uint8_t* buff, uint8_t byte
     set_status(dev::status(), rc);
     return (rc | count);
   }
+#endif
   return BTR_DEV_ENOTOPEN;
 }
 
-uint32_t I2C::read(uint8_t addr, uint8_t reg, uint8_t* buff, uint8_t count)
+uint32_t I2C::read(uint8_t addr, uint8_t* buff, uint8_t bytes, bool stop_comm)
 {
-  if (isOpen()) {
-    uint32_t rc = start(addr, BTR_I2C_WRITE);
+#if BTR_STM32 > 0 && BTR_I2C_IRQ_ENABLED > 0
+  // Each transaction ends with a stop.
+  (void) stop_comm;
 
-    if (is_ok(rc)) {
-      rc = sendByte(reg);
+  if (isOpen()) {
+    I2CTransaction t;
+    t.addr = addr;
+    t.rd = buff;
+    t.rd_bytes = (bytes > 0 ? bytes : 1);
 
-      if (is_ok(rc)) {
-        // Stop then start in read (I2C restart).
-        stop();
-        rc = read(addr, buff, count, false);
-      }
-      stop();
-    }
+    uint32_t rc = (transfer(&t) & 0xFFFF0000);
     set_status(dev::status(), rc);
     return rc;
   }
-  return BTR_DEV_ENOTOPEN;
-}
-
-uint32_t I2C::read(uint8_t addr, uint8_t* buff, uint8_t bytes, bool stop_comm)
-{
+#else
   if (isOpen()) {
     uint32_t rc = start(addr, BTR_I2C_READ);
     uint32_t count = 0;
@@ -139,8 +192,52 @@ uint32_t I2C::read(uint8_t addr, uint8_t* buff, uint8_t bytes, bool stop_comm)
     set_status(dev::status(), rc);
     return (rc | count);
   }
+#endif
+  return BTR_DEV_ENOTOPEN;
+}
+
+uint32_t I2C::writeRead(
+    uint8_t addr, const uint8_t* wbuff, uint8_t wcount, uint8_t* rbuff, uint8_t rcount)
+{
+#if BTR_STM32 > 0 && BTR_I2C_IRQ_ENABLED > 0
+  if (isOpen()) {
+    I2CTransaction t;
+    t.addr = addr;
+    t.wr = wbuff;
+    t.wr_bytes = wcount;
+    t.rd = rbuff;
+    t.rd_bytes = rcount;
+
+    uint32_t rc = (transfer(&t) & 0xFFFF0000);
+    set_status(dev::status(), rc);
+    return rc;
+  }
+#else
+  if (isOpen()) {
+    uint32_t rc = start(addr, BTR_I2C_WRITE);
+
+    if (is_ok(rc)) {
+      for (uint8_t i = 0; i < wcount; i++) {
+        rc = sendByte(wbuff[i]);
+
+        if (is_err(rc)) {
+          break;
+        }
+      }
+
+      if (is_ok(rc)) {
+        // Repeated start, the bus stays ours between the write and the read.
+        rc = read(addr, rbuff, rcount, false);
+      }
+      stop();
+    }
+    set_status(dev::status(), rc);
+    return rc;
+  }
+#endif
   return BTR_DEV_ENOTOPEN;
 }
+#endif // BTR_ESP32 == 0 && BTR_I2C_LINUX_DEV_ENABLED == 0
 
 /////////////////////////////////////////////// PROTECTED //////////////////////////////////////////
 
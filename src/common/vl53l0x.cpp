@@ -12,7 +12,9 @@
 // PROJECT INCLDUES
 #include "devices/defines.hpp"
 #include "devices/vl53l0x.hpp"
+#include "devices/crc.hpp"
 #include "devices/i2c.hpp"
+#include "devices/reciprocal.hpp"
 #include "devices/time.hpp"
 
 #if BTR_VL53L0X_ENABLED > 0
@@ -22,13 +24,142 @@ namespace btr
 
 /////////////////////////////////////////////// PUBLIC /////////////////////////////////////////////
 
+constexpr VL53L0X::RegOp VL53L0X::TUNING_OPS[] = {
+  { 1, 0x00, 0x00 },
+
+  { 0, 0x09, 0x00 },
+  { 0, 0x10, 0x00 },
+  { 0, 0x11, 0x00 },
+
+  { 0, 0x24, 0x01 },
+  { 0, 0x25, 0xFF },
+  { 0, 0x75, 0x00 },
+
+  { 1, 0x4E, 0x2C },
+  { 1, 0x48, 0x00 },
+  { 1, 0x30, 0x20 },
+
+  { 0, 0x30, 0x09 },
+  { 0, 0x54, 0x00 },
+  { 0, 0x31, 0x04 },
+  { 0, 0x32, 0x03 },
+  { 0, 0x40, 0x83 },
+  { 0, 0x46, 0x25 },
+  { 0, 0x60, 0x00 },
+  { 0, 0x27, 0x00 },
+  { 0, 0x50, 0x06 },
+  { 0, 0x51, 0x00 },
+  { 0, 0x52, 0x96 },
+  { 0, 0x56, 0x08 },
+  { 0, 0x57, 0x30 },
+  { 0, 0x61, 0x00 },
+  { 0, 0x62, 0x00 },
+  { 0, 0x64, 0x00 },
+  { 0, 0x65, 0x00 },
+  { 0, 0x66, 0xA0 },
+
+  { 1, 0x22, 0x32 },
+  { 1, 0x47, 0x14 },
+  { 1, 0x49, 0xFF },
+  { 1, 0x4A, 0x00 },
+
+  { 0, 0x7A, 0x0A },
+  { 0, 0x7B, 0x00 },
+  { 0, 0x78, 0x21 },
+
+  { 1, 0x23, 0x34 },
+  { 1, 0x42, 0x00 },
+  { 1, 0x44, 0xFF },
+  { 1, 0x45, 0x26 },
+  { 1, 0x46, 0x05 },
+  { 1, 0x40, 0x40 },
+  { 1, 0x0E, 0x06 },
+  { 1, 0x20, 0x1A },
+  { 1, 0x43, 0x40 },
+
+  { 0, 0x34, 0x03 },
+  { 0, 0x35, 0x44 },
+
+  { 1, 0x31, 0x04 },
+  { 1, 0x4B, 0x09 },
+  { 1, 0x4C, 0x05 },
+  { 1, 0x4D, 0x04 },
+
+  { 0, 0x44, 0x00 },
+  { 0, 0x45, 0x20 },
+  { 0, 0x47, 0x08 },
+  { 0, 0x48, 0x28 },
+  { 0, 0x67, 0x00 },
+  { 0, 0x70, 0x04 },
+  { 0, 0x71, 0x01 },
+  { 0, 0x72, 0xFE },
+  { 0, 0x76, 0x00 },
+  { 0, 0x77, 0x00 },
+
+  { 1, 0x0D, 0x01 },
+
+  { 0, 0x80, 0x01 },
+  { 0, 0x01, 0xF8 },
+
+  { 1, 0x8E, 0x01 },
+  { 1, 0x00, 0x01 },
+  { 0, 0x80, 0x00 },
+};
+
+constexpr uint16_t VL53L0X::TUNING_OPS_COUNT = sizeof(TUNING_OPS) / sizeof(TUNING_OPS[0]);
+
+/** Calibration layout version. */
+static constexpr uint8_t CAL_VERSION = 1;
+
+static constexpr Reciprocal DIV_1000 = makeReciprocal(1000);
+
+/** Macro period in nanoseconds of a VCSEL period, and its reciprocal. */
+struct MacroPeriod
+{
+  uint32_t ns;
+  Reciprocal rcp;
+};
+
+static constexpr uint8_t VCSEL_PCLKS_MIN = 8;
+static constexpr uint8_t VCSEL_PCLKS_MAX = 18;
+
+static constexpr MacroPeriod makeMacroPeriod(uint8_t vcsel_period_pclks)
+{
+  MacroPeriod p = {
+    BTR_VL53L0X_CALC_PERIOD(vcsel_period_pclks),
+    makeReciprocal(BTR_VL53L0X_CALC_PERIOD(vcsel_period_pclks))
+  };
+  return p;
+}
+
+/** Macro periods of the even VCSEL periods from VCSEL_PCLKS_MIN to VCSEL_PCLKS_MAX. */
+static constexpr MacroPeriod MACRO_PERIODS[] = {
+  makeMacroPeriod(8),
+  makeMacroPeriod(10),
+  makeMacroPeriod(12),
+  makeMacroPeriod(14),
+  makeMacroPeriod(16),
+  makeMacroPeriod(18),
+};
+
 //============================================= LIFECYCLE ==========================================
 
 VL53L0X::VL53L0X()
   :
     addr_(BTR_VL53L0X_ADDR_DFLT),
     stop_var_(0),
-    timing_budget_us_(0)
+    cal_(),
+    init_state_(INIT_STATE_IDLE),
+    init_io_2v8_(true),
+    init_restore_(false),
+    init_tm_(0),
+    timing_budget_us_(0),
+    page_(0),
+    shadow_(),
+    ready_cb_(nullptr),
+    ready_arg_(nullptr),
+    ready_irq_(false),
+    data_ready_(false)
 {
 }
 
@@ -36,199 +167,133 @@ VL53L0X::VL53L0X()
 
 int VL53L0X::init(bool io_2v8)
 {
-  // Sensor uses 1V8 mode for I/O by default.
-
-  if (io_2v8) {
-    uint8_t v = readReg(VHV_CONFIG_PAD_SCL_SDA__EXTSUP_HV);
-    writeReg(VHV_CONFIG_PAD_SCL_SDA__EXTSUP_HV, (v | 0x01)); // set bit 0
-  }
-
-  // Set I2C standard mode.
-  writeReg(0x88, 0x00);
-
-  writeReg(0x80, 0x01);
-  writeReg(0xFF, 0x01);
-  writeReg(0x00, 0x00);
-  stop_var_ = readReg(0x91);
-  writeReg(0x00, 0x01);
-  writeReg(0xFF, 0x00);
-  writeReg(0x80, 0x00);
-
-  // Disable SIGNAL_RATE_MSRC (bit 1) and SIGNAL_RATE_PRE_RANGE (bit 4) limit checks.
-  writeReg(MSRC_CONFIG_CONTROL, readReg(MSRC_CONFIG_CONTROL) | 0x12);
+  startInit(io_2v8);
+  return finishInit();
+}
 
-  // Set range signal rate limit to 0.25 MCPS (million counts per second).
-  setSignalRateLimit(0.25);
+int VL53L0X::init(const Calibration& cal, bool io_2v8)
+{
+  startInit(cal, io_2v8);
+  return finishInit();
+}
 
-  writeReg(SYSTEM_SEQUENCE_CONFIG, 0xFF);
+void VL53L0X::startInit(bool io_2v8)
+{
+  init_state_ = INIT_STATE_BEGIN;
+  init_io_2v8_ = io_2v8;
+  init_restore_ = false;
+}
 
-  uint8_t spad_count;
-  bool spad_type_is_aperture;
+void VL53L0X::startInit(const Calibration& cal, bool io_2v8)
+{
+  startInit(io_2v8);
 
-  if (!getSpadInfo(&spad_count, &spad_type_is_aperture)) {
-    return -1;
+  if (isValid(cal)) {
+    cal_ = cal;
+    init_restore_ = true;
   }
+}
 
-  // The SPAD map (RefGoodSpadMap) is read by VL53L0X_get_info_from_device() in
-  // the API, but the same data seems to be more easily readable from
-  // GLOBAL_CONFIG_SPAD_ENABLES_REF_0 through _6, so read it from there
-  uint8_t ref_spad_map[6];
-  readMulti(GLOBAL_CONFIG_SPAD_ENABLES_REF_0, ref_spad_map, 6);
-
-  writeReg(0xFF, 0x01);
-  writeReg(DYNAMIC_SPAD_REF_EN_START_OFFSET, 0x00);
-  writeReg(DYNAMIC_SPAD_NUM_REQUESTED_REF_SPAD, 0x2C);
-  writeReg(0xFF, 0x00);
-  writeReg(GLOBAL_CONFIG_REF_EN_START_SELECT, 0xB4);
-
-  uint8_t first_spad_to_enable = spad_type_is_aperture ? 12 : 0; // 12 is the first aperture spad
-  uint8_t spads_enabled = 0;
-
-  for (uint8_t i = 0; i < 48; i++) {
-    if (i < first_spad_to_enable || spads_enabled == spad_count) {
-      // This bit is lower than the first one that should be enabled, or
-      // (reference_spad_count) bits have already been enabled, so zero this bit
-      ref_spad_map[i / 8] &= ~(1 << (i % 8));
-    } else if ((ref_spad_map[i / 8] >> (i % 8)) & 0x1) {
-      spads_enabled++;
-    }
+VL53L0X::InitStatus VL53L0X::initStep()
+{
+  switch (init_state_) {
+    case INIT_STATE_BEGIN:
+      beginInit();
+
+      if (init_restore_) {
+        init_state_ = INIT_STATE_CONFIG;
+      } else {
+        requestSpadInfo();
+        init_tm_ = MILLIS();
+        init_state_ = INIT_STATE_SPAD_WAIT;
+      }
+      return INIT_PENDING;
+
+    case INIT_STATE_SPAD_WAIT:
+      if (0x00 == readReg(0x83)) {
+        return initTimeout();
+      }
+      readSpadInfo();
+      init_state_ = INIT_STATE_CONFIG;
+      return INIT_PENDING;
+
+    case INIT_STATE_CONFIG:
+      configure();
+
+      if (init_restore_) {
+        refCalibrationIo(false, &cal_.vhv_settings, &cal_.phase_cal);
+        writeReg(SYSTEM_SEQUENCE_CONFIG, 0xE8);
+        init_state_ = INIT_STATE_DONE;
+        return INIT_DONE;
+      }
+
+      writeReg(SYSTEM_SEQUENCE_CONFIG, 0x01);
+      startRefCalibration(0x40);
+      init_tm_ = MILLIS();
+      init_state_ = INIT_STATE_VHV_WAIT;
+      return INIT_PENDING;
+
+    case INIT_STATE_VHV_WAIT:
+      if (false == refCalibrationDone()) {
+        return initTimeout();
+      }
+      stopRefCalibration();
+
+      writeReg(SYSTEM_SEQUENCE_CONFIG, 0x02);
+      startRefCalibration(0x00);
+      init_tm_ = MILLIS();
+      init_state_ = INIT_STATE_PHASE_WAIT;
+      return INIT_PENDING;
+
+    case INIT_STATE_PHASE_WAIT:
+      if (false == refCalibrationDone()) {
+        return initTimeout();
+      }
+      stopRefCalibration();
+
+      // Restore the previous sequence config.
+      writeReg(SYSTEM_SEQUENCE_CONFIG, 0xE8);
+      cal_.version = CAL_VERSION;
+      init_state_ = INIT_STATE_DONE;
+      return INIT_DONE;
+
+    case INIT_STATE_DONE:
+      return INIT_DONE;
+
+    default:
+      return INIT_ERROR;
   }
+}
 
-  writeMulti(GLOBAL_CONFIG_SPAD_ENABLES_REF_0, ref_spad_map, 6);
-
-  // Apply default tuning settings.
-
-  writeReg(0xFF, 0x01);
-  writeReg(0x00, 0x00);
-
-  writeReg(0xFF, 0x00);
-  writeReg(0x09, 0x00);
-  writeReg(0x10, 0x00);
-  writeReg(0x11, 0x00);
-
-  writeReg(0x24, 0x01);
-  writeReg(0x25, 0xFF);
-  writeReg(0x75, 0x00);
-
-  writeReg(0xFF, 0x01);
-  writeReg(0x4E, 0x2C);
-  writeReg(0x48, 0x00);
-  writeReg(0x30, 0x20);
-
-  writeReg(0xFF, 0x00);
-  writeReg(0x30, 0x09);
-  writeReg(0x54, 0x00);
-  writeReg(0x31, 0x04);
-  writeReg(0x32, 0x03);
-  writeReg(0x40, 0x83);
-  writeReg(0x46, 0x25);
-  writeReg(0x60, 0x00);
-  writeReg(0x27, 0x00);
-  writeReg(0x50, 0x06);
-  writeReg(0x51, 0x00);
-  writeReg(0x52, 0x96);
-  writeReg(0x56, 0x08);
-  writeReg(0x57, 0x30);
-  writeReg(0x61, 0x00);
-  writeReg(0x62, 0x00);
-  writeReg(0x64, 0x00);
-  writeReg(0x65, 0x00);
-  writeReg(0x66, 0xA0);
-
-  writeReg(0xFF, 0x01);
-  writeReg(0x22, 0x32);
-  writeReg(0x47, 0x14);
-  writeReg(0x49, 0xFF);
-  writeReg(0x4A, 0x00);
-
-  writeReg(0xFF, 0x00);
-  writeReg(0x7A, 0x0A);
-  writeReg(0x7B, 0x00);
-  writeReg(0x78, 0x21);
-
-  writeReg(0xFF, 0x01);
-  writeReg(0x23, 0x34);
-  writeReg(0x42, 0x00);
-  writeReg(0x44, 0xFF);
-  writeReg(0x45, 0x26);
-  writeReg(0x46, 0x05);
-  writeReg(0x40, 0x40);
-  writeReg(0x0E, 0x06);
-  writeReg(0x20, 0x1A);
-  writeReg(0x43, 0x40);
-
-  writeReg(0xFF, 0x00);
-  writeReg(0x34, 0x03);
-  writeReg(0x35, 0x44);
-
-  writeReg(0xFF, 0x01);
-  writeReg(0x31, 0x04);
-  writeReg(0x4B, 0x09);
-  writeReg(0x4C, 0x05);
-  writeReg(0x4D, 0x04);
-
-  writeReg(0xFF, 0x00);
-  writeReg(0x44, 0x00);
-  writeReg(0x45, 0x20);
-  writeReg(0x47, 0x08);
-  writeReg(0x48, 0x28);
-  writeReg(0x67, 0x00);
-  writeReg(0x70, 0x04);
-  writeReg(0x71, 0x01);
-  writeReg(0x72, 0xFE);
-  writeReg(0x76, 0x00);
-  writeReg(0x77, 0x00);
-
-  writeReg(0xFF, 0x01);
-  writeReg(0x0D, 0x01);
-
-  writeReg(0xFF, 0x00);
-  writeReg(0x80, 0x01);
-  writeReg(0x01, 0xF8);
-
-  writeReg(0xFF, 0x01);
-  writeReg(0x8E, 0x01);
-  writeReg(0x00, 0x01);
-  writeReg(0xFF, 0x00);
-  writeReg(0x80, 0x00);
-
-  // Set interrupt config to new sample ready.
-  writeReg(SYSTEM_INTERRUPT_CONFIG_GPIO, 0x04);
-  // Active low.
-  writeReg(GPIO_HV_MUX_ACTIVE_HIGH, readReg(GPIO_HV_MUX_ACTIVE_HIGH) & ~0x10);
-  writeReg(SYSTEM_INTERRUPT_CLEAR, 0x01);
-
-  timing_budget_us_ = getMeasurementTimingBudget();
-
-  // Disable MSRC and TCC by default.
-  // MSRC = Minimum Signal Rate Check
-  // TCC = Target CentreCheck
-  writeReg(SYSTEM_SEQUENCE_CONFIG, 0xE8);
-
-  // Recalculate timing budget.
-  setMeasurementTimingBudget(timing_budget_us_);
-
-  writeReg(SYSTEM_SEQUENCE_CONFIG, 0x01);
-
-  if (!performSingleRefCalibration(0x40)) {
-    return -1;
+bool VL53L0X::getCalibration(Calibration* cal)
+{
+  if (0 == cal_.version) {
+    return false;
   }
 
-  writeReg(SYSTEM_SEQUENCE_CONFIG, 0x02);
-
-  if (!performSingleRefCalibration(0x00)) {
-    return -1;
-  }
+  refCalibrationIo(true, &cal_.vhv_settings, &cal_.phase_cal);
+  cal_.crc = calibrationCrc(cal_);
+  *cal = cal_;
+  return true;
+}
 
-  // Restore the previous sequence config.
-  writeReg(SYSTEM_SEQUENCE_CONFIG, 0xE8);
-  return 0;
+bool VL53L0X::isValid(const Calibration& cal)
+{
+  return (CAL_VERSION == cal.version && calibrationCrc(cal) == cal.crc);
 }
 
 void VL53L0X::setAddress(uint8_t addr)
 {
+  // The sensor still answers at the old address.
+  writeReg(I2C_SLAVE_DEVICE_ADDRESS, addr & 0x7F);
   addr_ = addr;
-  writeReg(I2C_SLAVE_DEVICE_ADDRESS, addr_ & 0x7F);
+}
+
+void VL53L0X::resetAddress()
+{
+  addr_ = BTR_VL53L0X_ADDR_DFLT;
+  page_ = 0;
+  shadow_.valid = false;
 }
 
 uint8_t VL53L0X::getAddress()
@@ -239,21 +304,29 @@ uint8_t VL53L0X::getAddress()
 void VL53L0X::writeReg(uint8_t reg, uint8_t value)
 {
   I2C* i2c = I2C::instance(BTR_VL53L0X_PORT_I2C, false);
-  i2c->write(addr_, reg, value);
+  uint32_t rc = i2c->write(addr_, reg, value);
+  updateShadow(rc, reg, &value, 1);
 }
 
 void VL53L0X::writeReg16Bit(uint8_t reg, uint16_t value)
 {
-  uint8_t* buff = reinterpret_cast<uint8_t*>(&value);
+  // The device expects the most significant byte first.
   I2C* i2c = I2C::instance(BTR_VL53L0X_PORT_I2C, false);
-  i2c->write(addr_, reg, buff, sizeof(value));
+  uint32_t rc = i2c->write(addr_, reg, value);
+
+  uint8_t data[2] = { uint8_t(value >> 8), uint8_t(value) };
+  updateShadow(rc, reg, data, sizeof(data));
 }
 
 void VL53L0X::writeReg32Bit(uint8_t reg, uint32_t value)
 {
-  uint8_t* buff = reinterpret_cast<uint8_t*>(&value);
+  // The device expects the most significant byte first.
   I2C* i2c = I2C::instance(BTR_VL53L0X_PORT_I2C, false);
-  i2c->write(addr_, reg, buff, sizeof(value));
+  uint32_t rc = i2c->write(addr_, reg, value);
+
+  uint8_t data[4] = { uint8_t(value >> 24), uint8_t(value >> 16), uint8_t(value >> 8),
+    uint8_t(value) };
+  updateShadow(rc, reg, data, sizeof(data));
 }
 
 uint8_t VL53L0X::readReg(uint8_t reg)
@@ -283,7 +356,40 @@ uint32_t VL53L0X::readReg32Bit(uint8_t reg)
 void VL53L0X::writeMulti(uint8_t reg, uint8_t* src, uint8_t count)
 {
   I2C* i2c = I2C::instance(BTR_VL53L0X_PORT_I2C, false);
-  i2c->write(addr_, reg, src, count);
+  uint32_t rc = i2c->write(addr_, reg, src, count);
+  updateShadow(rc, reg, src, count);
+}
+
+void VL53L0X::writeOps(const RegOp* ops, uint16_t count)
+{
+  I2C* i2c = I2C::instance(BTR_VL53L0X_PORT_I2C, false);
+  uint8_t buff[BTR_VL53L0X_BURST_MAX];
+
+  for (uint16_t i = 0; i < count; ) {
+    const RegOp& first = ops[i];
+
+    if (first.page != page_) {
+      writeReg(0xFF, first.page);
+    }
+
+    uint8_t n = 0;
+
+    do {
+      buff[n] = ops[i + n].value;
+      n++;
+    } while (i + n < count
+        && n < BTR_VL53L0X_BURST_MAX
+        && ops[i + n].page == page_
+        && ops[i + n].reg == uint8_t(first.reg + n));
+
+    uint32_t rc = i2c->write(addr_, first.reg, buff, n);
+    updateShadow(rc, first.reg, buff, n);
+    i += n;
+  }
+
+  if (0 != page_) {
+    writeReg(0xFF, 0x00);
+  }
 }
 
 void VL53L0X::readMulti(uint8_t reg, uint8_t* dst, uint8_t count)
@@ -292,6 +398,8 @@ void VL53L0X::readMulti(uint8_t reg, uint8_t* dst, uint8_t count)
   i2c->read(addr_, reg, dst, count);
 }
 
+#if BTR_VL53L0X_FIXED_POINT_ENABLED == 0
+
 bool VL53L0X::setSignalRateLimit(float limit_mcps)
 {
   if (limit_mcps < BTR_VL53L0X_LIMIT_MCPS_MIN || limit_mcps > BTR_VL53L0X_LIMIT_MCPS_MAX) {
@@ -299,13 +407,58 @@ bool VL53L0X::setSignalRateLimit(float limit_mcps)
   }
 
   // Q9.7 fixed point format (9 integer bits, 7 fractional bits)
-  writeReg16Bit(FINAL_RANGE_CONFIG_MIN_COUNT_RATE_RTN_LIMIT, limit_mcps * (1 << 7));
-  return true;
+  return setSignalRateLimitQ7(limit_mcps * (1 << 7));
 }
 
 float VL53L0X::getSignalRateLimit()
 {
-  return (float) readReg16Bit(FINAL_RANGE_CONFIG_MIN_COUNT_RATE_RTN_LIMIT) / (1 << 7);
+  return (float) getSignalRateLimitQ7() / (1 << 7);
+}
+
+#endif // BTR_VL53L0X_FIXED_POINT_ENABLED == 0
+
+bool VL53L0X::setSignalRateLimitQ7(uint16_t limit_q7)
+{
+  // The limits in Q9.7, folded at compile time.
+  constexpr uint32_t min_q7 = BTR_VL53L0X_LIMIT_MCPS_MIN * (1 << 7);
+  constexpr uint32_t max_q7 = BTR_VL53L0X_LIMIT_MCPS_MAX * (1 << 7);
+
+  if (limit_q7 < min_q7 || limit_q7 > max_q7) {
+    return false;
+  }
+
+  writeReg16Bit(FINAL_RANGE_CONFIG_MIN_COUNT_RATE_RTN_LIMIT, limit_q7);
+  return true;
+}
+
+uint16_t VL53L0X::getSignalRateLimitQ7()
+{
+  return readReg16Bit(FINAL_RANGE_CONFIG_MIN_COUNT_RATE_RTN_LIMIT);
+}
+
+uint32_t VL53L0X::timeoutMclksToMicroseconds(uint16_t timeout_period_mclks, uint8_t vcsel_period_pclks)
+{
+  uint32_t macro_period_ns;
+
+  if (vcsel_period_pclks >= VCSEL_PCLKS_MIN && vcsel_period_pclks <= VCSEL_PCLKS_MAX
+      && 0 == (vcsel_period_pclks & 1)) {
+    macro_period_ns = MACRO_PERIODS[(vcsel_period_pclks - VCSEL_PCLKS_MIN) >> 1].ns;
+  } else {
+    macro_period_ns = BTR_VL53L0X_CALC_PERIOD(vcsel_period_pclks);
+  }
+  return divide((timeout_period_mclks * macro_period_ns) + (macro_period_ns / 2), DIV_1000);
+}
+
+uint32_t VL53L0X::timeoutMicrosecondsToMclks(uint32_t timeout_period_us, uint8_t vcsel_period_pclks)
+{
+  if (vcsel_period_pclks >= VCSEL_PCLKS_MIN && vcsel_period_pclks <= VCSEL_PCLKS_MAX
+      && 0 == (vcsel_period_pclks & 1)) {
+    const MacroPeriod& p = MACRO_PERIODS[(vcsel_period_pclks - VCSEL_PCLKS_MIN) >> 1];
+    return divide((timeout_period_us * 1000) + (p.ns / 2), p.rcp);
+  }
+
+  uint32_t macro_period_ns = BTR_VL53L0X_CALC_PERIOD(vcsel_period_pclks);
+  return (((timeout_period_us * 1000) + (macro_period_ns / 2)) / macro_period_ns);
 }
 
 bool VL53L0X::setMeasurementTimingBudget(uint32_t budget_us)
@@ -551,7 +704,7 @@ bool VL53L0X::setVcselPulsePeriod(VcselPeriodType type, uint8_t period_pclks)
   setMeasurementTimingBudget(timing_budget_us_);
 
   // Perform phase calibration. This is needed after changing VCSEL period.
-  uint8_t sequence_config = readReg(SYSTEM_SEQUENCE_CONFIG);
+  uint8_t sequence_config = shadow_.sequence_config;
   writeReg(SYSTEM_SEQUENCE_CONFIG, 0x02);
   performSingleRefCalibration(0x0);
   writeReg(SYSTEM_SEQUENCE_CONFIG, sequence_config);
@@ -561,10 +714,12 @@ bool VL53L0X::setVcselPulsePeriod(VcselPeriodType type, uint8_t period_pclks)
 
 uint8_t VL53L0X::getVcselPulsePeriod(VcselPeriodType type)
 {
+  loadShadow();
+
   if (type == VcselPeriodPreRange) {
-    return BTR_VL53L0X_DECODE_VCSEL(readReg(PRE_RANGE_CONFIG_VCSEL_PERIOD));
+    return BTR_VL53L0X_DECODE_VCSEL(shadow_.pre_range[0]);
   } else if (type == VcselPeriodFinalRange) {
-    return BTR_VL53L0X_DECODE_VCSEL(readReg(FINAL_RANGE_CONFIG_VCSEL_PERIOD));
+    return BTR_VL53L0X_DECODE_VCSEL(shadow_.final_range[0]);
   } else {
     return 255;
   }
@@ -579,6 +734,7 @@ void VL53L0X::startContinuous(uint32_t period)
   writeReg(0x00, 0x01);
   writeReg(0xFF, 0x00);
   writeReg(0x80, 0x00);
+  data_ready_ = false;
 
   if (period != 0) {
     uint16_t osc_calibrate_val = readReg16Bit(OSC_CALIBRATE_VAL);
@@ -612,17 +768,55 @@ void VL53L0X::stopContinuous()
 uint16_t VL53L0X::readRangeContinuousMillimeters()
 {
   uint32_t tm = MILLIS();
+  uint16_t range = 0;
 
-  while ((readReg(RESULT_INTERRUPT_STATUS) & 0x07) == 0) {
+  while (false == tryReadRange(&range)) {
     if (IS_TIMEOUT(BTR_VL53L0X_TIMEOUT_MS, tm)) {
       set_status(dev::status(), BTR_DEV_ETIMEOUT);
+      return UINT16_MAX;
     }
   }
+  return range;
+}
+
+void VL53L0X::enableDataReadyIrq(void (*callback)(void* arg), void* arg)
+{
+  ready_cb_ = callback;
+  ready_arg_ = arg;
+  ready_irq_ = true;
+}
+
+void VL53L0X::onDataReady()
+{
+  data_ready_ = true;
+
+  if (nullptr != ready_cb_) {
+    ready_cb_(ready_arg_);
+  }
+}
+
+bool VL53L0X::dataReady()
+{
+  if (ready_irq_) {
+    return data_ready_;
+  }
+  return ((readReg(RESULT_INTERRUPT_STATUS) & 0x07) != 0);
+}
+
+bool VL53L0X::tryReadRange(uint16_t* mm)
+{
+  if (false == dataReady()) {
+    return false;
+  }
+
+  // The pin stays low until the interrupt is cleared, so the next sample can't be missed.
+  data_ready_ = false;
 
   // Assumptions: Linearity Corrective Gain is 1000 (default). Fractional ranging is not enabled.
   uint16_t range = readReg16Bit(RESULT_RANGE_STATUS + 10);
   writeReg(SYSTEM_INTERRUPT_CLEAR, 0x01);
-  return (range + BTR_VL53L0X_COMPENSATE_MM);
+  *mm = (range + BTR_VL53L0X_COMPENSATE_MM);
+  return true;
 }
 
 uint16_t VL53L0X::readRangeSingleMillimeters()
@@ -634,6 +828,7 @@ uint16_t VL53L0X::readRangeSingleMillimeters()
   writeReg(0x00, 0x01);
   writeReg(0xFF, 0x00);
   writeReg(0x80, 0x00);
+  data_ready_ = false;
   writeReg(SYSRANGE_START, 0x01);
 
   uint32_t tm = MILLIS();
@@ -642,6 +837,7 @@ uint16_t VL53L0X::readRangeSingleMillimeters()
   while (readReg(SYSRANGE_START) & 0x01) {
     if (IS_TIMEOUT(BTR_VL53L0X_TIMEOUT_MS, tm)) {
       set_status(dev::status(), BTR_DEV_ETIMEOUT);
+      return UINT16_MAX;
     }
   }
   return readRangeContinuousMillimeters();
@@ -651,10 +847,120 @@ uint16_t VL53L0X::readRangeSingleMillimeters()
 
 //============================================= OPERATIONS =========================================
 
-bool VL53L0X::getSpadInfo(uint8_t * count, bool * type_is_aperture)
+int VL53L0X::finishInit()
+{
+  InitStatus status;
+
+  do {
+    status = initStep();
+  } while (INIT_PENDING == status);
+
+  return (INIT_DONE == status ? 0 : -1);
+}
+
+VL53L0X::InitStatus VL53L0X::initTimeout()
+{
+  if (IS_TIMEOUT(BTR_VL53L0X_TIMEOUT_MS, init_tm_)) {
+    init_state_ = INIT_STATE_ERROR;
+    return INIT_ERROR;
+  }
+  return INIT_PENDING;
+}
+
+void VL53L0X::beginInit()
+{
+  page_ = 0;
+  shadow_.valid = false;
+
+  // Sensor uses 1V8 mode for I/O by default.
+
+  if (init_io_2v8_) {
+    uint8_t v = readReg(VHV_CONFIG_PAD_SCL_SDA__EXTSUP_HV);
+    writeReg(VHV_CONFIG_PAD_SCL_SDA__EXTSUP_HV, (v | 0x01)); // set bit 0
+  }
+
+  // Set I2C standard mode.
+  writeReg(0x88, 0x00);
+
+  if (false == init_restore_) {
+    cal_.version = 0;
+
+    writeReg(0x80, 0x01);
+    writeReg(0xFF, 0x01);
+    writeReg(0x00, 0x00);
+    cal_.stop_var = readReg(0x91);
+    writeReg(0x00, 0x01);
+    writeReg(0xFF, 0x00);
+    writeReg(0x80, 0x00);
+  }
+  stop_var_ = cal_.stop_var;
+
+  // Disable SIGNAL_RATE_MSRC (bit 1) and SIGNAL_RATE_PRE_RANGE (bit 4) limit checks.
+  writeReg(MSRC_CONFIG_CONTROL, readReg(MSRC_CONFIG_CONTROL) | 0x12);
+
+  // Set range signal rate limit to 0.25 MCPS (million counts per second).
+  setSignalRateLimitQ7(uint16_t(0.25 * (1 << 7)));
+
+  writeReg(SYSTEM_SEQUENCE_CONFIG, 0xFF);
+}
+
+void VL53L0X::configure()
+{
+  static constexpr RegOp SPAD_OPS[] = {
+    { 1, DYNAMIC_SPAD_REF_EN_START_OFFSET, 0x00 },
+    { 1, DYNAMIC_SPAD_NUM_REQUESTED_REF_SPAD, 0x2C },
+    { 0, GLOBAL_CONFIG_REF_EN_START_SELECT, 0xB4 },
+  };
+  writeOps(SPAD_OPS, sizeof(SPAD_OPS) / sizeof(SPAD_OPS[0]));
+  writeMulti(GLOBAL_CONFIG_SPAD_ENABLES_REF_0, cal_.spad_map, 6);
+
+  // Apply default tuning settings.
+  writeOps(TUNING_OPS, TUNING_OPS_COUNT);
+
+  // Set interrupt config to new sample ready.
+  writeReg(SYSTEM_INTERRUPT_CONFIG_GPIO, 0x04);
+  // Active low.
+  writeReg(GPIO_HV_MUX_ACTIVE_HIGH, readReg(GPIO_HV_MUX_ACTIVE_HIGH) & ~0x10);
+  writeReg(SYSTEM_INTERRUPT_CLEAR, 0x01);
+
+  timing_budget_us_ = getMeasurementTimingBudget();
+
+  // Disable MSRC and TCC by default.
+  // MSRC = Minimum Signal Rate Check
+  // TCC = Target CentreCheck
+  writeReg(SYSTEM_SEQUENCE_CONFIG, 0xE8);
+
+  // Recalculate timing budget.
+  setMeasurementTimingBudget(timing_budget_us_);
+}
+
+void VL53L0X::refCalibrationIo(bool read, uint8_t* vhv_settings, uint8_t* phase_cal)
+{
+  static constexpr RegOp ENTER_OPS[] = { { 1, 0x00, 0x00 } };
+  static constexpr RegOp EXIT_OPS[] = { { 1, 0x00, 0x01 } };
+
+  writeOps(ENTER_OPS, 1);
+
+  if (read) {
+    *vhv_settings = readReg(0xCB);
+    *phase_cal = readReg(0xEE);
+  } else {
+    writeReg(0xCB, *vhv_settings);
+    writeReg(0xEE, (readReg(0xEE) & 0x80) | *phase_cal);
+  }
+
+  writeOps(EXIT_OPS, 1);
+}
+
+uint16_t VL53L0X::calibrationCrc(const Calibration& cal)
 {
-  uint8_t tmp;
+  const uint8_t* data = reinterpret_cast<const uint8_t*>(&cal);
+  return Crc16Bitwise::finish(Crc16Bitwise::update(
+        Crc16Bitwise::init(), data, offsetof(Calibration, crc)));
+}
 
+void VL53L0X::requestSpadInfo()
+{
   writeReg(0x80, 0x01);
   writeReg(0xFF, 0x01);
   writeReg(0x00, 0x00);
@@ -668,20 +974,16 @@ bool VL53L0X::getSpadInfo(uint8_t * count, bool * type_is_aperture)
 
   writeReg(0x94, 0x6b);
   writeReg(0x83, 0x00);
+}
 
-  uint32_t tm = MILLIS();
-
-  while (readReg(0x83) == 0x00) {
-    if (IS_TIMEOUT(BTR_VL53L0X_TIMEOUT_MS, tm)) {
-      return false;
-    }
-  }
-
+void VL53L0X::readSpadInfo()
+{
   writeReg(0x83, 0x01);
-  tmp = readReg(0x92);
+  uint8_t tmp = readReg(0x92);
 
-  *count = tmp & 0x7f;
-  *type_is_aperture = (tmp >> 7) & 0x01;
+  uint8_t spad_count = tmp & 0x7f;
+  bool spad_type_is_aperture = (tmp >> 7) & 0x01;
+  cal_.spad_info = tmp;
 
   writeReg(0x81, 0x00);
   writeReg(0xFF, 0x06);
@@ -692,12 +994,92 @@ bool VL53L0X::getSpadInfo(uint8_t * count, bool * type_is_aperture)
   writeReg(0xFF, 0x00);
   writeReg(0x80, 0x00);
 
-  return true;
+  // The SPAD map (RefGoodSpadMap) is read by VL53L0X_get_info_from_device() in
+  // the API, but the same data seems to be more easily readable from
+  // GLOBAL_CONFIG_SPAD_ENABLES_REF_0 through _6, so read it from there
+  uint8_t* ref_spad_map = cal_.spad_map;
+  readMulti(GLOBAL_CONFIG_SPAD_ENABLES_REF_0, ref_spad_map, 6);
+
+  uint8_t first_spad_to_enable = spad_type_is_aperture ? 12 : 0; // 12 is the first aperture spad
+  uint8_t spads_enabled = 0;
+
+  for (uint8_t i = 0; i < 48; i++) {
+    if (i < first_spad_to_enable || spads_enabled == spad_count) {
+      // This bit is lower than the first one that should be enabled, or
+      // (reference_spad_count) bits have already been enabled, so zero this bit
+      ref_spad_map[i / 8] &= ~(1 << (i % 8));
+    } else if ((ref_spad_map[i / 8] >> (i % 8)) & 0x1) {
+      spads_enabled++;
+    }
+  }
+}
+
+void VL53L0X::loadShadow()
+{
+  if (shadow_.valid) {
+    return;
+  }
+
+  I2C* i2c = I2C::instance(BTR_VL53L0X_PORT_I2C, false);
+  uint32_t rc[] = {
+    i2c->read(addr_, SYSTEM_SEQUENCE_CONFIG, &shadow_.sequence_config),
+    i2c->read(addr_, PRE_RANGE_CONFIG_VCSEL_PERIOD, shadow_.pre_range, sizeof(shadow_.pre_range)),
+    i2c->read(addr_, MSRC_CONFIG_TIMEOUT_MACROP, &shadow_.msrc_timeout),
+    i2c->read(addr_, FINAL_RANGE_CONFIG_VCSEL_PERIOD, shadow_.final_range,
+        sizeof(shadow_.final_range))
+  };
+
+  // Whatever failed to read is read again next time.
+  shadow_.valid = (is_ok(rc[0]) && is_ok(rc[1]) && is_ok(rc[2]) && is_ok(rc[3]));
+}
+
+void VL53L0X::updateShadow(uint32_t rc, uint8_t reg, const uint8_t* data, uint8_t count)
+{
+  // The sensor may have got none, some or all of the bytes, read the registers again.
+  if (false == is_ok(rc)) {
+    shadow_.valid = false;
+    return;
+  }
+
+  for (uint8_t i = 0; i < count; i++, reg++) {
+    if (0xFF == reg) {
+      page_ = data[i];
+      continue;
+    } else if (0 != page_) {
+      continue;
+    }
+
+    switch (reg) {
+      case SYSTEM_SEQUENCE_CONFIG:
+        shadow_.sequence_config = data[i];
+        break;
+      case PRE_RANGE_CONFIG_VCSEL_PERIOD:
+      case PRE_RANGE_CONFIG_TIMEOUT_MACROP_HI:
+      case PRE_RANGE_CONFIG_TIMEOUT_MACROP_LO:
+        shadow_.pre_range[reg - PRE_RANGE_CONFIG_VCSEL_PERIOD] = data[i];
+        break;
+      case MSRC_CONFIG_TIMEOUT_MACROP:
+        shadow_.msrc_timeout = data[i];
+        break;
+      case FINAL_RANGE_CONFIG_VCSEL_PERIOD:
+      case FINAL_RANGE_CONFIG_TIMEOUT_MACROP_HI:
+      case FINAL_RANGE_CONFIG_TIMEOUT_MACROP_LO:
+        shadow_.final_range[reg - FINAL_RANGE_CONFIG_VCSEL_PERIOD] = data[i];
+        break;
+      case SOFT_RESET_GO2_SOFT_RESET_N:
+        // The registers return to their defaults.
+        shadow_.valid = false;
+        break;
+      default:
+        break;
+    }
+  }
 }
 
 void VL53L0X::getSequenceStepEnables(SequenceStepEnables * enables)
 {
-  uint8_t sequence_config = readReg(SYSTEM_SEQUENCE_CONFIG);
+  loadShadow();
+  uint8_t sequence_config = shadow_.sequence_config;
 
   enables->tcc          = (sequence_config >> 4) & 0x1;
   enables->dss          = (sequence_config >> 3) & 0x1;
@@ -711,13 +1093,13 @@ void VL53L0X::getSequenceStepTimeouts(
 {
   timeouts->pre_range_vcsel_period_pclks = getVcselPulsePeriod(VcselPeriodPreRange);
 
-  timeouts->msrc_dss_tcc_mclks = readReg(MSRC_CONFIG_TIMEOUT_MACROP) + 1;
+  timeouts->msrc_dss_tcc_mclks = shadow_.msrc_timeout + 1;
   timeouts->msrc_dss_tcc_us =
     timeoutMclksToMicroseconds(timeouts->msrc_dss_tcc_mclks,
                                timeouts->pre_range_vcsel_period_pclks);
 
   timeouts->pre_range_mclks =
-    decodeTimeout(readReg16Bit(PRE_RANGE_CONFIG_TIMEOUT_MACROP_HI));
+    decodeTimeout((shadow_.pre_range[1] << 8) | shadow_.pre_range[2]);
   timeouts->pre_range_us =
     timeoutMclksToMicroseconds(timeouts->pre_range_mclks,
                                timeouts->pre_range_vcsel_period_pclks);
@@ -725,7 +1107,7 @@ void VL53L0X::getSequenceStepTimeouts(
   timeouts->final_range_vcsel_period_pclks = getVcselPulsePeriod(VcselPeriodFinalRange);
 
   timeouts->final_range_mclks =
-    decodeTimeout(readReg16Bit(FINAL_RANGE_CONFIG_TIMEOUT_MACROP_HI));
+    decodeTimeout((shadow_.final_range[1] << 8) | shadow_.final_range[2]);
 
   if (enables->pre_range) {
     timeouts->final_range_mclks -= timeouts->pre_range_mclks;
@@ -761,34 +1143,37 @@ uint16_t VL53L0X::encodeTimeout(uint16_t timeout_mclks)
   return 0;
 }
 
-uint32_t VL53L0X::timeoutMclksToMicroseconds(uint16_t timeout_period_mclks, uint8_t vcsel_period_pclks)
-{
-  uint32_t macro_period_ns = BTR_VL53L0X_CALC_PERIOD(vcsel_period_pclks);
-  return ((timeout_period_mclks * macro_period_ns) + (macro_period_ns / 2)) / 1000;
-}
-
-uint32_t VL53L0X::timeoutMicrosecondsToMclks(uint32_t timeout_period_us, uint8_t vcsel_period_pclks)
-{
-  uint32_t macro_period_ns = BTR_VL53L0X_CALC_PERIOD(vcsel_period_pclks);
-  return (((timeout_period_us * 1000) + (macro_period_ns / 2)) / macro_period_ns);
-}
-
 bool VL53L0X::performSingleRefCalibration(uint8_t vhv_init_byte)
 {
-  // VL53L0X_REG_SYSRANGE_MODE_START_STOP
-  writeReg(SYSRANGE_START, 0x01 | vhv_init_byte);
+  startRefCalibration(vhv_init_byte);
 
   uint32_t tm = MILLIS();
 
-  while ((readReg(RESULT_INTERRUPT_STATUS) & 0x07) == 0) {
+  while (false == refCalibrationDone()) {
     if (IS_TIMEOUT(BTR_VL53L0X_TIMEOUT_MS, tm)) {
       return false; 
     }
   }
 
+  stopRefCalibration();
+  return true;
+}
+
+void VL53L0X::startRefCalibration(uint8_t vhv_init_byte)
+{
+  // VL53L0X_REG_SYSRANGE_MODE_START_STOP
+  writeReg(SYSRANGE_START, 0x01 | vhv_init_byte);
+}
+
+bool VL53L0X::refCalibrationDone()
+{
+  return (readReg(RESULT_INTERRUPT_STATUS) & 0x07) != 0;
+}
+
+void VL53L0X::stopRefCalibration()
+{
   writeReg(SYSTEM_INTERRUPT_CLEAR, 0x01);
   writeReg(SYSRANGE_START, 0x00);
-  return true;
 }
 
 } // namespace btr
@@ -0,0 +1,175 @@
+// Copyright (C) 2019 Sergey Kapustin <kapucin@gmail.com>
+
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+// SYSTEM INCLUDES
+#include <string.h>
+
+// PROJECT INCLUDES
+#include "devices/vl53l0x_array.hpp"  // class implemented
+#include "devices/time.hpp"
+
+#if BTR_VL53L0X_ENABLED > 0
+
+namespace btr
+{
+
+/////////////////////////////////////////////// PUBLIC /////////////////////////////////////////////
+
+//============================================= LIFECYCLE ==========================================
+
+VL53L0XArray::VL53L0XArray()
+  :
+    sensors_(),
+    snapshot_(),
+    next_(),
+    fresh_(0),
+    started_(0),
+    start_ms_(0),
+    period_(0),
+    count_(0)
+{
+}
+
+//============================================= OPERATIONS =========================================
+
+int VL53L0XArray::init(uint8_t count, XshutFunc xshut, void* arg, bool io_2v8)
+{
+  if (0 == count || count > BTR_VL53L0X_ARRAY_SIZE || (nullptr == xshut && count > 1)) {
+    return -1;
+  }
+
+  count_ = 0;
+  started_ = 0;
+  fresh_ = 0;
+  memset(&snapshot_, 0, sizeof(snapshot_));
+  memset(&next_, 0, sizeof(next_));
+
+  // All sensors answer at the default address after reset. Only one may be up at a time until
+  // it has its own address.
+  for (uint8_t i = 0; nullptr != xshut && i < count; i++) {
+    xshut(i, false, arg);
+  }
+
+  for (uint8_t i = 0; i < count; i++) {
+    if (nullptr != xshut) {
+      xshut(i, true, arg);
+    }
+
+    sensors_[i].resetAddress();
+    sensors_[i].setAddress(BTR_VL53L0X_ARRAY_ADDR + i);
+    sensors_[i].startInit(io_2v8);
+  }
+
+  // Initialize the sensors together, one's bus transfers run while the others calibrate.
+  uint8_t pending = count;
+
+  while (pending > 0) {
+    pending = 0;
+
+    for (uint8_t i = 0; i < count; i++) {
+      VL53L0X::InitStatus status = sensors_[i].initStep();
+
+      if (VL53L0X::INIT_ERROR == status) {
+        return -1;
+      }
+      pending += (VL53L0X::INIT_PENDING == status ? 1 : 0);
+    }
+  }
+
+  count_ = count;
+  return 0;
+}
+
+void VL53L0XArray::start(uint32_t period)
+{
+  period_ = period;
+  start_ms_ = MILLIS();
+  started_ = 0;
+  fresh_ = 0;
+  startDue();
+}
+
+void VL53L0XArray::stop()
+{
+  for (uint8_t i = 0; i < count_; i++) {
+    if (started_ & (1UL << i)) {
+      sensors_[i].stopContinuous();
+    }
+  }
+  started_ = 0;
+}
+
+bool VL53L0XArray::poll()
+{
+  if (0 == count_) {
+    return false;
+  }
+
+  uint32_t all = (count_ < 32 ? (1UL << count_) - 1 : UINT32_MAX);
+
+  if (started_ != all) {
+    startDue();
+  }
+
+  for (uint8_t i = 0; i < count_; i++) {
+    uint32_t bit = (1UL << i);
+    uint16_t mm = 0;
+
+    if ((started_ & bit) && sensors_[i].tryReadRange(&mm)) {
+      next_.mm[i] = mm;
+      next_.ms[i] = MILLIS();
+      fresh_ |= bit;
+    }
+  }
+
+  if (fresh_ != all) {
+    return false;
+  }
+
+  next_.cycle = snapshot_.cycle + 1;
+  snapshot_ = next_;
+  fresh_ = 0;
+  return true;
+}
+
+//============================================= ATTRIBUTES =========================================
+
+const VL53L0XArray::Snapshot& VL53L0XArray::snapshot() const
+{
+  return snapshot_;
+}
+
+uint8_t VL53L0XArray::count() const
+{
+  return count_;
+}
+
+VL53L0X* VL53L0XArray::sensor(uint8_t index)
+{
+  return (index < count_ ? &sensors_[index] : nullptr);
+}
+
+/////////////////////////////////////////////// PRIVATE ////////////////////////////////////////////
+
+//============================================= OPERATIONS =========================================
+
+void VL53L0XArray::startDue()
+{
+  uint32_t elapsed = TIME_DIFF(MILLIS(), start_ms_);
+
+  for (uint8_t i = 0; i < count_; i++) {
+    uint32_t bit = (1UL << i);
+
+    if (0 == (started_ & bit) && elapsed >= i * period_ / count_) {
+      sensors_[i].startContinuous(period_);
+      started_ |= bit;
+    }
+  }
+}
+
+} // namespace btr
+
+#endif // BTR_VL53L0X_ENABLED > 0
@@ -22,6 +22,28 @@ namespace btr
 static I2C i2c_0(0);
 #endif
 
+/**
+ * Map an ESP-IDF error to a status code as described in defines.hpp.
+ */
+static uint32_t toStatus(esp_err_t err)
+{
+  switch (err) {
+    case ESP_OK:
+      return BTR_DEV_ENOERR;
+    case ESP_ERR_TIMEOUT:
+      // The bus is busy or the hardware is stuck.
+      return BTR_DEV_ETIMEOUT;
+    case ESP_ERR_NOT_FOUND:
+      return BTR_DEV_ENOACK;
+    case ESP_ERR_INVALID_ARG:
+      return BTR_DEV_EINVAL;
+    case ESP_ERR_NO_MEM:
+      return BTR_DEV_ENOMEM;
+    default:
+      return BTR_DEV_EFAIL;
+  }
+}
+
 /////////////////////////////////////////////// PUBLIC /////////////////////////////////////////////
 
 //============================================= LIFECYCLE ==========================================
@@ -33,7 +55,7 @@ I2C* I2C::instance(uint32_t dev_id, bool open)
 {
   (void) dev_id;
 
-  if (false == open_ && open) {
+  if (open && false == i2c_0.isOpen()) {
     i2c_0.open();
   }
   return &i2c_0;
@@ -45,125 +67,159 @@ void I2C::open()
     close();
   }
 
-  i2c_master_bus_config_t config = {
-    .clk_source = BTR_I2C_CLK_SRC,
-    .i2c_port = BTR_I2C_MASTER_PORT,
-    .scl_io_num = BTR_I2C_MASTER_SCL_IO,
-    .sda_io_num = BTR_I2C_MASTER_SDA_IO,
-    .glitch_ignore_cnt = BTR_I2C_GLITCH_IGNORE_COUNT,
-    .flags.enable_internal_pullup = BTR_I2C_INTERNAL_PULLUP,
-  };
+  // C++ doesn't take the nested and out-of-order designators that C would.
+  i2c_master_bus_config_t config = {};
+  config.i2c_port = BTR_I2C_MASTER_PORT;
+  config.sda_io_num = BTR_I2C_MASTER_SDA_IO;
+  config.scl_io_num = BTR_I2C_MASTER_SCL_IO;
+  config.clk_source = BTR_I2C_CLK_SRC;
+  config.glitch_ignore_cnt = BTR_I2C_GLITCH_IGNORE_COUNT;
+  config.flags.enable_internal_pullup = BTR_I2C_INTERNAL_PULLUP;
 
   esp_err_t err = i2c_new_master_bus(&config, &bus_handle_);
 
   if (ESP_OK == err) {
     open_ = true;
+  } else {
+    bus_handle_ = nullptr;
+    set_status(dev::status(), toStatus(err));
   }
-
-  uint32_t rc = BTR_DEV_ENOERR;
-
-  if (ESP_OK != err) {
-    ESP_ERROR_CHECK(err)
-
-    if (ESP_ERR_NO_MEM == rc) {
-      rc = BTR_DEV_ENOMEM; // Create I2C bus failed because of out of memory.
-    } else if (ESP_ERR_NOT_FOUND == rc) {
-      rc = BTR_DEV_EFAIL; // No more free bus.
-    } else {
-      rc = BTR_DEV_EINVAL; // I2C bus initialization failed because of invalid argument.
-    }
-  }
-  return rc;
 }
 
 void I2C::close()
 {
+  devices_.clear();
+  dev_handle_ = nullptr;
   i2c_del_master_bus(bus_handle_);
   bus_handle_ = nullptr;
   open_ = false;
 }
 
-/////////////////////////////////////////////// PROTECTED //////////////////////////////////////////
+uint32_t I2C::scan()
+{
+  if (false == isOpen()) {
+    return BTR_DEV_ENOTOPEN;
+  }
 
-//============================================= OPERATIONS =========================================
+  uint32_t rc = BTR_DEV_ENOERR;
+  uint32_t count = 0;
 
-/////////////////////////////////////////////// PRIVATE ////////////////////////////////////////////
+  for (uint8_t addr = 0; addr < BTR_I2C_SCAN_MAX; addr++) {
+    // Probing needs no device handle, so the scan doesn't flush devices_.
+    esp_err_t err = i2c_master_probe(bus_handle_, addr, BTR_I2C_IO_TIMEOUT_MS);
 
-//============================================= OPERATIONS =========================================
+    if (ESP_OK == err) {
+      ++count;
+    } else if (ESP_ERR_NOT_FOUND != err) {
+      rc = toStatus(err);
+      break;
+    }
+  }
+  set_status(dev::status(), rc);
+  return (rc | count);
+}
 
-uint32_t I2C::start(uint8_t addr, uint8_t rw)
+uint32_t I2C::write(uint8_t addr, uint8_t reg, const uint8_t* buff, uint8_t bytes)
 {
-  (void) rw;
+  if (false == isOpen()) {
+    return BTR_DEV_ENOTOPEN;
+  }
+
+  uint32_t rc = start(addr, BTR_I2C_WRITE);
+  uint32_t count = 0;
 
-  if (dev_handle_) {
+  if (is_ok(rc)) {
+    // Register and data in one transfer, without copying them together.
+    i2c_master_transmit_multi_buffer_info_t info[] = {
+      { .write_buffer = &reg, .buffer_size = 1 },
+      { .write_buffer = const_cast<uint8_t*>(buff), .buffer_size = bytes },
+    };
+
+    rc = toStatus(i2c_master_multi_buffer_transmit(
+          dev_handle_, info, (bytes > 0 ? 2 : 1), BTR_I2C_IO_TIMEOUT_MS));
+
+    if (is_ok(rc)) {
+      count = 1 + bytes;
+    }
     stop();
   }
+  set_status(dev::status(), rc);
+  return (rc | count);
+}
+
+uint32_t I2C::read(uint8_t addr, uint8_t* buff, uint8_t bytes, bool stop_comm)
+{
+  // Each driver transfer ends with a stop.
+  (void) stop_comm;
+
+  if (false == isOpen()) {
+    return BTR_DEV_ENOTOPEN;
+  }
 
-  uint32_t rc = waitBusy();
+  uint32_t rc = start(addr, BTR_I2C_READ);
 
   if (is_ok(rc)) {
-    i2c_device_config_t dev_cfg = {
-      .dev_addr_length = I2C_ADDR_BIT_LEN_7,
-      .device_address = addr,
-      .scl_speed_hz = BTR_I2C_SPEED,
-    };
+    rc = toStatus(i2c_master_receive(
+          dev_handle_, buff, (bytes > 0 ? bytes : 1), BTR_I2C_IO_TIMEOUT_MS));
+    stop();
+  }
+  set_status(dev::status(), rc);
+  return rc;
+}
 
-    esp_err_t err = i2c_master_bus_add_device(bus_handle_, &dev_cfg, &dev_handle_);
+uint32_t I2C::writeRead(
+    uint8_t addr, const uint8_t* wbuff, uint8_t wcount, uint8_t* rbuff, uint8_t rcount)
+{
+  if (false == isOpen()) {
+    return BTR_DEV_ENOTOPEN;
+  }
 
-    if (ESP_OK != err) {
-      ESP_ERROR_CHECK(err)
+  uint32_t rc = start(addr, BTR_I2C_WRITE);
 
-      if (ESP_ERR_NO_MEM == rc) {
-        rc = BTR_DEV_ENOMEM; 
-      } else {
-        rc = BTR_DEV_EINVAL; 
-      }
-    }
+  if (is_ok(rc)) {
+    // Write, repeated start and read in one driver transaction.
+    rc = toStatus(i2c_master_transmit_receive(
+          dev_handle_, wbuff, wcount, rbuff, rcount, BTR_I2C_IO_TIMEOUT_MS));
+    stop();
   }
+  set_status(dev::status(), rc);
   return rc;
 }
 
+/////////////////////////////////////////////// PROTECTED //////////////////////////////////////////
+
+//============================================= OPERATIONS =========================================
+
+/////////////////////////////////////////////// PRIVATE ////////////////////////////////////////////
+
+//============================================= OPERATIONS =========================================
+
+uint32_t I2C::start(uint8_t addr, uint8_t rw)
+{
+  (void) rw;
+
+  // The handle stays in devices_ after the transfer, stop() only lets go of it.
+  dev_handle_ = devices_.get(addr);
+  return (nullptr == dev_handle_ ? BTR_DEV_EFAIL : BTR_DEV_ENOERR);
+}
+
 uint32_t I2C::stop()
 {
-  i2c_master_bus_rm_device(dev_handle_);
   dev_handle_ = nullptr;
   return BTR_DEV_ENOERR;
 }
 
 uint32_t I2C::sendByte(uint8_t val)
 {
-  esp_err_t err = i2c_master_transmit(dev_handle_, &val, sizeof(uint8_t), BTR_I2C_IO_TIMEOUT_MS);
-  uint32_t rc = BTR_DEV_ENOERR;
-
-  if (ESP_OK != err) {
-    ESP_ERROR_CHECK(err)
-
-    if (ESP_ERR_TIMEOUT == rc) {
-      // Operation timeout(larger than xfer_timeout_ms) because the bus is busy or hardware crash.
-      rc = BTR_DEV_ETIMEOUT;
-    } else {
-      rc = BTR_DEV_EINVAL; // ESP_ERR_INVALID_ARG: I2C master transmit parameter invalid.
-    }
-  }
-  return rc;
+  return toStatus(
+      i2c_master_transmit(dev_handle_, &val, sizeof(uint8_t), BTR_I2C_IO_TIMEOUT_MS));
 }
 
 uint32_t I2C::receiveByte(bool expect_ack, uint8_t* val)
 {
-  esp_err_t err = i2c_master_receive(dev_handle_, val, sizeof(uint8_t), BTR_I2C_IO_TIMEOUT_MS);
-  uint32_t rc = BTR_DEV_ENOERR;
-
-  if (ESP_OK != err) {
-    ESP_ERROR_CHECK(err)
+  (void) expect_ack;
 
-    if (ESP_ERR_TIMEOUT == rc) {
-      // Operation timeout(larger than xfer_timeout_ms) because the bus is busy or hardware crash.
-      rc = BTR_DEV_ETIMEOUT;
-    } else {
-      rc = BTR_DEV_EINVAL; // ESP_ERR_INVALID_ARG: I2C master receive parameter invalid.
-    }
-  }
-  return rc;
+  return toStatus(i2c_master_receive(dev_handle_, val, sizeof(uint8_t), BTR_I2C_IO_TIMEOUT_MS));
 }
 
 uint32_t I2C::waitBusy()
@@ -171,7 +227,7 @@ uint32_t I2C::waitBusy()
   esp_err_t err = i2c_master_bus_wait_all_done(bus_handle_, BTR_I2C_IO_TIMEOUT_MS);
   uint32_t rc = BTR_DEV_ENOERR;
 
-  if (ESP_OK != err)
+  if (ESP_OK != err) {
     if (ESP_ERR_TIMEOUT == err) {
       rc = BTR_DEV_ETIMEOUT;
     } else { 
@@ -181,6 +237,28 @@ uint32_t I2C::waitBusy()
   return rc;
 }
 
+//============================================= Bus ================================================
+
+i2c_master_dev_handle_t I2C::Bus::addDevice(uint8_t addr)
+{
+  i2c_device_config_t dev_cfg = {};
+  dev_cfg.dev_addr_length = I2C_ADDR_BIT_LEN_7;
+  dev_cfg.device_address = addr;
+  dev_cfg.scl_speed_hz = BTR_I2C_SPEED;
+
+  i2c_master_dev_handle_t handle = nullptr;
+
+  if (ESP_OK != i2c_master_bus_add_device(owner->bus_handle_, &dev_cfg, &handle)) {
+    handle = nullptr;
+  }
+  return handle;
+}
+
+void I2C::Bus::removeDevice(i2c_master_dev_handle_t handle)
+{
+  i2c_master_bus_rm_device(handle);
+}
+
 } // namespace btr
 
 #endif // BTR_I2C_ENABLED > 0
@@ -22,6 +22,30 @@
 namespace btr
 {
 
+#if BTR_I2C_IRQ_ENABLED > 0
+/** I2Cn event and error interrupts. */
+static void irqs(uint32_t dev, uint8_t* ev_irq, uint8_t* er_irq)
+{
+  if (I2C1 == dev) {
+    *ev_irq = NVIC_I2C1_EV_IRQ;
+    *er_irq = NVIC_I2C1_ER_IRQ;
+  } else {
+    *ev_irq = NVIC_I2C2_EV_IRQ;
+    *er_irq = NVIC_I2C2_ER_IRQ;
+  }
+}
+
+/**
+ * Wake the task blocked in transfer(), called from the I2C interrupts.
+ */
+static void notifyTask(I2CTransaction* t)
+{
+  BaseType_t woken = pdFALSE;
+  vTaskNotifyGiveFromISR(static_cast<TaskHandle_t>(t->arg), &woken);
+  portYIELD_FROM_ISR(woken);
+}
+#endif
+
 #if BTR_I2C0_ENABLED > 0
 static I2C i2c_0(I2C1);
 #endif
@@ -87,16 +111,85 @@ void I2C::open()
 
 	i2c_set_dutycycle(bus_handle_, I2C_CCR_DUTY_DIV2);
 	//i2c_set_own_7bit_slave_address(bus_handle_, 0x23);
+
+#if BTR_I2C_IRQ_ENABLED > 0
+  uint8_t ev_irq = 0;
+  uint8_t er_irq = 0;
+  irqs(bus_handle_, &ev_irq, &er_irq);
+
+  // TXE/RXNE (ITBUFEN) are switched on and off by the engine.
+  i2c_enable_interrupt(bus_handle_, I2C_CR2_ITEVTEN | I2C_CR2_ITERREN);
+  nvic_set_priority(ev_irq, configMAX_SYSCALL_INTERRUPT_PRIORITY);
+  nvic_set_priority(er_irq, configMAX_SYSCALL_INTERRUPT_PRIORITY);
+  nvic_enable_irq(ev_irq);
+  nvic_enable_irq(er_irq);
+#endif
+
 	i2c_peripheral_enable(bus_handle_);
   open_ = true;
 }
 
 void I2C::close()
 {
+#if BTR_I2C_IRQ_ENABLED > 0
+  uint8_t ev_irq = 0;
+  uint8_t er_irq = 0;
+  irqs(bus_handle_, &ev_irq, &er_irq);
+
+  nvic_disable_irq(ev_irq);
+  nvic_disable_irq(er_irq);
+  i2c_disable_interrupt(bus_handle_, I2C_CR2_ITEVTEN | I2C_CR2_ITERREN | I2C_CR2_ITBUFEN);
+#endif
 	i2c_peripheral_disable(bus_handle_);
   open_ = false;
 }
 
+#if BTR_I2C_IRQ_ENABLED > 0
+uint32_t I2C::submit(I2CTransaction* t)
+{
+  if (false == isOpen()) {
+    return BTR_DEV_ENOTOPEN;
+  }
+  return engine_.submit(t);
+}
+
+uint32_t I2C::transfer(I2CTransaction* t, uint32_t timeout)
+{
+  t->callback = notifyTask;
+  t->arg = xTaskGetCurrentTaskHandle();
+
+  uint32_t rc = submit(t);
+
+  if (false == is_ok(rc)) {
+    return rc;
+  }
+
+  TimeOut_t time_out;
+  TickType_t ticks = pdMS_TO_TICKS(timeout);
+  vTaskSetTimeOutState(&time_out);
+
+  // Other tasks run while the interrupts move the bytes.
+  while (false == t->done) {
+    if (pdTRUE == xTaskCheckForTimeOut(&time_out, &ticks)) {
+      engine_.abort(t);
+      break;
+    }
+    ulTaskNotifyTake(pdTRUE, ticks);
+  }
+  return t->status;
+}
+
+void I2C::onEvent()
+{
+  engine_.onEvent();
+}
+
+void I2C::onError()
+{
+  engine_.onError();
+}
+#endif // BTR_I2C_IRQ_ENABLED > 0
+
 /////////////////////////////////////////////// PROTECTED //////////////////////////////////////////
 
 //============================================= OPERATIONS =========================================
@@ -107,7 +200,8 @@ void I2C::close()
 
 uint32_t I2C::start(uint8_t addr, uint8_t rw)
 {
-  uint32_t rc = waitBusy();
+  // A repeated start while this master holds the bus doesn't wait for it to be free.
+  uint32_t rc = ((I2C_SR2(bus_handle_) & I2C_SR2_MSL) ? BTR_DEV_ENOERR : waitBusy());
 
   if (is_ok(rc)) {
     // Clear acknowledge failure.
@@ -207,6 +301,90 @@ uint32_t I2C::receiveByte(bool expect_ack, uint8_t* val)
   return rc;
 }
 
+#if BTR_I2C_IRQ_ENABLED > 0
+//============================================= Hal ================================================
+
+uint16_t I2C::Hal::sr1()
+{
+  return I2C_SR1(owner->bus_handle_);
+}
+
+uint16_t I2C::Hal::sr2()
+{
+  return I2C_SR2(owner->bus_handle_);
+}
+
+void I2C::Hal::clearSr1(uint16_t bits)
+{
+  // Error flags are cleared by writing 0, writing 1 leaves the others unchanged.
+  I2C_SR1(owner->bus_handle_) = uint16_t(~bits);
+}
+
+uint8_t I2C::Hal::readDr()
+{
+  return i2c_get_data(owner->bus_handle_);
+}
+
+void I2C::Hal::writeDr(uint8_t value)
+{
+  i2c_send_data(owner->bus_handle_, value);
+}
+
+void I2C::Hal::start()
+{
+  i2c_send_start(owner->bus_handle_);
+}
+
+void I2C::Hal::stop()
+{
+  i2c_send_stop(owner->bus_handle_);
+}
+
+void I2C::Hal::setAck(bool on)
+{
+  if (on) {
+    i2c_enable_ack(owner->bus_handle_);
+  } else {
+    i2c_disable_ack(owner->bus_handle_);
+  }
+}
+
+void I2C::Hal::setPos(bool on)
+{
+  if (on) {
+    I2C_CR1(owner->bus_handle_) |= I2C_CR1_POS;
+  } else {
+    I2C_CR1(owner->bus_handle_) &= ~I2C_CR1_POS;
+  }
+}
+
+void I2C::Hal::enableBufferIrq(bool on)
+{
+  if (on) {
+    i2c_enable_interrupt(owner->bus_handle_, I2C_CR2_ITBUFEN);
+  } else {
+    i2c_disable_interrupt(owner->bus_handle_, I2C_CR2_ITBUFEN);
+  }
+}
+
+void I2C::Hal::reset()
+{
+  owner->reset();
+}
+
+void I2C::Hal::lock()
+{
+  taskENTER_CRITICAL();
+}
+
+void I2C::Hal::unlock()
+{
+  taskEXIT_CRITICAL();
+}
+
+//==================================================================================================
+#endif // BTR_I2C_IRQ_ENABLED > 0
+
 uint32_t I2C::waitBusy()
 {
   uint32_t rc = BTR_DEV_ENOERR;
@@ -232,4 +410,36 @@ uint32_t I2C::waitBusy()
 
 } // namespace btr
 
+#if BTR_I2C_IRQ_ENABLED > 0
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// C
+
+extern "C" {
+
+#if BTR_I2C0_ENABLED > 0
+void i2c1_ev_isr()
+{
+  btr::i2c_0.onEvent();
+}
+
+void i2c1_er_isr()
+{
+  btr::i2c_0.onError();
+}
+#endif
+#if BTR_I2C1_ENABLED > 0
+void i2c2_ev_isr()
+{
+  btr::i2c_1.onEvent();
+}
+
+void i2c2_er_isr()
+{
+  btr::i2c_1.onError();
+}
+#endif
+
+} // extern "C"
+#endif // BTR_I2C_IRQ_ENABLED > 0
+
 #endif // BTR_I2C_ENABLED > 0
@@ -5,6 +5,9 @@
  * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
 
 // SYSTEM INCLUDES
+#if BTR_USART_DMA_TX_ENABLED > 0 || BTR_USART_DMA_RX_ENABLED > 0
+#include <libopencm3/stm32/dma.h>
+#endif
 
 // PROJECT INCLUDES
 #include "devices/usart.hpp"  // class implemented
@@ -75,39 +78,246 @@ static btr::Usart usart_2(
   CTS_PORT, RTS_PORT);
 #endif
 
+#if BTR_USART_DMA_TX_ENABLED == 0
 static void txTask(void* arg)
 {
   btr::Usart* u = (btr::Usart*) arg;
-  char ch;
+  uint8_t ch;
 
   for (;;) {
-    if (pdPASS == xQueueReceive(u->tx_q_, &ch, 500)) {
+    if (u->tx_ring_.pop(&ch)) {
       while (false == usart_get_flag(u->pin_, USART_SR_TXE)) {
         taskYIELD();
       }
       usart_send(u->pin_, ch);
       //LED_TOGGLE();
+    } else {
+      // send() notifies after it pushes data, the time-out only guards against a missed one.
+      ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(500));
     }
   }
 }
+#endif
+
+/**
+ * Start the transmitter: the DMA channel if enabled, the TX task otherwise.
+ *
+ * @return 0 on success, -1 on failure
+ */
+static int startTx(btr::Usart* u)
+{
+#if BTR_USART_DMA_TX_ENABLED > 0
+  uint8_t ch = u->dma_hal_.channel;
+
+  rcc_periph_clock_enable(RCC_DMA1);
+  dma_channel_reset(DMA1, ch);
+  dma_set_peripheral_address(DMA1, ch, (uint32_t) &USART_DR(u->pin_));
+  dma_set_read_from_memory(DMA1, ch);
+  dma_enable_memory_increment_mode(DMA1, ch);
+  dma_set_peripheral_size(DMA1, ch, DMA_CCR_PSIZE_8BIT);
+  dma_set_memory_size(DMA1, ch, DMA_CCR_MSIZE_8BIT);
+  dma_set_priority(DMA1, ch, DMA_CCR_PL_HIGH);
+  dma_enable_transfer_complete_interrupt(DMA1, ch);
+  nvic_set_priority(u->dma_hal_.irq, configMAX_SYSCALL_INTERRUPT_PRIORITY);
+  nvic_enable_irq(u->dma_hal_.irq);
+  usart_enable_tx_dma(u->pin_);
+  return 0;
+#else
+  if (pdPASS != xTaskCreate(
+        txTask, nullptr, configMINIMAL_STACK_SIZE, u, BTR_USART_PRIORITY, &u->tx_task_)) {
+    return -1;
+  }
+  return 0;
+#endif
+}
+
+/**
+ * Start the receiver: the DMA channel in circular mode and the IDLE interrupt if enabled, the RXNE
+ * interrupt otherwise.
+ */
+static void startRx(btr::Usart* u)
+{
+#if BTR_USART_DMA_RX_ENABLED > 0
+  uint8_t ch = u->dma_rx_channel_;
+
+  rcc_periph_clock_enable(RCC_DMA1);
+  dma_channel_reset(DMA1, ch);
+  dma_set_peripheral_address(DMA1, ch, (uint32_t) &USART_DR(u->pin_));
+  dma_set_memory_address(DMA1, ch, (uint32_t) u->rx_ring_.buffer());
+  dma_set_number_of_data(DMA1, ch, u->rx_ring_.bufferSize());
+  dma_set_read_from_peripheral(DMA1, ch);
+  dma_enable_memory_increment_mode(DMA1, ch);
+  dma_enable_circular_mode(DMA1, ch);
+  dma_set_peripheral_size(DMA1, ch, DMA_CCR_PSIZE_8BIT);
+  dma_set_memory_size(DMA1, ch, DMA_CCR_MSIZE_8BIT);
+  dma_set_priority(DMA1, ch, DMA_CCR_PL_VERY_HIGH);
+  dma_enable_half_transfer_interrupt(DMA1, ch);
+  dma_enable_transfer_complete_interrupt(DMA1, ch);
+  // The channel restarts at buffer(), so must the ring, or it resumes at the last lap's position.
+  u->rx_ring_.reset();
+
+  // Same priority as the USART interrupt, so the two never preempt each other in publish().
+  nvic_set_priority(u->dma_rx_irq_, configMAX_SYSCALL_INTERRUPT_PRIORITY);
+  nvic_enable_irq(u->dma_rx_irq_);
+  dma_enable_channel(DMA1, ch);
+  usart_enable_rx_dma(u->pin_);
+  USART_CR1(u->pin_) |= USART_CR1_IDLEIE;
+#else
+  usart_enable_rx_interrupt(u->pin_);
+#endif
+}
+
+/**
+ * Wake the reader once the bytes it waits for are in, not on every byte.
+ */
+static void wakeReader(btr::Usart* u)
+{
+  TaskHandle_t task = u->rx_task_;
+
+  if (nullptr != task && (u->rx_ring_.size() >= u->rx_wanted_ || u->rx_ring_.full())) {
+    BaseType_t woken = pdFALSE;
+    vTaskNotifyGiveFromISR(task, &woken);
+    portYIELD_FROM_ISR(woken);
+  }
+}
+
+#if BTR_USART_DMA_RX_ENABLED > 0
+/** USARTn_RX requests are wired to fixed DMA1 channels on STM32F1. */
+static void dmaRxChannel(uint32_t usart, uint8_t* channel, uint8_t* irq)
+{
+  switch (usart) {
+    case USART1:
+      *channel = DMA_CHANNEL5;
+      *irq = NVIC_DMA1_CHANNEL5_IRQ;
+      break;
+    case USART2:
+      *channel = DMA_CHANNEL6;
+      *irq = NVIC_DMA1_CHANNEL6_IRQ;
+      break;
+    case USART3:
+    default:
+      *channel = DMA_CHANNEL3;
+      *irq = NVIC_DMA1_CHANNEL3_IRQ;
+  }
+}
+
+/**
+ * Make the bytes the DMA channel wrote so far available to recv().
+ */
+static void publishRx(btr::Usart* u)
+{
+  if (u->rx_ring_.publish(dma_get_number_of_data(DMA1, u->dma_rx_channel_))) {
+    u->rx_error_ |= (BTR_DEV_EOVERFLOW >> 16);
+  }
+  wakeReader(u);
+}
+
+static void onDmaRx(btr::Usart* u)
+{
+  uint8_t ch = u->dma_rx_channel_;
+
+  if (dma_get_interrupt_flag(DMA1, ch, DMA_HTIF | DMA_TCIF)) {
+    dma_clear_interrupt_flags(DMA1, ch, DMA_HTIF | DMA_TCIF);
+    publishRx(u);
+  }
+}
+
+#if BTR_USART0_ENABLED > 0
+void dma1_channel5_isr()
+{
+  onDmaRx(&usart_0);
+}
+#endif
+#if BTR_USART1_ENABLED > 0
+void dma1_channel6_isr()
+{
+  onDmaRx(&usart_1);
+}
+#endif
+#if BTR_USART2_ENABLED > 0
+void dma1_channel3_isr()
+{
+  onDmaRx(&usart_2);
+}
+#endif
+#endif // BTR_USART_DMA_RX_ENABLED > 0
 
 static void onRecv(btr::Usart* u)
 {
+#if BTR_USART_DMA_RX_ENABLED > 0
+  // The line went idle after a burst. Reading SR then DR clears the flag, DMA has taken the data.
+  if (USART_SR(u->pin_) & USART_SR_IDLE) {
+    (void) USART_DR(u->pin_);
+    publishRx(u);
+  }
+#else
   while (USART_SR(u->pin_) & USART_SR_RXNE) {
-    char ch = USART_DR(u->pin_);
-    uint16_t head_next = (u->rx_head_ + 1) % BTR_USART_RX_BUFF_SIZE;
+    uint8_t ch = USART_DR(u->pin_);
 
     // Save data if buffer has room, discard the data otherwise
-    if (head_next != u->rx_tail_) {
-      u->rx_buff_[u->rx_head_] = ch;
-      u->rx_head_ = head_next;
-    } else {
+    if (false == u->rx_ring_.push(ch)) {
       u->rx_error_ |= (BTR_DEV_EOVERFLOW >> 16);
     }
   }
+
+  wakeReader(u);
+#endif
   //LED_TOGGLE();
 }
 
+#if BTR_USART_DMA_TX_ENABLED > 0
+/** USARTn_TX requests are wired to fixed DMA1 channels on STM32F1. */
+static btr::Usart::DmaHal dmaTxHal(uint32_t usart)
+{
+  switch (usart) {
+    case USART1:
+      return { usart, DMA_CHANNEL4, NVIC_DMA1_CHANNEL4_IRQ };
+    case USART2:
+      return { usart, DMA_CHANNEL7, NVIC_DMA1_CHANNEL7_IRQ };
+    case USART3:
+    default:
+      return { usart, DMA_CHANNEL2, NVIC_DMA1_CHANNEL2_IRQ };
+  }
+}
+
+static void onDmaTxComplete(btr::Usart* u)
+{
+  uint8_t ch = u->dma_hal_.channel;
+
+  if (dma_get_interrupt_flag(DMA1, ch, DMA_TCIF)) {
+    dma_clear_interrupt_flags(DMA1, ch, DMA_TCIF);
+    u->dma_tx_.onComplete();
+
+    TaskHandle_t task = u->tx_waiter_;
+
+    if (nullptr != task) {
+      BaseType_t woken = pdFALSE;
+      vTaskNotifyGiveFromISR(task, &woken);
+      portYIELD_FROM_ISR(woken);
+    }
+  }
+}
+
+#if BTR_USART0_ENABLED > 0
+void dma1_channel4_isr()
+{
+  onDmaTxComplete(&usart_0);
+}
+#endif
+#if BTR_USART1_ENABLED > 0
+void dma1_channel7_isr()
+{
+  onDmaTxComplete(&usart_1);
+}
+#endif
+#if BTR_USART2_ENABLED > 0
+void dma1_channel2_isr()
+{
+  onDmaTxComplete(&usart_2);
+}
+#endif
+#endif // BTR_USART_DMA_TX_ENABLED > 0
+
 #if BTR_USART0_ENABLED > 0
 void usart1_isr()
 {
@@ -156,13 +366,26 @@ Usart::Usart(
     rx_(rx),
     cts_(cts),
     rts_(rts),
-    tx_q_(nullptr),
+    rx_task_(nullptr),
+    rx_wanted_(0),
+    tx_task_(nullptr),
+#if BTR_USART_DMA_TX_ENABLED > 0
+    dma_hal_(dmaTxHal(pin)),
+    dma_tx_(&dma_hal_, &tx_ring_),
+    tx_waiter_(nullptr),
+#endif
+#if BTR_USART_DMA_RX_ENABLED > 0
+    dma_rx_channel_(0),
+    dma_rx_irq_(0),
+#endif
     rx_error_(0),
     enable_flush_(false),
-    rx_head_(0),
-    rx_tail_(0),
-    rx_buff_()
+    rx_ring_(),
+    tx_ring_()
 {
+#if BTR_USART_DMA_RX_ENABLED > 0
+  dmaRxChannel(pin, &dma_rx_channel_, &dma_rx_irq_);
+#endif
 } 
 
 //============================================= OPERATIONS =========================================
@@ -263,17 +486,14 @@ int Usart::open(
       usart_set_stopbits(pin_, USART_STOPBITS_1);
   }
 
-  if (nullptr == (tx_q_ = xQueueCreate(BTR_USART_TX_BUFF_SIZE, sizeof(char)))) {
-    goto cleanup;
-  }
-
-  if (pdPASS != xTaskCreate(
-        txTask, nullptr, configMINIMAL_STACK_SIZE, this, BTR_USART_PRIORITY, nullptr)) {
+  if (0 != startTx(this)) {
     goto cleanup;
   }
 
+  // The ISR calls FreeRTOS, so its priority must not be above the syscall priority.
+  nvic_set_priority(irq_, configMAX_SYSCALL_INTERRUPT_PRIORITY);
   nvic_enable_irq(irq_);
-  usart_enable_rx_interrupt(pin_);
+  startRx(this);
   usart_enable(pin_);
   enable_flush_ = true;
   return 0;
@@ -288,20 +508,24 @@ void Usart::close()
   enable_flush_ = false;
   usart_disable_rx_interrupt(pin_);
   nvic_disable_irq(irq_);
+#if BTR_USART_DMA_RX_ENABLED > 0
+  USART_CR1(pin_) &= ~USART_CR1_IDLEIE;
+  usart_disable_rx_dma(pin_);
+  dma_disable_channel(DMA1, dma_rx_channel_);
+  nvic_disable_irq(dma_rx_irq_);
+#endif
+#if BTR_USART_DMA_TX_ENABLED > 0
+  usart_disable_tx_dma(pin_);
+  nvic_disable_irq(dma_hal_.irq);
+#endif
   usart_disable(pin_);
   rcc_periph_clock_disable(rcc_usart_);
   rcc_periph_clock_disable(rcc_gpio_);
-
-  if (nullptr != tx_q_) {
-    vQueueDelete(tx_q_);
-    tx_q_ = nullptr;
-  }
 }
 
 int Usart::available()
 {
-  uint16_t bytes = BTR_USART_RX_BUFF_SIZE + rx_head_ - rx_tail_;
-  return (bytes % BTR_USART_RX_BUFF_SIZE);
+  return rx_ring_.size();
 }
 
 int Usart::flush(DirectionType dir)
@@ -309,9 +533,9 @@ int Usart::flush(DirectionType dir)
   int rc = 0;
 
   if (dir == DirectionType::OUT || dir == DirectionType::INOUT) {
-    if ((rc = uxQueueMessagesWaiting(tx_q_)) > 0) {
+    if ((rc = tx_ring_.size()) > 0) {
       vTaskDelay(pdMS_TO_TICKS(BTR_USART_TX_DELAY_MS));
-      rc = uxQueueMessagesWaiting(tx_q_);
+      rc = tx_ring_.size();
     }
   }
   return rc;
@@ -319,46 +543,79 @@ int Usart::flush(DirectionType dir)
 
 uint32_t Usart::send(const char* buff, uint16_t bytes, uint32_t timeout)
 {
+#if BTR_USART_DMA_TX_ENABLED > 0
+  TickType_t ticks = (timeout > 0 ? pdMS_TO_TICKS(timeout) : 0);
+
+  if (0 == ticks && timeout > 0) {
+    ticks = 1;
+  }
+
+  tx_waiter_ = xTaskGetCurrentTaskHandle();
+
+  uint32_t rc = dma_tx_.writeWait((const uint8_t*) buff, bytes, [ticks]() {
+        return (ulTaskNotifyTake(pdTRUE, ticks) > 0);
+      });
+
+  tx_waiter_ = nullptr;
+
+  if (rc < bytes) {
+    rc |= BTR_DEV_ETIMEOUT;
+  }
+  return rc;
+#else
   uint32_t rc = 0;
+  uint32_t delay = 0;
 
   while (bytes > 0) {
-    if (pdPASS != xQueueSend(tx_q_, buff, pdMS_TO_TICKS(timeout))) {
+    uint16_t n = tx_ring_.pushN((const uint8_t*) buff, bytes);
+
+    if (n > 0) {
+      buff += n;
+      rc += n;
+      bytes -= n;
+      delay = 0;
+
+      if (nullptr != tx_task_) {
+        xTaskNotifyGive(tx_task_);
+      }
+    } else if (delay >= timeout) {
       rc |= BTR_DEV_ETIMEOUT;
       break;
+    } else {
+      // Wait for the TX task to drain the ring.
+      vTaskDelay(1);
+      delay += portTICK_PERIOD_MS;
     }
-    ++buff;
-    ++rc;
-    --bytes;
   }
   return rc;
+#endif // BTR_USART_DMA_TX_ENABLED > 0
 }
 
 uint32_t Usart::recv(char* buff, uint16_t bytes, uint32_t timeout)
 {
-  uint32_t rc = 0;
-  uint32_t delay = 0;
+  // Time-out 0 waits until all bytes arrive.
+  TickType_t ticks = (timeout > 0 ? pdMS_TO_TICKS(timeout) : portMAX_DELAY);
 
-  while (bytes > 0) {
-    if (rx_head_ != rx_tail_) {
-      *buff++ = rx_buff_[rx_tail_];  
-      rx_tail_ = (rx_tail_ + 1 ) % BTR_USART_RX_BUFF_SIZE;
-      delay = 0;
-      --bytes;
-      ++rc;
-    } else {
-      if (timeout > 0) {
-        if (delay >= timeout) {
-          rc |= BTR_DEV_ETIMEOUT;
-          break;
-        } else {
-          // Wait and test queue one time after the delay.
-          vTaskDelay(pdMS_TO_TICKS(timeout));
-          delay = timeout;
+  if (0 == ticks) {
+    ticks = 1;
+  }
+
+  rx_task_ = xTaskGetCurrentTaskHandle();
+
+  uint32_t rc = rx_ring_.popWait((uint8_t*) buff, bytes, [this, ticks](size_t missing) {
+        rx_wanted_ = (missing < rx_ring_.capacity() ? missing : rx_ring_.capacity());
+
+        // Bytes that came in before rx_wanted_ was set didn't notify.
+        if (rx_ring_.size() >= rx_wanted_) {
+          return true;
         }
-      } else {
-        taskYIELD();
-      }
-    }
+        return (ulTaskNotifyTake(pdTRUE, ticks) > 0);
+      });
+
+  rx_task_ = nullptr;
+
+  if (rc < bytes) {
+    rc |= BTR_DEV_ETIMEOUT;
   }
 
   rc |= (uint32_t(rx_error_) << 16);
@@ -366,6 +623,17 @@ uint32_t Usart::recv(char* buff, uint16_t bytes, uint32_t timeout)
   return rc;
 }
 
+#if BTR_USART_DMA_TX_ENABLED > 0
+void Usart::DmaHal::startDma(const uint8_t* data, uint16_t bytes)
+{
+  // The channel is configured in open(), a transfer only sets the buffer.
+  dma_disable_channel(DMA1, channel);
+  dma_set_memory_address(DMA1, channel, (uint32_t) data);
+  dma_set_number_of_data(DMA1, channel, bytes);
+  dma_enable_channel(DMA1, channel);
+}
+#endif
+
 } // namespace btr
 
 #endif // BTR_USARTn_ENABLED > 0
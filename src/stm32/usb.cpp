@@ -11,20 +11,64 @@
 #include <libopencm3/stm32/gpio.h>
 #include <libopencm3/usb/usbd.h>
 #include <libopencm3/usb/cdc.h>
+#include <libopencm3/stm32/st_usbfs.h>
 #include <libopencm3/cm3/scb.h>
 #include "FreeRTOS.h"
 #include "task.h"
-#include "queue.h"
 
 // PROJECT INCLUDES
 #include "devices/stm32/usb.hpp"  // class implemented
+#include "devices/spsc_ring.hpp"
+#include "devices/usb_cdc_pipe.hpp"
+
+/** Bulk endpoints of the CDC data interface. */
+#define DATA_OUT_EP 0x01
+#define DATA_IN_EP  0x82
+
+/** Bulk endpoints for UsbCdcPipe. */
+struct UsbHal
+{
+  bool writePacket(const uint8_t* data, uint16_t bytes)
+  {
+    // usbd_ep_write_packet() returns 0 for both a busy endpoint and a ZLP, so check first.
+    if ((*USB_EP_REG(DATA_IN_EP & 0x7F) & USB_EP_TX_STAT) == USB_EP_TX_STAT_VALID) {
+      return false;
+    }
+    usbd_ep_write_packet(dev, DATA_IN_EP, data, bytes);
+    return true;
+  }
+
+  uint16_t readPacket(uint8_t* data, uint16_t bytes)
+  {
+    return usbd_ep_read_packet(dev, DATA_OUT_EP, data, bytes);
+  }
+
+  void setOutNak(bool nak)
+  {
+    usbd_ep_nak_set(dev, DATA_OUT_EP, nak ? 1 : 0);
+  }
+
+  usbd_device* dev;
+};
+
+typedef btr::SpscRing<uint8_t, BTR_USB_TX_BUFF_SIZE> TxRing;
+typedef btr::SpscRing<uint8_t, BTR_USB_RX_BUFF_SIZE> RxRing;
 
 extern "C" {
 
 static volatile bool ready_ = false;
 static volatile uint8_t rx_error_;
-static QueueHandle_t tx_q_;
-static QueueHandle_t rx_q_;
+/** Filled by send(), drained by txTask a packet at a time. */
+static TxRing tx_ring_;
+/** Filled by onDataRecv() on txTask a packet at a time, drained by recv(). */
+static RxRing rx_ring_;
+static UsbHal hal_ = { nullptr };
+/** Moves packets between the endpoints and the rings, runs on txTask only. */
+static btr::UsbCdcPipe<UsbHal, TxRing, RxRing> pipe_(&hal_, &tx_ring_, &rx_ring_);
+/** Task blocked in recv(), notified by onDataRecv(). */
+static TaskHandle_t volatile rx_task_ = nullptr;
+/** Bytes the blocked task waits for. */
+static volatile uint16_t rx_wanted_ = 0;
 static uint8_t ctrl_buff_[BTR_USART_CR_BUFF_SIZE];
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -63,18 +107,18 @@ static const struct usb_endpoint_descriptor data_endp[] = {
   {
     .bLength = USB_DT_ENDPOINT_SIZE,
     .bDescriptorType = USB_DT_ENDPOINT,
-    .bEndpointAddress = 0x01,
+    .bEndpointAddress = DATA_OUT_EP,
     .bmAttributes = USB_ENDPOINT_ATTR_BULK,
-    .wMaxPacketSize = 64,
+    .wMaxPacketSize = BTR_USB_PACKET_SIZE,
     .bInterval = 1,
     .extra = NULL,
     .extralen = 0,
   }, {
     .bLength = USB_DT_ENDPOINT_SIZE,
     .bDescriptorType = USB_DT_ENDPOINT,
-    .bEndpointAddress = 0x82,
+    .bEndpointAddress = DATA_IN_EP,
     .bmAttributes = USB_ENDPOINT_ATTR_BULK,
-    .wMaxPacketSize = 64,
+    .wMaxPacketSize = BTR_USB_PACKET_SIZE,
     .bInterval = 1,
     .extra = NULL,
     .extralen = 0,
@@ -207,50 +251,49 @@ static enum usbd_request_return_codes onCtrlRecv(
   return USBD_REQ_NOTSUPP;
 }
 
+/**
+ * Wake up recv() if the receive ring has the bytes it waits for, or no room for more.
+ */
+static void notifyRx()
+{
+  TaskHandle_t task = rx_task_;
+
+  if (nullptr != task && (rx_ring_.size() >= rx_wanted_ || rx_ring_.full())) {
+    xTaskNotifyGive(task);
+  }
+}
+
 static void onDataRecv(usbd_device* usbd_dev, uint8_t ep)
 {
+  (void) usbd_dev;
   (void) ep;
-  uint32_t rx_q_avail = uxQueueSpacesAvailable(rx_q_);
 
-  if (rx_q_avail > 0) {
-    char buff[BTR_USART_RX_BUFF_SIZE];
+  pipe_.onPacketReceived();
+  notifyRx();
+  gpio_toggle(BTR_BUILTIN_LED_PORT, BTR_BUILTIN_LED_PIN);
+}
 
-    int bytes = (BTR_USART_RX_BUFF_SIZE < rx_q_avail ? BTR_USART_RX_BUFF_SIZE : rx_q_avail);
-    bytes = usbd_ep_read_packet(usbd_dev, 0x01, buff, bytes);
+static void onDataSent(usbd_device* usbd_dev, uint8_t ep)
+{
+  (void) usbd_dev;
+  (void) ep;
 
-    for (int i = 0; i < bytes; ++i) {
-      xQueueSend(rx_q_, &buff[i], 0);
-    }
-  }
-  gpio_toggle(BTR_BUILTIN_LED_PORT, BTR_BUILTIN_LED_PIN);
+  pipe_.onPacketSent();
 }
 
 static void txTask(void* arg)
 {
   usbd_device* usb_dev = (usbd_device *) arg;
 
-  char buff[BTR_USART_TX_BUFF_SIZE];
-  uint16_t bytes = 0;
-
   for (;;) {
     usbd_poll(usb_dev);
 
-    if (ready_) {
-      while (bytes < sizeof(buff) && xQueueReceive(tx_q_, &buff[bytes], 0) == pdPASS) {
-        ++bytes;
-      }
-
-      if (bytes > 0) {
-        if (usbd_ep_write_packet(usb_dev, 0x82, buff, bytes) != 0) {
-          gpio_toggle(BTR_BUILTIN_LED_PORT, BTR_BUILTIN_LED_PIN);
-          bytes = 0;
-        }
-      } else {
-        taskYIELD();
-      }
-    } else  {
-      taskYIELD();
+    // Release the OUT endpoint once recv() made room, send what send() queued. The held packet
+    // going into the ring is new data for recv() as well.
+    if (ready_ && pipe_.poll() > 0) {
+      notifyRx();
     }
+    taskYIELD();
   }
 }
 
@@ -258,8 +301,9 @@ static void setConfig(usbd_device* usbd_dev, uint16_t wval)
 {
   (void) wval;
 
-  usbd_ep_setup(usbd_dev, 0x01, USB_ENDPOINT_ATTR_BULK, BTR_USART_RX_BUFF_SIZE, onDataRecv);
-  usbd_ep_setup(usbd_dev, 0x82, USB_ENDPOINT_ATTR_BULK, BTR_USART_TX_BUFF_SIZE, NULL);
+  pipe_.reset();
+  usbd_ep_setup(usbd_dev, DATA_OUT_EP, USB_ENDPOINT_ATTR_BULK, BTR_USB_PACKET_SIZE, onDataRecv);
+  usbd_ep_setup(usbd_dev, DATA_IN_EP, USB_ENDPOINT_ATTR_BULK, BTR_USB_PACKET_SIZE, onDataSent);
   usbd_ep_setup(usbd_dev, 0x83, USB_ENDPOINT_ATTR_INTERRUPT, BTR_USART_IR_BUFF_SIZE, NULL);
 
   usbd_register_control_callback(
@@ -303,9 +347,6 @@ bool Usb::isOpen()
 int Usb::open()
 {
   if (false == isOpen()) {
-    tx_q_ = xQueueCreate(BTR_USART_TX_BUFF_SIZE, sizeof(char));
-    rx_q_ = xQueueCreate(BTR_USART_RX_BUFF_SIZE, sizeof(char));
-
     rcc_periph_clock_enable(RCC_GPIOA);
     rcc_periph_clock_enable(RCC_USB);
 
@@ -315,6 +356,7 @@ int Usb::open()
         ctrl_buff_, sizeof(ctrl_buff_));
 
     usbd_register_set_config_callback(usb_dev, setConfig);
+    hal_.dev = usb_dev;
 
     xTaskCreate(txTask, "USB", configMINIMAL_STACK_SIZE, usb_dev, configMAX_PRIORITIES-1, NULL);
   }
@@ -334,7 +376,7 @@ void Usb::close()
 
 int Usb::available()
 {
-  return uxQueueMessagesWaiting(rx_q_);
+  return rx_ring_.size();
 }
 
 int Usb::flush(DirectionType dir)
@@ -342,9 +384,9 @@ int Usb::flush(DirectionType dir)
   int rc = 0;
 
   if (dir == DirectionType::OUT || dir == DirectionType::INOUT) {
-    if ((rc = uxQueueMessagesWaiting(tx_q_)) > 0) {
+    if ((rc = tx_ring_.size()) > 0) {
       vTaskDelay(pdMS_TO_TICKS(BTR_USART_TX_DELAY_MS));
-      rc = uxQueueMessagesWaiting(tx_q_);
+      rc = tx_ring_.size();
     }
   }
   return rc;
@@ -354,16 +396,24 @@ int Usb::flush(DirectionType dir)
 uint32_t Usb::send(const char* buff, uint16_t bytes, uint32_t timeout)
 {
   uint32_t rc = 0;
+  uint32_t delay = 0;
 
   if (isOpen()) {
     while (bytes > 0) {
-      if (pdPASS != xQueueSend(tx_q_, buff, pdMS_TO_TICKS(timeout))) {
+      uint16_t n = tx_ring_.pushN((const uint8_t*) buff, bytes);
+
+      if (n > 0) {
+        buff += n;
+        rc += n;
+        bytes -= n;
+        delay = 0;
+      } else if (delay >= timeout) {
         rc |= BTR_DEV_ETIMEOUT;
         break;
+      } else {
+        vTaskDelay(1);
+        delay += portTICK_PERIOD_MS;
       }
-      ++buff;
-      ++rc;
-      --bytes;
     }
   } else {
     rc = BTR_DEV_ENOTOPEN;
@@ -377,16 +427,28 @@ uint32_t Usb::recv(char* buff, uint16_t bytes, uint32_t timeout)
   uint32_t rc = 0;
 
   if (isOpen()) {
-    while (bytes > 0) {
-      if (pdPASS == xQueueReceive(rx_q_, buff, pdMS_TO_TICKS(timeout))) {
-        ++buff;
-        --bytes;
-        ++rc;
-      } else {
-        // return can be errQUEUE_EMPTY as per PDF manual (not online)
-        rc |= BTR_DEV_ETIMEOUT;
-        break;
-      }
+    TickType_t ticks = pdMS_TO_TICKS(timeout);
+
+    if (0 == ticks && timeout > 0) {
+      ticks = 1;
+    }
+
+    rx_task_ = xTaskGetCurrentTaskHandle();
+
+    rc = rx_ring_.popWait((uint8_t*) buff, bytes, [ticks](size_t missing) {
+          rx_wanted_ = (missing < rx_ring_.capacity() ? missing : rx_ring_.capacity());
+
+          // Bytes that came in before rx_wanted_ was set didn't notify.
+          if (rx_ring_.size() >= rx_wanted_) {
+            return true;
+          }
+          return (ulTaskNotifyTake(pdTRUE, ticks) > 0);
+        });
+
+    rx_task_ = nullptr;
+
+    if (rc < bytes) {
+      rc |= BTR_DEV_ETIMEOUT;
     }
 
     rc |= (uint32_t(rx_error_) << 16);
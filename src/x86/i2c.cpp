@@ -0,0 +1,111 @@
+// Copyright (C) 2019 Sergey Kapustin <kapucin@gmail.com>
+
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+// SYSTEM INCLUDES
+
+// PROJECT INCLUDES
+#include "devices/i2c.hpp"  // class partially implemented
+
+#if (BTR_I2C0_ENABLED > 0 || BTR_I2C1_ENABLED > 0) && BTR_I2C_LINUX_DEV_ENABLED == 0
+
+namespace btr
+{
+
+#if BTR_I2C0_ENABLED > 0
+static I2C i2c_0(0);
+#endif
+#if BTR_I2C1_ENABLED > 0
+static I2C i2c_1(1);
+#endif
+
+/////////////////////////////////////////////// PUBLIC /////////////////////////////////////////////
+
+//============================================= LIFECYCLE ==========================================
+
+//============================================= OPERATIONS =========================================
+
+// static
+I2C* I2C::instance(uint32_t id, bool open)
+{
+  switch (id) {
+#if BTR_I2C0_ENABLED > 0
+    case 0:
+      if (open) {
+        i2c_0.open();
+      }
+      return &i2c_0;
+#endif
+#if BTR_I2C1_ENABLED > 0
+    case 1:
+      if (open) {
+        i2c_1.open();
+      }
+      return &i2c_1;
+#endif
+    default:
+      set_status(dev::status(), BTR_DEV_EINVAL);
+      return nullptr;
+  }
+}
+
+void I2C::open()
+{
+  open_ = true;
+}
+
+void I2C::close()
+{
+  sim_.stop();
+  open_ = false;
+}
+
+I2CSim* I2C::sim()
+{
+  return &sim_;
+}
+
+/////////////////////////////////////////////// PRIVATE ////////////////////////////////////////////
+
+//============================================= OPERATIONS =========================================
+
+uint32_t I2C::start(uint8_t addr, uint8_t rw)
+{
+  if (false == sim_.start(addr, BTR_I2C_READ == rw)) {
+    stop();
+    return BTR_DEV_ENOACK;
+  }
+  return BTR_DEV_ENOERR;
+}
+
+uint32_t I2C::stop()
+{
+  sim_.stop();
+  return BTR_DEV_ENOERR;
+}
+
+uint32_t I2C::sendByte(uint8_t val)
+{
+  if (false == sim_.write(val)) {
+    stop();
+    return BTR_DEV_ESENDBYTE;
+  }
+  return BTR_DEV_ENOERR;
+}
+
+uint32_t I2C::receiveByte(bool expect_ack, uint8_t* val)
+{
+  *val = sim_.read(expect_ack);
+  return BTR_DEV_ENOERR;
+}
+
+uint32_t I2C::waitBusy()
+{
+  return BTR_DEV_ENOERR;
+}
+
+} // namespace btr
+
+#endif // (BTR_I2C0_ENABLED > 0 || BTR_I2C1_ENABLED > 0) && BTR_I2C_LINUX_DEV_ENABLED == 0
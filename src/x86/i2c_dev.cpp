@@ -0,0 +1,216 @@
+// Copyright (C) 2019 Sergey Kapustin <kapucin@gmail.com>
+
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+// SYSTEM INCLUDES
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/i2c.h>
+#include <linux/i2c-dev.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+
+// PROJECT INCLUDES
+#include "devices/i2c.hpp"  // class partially implemented
+
+#if (BTR_I2C0_ENABLED > 0 || BTR_I2C1_ENABLED > 0) && BTR_I2C_LINUX_DEV_ENABLED > 0
+
+namespace btr
+{
+
+#if BTR_I2C0_ENABLED > 0
+static I2C i2c_0(0);
+#endif
+#if BTR_I2C1_ENABLED > 0
+static I2C i2c_1(1);
+#endif
+
+/**
+ * Run messages as one combined transfer: a start before the first one, repeated starts between
+ * them and a stop after the last one.
+ *
+ * @param fd - i2c-dev file descriptor
+ * @param msgs - the messages
+ * @param count - the number of messages
+ * @return status code as described in defines.hpp
+ */
+static uint32_t rdwr(int fd, i2c_msg* msgs, uint32_t count)
+{
+  i2c_rdwr_ioctl_data data = { msgs, count };
+
+  if (ioctl(fd, I2C_RDWR, &data) >= 0) {
+    return BTR_DEV_ENOERR;
+  }
+
+  switch (errno) {
+    case ENXIO:
+      // No ACK of the address.
+    case EREMOTEIO:
+      // No ACK of a data byte.
+      return BTR_DEV_ENOACK;
+    case ETIMEDOUT:
+      return BTR_DEV_ETIMEOUT;
+    case EINVAL:
+      return BTR_DEV_EINVAL;
+    default:
+      return BTR_DEV_EFAIL;
+  }
+}
+
+/////////////////////////////////////////////// PUBLIC /////////////////////////////////////////////
+
+//============================================= LIFECYCLE ==========================================
+
+//============================================= OPERATIONS =========================================
+
+// static
+I2C* I2C::instance(uint32_t id, bool open)
+{
+  switch (id) {
+#if BTR_I2C0_ENABLED > 0
+    case 0:
+      if (open) {
+        i2c_0.open();
+      }
+      return &i2c_0;
+#endif
+#if BTR_I2C1_ENABLED > 0
+    case 1:
+      if (open) {
+        i2c_1.open();
+      }
+      return &i2c_1;
+#endif
+    default:
+      set_status(dev::status(), BTR_DEV_EINVAL);
+      return nullptr;
+  }
+}
+
+void I2C::open()
+{
+  if (isOpen()) {
+    return;
+  }
+
+  char path[32];
+  snprintf(path, sizeof(path), BTR_I2C_DEV_PATH, bus_handle_);
+  fd_ = ::open(path, O_RDWR | O_CLOEXEC);
+
+  if (fd_ < 0) {
+    set_status(dev::status(), BTR_DEV_EINIT);
+    return;
+  }
+
+  // SMBus-only adapters, e.g. i2c-stub, can't run combined transfers.
+  unsigned long funcs = 0;
+
+  if (ioctl(fd_, I2C_FUNCS, &funcs) < 0 || 0 == (funcs & I2C_FUNC_I2C)) {
+    ::close(fd_);
+    fd_ = -1;
+    set_status(dev::status(), BTR_DEV_EINIT);
+    return;
+  }
+
+  // The adapter's time-out is in units of 10 ms. The bus speed is set by the kernel, e.g. in the
+  // device tree, BTR_I2C_SPEED doesn't apply.
+  ioctl(fd_, I2C_TIMEOUT, static_cast<unsigned long>((BTR_I2C_IO_TIMEOUT_MS + 9) / 10));
+  open_ = true;
+}
+
+void I2C::close()
+{
+  if (fd_ >= 0) {
+    ::close(fd_);
+    fd_ = -1;
+  }
+  open_ = false;
+}
+
+uint32_t I2C::scan()
+{
+  if (false == isOpen()) {
+    return BTR_DEV_ENOTOPEN;
+  }
+
+  uint32_t rc = BTR_DEV_ENOERR;
+  uint32_t count = 0;
+  uint8_t val = 0;
+
+  for (uint8_t addr = 0; addr < BTR_I2C_SCAN_MAX; addr++) {
+    // A one-byte read, zero-length messages aren't supported by all adapters.
+    i2c_msg msg = { addr, I2C_M_RD, 1, &val };
+    rc = rdwr(fd_, &msg, 1);
+
+    if (is_ok(rc)) {
+      ++count;
+    } else if (BTR_DEV_ENOACK == rc) {
+      rc = BTR_DEV_ENOERR;
+    } else {
+      break;
+    }
+  }
+  set_status(dev::status(), rc);
+  return (rc | count);
+}
+
+uint32_t I2C::write(uint8_t addr, uint8_t reg, const uint8_t* buff, uint8_t bytes)
+{
+  if (false == isOpen()) {
+    return BTR_DEV_ENOTOPEN;
+  }
+
+  // Register and data go in one message. A second message would begin with a repeated start.
+  uint8_t data[1 + UINT8_MAX];
+  data[0] = reg;
+  memcpy(&data[1], buff, bytes);
+
+  i2c_msg msg = { addr, 0, uint16_t(1 + bytes), data };
+  uint32_t rc = rdwr(fd_, &msg, 1);
+  uint32_t count = (is_ok(rc) ? 1 + bytes : 0);
+
+  set_status(dev::status(), rc);
+  return (rc | count);
+}
+
+uint32_t I2C::read(uint8_t addr, uint8_t* buff, uint8_t bytes, bool stop_comm)
+{
+  // Each transfer ends with a stop.
+  (void) stop_comm;
+
+  if (false == isOpen()) {
+    return BTR_DEV_ENOTOPEN;
+  }
+
+  i2c_msg msg = { addr, I2C_M_RD, uint16_t(bytes > 0 ? bytes : 1), buff };
+  uint32_t rc = rdwr(fd_, &msg, 1);
+
+  set_status(dev::status(), rc);
+  return rc;
+}
+
+uint32_t I2C::writeRead(
+    uint8_t addr, const uint8_t* wbuff, uint8_t wcount, uint8_t* rbuff, uint8_t rcount)
+{
+  if (false == isOpen()) {
+    return BTR_DEV_ENOTOPEN;
+  }
+
+  // Write, repeated start and read in one system call.
+  i2c_msg msgs[] = {
+    { addr, 0, wcount, const_cast<uint8_t*>(wbuff) },
+    { addr, I2C_M_RD, rcount, rbuff },
+  };
+  uint32_t rc = rdwr(fd_, msgs, 2);
+
+  set_status(dev::status(), rc);
+  return rc;
+}
+
+} // namespace btr
+
+#endif // (BTR_I2C0_ENABLED > 0 || BTR_I2C1_ENABLED > 0) && BTR_I2C_LINUX_DEV_ENABLED > 0
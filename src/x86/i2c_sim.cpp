@@ -0,0 +1,183 @@
+// Copyright (C) 2019 Sergey Kapustin <kapucin@gmail.com>
+
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+// SYSTEM INCLUDES
+#include <string.h>
+
+// PROJECT INCLUDES
+#include "devices/x86/i2c_sim.hpp"  // class implemented
+
+namespace btr
+{
+
+/////////////////////////////////////////////// PUBLIC /////////////////////////////////////////////
+
+//============================================= I2CSimDevice =======================================
+
+I2CSimDevice::I2CSimDevice()
+  :
+    regs_(),
+    ptr_(0),
+    select_(false)
+{
+}
+
+void I2CSimDevice::start(bool read)
+{
+  select_ = (false == read);
+}
+
+bool I2CSimDevice::write(uint8_t value)
+{
+  if (select_) {
+    select_ = false;
+    ptr_ = value;
+    return true;
+  }
+  return onRegWrite(ptr_++, value);
+}
+
+uint8_t I2CSimDevice::read()
+{
+  return onRegRead(ptr_++);
+}
+
+void I2CSimDevice::setReg(uint8_t reg, uint8_t value)
+{
+  regs_[reg] = value;
+}
+
+void I2CSimDevice::setReg16(uint8_t reg, uint16_t value)
+{
+  regs_[reg] = uint8_t(value >> 8);
+  regs_[uint8_t(reg + 1)] = uint8_t(value);
+}
+
+uint8_t I2CSimDevice::reg(uint8_t reg) const
+{
+  return regs_[reg];
+}
+
+uint16_t I2CSimDevice::reg16(uint8_t reg) const
+{
+  return uint16_t((regs_[reg] << 8) | regs_[uint8_t(reg + 1)]);
+}
+
+bool I2CSimDevice::onRegWrite(uint8_t reg, uint8_t value)
+{
+  regs_[reg] = value;
+  return true;
+}
+
+uint8_t I2CSimDevice::onRegRead(uint8_t reg)
+{
+  return regs_[reg];
+}
+
+//============================================= I2CSim =============================================
+
+I2CSim::I2CSim(uint32_t speed)
+  :
+    devices_(),
+    active_(nullptr),
+    held_(false),
+    bit_ns_(1000000000 / speed),
+    start_ns_(0),
+    stop_ns_(0),
+    stats_()
+{
+  // UM10204 minimums: tSU;STA + tHD;STA, tSU;STO + tBUF.
+  if (speed <= 100000) {
+    start_ns_ = 4700 + 4000;
+    stop_ns_ = 4000 + 4700;
+  } else if (speed <= 400000) {
+    start_ns_ = 600 + 600;
+    stop_ns_ = 600 + 1300;
+  } else {
+    start_ns_ = 260 + 260;
+    stop_ns_ = 260 + 500;
+  }
+}
+
+void I2CSim::attach(uint8_t addr, I2CSimDevice* dev)
+{
+  devices_[addr & 0x7F] = dev;
+}
+
+void I2CSim::detach(uint8_t addr)
+{
+  devices_[addr & 0x7F] = nullptr;
+}
+
+bool I2CSim::start(uint8_t addr, bool read)
+{
+  stats_.starts++;
+  stats_.repeated_starts += (held_ ? 1 : 0);
+  stats_.bus_ns += start_ns_;
+  held_ = true;
+
+  // Address byte and ACK bit.
+  stats_.bytes++;
+  stats_.bus_ns += 9 * bit_ns_;
+  active_ = devices_[addr & 0x7F];
+
+  if (nullptr == active_) {
+    stats_.nacks++;
+    return false;
+  }
+
+  active_->start(read);
+  return true;
+}
+
+bool I2CSim::write(uint8_t value)
+{
+  stats_.bytes++;
+  stats_.bus_ns += 9 * bit_ns_;
+
+  if (nullptr == active_ || false == active_->write(value)) {
+    stats_.nacks++;
+    return false;
+  }
+  return true;
+}
+
+uint8_t I2CSim::read(bool ack)
+{
+  stats_.bytes++;
+  stats_.bus_ns += 9 * bit_ns_;
+  stats_.nacks += (ack ? 0 : 1);
+
+  // Nobody drives SDA, the pull-up reads as 1s.
+  return (nullptr == active_ ? 0xFF : active_->read());
+}
+
+void I2CSim::stop()
+{
+  if (held_) {
+    held_ = false;
+    active_ = nullptr;
+    stats_.stops++;
+    stats_.bus_ns += stop_ns_;
+  }
+}
+
+void I2CSim::resetStats()
+{
+  memset(&stats_, 0, sizeof(stats_));
+}
+
+const I2CSim::Stats& I2CSim::stats() const
+{
+  return stats_;
+}
+
+I2CSimDevice* I2CSim::device(uint8_t addr) const
+{
+  return devices_[addr & 0x7F];
+}
+
+} // namespace btr
@@ -0,0 +1,85 @@
+// Copyright (C) 2019 Sergey Kapustin <kapucin@gmail.com>
+
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+// SYSTEM INCLUDES
+#include <chrono>
+
+// PROJECT INCLUDES
+#include "devices/time.hpp"  // class implemented
+
+#if BTR_TIME_ENABLED > 0
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// Local defines {
+
+// } Local defines
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// Static members {
+
+// } Static members
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// ISRs {
+
+extern "C" {
+} // extern "C"
+
+// } ISRs
+
+namespace btr
+{
+
+/** Steady clock reading at the first use. */
+static const std::chrono::steady_clock::time_point START = std::chrono::steady_clock::now();
+
+/**
+ * @return time since START
+ */
+static std::chrono::steady_clock::duration elapsed()
+{
+  return (std::chrono::steady_clock::now() - START);
+}
+
+/////////////////////////////////////////////// PUBLIC /////////////////////////////////////////////
+
+//============================================= LIFECYCLE ==========================================
+
+//============================================= OPERATIONS =========================================
+
+// static
+void Time::init()
+{
+  // Noop
+}
+
+// static
+void Time::shutdown()
+{
+  // Noop
+}
+
+// static
+uint32_t Time::sec()
+{
+  return std::chrono::duration_cast<std::chrono::seconds>(elapsed()).count();
+}
+
+// static
+uint32_t Time::millis()
+{
+  return std::chrono::duration_cast<std::chrono::milliseconds>(elapsed()).count();
+}
+
+// static
+uint32_t Time::diff(uint32_t head_time, uint32_t tail_time)
+{
+  return ((UINT32_MAX + head_time - tail_time) % UINT32_MAX);
+}
+
+} // namespace btr
+
+#endif // BTR_TIME_ENABLED > 0
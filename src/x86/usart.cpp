@@ -7,6 +7,8 @@
 // SYSTEM INCLUDES
 #include <boost/bind/bind.hpp>
 #include <sys/ioctl.h>
+#include <errno.h>
+#include <algorithm>
 
 // PROJECT INCLUDES
 #include "devices/usart.hpp"
@@ -16,32 +18,258 @@
 namespace btr
 {
 
-static void onTimeout(Usart* u, const boost::system::error_code& error)
+static void startOpr(Usart* u, Usart::AsyncOpr* opr, bool tx);
+
+static void onTimeout(
+    const std::weak_ptr<bool>& alive, Usart* u, Usart::AsyncOpr* opr, uint32_t seq,
+    const boost::system::error_code& error)
 {
-  // When the timer is cancelled, the error generated is bio::operation_aborted.
+  if (alive.expired()) {
+    return;
+  }
+
+  __atomic_sub_fetch(&opr->pending, 1, __ATOMIC_RELEASE);
+
+  // When the timer is cancelled, the error generated is bio::operation_aborted. An expiration can
+  // also be queued after the operation completed, so skip stale ones.
   //
-  if (!error) {
+  if (!error && seq == opr->seq && opr->handler) {
     // When the timer fires, there is no error, therefore just cancel pending operation.
-    u->serial_port_.cancel();
+    opr->expired = true;
+    // The port may have been closed since the expiration was queued.
+    boost::system::error_code ec;
+    u->serial_port_.cancel(ec);
   }
 }
 
-static void timeAsyncOpr(Usart* u, uint32_t timeout)
+/**
+ * Drop the bytes already transferred from the front of the operation's buffer sequence.
+ */
+static void consumeBuffs(Usart::AsyncOpr* opr, size_t bytes)
 {
-  u->timer_.expires_from_now(boost::posix_time::milliseconds(timeout));
-  u->timer_.async_wait(boost::bind(&onTimeout, u, bio::placeholders::error));
-  u->io_service_.run();
+  auto it = opr->buffs.begin();
+
+  for (; it != opr->buffs.end() && bytes > 0; ++it) {
+    size_t n = std::min(bytes, it->size());
+    *it += n;
+    bytes -= n;
+
+    if (it->size() > 0) {
+      break;
+    }
+  }
+  opr->buffs.erase(opr->buffs.begin(), it);
 }
 
-static void onOprComplete(Usart* u, const boost::system::error_code& err, size_t bytes_transferred)
+static void onOprComplete(
+    const std::weak_ptr<bool>& alive, Usart* u, Usart::AsyncOpr* opr, bool tx,
+    const boost::system::error_code& err, size_t bytes_transferred)
 {
-  u->bytes_transferred_ = bytes_transferred;
+  if (alive.expired()) {
+    return;
+  }
 
-  if (err) {
-    // When timer cancels operation, the error is 89, Operation canceled.
-    errno = err.value();
+  __atomic_sub_fetch(&opr->pending, 1, __ATOMIC_RELEASE);
+  opr->transferred += bytes_transferred;
+
+  // Cancelling a serial port aborts operations in both directions. Resume this one if it was
+  // aborted on behalf of the time-out in the other direction.
+  if (err == bio::error::operation_aborted
+      && false == opr->expired
+      && opr->transferred < opr->bytes
+      && u->serial_port_.is_open())
+  {
+    consumeBuffs(opr, bytes_transferred);
+    startOpr(u, opr, tx);
+    return;
+  }
+
+  // A streaming operation transfers a chunk at a time and restarts the idle timer on progress.
+  if (!err
+      && opr->idle_timeout > 0
+      && opr->transferred < opr->bytes
+      && u->serial_port_.is_open())
+  {
+    consumeBuffs(opr, bytes_transferred);
+    opr->timer.expires_from_now(boost::posix_time::milliseconds(opr->idle_timeout));
+    __atomic_add_fetch(&opr->pending, 1, __ATOMIC_RELEASE);
+    opr->timer.async_wait(boost::bind(
+        &onTimeout, std::weak_ptr<bool>(u->alive_), u, opr, opr->seq, bio::placeholders::error));
+    startOpr(u, opr, tx);
+    return;
+  }
+
+  opr->timer.cancel();
+
+  int error = 0;
+
+  if (opr->expired && opr->transferred < opr->bytes) {
+    error = ETIMEDOUT;
+  } else if (err) {
+    error = err.value();
+  }
+
+  Usart::Handler handler;
+  handler.swap(opr->handler);
+  handler(error, opr->transferred);
+}
+
+static void startOpr(Usart* u, Usart::AsyncOpr* opr, bool tx)
+{
+  auto on_complete = boost::bind(
+      &onOprComplete, std::weak_ptr<bool>(u->alive_), u, opr, tx, bio::placeholders::error,
+      bio::placeholders::bytes_transferred);
+
+  __atomic_add_fetch(&opr->pending, 1, __ATOMIC_RELEASE);
+
+  if (opr->idle_timeout > 0) {
+    if (tx) {
+      u->serial_port_.async_write_some(opr->buffs, on_complete);
+    } else {
+      u->serial_port_.async_read_some(opr->buffs, on_complete);
+    }
+  } else if (tx) {
+    bio::async_write(u->serial_port_, opr->buffs, on_complete);
+  } else {
+    bio::async_read(u->serial_port_, opr->buffs, on_complete);
+  }
+}
+
+/**
+ * Start an operation and its time-out timer. Must run on the event loop thread.
+ *
+ * @param iov - buffers to transfer, the array is copied so it only needs to be valid on entry
+ * @param idle - if true, timeout limits the time without progress rather than the whole operation
+ */
+static void beginOpr(
+    Usart* u, Usart::AsyncOpr* opr, bool tx, const struct iovec* iov, int iovcnt,
+    Usart::Handler handler, uint32_t timeout, bool idle = false)
+{
+  if (opr->handler) {
+    handler(EBUSY, 0);
+    return;
+  }
+
+  // Don't start a timer that would keep close() waiting.
+  if (false == u->serial_port_.is_open()) {
+    handler(EBADF, 0);
+    return;
+  }
+
+  opr->handler.swap(handler);
+  // The vector keeps its capacity between operations, so framing doesn't allocate once warmed up.
+  opr->buffs.clear();
+  opr->bytes = 0;
+
+  for (int i = 0; i < iovcnt; i++) {
+    opr->buffs.emplace_back(iov[i].iov_base, iov[i].iov_len);
+    opr->bytes += iov[i].iov_len;
+  }
+
+  opr->transferred = 0;
+  opr->idle_timeout = (idle ? timeout : 0);
+  opr->expired = false;
+  ++opr->seq;
+
+  startOpr(u, opr, tx);
+
+  opr->timer.expires_from_now(boost::posix_time::milliseconds(timeout));
+  __atomic_add_fetch(&opr->pending, 1, __ATOMIC_RELEASE);
+  opr->timer.async_wait(boost::bind(
+      &onTimeout, std::weak_ptr<bool>(u->alive_), u, opr, opr->seq, bio::placeholders::error));
+}
+
+/**
+ * Notify close() once the handlers of cancelled operations have run. They are queued when the
+ * operations are cancelled, so this is requeued behind them until none is left.
+ */
+static void drainOprs(Usart* u, bool* done)
+{
+  if (u->tx_opr_.pending > 0 || u->rx_opr_.pending > 0) {
+    bio::post(*u->service_, [u, done]() { drainOprs(u, done); });
+    return;
+  }
+
+  std::lock_guard<std::mutex> lock(u->opr_mutex_);
+  *done = true;
+  u->opr_cv_.notify_all();
+}
+
+/**
+ * Block until an operation completes. With a private event loop, run the loop in the calling
+ * thread until this operation's handler has run, not until the loop is out of work. With a shared
+ * loop, queue the operation onto the loop thread and wait for its handler.
+ */
+static size_t runOpr(
+    Usart* u, bool tx, const struct iovec* iov, int iovcnt, uint32_t timeout, bool idle = false)
+{
+  Usart::AsyncOpr* opr = (tx ? &u->tx_opr_ : &u->rx_opr_);
+  int error = 0;
+  size_t transferred = 0;
+  bool done = false;
+
+  Usart::Handler handler = [u, &error, &transferred, &done](int e, size_t bytes) {
+    std::lock_guard<std::mutex> lock(u->opr_mutex_);
+    error = e;
+    transferred = bytes;
+    done = true;
+    u->opr_cv_.notify_all();
+  };
+
+  errno = 0;
+
+  if (u->service_ == &u->io_service_) {
+    u->io_service_.reset();
+    beginOpr(u, opr, tx, iov, iovcnt, handler, timeout, idle);
+
+    while (false == done && u->io_service_.run_one() > 0) {
+    }
+  } else if (u->service_->get_executor().running_in_this_thread()) {
+    // Waiting on the loop thread would never let the operation complete.
+    error = EDEADLK;
+  } else {
+    std::unique_lock<std::mutex> lock(u->opr_mutex_);
+    bio::post(*u->service_, [=]() {
+      beginOpr(u, opr, tx, iov, iovcnt, handler, timeout, idle);
+    });
+    u->opr_cv_.wait(lock, [&done]() { return done; });
+  }
+
+  // The event loop may leave errno set by a non-blocking attempt, report this operation's result.
+  errno = error;
+  return transferred;
+}
+
+/**
+ * Complete an asynchronous operation with EOPNOTSUPP if the port has a private event loop. The
+ * loop runs only inside blocking calls, so nothing would run the operation in between.
+ *
+ * @return true if the operation was rejected
+ */
+static bool rejectAsync(Usart* u, const Usart::Handler& handler)
+{
+  if (u->service_ == &u->io_service_) {
+    handler(EOPNOTSUPP, 0);
+    return true;
+  }
+  return false;
+}
+
+static Usart::IoErrorType toIoError(int error)
+{
+  switch (error) {
+    case 0:
+      return Usart::IO_OK;
+    case ETIMEDOUT:
+      return Usart::IO_TIMEOUT;
+    case EBADF:
+      return Usart::IO_NOT_OPEN;
+    case EBUSY:
+    case EDEADLK:
+      return Usart::IO_BUSY;
+    default:
+      return Usart::IO_FAILED;
   }
-  u->timer_.cancel();
 }
 
 /////////////////////////////////////////////// PUBLIC /////////////////////////////////////////////
@@ -49,18 +277,50 @@ static void onOprComplete(Usart* u, const boost::system::error_code& err, size_t
 //============================================= LIFECYCLE ==========================================
 
 #if BTR_X86 > 0
+Usart::AsyncOpr::AsyncOpr(bio::io_service& io_service)
+  :
+  timer(io_service),
+  handler(),
+  buffs(),
+  bytes(0),
+  transferred(0),
+  idle_timeout(0),
+  seq(0),
+  pending(0),
+  expired(false)
+{
+}
+
 Usart::Usart()
   :
   io_service_(),
+  service_(&io_service_),
   serial_port_(io_service_),
-  timer_(io_service_),
-  bytes_transferred_(0)
+  tx_opr_(io_service_),
+  rx_opr_(io_service_),
+  opr_mutex_(),
+  opr_cv_(),
+  alive_(std::make_shared<bool>(true))
+{
+}
+
+Usart::Usart(bio::io_service& io_service)
+  :
+  io_service_(),
+  service_(&io_service),
+  serial_port_(io_service),
+  tx_opr_(io_service),
+  rx_opr_(io_service),
+  opr_mutex_(),
+  opr_cv_(),
+  alive_(std::make_shared<bool>(true))
 {
 }
 
 Usart::~Usart()
 {
   close();
+  alive_.reset();
 }
 #endif // BTR_X86
 
@@ -161,10 +421,40 @@ int Usart::open(
 
 void Usart::close()
 {
-  if (serial_port_.is_open()) {
-    timer_.cancel();
-    serial_port_.cancel();
-    serial_port_.close();
+  auto shutdown = [this]() {
+    if (serial_port_.is_open()) {
+      tx_opr_.timer.cancel();
+      rx_opr_.timer.cancel();
+      serial_port_.cancel();
+      serial_port_.close();
+    }
+  };
+
+  bool loop_thread = service_->get_executor().running_in_this_thread();
+
+  if (service_ == &io_service_ && false == loop_thread) {
+    shutdown();
+    // Run the cancelled operations' handlers now rather than in the next operation's loop.
+    io_service_.reset();
+    io_service_.poll();
+  } else if (loop_thread || service_->stopped()) {
+    // Cancelled operations complete after this returns. If the instance is destroyed meanwhile,
+    // alive_ tells their handlers.
+    shutdown();
+  } else if (serial_port_.is_open()
+      || __atomic_load_n(&tx_opr_.pending, __ATOMIC_ACQUIRE) > 0
+      || __atomic_load_n(&rx_opr_.pending, __ATOMIC_ACQUIRE) > 0)
+  {
+    // The port belongs to the loop thread, close it there and wait until the handlers of the
+    // cancelled operations have run, so that none refers to this instance afterwards.
+    std::unique_lock<std::mutex> lock(opr_mutex_);
+    bool done = false;
+
+    bio::post(*service_, [this, shutdown, &done]() {
+      shutdown();
+      drainOprs(this, &done);
+    });
+    opr_cv_.wait(lock, [&done]() { return done; });
   }
 }
 
@@ -199,34 +489,86 @@ int Usart::flush(DirectionType dir)
 
 uint32_t Usart::send(const char* buff, uint16_t bytes, uint32_t timeout)
 {
-  io_service_.reset();
-  errno = 0;
-  bytes_transferred_ = 0;
-
-  bio::async_write(
-      serial_port_,
-      bio::buffer(buff, bytes),
-      boost::bind(
-        &onOprComplete, this, bio::placeholders::error, bio::placeholders::bytes_transferred));
+  struct iovec iov = { const_cast<char*>(buff), bytes };
+  return runOpr(this, true, &iov, 1, timeout);
+}
 
-  timeAsyncOpr(this, timeout);
-  return bytes_transferred_;
+uint32_t Usart::sendv(const struct iovec* iov, int iovcnt, uint32_t timeout)
+{
+  return runOpr(this, true, iov, iovcnt, timeout);
 }
 
 uint32_t Usart::recv(char* buff, uint16_t bytes, uint32_t timeout)
 {
-  io_service_.reset();
-  errno = 0;
-  bytes_transferred_ = 0;
+  struct iovec iov = { buff, bytes };
+  return runOpr(this, false, &iov, 1, timeout);
+}
 
-  bio::async_read(
-      serial_port_,
-      bio::buffer(buff, bytes),
-      boost::bind(
-        &onOprComplete, this, bio::placeholders::error, bio::placeholders::bytes_transferred));
+Usart::IoResult Usart::sendBulk(const char* buff, size_t bytes, uint32_t idle_timeout)
+{
+  struct iovec iov = { const_cast<char*>(buff), bytes };
+  IoResult result;
+  result.bytes = runOpr(this, true, &iov, 1, idle_timeout, true);
+  result.error = toIoError(errno);
+  return result;
+}
+
+Usart::IoResult Usart::recvBulk(char* buff, size_t bytes, uint32_t idle_timeout)
+{
+  struct iovec iov = { buff, bytes };
+  IoResult result;
+  result.bytes = runOpr(this, false, &iov, 1, idle_timeout, true);
+  result.error = toIoError(errno);
+  return result;
+}
+
+void Usart::asyncSend(const char* buff, uint16_t bytes, Handler handler, uint32_t timeout)
+{
+  if (rejectAsync(this, handler)) {
+    return;
+  }
+
+  struct iovec iov = { const_cast<char*>(buff), bytes };
+
+  std::weak_ptr<bool> alive(alive_);
+
+  bio::post(*service_, [this, alive, iov, handler, timeout]() {
+    if (false == alive.expired()) {
+      beginOpr(this, &tx_opr_, true, &iov, 1, handler, timeout);
+    }
+  });
+}
 
-  timeAsyncOpr(this, timeout);
-  return bytes_transferred_;
+void Usart::asyncSendv(const struct iovec* iov, int iovcnt, Handler handler, uint32_t timeout)
+{
+  if (rejectAsync(this, handler)) {
+    return;
+  }
+
+  std::weak_ptr<bool> alive(alive_);
+
+  bio::post(*service_, [this, alive, iov, iovcnt, handler, timeout]() {
+    if (false == alive.expired()) {
+      beginOpr(this, &tx_opr_, true, iov, iovcnt, handler, timeout);
+    }
+  });
+}
+
+void Usart::asyncRecv(char* buff, uint16_t bytes, Handler handler, uint32_t timeout)
+{
+  if (rejectAsync(this, handler)) {
+    return;
+  }
+
+  struct iovec iov = { buff, bytes };
+
+  std::weak_ptr<bool> alive(alive_);
+
+  bio::post(*service_, [this, alive, iov, handler, timeout]() {
+    if (false == alive.expired()) {
+      beginOpr(this, &rx_opr_, false, &iov, 1, handler, timeout);
+    }
+  });
 }
 
 /////////////////////////////////////////////// PROTECTED //////////////////////////////////////////
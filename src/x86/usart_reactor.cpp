@@ -0,0 +1,287 @@
+// Copyright (C) 2019 Sergey Kapustin <kapucin@gmail.com>
+
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+// SYSTEM INCLUDES
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+#include <errno.h>
+#include <algorithm>
+
+// PROJECT INCLUDES
+#include "devices/x86/usart_reactor.hpp"  // class implemented
+
+#ifndef BTR_USART_REACTOR_MAX_EVENTS
+#define BTR_USART_REACTOR_MAX_EVENTS 64
+#endif
+
+namespace btr
+{
+
+static uint32_t toEpollEvents(uint32_t events)
+{
+  uint32_t ev = 0;
+
+  if (events & UsartReactor::READABLE) {
+    ev |= EPOLLIN;
+  }
+  if (events & UsartReactor::WRITABLE) {
+    ev |= EPOLLOUT;
+  }
+  return ev;
+}
+
+/////////////////////////////////////////////// PUBLIC /////////////////////////////////////////////
+
+//============================================= LIFECYCLE ==========================================
+
+UsartReactor::UsartReactor()
+  :
+  epoll_fd_(-1),
+  dispatching_(false),
+  closing_(false),
+  entries_()
+{
+}
+
+UsartReactor::~UsartReactor()
+{
+  close();
+}
+
+//============================================= OPERATIONS =========================================
+
+int UsartReactor::open()
+{
+  if (epoll_fd_ < 0) {
+    epoll_fd_ = epoll_create1(EPOLL_CLOEXEC);
+  }
+  closing_ = false;
+  return (epoll_fd_ < 0 ? -1 : 0);
+}
+
+void UsartReactor::close()
+{
+  while (size() > 0) {
+    for (auto& e : entries_) {
+      if (false == e->removed) {
+        remove(e->port);
+        break;
+      }
+    }
+  }
+
+  // Entries can still be referenced by events pending dispatch, poll() finishes closing.
+  if (dispatching_) {
+    closing_ = true;
+    return;
+  }
+
+  entries_.clear();
+  closing_ = false;
+
+  if (epoll_fd_ >= 0) {
+    ::close(epoll_fd_);
+    epoll_fd_ = -1;
+  }
+}
+
+int UsartReactor::add(UsartTermios* port, uint32_t events, Handler handler)
+{
+  if (epoll_fd_ < 0 || closing_ || nullptr == port || false == port->isOpen() || find(port)) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  std::unique_ptr<Entry> e(new Entry());
+  e->port = port;
+  e->handler = handler;
+  e->removed = false;
+  e->port_source = { e.get(), false };
+  e->timer_source = { e.get(), true };
+  e->timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+
+  if (e->timer_fd < 0) {
+    return -1;
+  }
+
+  struct epoll_event pev = {};
+  pev.events = toEpollEvents(events);
+  pev.data.ptr = &e->port_source;
+
+  struct epoll_event tev = {};
+  tev.events = EPOLLIN;
+  tev.data.ptr = &e->timer_source;
+
+  if (port->setNonBlocking(true) != 0) {
+    ::close(e->timer_fd);
+    return -1;
+  }
+
+  if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, port->handle(), &pev) != 0) {
+    int error = errno;
+    port->setNonBlocking(false);
+    ::close(e->timer_fd);
+    errno = error;
+    return -1;
+  }
+
+  if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, e->timer_fd, &tev) != 0) {
+    int error = errno;
+    epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, port->handle(), nullptr);
+    port->setNonBlocking(false);
+    ::close(e->timer_fd);
+    errno = error;
+    return -1;
+  }
+
+  entries_.push_back(std::move(e));
+  return 0;
+}
+
+int UsartReactor::modify(UsartTermios* port, uint32_t events)
+{
+  Entry* e = find(port);
+
+  if (nullptr == e) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  struct epoll_event pev = {};
+  pev.events = toEpollEvents(events);
+  pev.data.ptr = &e->port_source;
+  return epoll_ctl(epoll_fd_, EPOLL_CTL_MOD, port->handle(), &pev);
+}
+
+int UsartReactor::remove(UsartTermios* port)
+{
+  Entry* e = find(port);
+
+  if (nullptr == e) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, port->handle(), nullptr);
+  epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, e->timer_fd, nullptr);
+  ::close(e->timer_fd);
+  e->timer_fd = -1;
+  e->removed = true;
+
+  if (port->isOpen()) {
+    port->setNonBlocking(false);
+  }
+
+  // Entries can still be referenced by events pending dispatch, release them afterwards.
+  if (false == dispatching_) {
+    purge();
+  }
+  return 0;
+}
+
+int UsartReactor::setDeadline(UsartTermios* port, uint32_t timeout_us)
+{
+  Entry* e = find(port);
+
+  if (nullptr == e) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  struct itimerspec spec = {};
+  spec.it_value.tv_sec = timeout_us / 1000000;
+  spec.it_value.tv_nsec = (timeout_us % 1000000) * 1000;
+  return timerfd_settime(e->timer_fd, 0, &spec, nullptr);
+}
+
+int UsartReactor::poll(int timeout_ms)
+{
+  struct epoll_event events[BTR_USART_REACTOR_MAX_EVENTS];
+  int count = epoll_wait(epoll_fd_, events, BTR_USART_REACTOR_MAX_EVENTS, timeout_ms);
+
+  if (count < 0) {
+    return (EINTR == errno ? 0 : -1);
+  }
+
+  dispatching_ = true;
+
+  for (int i = 0; i < count; i++) {
+    Source* src = static_cast<Source*>(events[i].data.ptr);
+    Entry* e = src->entry;
+
+    if (e->removed) {
+      continue;
+    }
+
+    uint32_t ev = 0;
+
+    if (src->is_timer) {
+      uint64_t expirations;
+
+      if (read(e->timer_fd, &expirations, sizeof(expirations)) > 0) {
+        ev = DEADLINE;
+      }
+    } else {
+      if (events[i].events & EPOLLIN) {
+        ev |= READABLE;
+      }
+      if (events[i].events & EPOLLOUT) {
+        ev |= WRITABLE;
+      }
+      if (events[i].events & (EPOLLERR | EPOLLHUP)) {
+        ev |= ERROR;
+      }
+    }
+
+    if (ev != 0) {
+      e->handler(e->port, ev);
+    }
+  }
+
+  dispatching_ = false;
+
+  if (closing_) {
+    close();
+  } else {
+    purge();
+  }
+  return count;
+}
+
+size_t UsartReactor::size() const
+{
+  return std::count_if(entries_.begin(), entries_.end(),
+      [](const std::unique_ptr<Entry>& e) { return false == e->removed; });
+}
+
+/////////////////////////////////////////////// PROTECTED //////////////////////////////////////////
+
+//============================================= OPERATIONS =========================================
+
+/////////////////////////////////////////////// PRIVATE ////////////////////////////////////////////
+
+//============================================= OPERATIONS =========================================
+
+UsartReactor::Entry* UsartReactor::find(UsartTermios* port)
+{
+  for (auto& e : entries_) {
+    if (e->port == port && false == e->removed) {
+      return e.get();
+    }
+  }
+  return nullptr;
+}
+
+void UsartReactor::purge()
+{
+  entries_.erase(
+      std::remove_if(entries_.begin(), entries_.end(),
+        [](const std::unique_ptr<Entry>& e) { return e->removed; }),
+      entries_.end());
+}
+
+} // namespace btr
@@ -0,0 +1,55 @@
+// Copyright (C) 2019 Sergey Kapustin <kapucin@gmail.com>
+
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+// SYSTEM INCLUDES
+
+// PROJECT INCLUDES
+#include "devices/x86/usart_service.hpp"  // class implemented
+
+namespace btr
+{
+
+/////////////////////////////////////////////// PUBLIC /////////////////////////////////////////////
+
+//============================================= LIFECYCLE ==========================================
+
+UsartService::UsartService()
+  :
+  io_service_(),
+  work_(io_service_),
+  thread_([this] { io_service_.run(); })
+{
+}
+
+UsartService::~UsartService()
+{
+  io_service_.stop();
+
+  if (thread_.joinable()) {
+    thread_.join();
+  }
+}
+
+//============================================= OPERATIONS =========================================
+
+// static
+UsartService* UsartService::instance()
+{
+  static UsartService service;
+  return &service;
+}
+
+bio::io_service& UsartService::ioService()
+{
+  return io_service_;
+}
+
+bool UsartService::isLoopThread() const
+{
+  return (std::this_thread::get_id() == thread_.get_id());
+}
+
+} // namespace btr
@@ -11,6 +11,8 @@
 #include <sys/ioctl.h>
 #include <errno.h>
 #include <string.h>
+#include <poll.h>
+#include <time.h>
 
 // PROJECT INCLUDES
 #include "devices/x86/usart_termios.hpp"
@@ -60,6 +62,14 @@ bool UsartTermios::isOpen()
 
 int UsartTermios::open()
 {
+  int baud_rate = getNativeBaud(baud_rate_);
+
+  // A rate without a Bxxx constant can only be set through termios2.
+  if (0 == baud_rate_ || (baud_rate < 0 && false == BTR_USART_ARBITRARY_BAUD)) {
+    errno = EINVAL;
+    return -1;
+  }
+
   port_ = ::open(port_name_, O_RDWR | O_NOCTTY);
 
   if (port_ < 0) {
@@ -105,11 +115,14 @@ int UsartTermios::open()
       return -1;
   }
 
-  int baud_rate = getNativeBaud(baud_rate_);
+  if (baud_rate >= 0
+      && (cfsetospeed(&options, baud_rate) != 0 || cfsetispeed(&options, baud_rate) != 0))
+  {
+    return -1;
+  }
 
-  if (cfsetospeed(&options, baud_rate) != 0
-      || cfsetispeed(&options, baud_rate) != 0
-      || tcsetattr(port_, TCSANOW, &options) != 0
+  if (tcsetattr(port_, TCSANOW, &options) != 0
+      || (baud_rate < 0 && setArbitraryBaud(port_, baud_rate_) != 0)
       || flush(INOUT) != 0)
   {
     return -1;
@@ -149,6 +162,23 @@ int UsartTermios::setTimeout(uint32_t timeout)
   return rc;
 }
 
+int UsartTermios::setNonBlocking(bool enable)
+{
+  int flags = fcntl(port_, F_GETFL);
+
+  if (flags < 0) {
+    return -1;
+  }
+
+  flags = (enable ? (flags | O_NONBLOCK) : (flags & ~O_NONBLOCK));
+  return fcntl(port_, F_SETFL, flags);
+}
+
+int UsartTermios::handle() const
+{
+  return port_;
+}
+
 int UsartTermios::available()
 {
   int bytes_available;
@@ -198,6 +228,16 @@ int UsartTermios::send(const char* buff, uint32_t bytes, bool drain)
   return rc;
 }
 
+int UsartTermios::sendv(const struct iovec* iov, int iovcnt, bool drain)
+{
+  int rc = writev(port_, iov, iovcnt);
+
+  if (drain) {
+    tcdrain(port_);
+  }
+  return rc;
+}
+
 int UsartTermios::recv()
 {
   char buff[1];
@@ -210,6 +250,69 @@ int UsartTermios::recv(char* buff, uint32_t bytes)
   return rc;
 }
 
+int UsartTermios::recvTimed(char* buff, uint32_t bytes, uint32_t total_us, uint32_t inter_byte_us)
+{
+  uint64_t now = monotonicUs();
+  uint64_t total_deadline = (total_us > 0 ? now + total_us : UINT64_MAX);
+  uint64_t byte_deadline = UINT64_MAX;
+  uint32_t received = 0;
+  struct pollfd pfd = { port_, POLLIN, 0 };
+
+  while (received < bytes) {
+    uint64_t deadline = (total_deadline < byte_deadline ? total_deadline : byte_deadline);
+    struct timespec ts;
+    struct timespec* tsp = nullptr;
+
+    if (deadline != UINT64_MAX) {
+      if (now >= deadline) {
+        errno = ETIMEDOUT;
+        break;
+      }
+
+      uint64_t wait_us = deadline - now;
+      ts.tv_sec = wait_us / 1000000;
+      ts.tv_nsec = (wait_us % 1000000) * 1000;
+      tsp = &ts;
+    }
+
+    int rc = ppoll(&pfd, 1, tsp, nullptr);
+
+    if (rc < 0 && errno != EINTR) {
+      return -1;
+    }
+
+    now = monotonicUs();
+
+    if (rc > 0) {
+      if (pfd.revents & POLLNVAL) {
+        errno = EIO;
+        return -1;
+      }
+
+      // Read what is left even if the peer hung up.
+      rc = read(port_, buff + received, bytes - received);
+
+      if (rc > 0) {
+        received += rc;
+
+        if (inter_byte_us > 0) {
+          byte_deadline = now + inter_byte_us;
+        }
+      } else if (0 == rc || (pfd.revents & POLLHUP)) {
+        // End of file, ppoll would keep returning at once.
+        errno = EIO;
+        break;
+      } else if (errno != EAGAIN && errno != EINTR) {
+        return -1;
+      } else if (pfd.revents & POLLERR) {
+        errno = EIO;
+        return -1;
+      }
+    }
+  }
+  return received;
+}
+
 #if 0
 void UsartTermios::setReadMinimum(uint32_t bytes)
 {
@@ -235,28 +338,74 @@ int UsartTermios::sendBreak(uint32_t duration)
 
 //============================================= OPERATIONS =========================================
 
-int UsartTermios::getNativeBaud(int num)
+// static
+uint64_t UsartTermios::monotonicUs()
 {
-  int baud = B57600;
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return uint64_t(ts.tv_sec) * 1000000 + ts.tv_nsec / 1000;
+}
 
+int UsartTermios::getNativeBaud(int num)
+{
+  // The rates above 230400 are Linux extensions.
   switch (num) {
-    case 9600:
-      baud = B9600;
-      break;
-    case 38400:
-      baud = B38400;
-      break;
-    case 57600:
-      baud = B57600;
-      break;
-    case 115200:
-      baud = B115200;
-      break;
-    default:
-      break;
+    case 50:      return B50;
+    case 75:      return B75;
+    case 110:     return B110;
+    case 134:     return B134;
+    case 150:     return B150;
+    case 200:     return B200;
+    case 300:     return B300;
+    case 600:     return B600;
+    case 1200:    return B1200;
+    case 1800:    return B1800;
+    case 2400:    return B2400;
+    case 4800:    return B4800;
+    case 9600:    return B9600;
+    case 19200:   return B19200;
+    case 38400:   return B38400;
+    case 57600:   return B57600;
+    case 115200:  return B115200;
+    case 230400:  return B230400;
+#ifdef B460800
+    case 460800:  return B460800;
+#endif
+#ifdef B500000
+    case 500000:  return B500000;
+#endif
+#ifdef B576000
+    case 576000:  return B576000;
+#endif
+#ifdef B921600
+    case 921600:  return B921600;
+#endif
+#ifdef B1000000
+    case 1000000: return B1000000;
+#endif
+#ifdef B1152000
+    case 1152000: return B1152000;
+#endif
+#ifdef B1500000
+    case 1500000: return B1500000;
+#endif
+#ifdef B2000000
+    case 2000000: return B2000000;
+#endif
+#ifdef B2500000
+    case 2500000: return B2500000;
+#endif
+#ifdef B3000000
+    case 3000000: return B3000000;
+#endif
+#ifdef B3500000
+    case 3500000: return B3500000;
+#endif
+#ifdef B4000000
+    case 4000000: return B4000000;
+#endif
+    default:      return -1;
   };
-
-  return baud;
 }
 
 } // namespace btr
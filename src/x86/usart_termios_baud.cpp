@@ -0,0 +1,65 @@
+// Copyright (C) 2019 Sergey Kapustin <kapucin@gmail.com>
+
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+// SYSTEM INCLUDES
+#include <errno.h>
+
+// PROJECT INCLUDES
+#include "devices/x86/usart_termios.hpp"  // class implemented
+
+// termios2 definitions conflict with termios.h, so this file must not include it.
+#if BTR_USART_ARBITRARY_BAUD > 0
+#include <asm/termbits.h>
+#include <sys/ioctl.h>
+#endif
+
+namespace btr
+{
+
+/////////////////////////////////////////////// PRIVATE ////////////////////////////////////////////
+
+//============================================= OPERATIONS =========================================
+
+// static
+int UsartTermios::setArbitraryBaud(int fd, uint32_t baud)
+{
+#if BTR_USART_ARBITRARY_BAUD > 0
+  struct termios2 options;
+
+  if (ioctl(fd, TCGETS2, &options) != 0) {
+    return -1;
+  }
+
+  options.c_cflag &= ~CBAUD;
+  options.c_cflag |= BOTHER;
+  options.c_ispeed = baud;
+  options.c_ospeed = baud;
+
+  if (ioctl(fd, TCSETS2, &options) != 0) {
+    return -1;
+  }
+
+  // Drivers round the rate to what the hardware can do, reject it if they couldn't get close.
+  if (ioctl(fd, TCGETS2, &options) != 0) {
+    return -1;
+  }
+
+  uint32_t diff = (options.c_ospeed > baud ? options.c_ospeed - baud : baud - options.c_ospeed);
+
+  if (diff > baud / 50) {
+    errno = EINVAL;
+    return -1;
+  }
+  return 0;
+#else
+  (void) fd;
+  (void) baud;
+  errno = EINVAL;
+  return -1;
+#endif
+}
+
+} // namespace btr
@@ -0,0 +1,311 @@
+// Copyright (C) 2019 Sergey Kapustin <kapucin@gmail.com>
+
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+// SYSTEM INCLUDES
+#include <gtest/gtest.h>
+#include <thread>
+#include <chrono>
+#include <mutex>
+#include <condition_variable>
+#include <string>
+
+// PROJECT INCLUDES
+#include "devices/dma_rx_ring.hpp"
+#include "utility/test_helpers.hpp"
+
+using namespace std::chrono;
+using namespace std::chrono_literals;
+
+namespace btr
+{
+
+//------------------------------------------------------------------------------
+
+/**
+ * Circular DMA channel model. Each byte goes into the ring's buffer and decrements the remaining
+ * count, which reloads at the end of a lap. Half and complete transfer publish like the DMA
+ * interrupt, idle() publishes like the USART IDLE interrupt.
+ */
+template<size_t N>
+struct FakeDmaRx
+{
+  explicit FakeDmaRx(DmaRxRing<N>* ring) : ring(ring)
+  {
+  }
+
+  void receive(const std::string& data)
+  {
+    for (char c : data) {
+      ring->buffer()[N - remaining] = uint8_t(c);
+
+      if (0 == --remaining) {
+        remaining = N;
+        interrupt();
+      } else if (N / 2 == remaining) {
+        interrupt();
+      }
+    }
+  }
+
+  void idle()
+  {
+    interrupt();
+  }
+
+  void interrupt()
+  {
+    interrupts++;
+    overflows += (ring->publish(remaining) ? 1 : 0);
+  }
+
+  DmaRxRing<N>* ring;
+  uint16_t remaining = N;
+  uint32_t interrupts = 0;
+  uint32_t overflows = 0;
+};
+
+static std::string pattern(size_t bytes, uint8_t seed)
+{
+  std::string s(bytes, '\0');
+
+  for (size_t i = 0; i < bytes; i++) {
+    s[i] = char(seed + i * 7);
+  }
+  return s;
+}
+
+template<size_t N>
+static std::string popAll(DmaRxRing<N>* ring)
+{
+  std::string s(N, '\0');
+  s.resize(ring->popN((uint8_t*) &s[0], N));
+  return s;
+}
+
+//------------------------------------------------------------------------------
+
+// Tests {
+
+TEST(DmaRxRingTest, idlePublishes)
+{
+  DmaRxRing<64> ring;
+  FakeDmaRx<64> dma(&ring);
+  std::string a = pattern(10, 1);
+
+  // Bytes written by DMA are invisible until an interrupt publishes them
+  dma.receive(a);
+  ASSERT_EQ(0U, dma.interrupts);
+  ASSERT_TRUE(ring.empty());
+
+  dma.idle();
+  ASSERT_EQ(10U, ring.size());
+
+  // An idle without new bytes publishes nothing
+  dma.idle();
+  ASSERT_EQ(10U, ring.size());
+  ASSERT_EQ(a, popAll(&ring));
+  ASSERT_TRUE(ring.empty());
+  ASSERT_EQ(0U, dma.overflows);
+}
+
+TEST(DmaRxRingTest, halfAndCompleteTransfer)
+{
+  DmaRxRing<64> ring;
+  FakeDmaRx<64> dma(&ring);
+  std::string a = pattern(40, 2);
+
+  // A long burst is published at half transfer, before the line goes idle
+  dma.receive(a);
+  ASSERT_EQ(1U, dma.interrupts);
+  ASSERT_EQ(32U, ring.size());
+  ASSERT_EQ(a.substr(0, 32), popAll(&ring));
+
+  dma.idle();
+  ASSERT_EQ(a.substr(32), popAll(&ring));
+
+  // The next burst wraps: complete transfer at the end of the lap, the rest at idle
+  std::string b = pattern(50, 3);
+  dma.receive(b);
+  ASSERT_EQ(3U, dma.interrupts);
+  ASSERT_EQ(24U, ring.size());
+  dma.idle();
+  ASSERT_EQ(50U, ring.size());
+
+  const uint8_t* data = nullptr;
+  ASSERT_EQ(24U, ring.peek(&data));
+  ASSERT_EQ(0, memcmp(b.data(), data, 24));
+  ring.consume(24);
+  ASSERT_EQ(26U, ring.peek(&data));
+  ASSERT_EQ(0, memcmp(b.data() + 24, data, 26));
+  ring.consume(26);
+  ASSERT_TRUE(ring.empty());
+}
+
+TEST(DmaRxRingTest, overflowResyncs)
+{
+  DmaRxRing<64> ring;
+  FakeDmaRx<64> dma(&ring);
+
+  // Nobody reads: the unread data reaches a full lap and is dropped
+  dma.receive(pattern(70, 4));
+  dma.idle();
+  ASSERT_LE(1U, dma.overflows);
+  ASSERT_TRUE(ring.empty());
+  ASSERT_EQ("", popAll(&ring));
+
+  // The reader picks up again at the data published after the drop
+  std::string a = pattern(20, 5);
+  dma.receive(a);
+  dma.idle();
+  ASSERT_EQ(a, popAll(&ring));
+
+  // Up to N - 1 unread bytes is still fine
+  std::string b = pattern(63, 6);
+  uint32_t overflows = dma.overflows;
+  dma.receive(b);
+  dma.idle();
+  ASSERT_EQ(overflows, dma.overflows);
+  ASSERT_TRUE(ring.full());
+  ASSERT_EQ(b, popAll(&ring));
+}
+
+TEST(DmaRxRingTest, resetRestartsAtBufferStart)
+{
+  DmaRxRing<64> ring;
+  FakeDmaRx<64> dma(&ring);
+
+  uint8_t buff[4];
+
+  // Usart is closed with bytes unread mid-lap
+  dma.receive(pattern(10, 7));
+  dma.idle();
+  ASSERT_EQ(4U, ring.popN(buff, sizeof(buff)));
+
+  // Reopening restarts the channel at the start of the buffer, and the ring with it
+  ring.reset();
+  dma.remaining = 64;
+  ASSERT_TRUE(ring.empty());
+
+  std::string a = pattern(20, 8);
+  dma.receive(a);
+  dma.idle();
+  ASSERT_EQ(20U, ring.size());
+  ASSERT_EQ(a, popAll(&ring));
+
+  // A pending overflow doesn't survive the restart either
+  dma.receive(pattern(70, 9));
+  dma.idle();
+  ASSERT_LE(1U, dma.overflows);
+  ring.reset();
+  dma.remaining = 64;
+
+  std::string b = pattern(40, 10);
+  dma.receive(b);
+  dma.idle();
+  ASSERT_EQ(b, popAll(&ring));
+}
+
+TEST(DmaRxRingTest, streamFuzz)
+{
+  DmaRxRing<128> ring;
+  FakeDmaRx<128> dma(&ring);
+  std::string sent;
+  std::string got;
+  uint32_t seed = 7;
+
+  // Random bursts and reads, the reader never falls a lap behind
+  for (int i = 0; i < 5000; i++) {
+    seed = seed * 1103515245 + 12345;
+    size_t burst = (seed >> 8) % 40;
+    std::string data = pattern(burst, uint8_t(i));
+
+    dma.receive(data);
+    sent += data;
+
+    if (seed % 4 != 0) {
+      dma.idle();
+    }
+
+    uint8_t buff[128];
+    got.append((const char*) buff, ring.popN(buff, (seed >> 16) % 128));
+
+    if (ring.size() > 40) {
+      got += popAll(&ring);
+    }
+  }
+
+  dma.idle();
+  got += popAll(&ring);
+
+  ASSERT_EQ(0U, dma.overflows);
+  ASSERT_EQ(sent, got);
+  TEST_MSG << "Bytes: " << sent.size() << ", interrupts: " << dma.interrupts << std::endl;
+}
+
+TEST(DmaRxRingTest, popWaitPerBurst)
+{
+  // The interrupt thread receives bursts and publishes them at idle, notifying the reader once the
+  // bytes it waits for are in, like Usart's IDLE interrupt on STM32.
+  const size_t BURSTS = 20;
+  const size_t BURST = 24;
+  DmaRxRing<64> ring;
+  FakeDmaRx<64> dma(&ring);
+  std::mutex mutex;
+  std::condition_variable cv;
+  bool notified = false;
+  size_t wanted = 1;
+  uint32_t wakeups = 0;
+  std::string sent;
+
+  for (size_t i = 0; i < BURSTS; i++) {
+    sent += pattern(BURST, uint8_t(i));
+  }
+
+  std::thread isr([&]() {
+    for (size_t i = 0; i < BURSTS; i++) {
+      std::this_thread::sleep_for(2ms);
+
+      std::lock_guard<std::mutex> lock(mutex);
+      dma.receive(sent.substr(i * BURST, BURST));
+      dma.idle();
+
+      if (ring.size() >= wanted || ring.full()) {
+        notified = true;
+        cv.notify_one();
+      }
+    }
+  });
+
+  std::string got(sent.size(), '\0');
+  size_t n = ring.popWait((uint8_t*) &got[0], got.size(), [&](size_t missing) {
+        std::unique_lock<std::mutex> lock(mutex);
+        wanted = std::min(missing, ring.capacity());
+
+        if (ring.size() >= wanted) {
+          return true;
+        }
+
+        wakeups++;
+        bool rc = cv.wait_for(lock, 100ms, [&notified]() { return notified; });
+        notified = false;
+        return rc;
+      });
+
+  isr.join();
+
+  ASSERT_EQ(sent.size(), n);
+  ASSERT_EQ(sent, got);
+  ASSERT_EQ(0U, dma.overflows);
+
+  // At most one wake-up per burst, not one per byte
+  ASSERT_GE(BURSTS, wakeups);
+  TEST_MSG << "Bytes: " << n << ", wake-ups: " << wakeups << ", interrupts: " << dma.interrupts
+    << std::endl;
+}
+
+// } Tests
+
+} // namespace btr
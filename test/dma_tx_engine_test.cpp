@@ -0,0 +1,280 @@
+// Copyright (C) 2019 Sergey Kapustin <kapucin@gmail.com>
+
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+// SYSTEM INCLUDES
+#include <gtest/gtest.h>
+#include <thread>
+#include <chrono>
+#include <mutex>
+#include <condition_variable>
+#include <string>
+#include <vector>
+
+// PROJECT INCLUDES
+#include "devices/dma_tx_engine.hpp"
+#include "devices/spsc_ring.hpp"
+#include "utility/test_helpers.hpp"
+
+using namespace std::chrono;
+using namespace std::chrono_literals;
+
+namespace btr
+{
+
+//------------------------------------------------------------------------------
+
+/**
+ * DMA channel model. A transfer reads the ring when it completes, so data overwritten in the ring
+ * while the transfer is in flight shows up as a mismatch.
+ */
+struct FakeDma
+{
+  void startDma(const uint8_t* data, uint16_t bytes)
+  {
+    starts++;
+
+    if (active) {
+      overlaps++;
+    }
+
+    active = true;
+    span = data;
+    span_bytes = bytes;
+    transfers.push_back(bytes);
+  }
+
+  /** Finish the transfer in flight and "send" its data. */
+  template<typename Engine>
+  void complete(Engine* engine)
+  {
+    ASSERT_TRUE(active);
+    wire.append((const char*) span, span_bytes);
+    active = false;
+    engine->onComplete();
+  }
+
+  bool active = false;
+  const uint8_t* span = nullptr;
+  uint16_t span_bytes = 0;
+  uint32_t starts = 0;
+  uint32_t overlaps = 0;
+  std::vector<uint16_t> transfers;
+  std::string wire;
+};
+
+typedef SpscRing<uint8_t, 64> Ring;
+typedef DmaTxEngine<FakeDma, Ring> Engine;
+
+static std::string pattern(size_t bytes, uint8_t seed)
+{
+  std::string s(bytes, '\0');
+
+  for (size_t i = 0; i < bytes; i++) {
+    s[i] = char(seed + i * 13);
+  }
+  return s;
+}
+
+//------------------------------------------------------------------------------
+
+// Tests {
+
+TEST(DmaTxEngineTest, startWhenIdle)
+{
+  FakeDma dma;
+  Ring ring;
+  Engine engine(&dma, &ring);
+  std::string data = pattern(10, 1);
+
+  ASSERT_FALSE(engine.busy());
+  ASSERT_EQ(10U, engine.write((const uint8_t*) data.data(), 10));
+  ASSERT_TRUE(engine.busy());
+  ASSERT_EQ(1U, dma.starts);
+  ASSERT_EQ(10U, dma.span_bytes);
+
+  // While busy, a write only queues
+  ASSERT_EQ(5U, engine.write((const uint8_t*) data.data(), 5));
+  ASSERT_EQ(1U, dma.starts);
+  ASSERT_EQ(15U, engine.pending());
+
+  // Completion starts the queued data, the next one goes idle
+  dma.complete(&engine);
+  ASSERT_EQ(2U, dma.starts);
+  ASSERT_EQ(5U, dma.span_bytes);
+  dma.complete(&engine);
+  ASSERT_FALSE(engine.busy());
+  ASSERT_EQ(0U, engine.pending());
+
+  ASSERT_EQ(data + data.substr(0, 5), dma.wire);
+  ASSERT_EQ(0U, dma.overlaps);
+
+  // Nothing to send, nothing started
+  ASSERT_EQ(0U, engine.write(nullptr, 0));
+  ASSERT_EQ(2U, dma.starts);
+}
+
+TEST(DmaTxEngineTest, wrapSplitsTransfer)
+{
+  FakeDma dma;
+  Ring ring;
+  Engine engine(&dma, &ring);
+  std::string a = pattern(50, 2);
+  std::string b = pattern(40, 3);
+
+  engine.write((const uint8_t*) a.data(), a.size());
+  dma.complete(&engine);
+
+  // Ring indices are at 50, 40 bytes wrap: 14 at the end, 26 at the start
+  ASSERT_EQ(40U, engine.write((const uint8_t*) b.data(), b.size()));
+  ASSERT_EQ(14U, dma.span_bytes);
+  dma.complete(&engine);
+  ASSERT_EQ(26U, dma.span_bytes);
+  dma.complete(&engine);
+
+  ASSERT_EQ(a + b, dma.wire);
+  ASSERT_EQ((std::vector<uint16_t>{ 50, 14, 26 }), dma.transfers);
+}
+
+TEST(DmaTxEngineTest, orderingFuzz)
+{
+  FakeDma dma;
+  Ring ring;
+  Engine engine(&dma, &ring);
+  std::string sent;
+  uint32_t seed = 1;
+
+  // Random writes interleaved with random completions, the wire must match the input
+  for (int i = 0; i < 5000; i++) {
+    seed = seed * 1103515245 + 12345;
+
+    if (seed % 3 != 0) {
+      std::string data = pattern(1 + (seed >> 8) % 40, uint8_t(i));
+      size_t n = engine.write((const uint8_t*) data.data(), data.size());
+      sent += data.substr(0, n);
+    } else if (dma.active) {
+      dma.complete(&engine);
+    }
+  }
+
+  while (dma.active) {
+    dma.complete(&engine);
+  }
+
+  ASSERT_FALSE(engine.busy());
+  ASSERT_EQ(sent, dma.wire);
+  ASSERT_EQ(0U, dma.overlaps);
+}
+
+TEST(DmaTxEngineTest, writeWaitTimeout)
+{
+  FakeDma dma;
+  Ring ring;
+  Engine engine(&dma, &ring);
+  std::string data = pattern(200, 4);
+  uint32_t waits = 0;
+
+  // The channel stalls: the ring fills up and the wait times out without progress.
+  size_t n = engine.writeWait((const uint8_t*) data.data(), data.size(),
+      [&waits]() { waits++; return false; });
+
+  ASSERT_EQ(ring.capacity(), n);
+  ASSERT_EQ(1U, waits);
+
+  // Completions during the wait let the whole buffer through.
+  FakeDma dma2;
+  Ring ring2;
+  Engine engine2(&dma2, &ring2);
+
+  n = engine2.writeWait((const uint8_t*) data.data(), data.size(),
+      [&dma2, &engine2]() { dma2.complete(&engine2); return true; });
+
+  ASSERT_EQ(data.size(), n);
+
+  while (dma2.active) {
+    dma2.complete(&engine2);
+  }
+  ASSERT_EQ(data, dma2.wire);
+}
+
+TEST(DmaTxEngineTest, interruptThread)
+{
+  // Completions come from another thread standing in for the DMA interrupt, and the engine is
+  // used without locks. The sender blocks on a latched notification, like ulTaskNotifyTake.
+  struct ThreadDma
+  {
+    void startDma(const uint8_t* data, uint16_t bytes)
+    {
+      if (__atomic_load_n(&active, __ATOMIC_ACQUIRE)) {
+        overlaps++;
+      }
+
+      starts++;
+      span = data;
+      span_bytes = bytes;
+      __atomic_store_n(&active, true, __ATOMIC_RELEASE);
+    }
+
+    bool active = false;
+    const uint8_t* span = nullptr;
+    uint16_t span_bytes = 0;
+    uint32_t starts = 0;
+    uint32_t overlaps = 0;
+  };
+
+  ThreadDma dma;
+  Ring ring;
+  DmaTxEngine<ThreadDma, Ring> engine(&dma, &ring);
+  std::string data = pattern(1 << 16, 5);
+  std::mutex mutex;
+  std::condition_variable cv;
+  bool notified = false;
+  bool done = false;
+  std::string wire;
+
+  std::thread isr([&]() {
+    while (false == __atomic_load_n(&done, __ATOMIC_ACQUIRE) || engine.busy()) {
+      if (false == __atomic_load_n(&dma.active, __ATOMIC_ACQUIRE)) {
+        std::this_thread::yield();
+        continue;
+      }
+
+      wire.append((const char*) dma.span, dma.span_bytes);
+      __atomic_store_n(&dma.active, false, __ATOMIC_RELEASE);
+      engine.onComplete();
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        notified = true;
+      }
+      cv.notify_one();
+    }
+  });
+
+  auto wait = [&]() {
+    std::unique_lock<std::mutex> lock(mutex);
+    bool rc = cv.wait_for(lock, 100ms, [&notified]() { return notified; });
+    notified = false;
+    return rc;
+  };
+
+  size_t n = 0;
+
+  for (size_t i = 0; i < data.size(); i += 100) {
+    size_t bytes = std::min<size_t>(100, data.size() - i);
+    n += engine.writeWait((const uint8_t*) data.data() + i, bytes, wait);
+  }
+
+  __atomic_store_n(&done, true, __ATOMIC_RELEASE);
+  isr.join();
+
+  ASSERT_EQ(data.size(), n);
+  ASSERT_EQ(data, wire);
+  ASSERT_EQ(0U, dma.overlaps);
+  TEST_MSG << "Bytes: " << n << ", transfers: " << dma.starts << std::endl;
+}
+
+// } Tests
+
+} // namespace btr
@@ -0,0 +1,162 @@
+// Copyright (C) 2019 Sergey Kapustin <kapucin@gmail.com>
+
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+// Built into the ESP32 test program only, see CMakeLists.txt.
+#if BTR_ESP32 > 0
+
+// PROJECT INCLUDES
+#include "esp_idf_stub.hpp"
+
+struct i2c_master_bus_t
+{
+  i2c_port_num_t port;
+};
+
+struct i2c_master_dev_t
+{
+  uint16_t addr;
+};
+
+namespace btr
+{
+
+static EspI2CStub stub_;
+
+// static
+EspI2CStub* EspI2CStub::instance()
+{
+  return &stub_;
+}
+
+void EspI2CStub::reset()
+{
+  uint32_t live = devices;
+  *this = EspI2CStub();
+  devices = live;
+}
+
+static void read(uint8_t* buff, size_t bytes)
+{
+  for (size_t i = 0; i < bytes; i++) {
+    buff[i] = (stub_.to_read.empty() ? 0 : stub_.to_read[i % stub_.to_read.size()]);
+  }
+}
+
+} // namespace btr
+
+using btr::stub_;
+
+esp_err_t i2c_new_master_bus(
+    const i2c_master_bus_config_t* bus_config, i2c_master_bus_handle_t* ret_bus_handle)
+{
+  *ret_bus_handle = new i2c_master_bus_t{ bus_config->i2c_port };
+  return ESP_OK;
+}
+
+esp_err_t i2c_del_master_bus(i2c_master_bus_handle_t bus_handle)
+{
+  if (nullptr == bus_handle) {
+    return ESP_ERR_INVALID_ARG;
+  }
+  // ESP-IDF refuses to delete a bus with devices on it.
+  if (stub_.devices > 0) {
+    return ESP_ERR_INVALID_STATE;
+  }
+  delete bus_handle;
+  return ESP_OK;
+}
+
+esp_err_t i2c_master_bus_add_device(
+    i2c_master_bus_handle_t bus_handle, const i2c_device_config_t* dev_config,
+    i2c_master_dev_handle_t* ret_handle)
+{
+  (void) bus_handle;
+
+  stub_.add_device++;
+  stub_.devices++;
+  *ret_handle = new i2c_master_dev_t{ dev_config->device_address };
+  return ESP_OK;
+}
+
+esp_err_t i2c_master_bus_rm_device(i2c_master_dev_handle_t handle)
+{
+  stub_.rm_device++;
+  stub_.devices--;
+  delete handle;
+  return ESP_OK;
+}
+
+esp_err_t i2c_master_transmit(
+    i2c_master_dev_handle_t i2c_dev, const uint8_t* write_buffer, size_t write_size,
+    int xfer_timeout_ms)
+{
+  (void) xfer_timeout_ms;
+
+  stub_.transmit++;
+  stub_.addr = i2c_dev->addr;
+  stub_.written.assign(write_buffer, write_buffer + write_size);
+  return stub_.error;
+}
+
+esp_err_t i2c_master_multi_buffer_transmit(
+    i2c_master_dev_handle_t i2c_dev, i2c_master_transmit_multi_buffer_info_t* buffer_info_array,
+    size_t array_size, int xfer_timeout_ms)
+{
+  (void) xfer_timeout_ms;
+
+  stub_.multi_buffer_transmit++;
+  stub_.addr = i2c_dev->addr;
+  stub_.written.clear();
+
+  for (size_t i = 0; i < array_size; i++) {
+    const uint8_t* buff = buffer_info_array[i].write_buffer;
+    stub_.written.insert(stub_.written.end(), buff, buff + buffer_info_array[i].buffer_size);
+  }
+  return stub_.error;
+}
+
+esp_err_t i2c_master_transmit_receive(
+    i2c_master_dev_handle_t i2c_dev, const uint8_t* write_buffer, size_t write_size,
+    uint8_t* read_buffer, size_t read_size, int xfer_timeout_ms)
+{
+  (void) xfer_timeout_ms;
+
+  stub_.transmit_receive++;
+  stub_.addr = i2c_dev->addr;
+  stub_.written.assign(write_buffer, write_buffer + write_size);
+  btr::read(read_buffer, read_size);
+  return stub_.error;
+}
+
+esp_err_t i2c_master_receive(
+    i2c_master_dev_handle_t i2c_dev, uint8_t* read_buffer, size_t read_size, int xfer_timeout_ms)
+{
+  (void) xfer_timeout_ms;
+
+  stub_.receive++;
+  stub_.addr = i2c_dev->addr;
+  stub_.written.clear();
+  btr::read(read_buffer, read_size);
+  return stub_.error;
+}
+
+esp_err_t i2c_master_probe(
+    i2c_master_bus_handle_t bus_handle, uint16_t address, int xfer_timeout_ms)
+{
+  (void) bus_handle;
+  (void) address;
+  (void) xfer_timeout_ms;
+  return ESP_ERR_NOT_FOUND;
+}
+
+esp_err_t i2c_master_bus_wait_all_done(i2c_master_bus_handle_t bus_handle, int timeout_ms)
+{
+  (void) bus_handle;
+  (void) timeout_ms;
+  return ESP_OK;
+}
+
+#endif // BTR_ESP32 > 0
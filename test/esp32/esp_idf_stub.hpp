@@ -0,0 +1,56 @@
+// Copyright (C) 2019 Sergey Kapustin <kapucin@gmail.com>
+
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+/** @file */
+
+#ifndef _btr_EspIdfStub_hpp_
+#define _btr_EspIdfStub_hpp_
+
+// SYSTEM INCLUDES
+#include <stdint.h>
+#include <vector>
+#include <driver/i2c_master.h>
+
+namespace btr
+{
+
+/**
+ * The state of the ESP-IDF I2C master stub: the number of calls to each driver function, the
+ * bytes the last transfer wrote and the bytes reads return.
+ */
+struct EspI2CStub
+{
+  /**
+   * @return the stub's state, shared by all driver functions
+   */
+  static EspI2CStub* instance();
+
+  /**
+   * Zero the counters and the buffers, keep the devices on the bus.
+   */
+  void reset();
+
+  uint32_t add_device;
+  uint32_t rm_device;
+  uint32_t transmit;
+  uint32_t multi_buffer_transmit;
+  uint32_t transmit_receive;
+  uint32_t receive;
+  /** The number of devices on the bus. */
+  uint32_t devices;
+  /** Address of the device of the last transfer. */
+  uint16_t addr;
+  /** Bytes written by the last transfer, the buffers joined together. */
+  std::vector<uint8_t> written;
+  /** Bytes returned by reads, repeated if a read is longer. */
+  std::vector<uint8_t> to_read;
+  /** Error returned by transfers. */
+  esp_err_t error;
+};
+
+} // namespace btr
+
+#endif // _btr_EspIdfStub_hpp_
@@ -0,0 +1,170 @@
+// Copyright (C) 2019 Sergey Kapustin <kapucin@gmail.com>
+
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+// Built into the ESP32 test program only, see CMakeLists.txt.
+#if BTR_ESP32 > 0
+
+// SYSTEM INCLUDES
+#include <gtest/gtest.h>
+#include <vector>
+
+// PROJECT INCLUDES
+#include "devices/i2c.hpp"
+#include "esp_idf_stub.hpp"
+#include "utility/test_helpers.hpp"
+
+namespace btr
+{
+
+//------------------------------------------------------------------------------
+
+class I2CEsp32Test : public testing::Test
+{
+public:
+
+  // LIFECYCLE
+
+  I2CEsp32Test()
+    :
+      stub_(EspI2CStub::instance()),
+      i2c_(I2C::instance(0, true))
+  {
+    stub_->reset();
+  }
+
+  ~I2CEsp32Test()
+  {
+    i2c_->close();
+  }
+
+protected:
+
+  // ATTRIBUTES
+
+  EspI2CStub* stub_;
+  I2C* i2c_;
+};
+
+//------------------------------------------------------------------------------
+
+// Tests {
+
+TEST_F(I2CEsp32Test, registerRead)
+{
+  const uint32_t READS = 10;
+  uint8_t buff[6] = {};
+
+  stub_->to_read = { 0x11, 0x22, 0x33, 0x44, 0x55, 0x66 };
+
+  // Register and data in one write-read transaction, whatever the byte count
+  for (uint32_t i = 0; i < READS; i++) {
+    ASSERT_TRUE(is_ok(i2c_->read(0x29, 0xC0, buff, sizeof(buff))));
+  }
+
+  ASSERT_EQ(READS, stub_->transmit_receive);
+  ASSERT_EQ(0x29, stub_->addr);
+  ASSERT_EQ((std::vector<uint8_t>{ 0xC0 }), stub_->written);
+  ASSERT_EQ(stub_->to_read, std::vector<uint8_t>(buff, buff + sizeof(buff)));
+
+  // No per-byte transfers, and the device is added once
+  ASSERT_EQ(0U, stub_->transmit);
+  ASSERT_EQ(0U, stub_->receive);
+  ASSERT_EQ(1U, stub_->add_device);
+  ASSERT_EQ(0U, stub_->rm_device);
+
+  uint16_t value = 0;
+  ASSERT_TRUE(is_ok(i2c_->read(0x29, 0xC0, &value)));
+  ASSERT_EQ(0x1122, value);
+  ASSERT_EQ(READS + 1, stub_->transmit_receive);
+}
+
+TEST_F(I2CEsp32Test, write)
+{
+  const uint8_t data[] = { 0x01, 0x02, 0x03 };
+
+  // Register and data in one transfer
+  uint32_t rc = i2c_->write(0x29, 0x80, data, sizeof(data));
+  ASSERT_TRUE(is_ok(rc));
+  ASSERT_EQ(1U + sizeof(data), (rc & 0xFFFF));
+  ASSERT_EQ(1U, stub_->multi_buffer_transmit);
+  ASSERT_EQ((std::vector<uint8_t>{ 0x80, 0x01, 0x02, 0x03 }), stub_->written);
+
+  // A register alone, e.g. a command
+  rc = i2c_->write(0x29, 0x81, nullptr, 0);
+  ASSERT_TRUE(is_ok(rc));
+  ASSERT_EQ(2U, stub_->multi_buffer_transmit);
+  ASSERT_EQ((std::vector<uint8_t>{ 0x81 }), stub_->written);
+
+  rc = i2c_->write(0x29, 0x82, uint16_t(0xABCD));
+  ASSERT_TRUE(is_ok(rc));
+  ASSERT_EQ((std::vector<uint8_t>{ 0x82, 0xAB, 0xCD }), stub_->written);
+
+  ASSERT_EQ(3U, stub_->multi_buffer_transmit);
+  ASSERT_EQ(0U, stub_->transmit);
+  ASSERT_EQ(1U, stub_->add_device);
+  ASSERT_EQ(0U, stub_->rm_device);
+}
+
+TEST_F(I2CEsp32Test, devicesStayOnBus)
+{
+  const uint32_t USES = 100;
+  const uint8_t addrs[] = { 0x29, 0x1E, 0x68 };
+  uint8_t buff[2];
+
+  // No add or remove per transfer while the addresses in use fit BTR_I2C_DEVICE_CACHE_SIZE
+  for (uint32_t i = 0; i < USES; i++) {
+    uint8_t addr = addrs[i % sizeof(addrs)];
+
+    if (i % 2) {
+      ASSERT_TRUE(is_ok(i2c_->read(addr, 0x00, buff, sizeof(buff))));
+    } else {
+      ASSERT_TRUE(is_ok(i2c_->write(addr, 0x00, buff, sizeof(buff))));
+    }
+    ASSERT_EQ(addr, stub_->addr);
+  }
+
+  ASSERT_EQ(sizeof(addrs), stub_->add_device);
+  ASSERT_EQ(0U, stub_->rm_device);
+  ASSERT_EQ(USES / 2, stub_->transmit_receive);
+  ASSERT_EQ(USES / 2, stub_->multi_buffer_transmit);
+
+  // Closing the bus removes them
+  i2c_->close();
+  ASSERT_EQ(sizeof(addrs), stub_->rm_device);
+  ASSERT_EQ(0U, stub_->devices);
+
+  TEST_MSG << USES << " transfers to " << sizeof(addrs) << " devices: " << stub_->add_device
+    << " device adds" << std::endl;
+}
+
+TEST_F(I2CEsp32Test, errors)
+{
+  uint8_t buff[2] = {};
+
+  stub_->error = ESP_ERR_NOT_FOUND;
+  ASSERT_EQ(BTR_DEV_ENOACK, i2c_->read(0x29, 0x00, buff, sizeof(buff)));
+  ASSERT_EQ(BTR_DEV_ENOACK, i2c_->write(0x29, 0x00, buff, sizeof(buff)));
+
+  stub_->error = ESP_ERR_TIMEOUT;
+  ASSERT_EQ(BTR_DEV_ETIMEOUT, i2c_->read(0x29, buff, sizeof(buff)));
+
+  stub_->error = ESP_ERR_INVALID_ARG;
+  ASSERT_EQ(BTR_DEV_EINVAL, i2c_->read(0x29, 0x00, buff, sizeof(buff)));
+
+  // A failed transfer keeps the device for the next one
+  stub_->error = ESP_OK;
+  ASSERT_TRUE(is_ok(i2c_->read(0x29, 0x00, buff, sizeof(buff))));
+  ASSERT_EQ(1U, stub_->add_device);
+
+  i2c_->close();
+  ASSERT_EQ(BTR_DEV_ENOTOPEN, i2c_->read(0x29, 0x00, buff, sizeof(buff)));
+}
+
+// } Tests
+
+} // namespace btr
+
+#endif // BTR_ESP32 > 0
@@ -0,0 +1,460 @@
+// Copyright (C) 2019 Sergey Kapustin <kapucin@gmail.com>
+
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+// SYSTEM INCLUDES
+#include <gtest/gtest.h>
+#include <thread>
+#include <chrono>
+#include <random>
+#include <string>
+#include <vector>
+
+// PROJECT INCLUDES
+#include "devices/defines.hpp"
+#include "devices/framed_link.hpp"
+#include "devices/x86/usart_termios.hpp"
+#include "devices/x86/pseudo_tty.hpp"
+#include "utility/test_helpers.hpp"
+
+using namespace std::chrono;
+using namespace std::chrono_literals;
+
+namespace btr
+{
+
+#define BAUD 115200
+#define DATA_BITS 8
+
+//------------------------------------------------------------------------------
+
+/**
+ * In-memory byte stream with the UsartTermios interface. recv() returns at most chunk bytes to
+ * exercise frames split across reads.
+ */
+class MemStream
+{
+public:
+
+  int send(const char* buff, uint32_t bytes)
+  {
+    data_.append(buff, bytes);
+    return bytes;
+  }
+
+  int recv(char* buff, uint32_t bytes)
+  {
+    size_t n = std::min<size_t>(std::min<size_t>(bytes, chunk_), data_.size() - pos_);
+    memcpy(buff, data_.data() + pos_, n);
+    pos_ += n;
+    return n;
+  }
+
+  int available()
+  {
+    return data_.size() - pos_;
+  }
+
+  size_t chunk_ = SIZE_MAX;
+  size_t pos_ = 0;
+  std::string data_;
+};
+
+template<typename Crc>
+static uint32_t crcOf(const uint8_t* data, size_t bytes)
+{
+  return Crc::finish(Crc::update(Crc::init(), data, bytes));
+}
+
+template<typename Crc>
+static uint32_t crcChunked(const uint8_t* data, size_t bytes, size_t chunk)
+{
+  typename Crc::ValueType crc = Crc::init();
+
+  for (size_t i = 0; i < bytes; i += chunk) {
+    crc = Crc::update(crc, data + i, std::min(chunk, bytes - i));
+  }
+  return Crc::finish(crc);
+}
+
+template<typename Codec>
+static std::vector<uint8_t> encode(const std::vector<uint8_t>& data)
+{
+  std::vector<uint8_t> out(Codec::maxEncoded(data.size()));
+  typename Codec::Encoder encoder(out.data());
+  encoder.put(data.data(), data.size());
+  out.resize(encoder.finish());
+  return out;
+}
+
+template<typename Codec>
+static void roundTrip(const std::vector<uint8_t>& data)
+{
+  std::vector<uint8_t> enc = encode<Codec>(data);
+
+  ASSERT_GE(Codec::maxEncoded(data.size()), enc.size());
+  ASSERT_EQ(Codec::DELIMITER, enc.front());
+  ASSERT_EQ(Codec::DELIMITER, enc.back());
+
+  for (size_t i = 1; i < enc.size() - 1; i++) {
+    ASSERT_NE(Codec::DELIMITER, enc[i]) << " at: " << i;
+  }
+
+  int32_t bytes = Codec::decode(enc.data() + 1, enc.size() - 2);
+  ASSERT_EQ(int32_t(data.size()), bytes);
+  ASSERT_EQ(0, memcmp(data.data(), enc.data() + 1, bytes));
+}
+
+template<typename Codec>
+static void codecRoundTrips()
+{
+  std::mt19937 gen(7);
+  std::vector<std::vector<uint8_t>> cases = {
+    {},
+    { 0 },
+    { 0, 0, 0 },
+    { Codec::DELIMITER, Slip::ESC, Slip::ESC_END, Slip::ESC_ESC },
+    std::vector<uint8_t>(253, 0x11),
+    std::vector<uint8_t>(254, 0x11),
+    std::vector<uint8_t>(255, 0x11),
+    std::vector<uint8_t>(508, 0x11),
+    std::vector<uint8_t>(300, 0x00)
+  };
+
+  std::vector<uint8_t> all(256);
+
+  for (size_t i = 0; i < all.size(); i++) {
+    all[i] = i;
+  }
+  cases.push_back(all);
+
+  for (size_t n = 0; n < 600; n += 37) {
+    std::vector<uint8_t> v(n);
+
+    for (uint8_t& b : v) {
+      b = gen() % 4 == 0 ? 0 : gen();
+    }
+    cases.push_back(v);
+  }
+
+  for (const auto& c : cases) {
+    roundTrip<Codec>(c);
+  }
+}
+
+//------------------------------------------------------------------------------
+
+class FramedLinkTest : public testing::Test
+{
+public:
+
+  // LIFECYCLE
+
+  FramedLinkTest()
+    :
+      tty_(),
+      reader_(),
+      sender_()
+  {
+    // Let socat finish the port set up, see UsartTermiosTest.
+    std::this_thread::sleep_for(20ms);
+
+    reader_.configure(TTY_SIM_0, BAUD, DATA_BITS, ParityType::NONE, BTR_USART_IO_TIMEOUT_MS);
+    sender_.configure(TTY_SIM_1, BAUD, DATA_BITS, ParityType::NONE, BTR_USART_IO_TIMEOUT_MS);
+    reader_.open();
+    sender_.open();
+  }
+
+protected:
+
+  // ATTRIBUTES
+
+  PseudoTTY tty_;
+  UsartTermios reader_;
+  UsartTermios sender_;
+};
+
+//------------------------------------------------------------------------------
+
+// Tests {
+
+TEST(CrcTest, checkValues)
+{
+  const uint8_t* check = (const uint8_t*) "123456789";
+
+  ASSERT_EQ(0x29B1U, crcOf<Crc16Bitwise>(check, 9));
+  ASSERT_EQ(0x29B1U, crcOf<Crc16Table>(check, 9));
+  ASSERT_EQ(0xCBF43926U, crcOf<Crc32Bitwise>(check, 9));
+  ASSERT_EQ(0xCBF43926U, crcOf<Crc32Table>(check, 9));
+  ASSERT_EQ(0xCBF43926U, crcOf<Crc32Slice8>(check, 9));
+}
+
+TEST(CrcTest, kernelsAgree)
+{
+  std::mt19937 gen(1);
+  std::vector<uint8_t> data(1031);
+
+  for (uint8_t& b : data) {
+    b = gen();
+  }
+
+  for (size_t n = 0; n < data.size(); n += 13) {
+    uint32_t crc16 = crcOf<Crc16Bitwise>(data.data(), n);
+    uint32_t crc32 = crcOf<Crc32Bitwise>(data.data(), n);
+
+    ASSERT_EQ(crc16, crcOf<Crc16Table>(data.data(), n)) << " bytes: " << n;
+    ASSERT_EQ(crc32, crcOf<Crc32Table>(data.data(), n)) << " bytes: " << n;
+    ASSERT_EQ(crc32, crcOf<Crc32Slice8>(data.data(), n)) << " bytes: " << n;
+    // Slice8 at unaligned addresses and with a tail in every update
+    ASSERT_EQ(crc32, crcChunked<Crc32Slice8>(data.data(), n, 11)) << " bytes: " << n;
+    ASSERT_EQ(crc16, crcChunked<Crc16Table>(data.data(), n, 5)) << " bytes: " << n;
+  }
+}
+
+TEST(CrcTest, benchmark)
+{
+  std::vector<uint8_t> data(1 << 20);
+  std::mt19937 gen(3);
+
+  for (uint8_t& b : data) {
+    b = gen();
+  }
+
+  auto measure = [&data](const char* name, uint32_t (*fn)(const uint8_t*, size_t)) {
+    const int rounds = 16;
+    volatile uint32_t sink = 0;
+    high_resolution_clock::time_point start = high_resolution_clock::now();
+
+    for (int i = 0; i < rounds; i++) {
+      sink = sink + fn(data.data(), data.size());
+    }
+
+    auto us = duration_cast<microseconds>(high_resolution_clock::now() - start).count();
+    TEST_MSG << name << ": " << (double(rounds) * data.size() / (us > 0 ? us : 1)) << " MB/s"
+      << std::endl;
+  };
+
+  measure("Crc16Bitwise", &crcOf<Crc16Bitwise>);
+  measure("Crc16Table", &crcOf<Crc16Table>);
+  measure("Crc32Bitwise", &crcOf<Crc32Bitwise>);
+  measure("Crc32Table", &crcOf<Crc32Table>);
+  measure("Crc32Slice8", &crcOf<Crc32Slice8>);
+}
+
+TEST(FramedLinkCodecTest, cobsRoundTrip)
+{
+  codecRoundTrips<Cobs>();
+}
+
+TEST(FramedLinkCodecTest, slipRoundTrip)
+{
+  codecRoundTrips<Slip>();
+}
+
+TEST(FramedLinkCodecTest, malformed)
+{
+  // COBS code points past the end of the frame
+  uint8_t cobs[] = { 0x05, 0x11, 0x22 };
+  ASSERT_EQ(-1, Cobs::decode(cobs, sizeof(cobs)));
+
+  // SLIP escape followed by a non-escape byte, and a trailing escape
+  uint8_t slip[] = { 0x11, Slip::ESC, 0x22 };
+  ASSERT_EQ(-1, Slip::decode(slip, sizeof(slip)));
+  ASSERT_EQ(-1, Slip::decode(slip, 2));
+}
+
+TEST(FramedLinkCodecTest, benchmark)
+{
+  std::vector<uint8_t> payload(BTR_FRAMED_LINK_MTU);
+  std::mt19937 gen(5);
+
+  for (uint8_t& b : payload) {
+    b = gen();
+  }
+
+  auto measure = [&payload](const char* name, auto codec) {
+    typedef decltype(codec) Codec;
+    const int frames = 20000;
+    std::vector<uint8_t> enc(Codec::maxEncoded(payload.size()));
+    std::vector<uint8_t> work(enc.size());
+    int64_t enc_us = 0;
+    int64_t dec_us = 0;
+    size_t enc_size = 0;
+
+    for (int i = 0; i < frames; i++) {
+      high_resolution_clock::time_point start = high_resolution_clock::now();
+      typename Codec::Encoder encoder(enc.data());
+      encoder.put(payload.data(), payload.size());
+      enc_size = encoder.finish();
+      high_resolution_clock::time_point mid = high_resolution_clock::now();
+
+      memcpy(work.data(), enc.data(), enc_size);
+      high_resolution_clock::time_point mid2 = high_resolution_clock::now();
+      int32_t n = Codec::decode(work.data() + 1, enc_size - 2);
+      high_resolution_clock::time_point end = high_resolution_clock::now();
+
+      ASSERT_EQ(int32_t(payload.size()), n);
+      enc_us += duration_cast<nanoseconds>(mid - start).count();
+      dec_us += duration_cast<nanoseconds>(end - mid2).count();
+    }
+
+    // Bytes per nanosecond to MB/s
+    double mb = double(frames) * payload.size() * 1000;
+    TEST_MSG << name << ": encode " << (mb / (enc_us > 0 ? enc_us : 1)) << " MB/s, decode "
+      << (mb / (dec_us > 0 ? dec_us : 1)) << " MB/s, " << payload.size() << " -> " << enc_size
+      << " bytes" << std::endl;
+  };
+
+  measure("Cobs", Cobs());
+  measure("Slip", Slip());
+}
+
+TEST(FramedLinkMemTest, splitReads)
+{
+  MemStream stream;
+  FramedLink<MemStream, Cobs, Crc16Table> tx(&stream);
+  FramedLink<MemStream, Cobs, Crc16Table> rx(&stream);
+  std::vector<std::vector<uint8_t>> sent;
+
+  for (size_t n = 0; n <= BTR_FRAMED_LINK_MTU; n += 17) {
+    std::vector<uint8_t> payload(n, uint8_t(n));
+
+    if (n > 0) {
+      payload[0] = 0;
+    }
+    ASSERT_EQ(n, tx.send(payload.data(), n));
+    sent.push_back(payload);
+  }
+
+  uint8_t too_big[BTR_FRAMED_LINK_MTU + 1] = {};
+  ASSERT_EQ(uint32_t(BTR_DEV_EOVERFLOW), tx.send(too_big, sizeof(too_big)));
+
+  stream.chunk_ = 3;
+
+  for (const auto& payload : sent) {
+    const uint8_t* p = nullptr;
+    uint32_t rc = rx.recv(&p);
+
+    ASSERT_EQ(payload.size(), rc);
+    ASSERT_EQ(0, memcmp(payload.data(), p, rc));
+  }
+
+  const uint8_t* p = nullptr;
+  ASSERT_EQ(uint32_t(BTR_DEV_ENODATA), rx.recv(&p));
+  ASSERT_EQ(sent.size(), rx.stats().frames);
+  ASSERT_EQ(0U, rx.stats().codec_errors + rx.stats().crc_errors + rx.stats().overflows);
+}
+
+TEST(FramedLinkMemTest, overflow)
+{
+  MemStream stream;
+  FramedLink<MemStream, Slip, Crc16Bitwise, 16> link(&stream);
+  std::string junk(100, 'x');
+  uint8_t payload[] = { 1, 2, 3 };
+  const uint8_t* p = nullptr;
+
+  stream.send(junk.data(), junk.size());
+  link.send(payload, sizeof(payload));
+
+  ASSERT_EQ(sizeof(payload), link.recv(&p));
+  ASSERT_EQ(0, memcmp(payload, p, sizeof(payload)));
+  ASSERT_LT(0U, link.stats().overflows);
+}
+
+TEST_F(FramedLinkTest, resync)
+{
+  // Sender encodes frames into memory, corrupts some, and writes them to the port with line
+  // noise in between. Every intact frame must arrive, in order, and no corrupt one.
+  typedef FramedLink<MemStream, Cobs, Crc32Slice8> MemLink;
+  typedef FramedLink<UsartTermios, Cobs, Crc32Slice8> PortLink;
+
+  const uint32_t FRAMES = 300;
+  std::mt19937 gen(11);
+  std::vector<std::vector<uint8_t>> expected;
+  std::string wire;
+  uint32_t corrupted = 0;
+
+  for (uint32_t i = 0; i < FRAMES; i++) {
+    std::vector<uint8_t> payload(4 + gen() % 60);
+    memcpy(payload.data(), &i, sizeof(i));
+
+    for (size_t j = sizeof(i); j < payload.size(); j++) {
+      payload[j] = (gen() % 8 == 0 ? 0 : gen());
+    }
+
+    MemStream frame;
+    MemLink encoder(&frame);
+    ASSERT_EQ(payload.size(), encoder.send(payload.data(), payload.size()));
+
+    if (gen() % 5 == 0) {
+      // Flip one bit after the leading delimiter
+      size_t pos = 1 + gen() % (frame.data_.size() - 1);
+      frame.data_[pos] ^= uint8_t(1 << (gen() % 8));
+      corrupted++;
+    } else {
+      expected.push_back(payload);
+    }
+
+    std::string noise(gen() % 24, '\0');
+
+    for (char& c : noise) {
+      c = gen();
+    }
+    wire += noise + frame.data_;
+  }
+
+  bool done = false;
+  int send_error = 0;
+
+  std::thread sender([&]() {
+    for (size_t i = 0; i < wire.size(); ) {
+      int rc = sender_.send(wire.data() + i, uint32_t(std::min<size_t>(512, wire.size() - i)));
+
+      if (rc < 0) {
+        send_error = errno;
+        break;
+      }
+      i += rc;
+    }
+    std::this_thread::sleep_for(50ms);
+    __atomic_store_n(&done, true, __ATOMIC_RELEASE);
+  });
+
+  PortLink link(&reader_);
+  std::vector<std::vector<uint8_t>> received;
+
+  while (true) {
+    const uint8_t* p = nullptr;
+    uint32_t rc = link.recv(&p);
+
+    if (rc == BTR_DEV_ENODATA) {
+      if (__atomic_load_n(&done, __ATOMIC_ACQUIRE)) {
+        break;
+      }
+      continue;
+    }
+    received.push_back(std::vector<uint8_t>(p, p + rc));
+  }
+
+  sender.join();
+  ASSERT_EQ(0, send_error) << " Message: " << strerror(send_error);
+
+  ASSERT_EQ(expected.size(), received.size());
+
+  for (size_t i = 0; i < expected.size(); i++) {
+    ASSERT_EQ(expected[i], received[i]) << " frame: " << i;
+  }
+
+  const PortLink::Stats& stats = link.stats();
+  ASSERT_EQ(expected.size(), stats.frames);
+  ASSERT_LE(corrupted, stats.codec_errors + stats.crc_errors);
+
+  TEST_MSG << "Frames: " << stats.frames << ", corrupted: " << corrupted << ", codec errors: "
+    << stats.codec_errors << ", crc errors: " << stats.crc_errors << std::endl;
+}
+
+// } Tests
+
+} // namespace btr
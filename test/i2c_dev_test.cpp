@@ -0,0 +1,255 @@
+// Copyright (C) 2019 Sergey Kapustin <kapucin@gmail.com>
+
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+// The fake below replaces open(), which a fortified <fcntl.h> defines inline.
+#undef _FORTIFY_SOURCE
+
+// SYSTEM INCLUDES
+#include <gtest/gtest.h>
+#include <dlfcn.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/i2c.h>
+#include <linux/i2c-dev.h>
+#include <stdarg.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+#include <vector>
+
+// PROJECT INCLUDES
+#include "devices/i2c.hpp"
+#include "devices/x86/i2c_sim.hpp"
+#include "utility/test_helpers.hpp"
+
+#if BTR_I2C_LINUX_DEV_ENABLED > 0
+
+namespace btr
+{
+
+//------------------------------------------------------------------------------
+
+/**
+ * Fake i2c-dev adapter. /dev/i2c-* files open /dev/null instead, and the i2c-dev ioctls on that
+ * descriptor run on a simulated bus. Everything else goes to the C library.
+ */
+struct FakeI2CDev
+{
+  void reset()
+  {
+    funcs = I2C_FUNC_I2C | I2C_FUNC_SMBUS_EMUL;
+    timeout = 0;
+    msgs.clear();
+    bus.resetStats();
+  }
+
+  int onIoctl(unsigned long request, void* arg)
+  {
+    switch (request) {
+      case I2C_FUNCS:
+        *static_cast<unsigned long*>(arg) = funcs;
+        return 0;
+      case I2C_TIMEOUT:
+        timeout = reinterpret_cast<unsigned long>(arg);
+        return 0;
+      case I2C_RDWR:
+        return onRdwr(static_cast<i2c_rdwr_ioctl_data*>(arg));
+      default:
+        errno = ENOTTY;
+        return -1;
+    }
+  }
+
+  int onRdwr(i2c_rdwr_ioctl_data* data)
+  {
+    msgs.push_back(data->nmsgs);
+
+    for (uint32_t i = 0; i < data->nmsgs; i++) {
+      i2c_msg& msg = data->msgs[i];
+      bool rd = (msg.flags & I2C_M_RD);
+
+      if (false == bus.start(msg.addr, rd)) {
+        bus.stop();
+        errno = ENXIO;
+        return -1;
+      }
+
+      for (uint16_t j = 0; j < msg.len; j++) {
+        if (rd) {
+          msg.buf[j] = bus.read(j + 1 < msg.len);
+        } else if (false == bus.write(msg.buf[j])) {
+          bus.stop();
+          errno = EREMOTEIO;
+          return -1;
+        }
+      }
+    }
+    bus.stop();
+    return data->nmsgs;
+  }
+
+  int fd = -1;
+  unsigned long funcs = 0;
+  unsigned long timeout = 0;
+  /** The number of messages in each I2C_RDWR call. */
+  std::vector<uint32_t> msgs;
+  I2CSim bus;
+};
+
+static FakeI2CDev fake;
+
+} // namespace btr
+
+extern "C" {
+
+int open(const char* path, int flags, ...)
+{
+  typedef int (*Open)(const char*, int, ...);
+  static Open next = reinterpret_cast<Open>(dlsym(RTLD_NEXT, "open"));
+
+  mode_t mode = 0;
+
+  if ((flags & O_CREAT) || (flags & O_TMPFILE) == O_TMPFILE) {
+    va_list args;
+    va_start(args, flags);
+    mode = va_arg(args, mode_t);
+    va_end(args);
+  }
+
+  if (0 == strncmp(path, "/dev/i2c-", 9)) {
+    btr::fake.fd = next("/dev/null", O_RDWR | O_CLOEXEC);
+    return btr::fake.fd;
+  }
+  return next(path, flags, mode);
+}
+
+int close(int fd)
+{
+  typedef int (*Close)(int);
+  static Close next = reinterpret_cast<Close>(dlsym(RTLD_NEXT, "close"));
+
+  if (fd == btr::fake.fd) {
+    btr::fake.fd = -1;
+  }
+  return next(fd);
+}
+
+int ioctl(int fd, unsigned long request, ...) __THROW
+{
+  typedef int (*Ioctl)(int, unsigned long, ...);
+  static Ioctl next = reinterpret_cast<Ioctl>(dlsym(RTLD_NEXT, "ioctl"));
+
+  va_list args;
+  va_start(args, request);
+  void* arg = va_arg(args, void*);
+  va_end(args);
+
+  if (fd >= 0 && fd == btr::fake.fd) {
+    return btr::fake.onIoctl(request, arg);
+  }
+  return next(fd, request, arg);
+}
+
+} // extern "C"
+
+namespace btr
+{
+
+class I2CDevTest : public testing::Test
+{
+public:
+
+  I2CDevTest()
+    :
+      i2c_(0)
+  {
+    fake.reset();
+    fake.bus.attach(0x50, &dev_);
+    i2c_.open();
+  }
+
+  ~I2CDevTest()
+  {
+    i2c_.close();
+    fake.bus.detach(0x50);
+  }
+
+protected:
+
+  I2C i2c_;
+  I2CSimDevice dev_;
+};
+
+//------------------------------------------------------------------------------
+
+// Tests {
+
+TEST_F(I2CDevTest, open)
+{
+  ASSERT_TRUE(i2c_.isOpen());
+  ASSERT_LE(0, fake.fd);
+  ASSERT_EQ(uint32_t((BTR_I2C_IO_TIMEOUT_MS + 9) / 10), fake.timeout);
+
+  i2c_.close();
+  ASSERT_EQ(-1, fake.fd);
+
+  // SMBus-only adapter
+  fake.funcs = I2C_FUNC_SMBUS_EMUL;
+  i2c_.open();
+  ASSERT_FALSE(i2c_.isOpen());
+  ASSERT_EQ(-1, fake.fd);
+  ASSERT_EQ(BTR_DEV_ENOTOPEN, i2c_.write(0x50, 0x10, uint8_t(1)));
+}
+
+TEST_F(I2CDevTest, registerAccess)
+{
+  ASSERT_EQ(3U, i2c_.write(0x50, 0x10, uint16_t(0x1234)));
+  ASSERT_EQ(0x1234, dev_.reg16(0x10));
+
+  uint16_t val = 0;
+  ASSERT_TRUE(is_ok(i2c_.read(0x50, 0x10, &val)));
+  ASSERT_EQ(0x1234, val);
+
+  // A plain read goes on after the last register read.
+  uint8_t buff[4] = { 0 };
+  dev_.setReg(0x12, 0x56);
+  ASSERT_TRUE(is_ok(i2c_.read(0x50, buff, sizeof(buff))));
+  ASSERT_EQ(0x56, buff[0]);
+
+  // One system call for each access, the register read in two messages.
+  ASSERT_EQ((std::vector<uint32_t>{ 1, 2, 1 }), fake.msgs);
+  ASSERT_EQ(1U, fake.bus.stats().repeated_starts);
+  ASSERT_EQ(3U, fake.bus.stats().stops);
+}
+
+TEST_F(I2CDevTest, absentDevice)
+{
+  ASSERT_EQ(BTR_DEV_ENOACK, i2c_.write(0x51, 0x10, uint8_t(1)));
+
+  uint8_t val = 0;
+  ASSERT_EQ(BTR_DEV_ENOACK, i2c_.read(0x51, 0x10, &val));
+  ASSERT_EQ(2U, fake.bus.stats().nacks);
+  ASSERT_EQ(2U, fake.bus.stats().stops);
+}
+
+TEST_F(I2CDevTest, scan)
+{
+  I2CSimDevice other;
+  fake.bus.attach(0x20, &other);
+
+  uint32_t rc = i2c_.scan();
+  fake.bus.detach(0x20);
+
+  ASSERT_TRUE(is_ok(rc));
+  ASSERT_EQ(2U, rc & 0xFFFF);
+  ASSERT_EQ(size_t(BTR_I2C_SCAN_MAX), fake.msgs.size());
+}
+
+// } Tests
+
+} // namespace btr
+
+#endif // BTR_I2C_LINUX_DEV_ENABLED > 0
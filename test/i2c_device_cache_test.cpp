@@ -0,0 +1,165 @@
+// Copyright (C) 2019 Sergey Kapustin <kapucin@gmail.com>
+
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+// SYSTEM INCLUDES
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <vector>
+
+// PROJECT INCLUDES
+#include "devices/i2c_device_cache.hpp"
+#include "utility/test_helpers.hpp"
+
+namespace btr
+{
+
+//------------------------------------------------------------------------------
+
+/**
+ * Stub of the ESP-IDF calls that add and remove devices on the bus, counting each call.
+ */
+struct FakeEspI2C
+{
+  struct Device
+  {
+    uint8_t addr;
+  };
+
+  typedef Device* Handle;
+
+  // i2c_master_bus_add_device()
+  Handle addDevice(uint8_t addr)
+  {
+    calls++;
+    adds++;
+
+    if (refuse) {
+      return nullptr;
+    }
+
+    Device* dev = new Device{ addr };
+    live.push_back(dev);
+    return dev;
+  }
+
+  // i2c_master_bus_rm_device()
+  void removeDevice(Handle dev)
+  {
+    calls++;
+    removes++;
+    removed.push_back(dev->addr);
+    live.erase(std::find(live.begin(), live.end(), dev));
+    delete dev;
+  }
+
+  ~FakeEspI2C()
+  {
+    for (Device* dev : live) {
+      delete dev;
+    }
+  }
+
+  bool refuse = false;
+  std::vector<Device*> live;
+  std::vector<uint8_t> removed;
+  uint32_t calls = 0;
+  uint32_t adds = 0;
+  uint32_t removes = 0;
+};
+
+typedef I2CDeviceCache<FakeEspI2C, 2> Cache2;
+
+//------------------------------------------------------------------------------
+
+// Tests {
+
+TEST(I2CDeviceCacheTest, reuseAndEvict)
+{
+  FakeEspI2C bus;
+  Cache2 cache(&bus);
+
+  FakeEspI2C::Handle a = cache.get(0x10);
+  FakeEspI2C::Handle b = cache.get(0x20);
+  ASSERT_NE(nullptr, a);
+  ASSERT_NE(nullptr, b);
+  ASSERT_EQ(2U, bus.adds);
+
+  // Known addresses don't touch the bus
+  ASSERT_EQ(a, cache.get(0x10));
+  ASSERT_EQ(b, cache.get(0x20));
+  ASSERT_EQ(a, cache.get(0x10));
+  ASSERT_EQ(2U, bus.calls);
+
+  // A third address replaces the least recently used one
+  FakeEspI2C::Handle c = cache.get(0x30);
+  ASSERT_EQ(0x30, c->addr);
+  ASSERT_EQ((std::vector<uint8_t>{ 0x20 }), bus.removed);
+  ASSERT_EQ(a, cache.get(0x10));
+  ASSERT_EQ(2U, cache.size());
+
+  cache.get(0x20);
+  ASSERT_EQ((std::vector<uint8_t>{ 0x20, 0x30 }), bus.removed);
+
+  cache.clear();
+  ASSERT_EQ(0U, cache.size());
+  ASSERT_TRUE(bus.live.empty());
+  ASSERT_EQ(bus.adds, bus.removes);
+}
+
+TEST(I2CDeviceCacheTest, addFails)
+{
+  FakeEspI2C bus;
+  Cache2 cache(&bus);
+
+  bus.refuse = true;
+  ASSERT_EQ(nullptr, cache.get(0x10));
+  ASSERT_EQ(0U, cache.size());
+
+  // The next use tries again
+  bus.refuse = false;
+  ASSERT_NE(nullptr, cache.get(0x10));
+  ASSERT_EQ(2U, bus.adds);
+  ASSERT_EQ(1U, cache.size());
+}
+
+TEST(I2CDeviceCacheTest, workingSet)
+{
+  const uint32_t USES = 100;
+  const uint8_t addrs[] = { 0x29, 0x1E, 0x68 };
+
+  // The addresses in use fit: each is added once, whatever the number of transfers
+  FakeEspI2C bus;
+  I2CDeviceCache<FakeEspI2C, 4> cache(&bus);
+
+  for (uint32_t i = 0; i < USES; i++) {
+    uint8_t addr = addrs[i % sizeof(addrs)];
+    FakeEspI2C::Handle dev = cache.get(addr);
+    ASSERT_NE(nullptr, dev);
+    ASSERT_EQ(addr, dev->addr);
+  }
+
+  ASSERT_EQ(sizeof(addrs), bus.adds);
+  ASSERT_EQ(0U, bus.removes);
+  ASSERT_EQ(sizeof(addrs), bus.calls);
+
+  // They don't: cycling through them evicts the next one each time
+  FakeEspI2C small_bus;
+  Cache2 small_cache(&small_bus);
+
+  for (uint32_t i = 0; i < USES; i++) {
+    ASSERT_NE(nullptr, small_cache.get(addrs[i % sizeof(addrs)]));
+  }
+
+  ASSERT_EQ(USES, small_bus.adds);
+  ASSERT_EQ(USES - 2, small_bus.removes);
+
+  TEST_MSG << "Device adds per " << USES << " lookups of " << sizeof(addrs) << " addresses: "
+    << bus.adds << " with 4 handles, " << small_bus.adds << " with 2" << std::endl;
+}
+
+// } Tests
+
+} // namespace btr
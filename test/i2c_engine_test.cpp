@@ -0,0 +1,635 @@
+// Copyright (C) 2019 Sergey Kapustin <kapucin@gmail.com>
+
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+// SYSTEM INCLUDES
+#include <gtest/gtest.h>
+#include <string.h>
+#include <vector>
+
+// PROJECT INCLUDES
+#include "devices/i2c_engine.hpp"
+#include "utility/test_helpers.hpp"
+
+namespace btr
+{
+
+//------------------------------------------------------------------------------
+
+/**
+ * Register model of an STM32F1 I2C master with one memory-like slave on the bus. The first byte
+ * written after the address sets the slave's register pointer, further bytes are written at the
+ * pointer, reads return bytes from the pointer on. The pointer advances on each byte.
+ *
+ * tick() moves the bus on by one step: an address, a data byte, a start or a stop condition. The
+ * flags behave like the hardware ones: SB, ADDR, TXE, RXNE and BTF stay set until the driver clears
+ * them the documented way, BTF of a finished write stays set until the next start or stop.
+ */
+struct FakeI2C
+{
+  typedef I2CEngine<FakeI2C> Engine;
+
+  /** Standard mode (100 kHz) timing in ns: a bit, start setup + hold, stop setup + bus free. */
+  static constexpr uint32_t BIT_NS = 10000;
+  static constexpr uint32_t START_NS = 4700 + 4000;
+  static constexpr uint32_t STOP_NS = 4000 + 4700;
+
+  typedef enum
+  {
+    BUS_IDLE,
+    BUS_START,
+    BUS_ADDR,
+    BUS_TX,
+    BUS_RX
+  } BusState;
+
+// Hal
+
+  uint16_t sr1()
+  {
+    uint16_t v = 0;
+
+    v |= (sb ? Engine::SR1_SB : 0);
+    v |= (addr ? Engine::SR1_ADDR : 0);
+    v |= (af ? Engine::SR1_AF : 0);
+
+    if (BUS_TX == state) {
+      v |= (tx_dr_full ? 0 : Engine::SR1_TXE);
+      v |= (tx_stall ? Engine::SR1_BTF : 0);
+    }
+
+    v |= (rx_dr_full ? Engine::SR1_RXNE : 0);
+    v |= (rx_dr_full && rx_shift_full ? Engine::SR1_BTF : 0);
+    return v;
+  }
+
+  uint16_t sr2()
+  {
+    if (addr) {
+      addr = false;
+      state = (rd_mode ? BUS_RX : BUS_TX);
+      slave_sending = rd_mode;
+      rx_count = 0;
+    }
+    return 0x0003;
+  }
+
+  void clearSr1(uint16_t bits)
+  {
+    af = af && 0 == (bits & Engine::SR1_AF);
+  }
+
+  uint8_t readDr()
+  {
+    uint8_t v = rx_dr;
+
+    if (false == rx_dr_full) {
+      bad_reads++;
+    }
+
+    rx_dr_full = rx_shift_full;
+    rx_dr = rx_shift;
+    rx_shift_full = false;
+    return v;
+  }
+
+  void writeDr(uint8_t value)
+  {
+    if (sb) {
+      sb = false;
+      addr_pending = true;
+      addr_byte = value;
+    } else if (BUS_TX == state) {
+      tx_stall = false;
+
+      if (false == tx_shift_full) {
+        tx_shift = value;
+        tx_shift_full = true;
+      } else if (false == tx_dr_full) {
+        tx_dr = value;
+        tx_dr_full = true;
+      } else {
+        bad_writes++;
+      }
+    } else {
+      bad_writes++;
+    }
+  }
+
+  void start()
+  {
+    start_req = true;
+  }
+
+  void stop()
+  {
+    stop_req = true;
+  }
+
+  void setAck(bool on)
+  {
+    ack = on;
+  }
+
+  void setPos(bool on)
+  {
+    pos = on;
+  }
+
+  void enableBufferIrq(bool on)
+  {
+    itbuf = on;
+  }
+
+  void reset()
+  {
+    resets++;
+    state = BUS_IDLE;
+    start_req = stop_req = sb = addr = af = addr_pending = false;
+    tx_dr_full = tx_shift_full = tx_stall = false;
+    rx_dr_full = rx_shift_full = slave_sending = false;
+  }
+
+  void lock()
+  {
+    locks++;
+  }
+
+  void unlock()
+  {
+  }
+
+// Bus
+
+  bool evtPending()
+  {
+    uint16_t v = sr1();
+    uint16_t buf = (itbuf ? Engine::SR1_TXE | Engine::SR1_RXNE : 0);
+    return 0 != (v & (Engine::SR1_SB | Engine::SR1_ADDR | Engine::SR1_BTF | buf));
+  }
+
+  bool errPending()
+  {
+    return af;
+  }
+
+  void tick()
+  {
+    if (addr_pending) {
+      addr_pending = false;
+      bus_ns += 9 * BIT_NS;
+      rd_mode = addr_byte & 1;
+
+      if (present && (addr_byte >> 1) == slave_addr) {
+        addr = true;
+        state = BUS_ADDR;
+        first_write = true;
+        tx_count = 0;
+      } else {
+        af = true;
+      }
+      return;
+    }
+
+    if (BUS_TX == state && tx_shift_full) {
+      bus_ns += 9 * BIT_NS;
+
+      if (first_write) {
+        ptr = tx_shift;
+        first_write = false;
+      } else {
+        mem[ptr++] = tx_shift;
+      }
+
+      if (nack_write_at == int(tx_count++)) {
+        // The master drops what it had queued
+        af = true;
+        tx_dr_full = tx_shift_full = false;
+        return;
+      }
+
+      tx_shift_full = tx_dr_full;
+      tx_shift = tx_dr;
+      tx_dr_full = false;
+      tx_stall = (false == tx_shift_full);
+      return;
+    }
+
+    if (BUS_RX == state && slave_sending && false == rx_shift_full) {
+      uint8_t b = mem[ptr++];
+      // With POS, ACK applies to the byte after the current one.
+      bool acked = (pos && 0 == rx_count ? true : ack);
+      bus_ns += 9 * BIT_NS;
+
+      rx_count++;
+      nacked += (acked ? 0 : 1);
+      slave_sending = acked;
+
+      if (false == rx_dr_full) {
+        rx_dr = b;
+        rx_dr_full = true;
+      } else {
+        rx_shift = b;
+        rx_shift_full = true;
+      }
+      return;
+    }
+
+    bool quiet = false == addr && false == sb && false == (BUS_TX == state && tx_shift_full) &&
+      false == (BUS_RX == state && slave_sending);
+
+    if (stop_req && quiet) {
+      stop_req = false;
+      stops++;
+      bus_ns += STOP_NS;
+      state = BUS_IDLE;
+      tx_stall = false;
+    } else if (start_req && quiet) {
+      start_req = false;
+      starts++;
+      bus_ns += START_NS;
+      sb = true;
+      state = BUS_START;
+      tx_stall = false;
+    }
+  }
+
+  /**
+   * Run the interrupts and the bus until the transaction is done.
+   *
+   * @return false if it didn't finish
+   */
+  bool run(Engine* engine, I2CTransaction* t, uint32_t max_steps = 10000)
+  {
+    for (uint32_t i = 0; i < max_steps && false == t->done; i++) {
+      if (errPending()) {
+        engine->onError();
+        irqs++;
+      } else if (evtPending()) {
+        engine->onEvent();
+        irqs++;
+      }
+      tick();
+    }
+    return t->done;
+  }
+
+  // Slave
+  uint8_t slave_addr = 0x29;
+  bool present = true;
+  uint8_t mem[256] = {};
+  uint8_t ptr = 0;
+  int nack_write_at = -1;
+  bool first_write = false;
+  uint32_t tx_count = 0;
+
+  // Master
+  BusState state = BUS_IDLE;
+  bool start_req = false;
+  bool stop_req = false;
+  bool ack = false;
+  bool pos = false;
+  bool itbuf = false;
+  bool sb = false;
+  bool addr = false;
+  bool af = false;
+  bool rd_mode = false;
+  bool addr_pending = false;
+  uint8_t addr_byte = 0;
+  bool tx_dr_full = false;
+  bool tx_shift_full = false;
+  bool tx_stall = false;
+  uint8_t tx_dr = 0;
+  uint8_t tx_shift = 0;
+  bool rx_dr_full = false;
+  bool rx_shift_full = false;
+  bool slave_sending = false;
+  uint8_t rx_dr = 0;
+  uint8_t rx_shift = 0;
+  uint32_t rx_count = 0;
+
+  // Stats
+  uint32_t starts = 0;
+  uint32_t stops = 0;
+  uint32_t resets = 0;
+  uint32_t locks = 0;
+  uint32_t irqs = 0;
+  uint32_t nacked = 0;
+  uint32_t bad_reads = 0;
+  uint32_t bad_writes = 0;
+  uint64_t bus_ns = 0;
+};
+
+typedef I2CEngine<FakeI2C> Engine;
+
+static void recordDone(I2CTransaction* t)
+{
+  static_cast<std::vector<I2CTransaction*>*>(t->arg)->push_back(t);
+}
+
+//------------------------------------------------------------------------------
+
+// Tests {
+
+TEST(I2CEngineTest, writeRegister)
+{
+  FakeI2C bus;
+  Engine engine(&bus);
+  uint8_t data[] = { 0xA1, 0xB2, 0xC3, 0xD4 };
+  I2CTransaction t;
+
+  t.addr = 0x29;
+  t.cmd[0] = 0x10;
+  t.cmd_bytes = 1;
+  t.wr = data;
+  t.wr_bytes = sizeof(data);
+
+  ASSERT_EQ(BTR_DEV_ENOERR, engine.submit(&t));
+  ASSERT_TRUE(engine.busy());
+  ASSERT_TRUE(bus.run(&engine, &t));
+
+  ASSERT_EQ(BTR_DEV_ENOERR | 5U, t.status);
+  ASSERT_FALSE(engine.busy());
+  ASSERT_EQ(0, memcmp(data, bus.mem + 0x10, sizeof(data)));
+
+  // Let the stop out
+  bus.tick();
+  ASSERT_EQ(1U, bus.starts);
+  ASSERT_EQ(1U, bus.stops);
+  ASSERT_EQ(0U, bus.bad_writes);
+}
+
+TEST(I2CEngineTest, readLengths)
+{
+  FakeI2C bus;
+  Engine engine(&bus);
+
+  for (int i = 0; i < 256; i++) {
+    bus.mem[i] = uint8_t(i * 3 + 1);
+  }
+
+  // Each length takes another path: 1 byte, 2 bytes with POS, 3 and more with BTF
+  for (uint16_t n = 1; n <= 9; n++) {
+    uint8_t buff[16] = {};
+    I2CTransaction t;
+
+    t.addr = 0x29;
+    t.cmd[0] = uint8_t(0x40 + n);
+    t.cmd_bytes = 1;
+    t.rd = buff;
+    t.rd_bytes = n;
+
+    uint32_t starts = bus.starts;
+    uint32_t nacked = bus.nacked;
+    ASSERT_EQ(BTR_DEV_ENOERR, engine.submit(&t));
+    ASSERT_TRUE(bus.run(&engine, &t)) << n;
+    bus.tick();
+
+    ASSERT_EQ(BTR_DEV_ENOERR | uint32_t(1 + n), t.status) << n;
+    ASSERT_EQ(0, memcmp(bus.mem + 0x40 + n, buff, n)) << n;
+    ASSERT_EQ(0, buff[n]) << n;
+
+    // Repeated start between register and data, only the last byte NACKed
+    ASSERT_EQ(starts + 2, bus.starts) << n;
+    ASSERT_EQ(nacked + 1, bus.nacked) << n;
+    ASSERT_EQ(FakeI2C::BUS_IDLE, bus.state) << n;
+  }
+
+  ASSERT_EQ(0U, bus.bad_reads);
+  ASSERT_EQ(0U, bus.bad_writes);
+}
+
+TEST(I2CEngineTest, readWithoutCommand)
+{
+  FakeI2C bus;
+  Engine engine(&bus);
+  uint8_t buff[4] = {};
+  I2CTransaction t;
+
+  bus.mem[7] = 0x77;
+  bus.mem[8] = 0x88;
+  bus.mem[9] = 0x99;
+  bus.ptr = 7;
+
+  // Reads from the slave's current pointer, no write phase
+  t.addr = 0x29;
+  t.rd = buff;
+  t.rd_bytes = 3;
+  engine.submit(&t);
+  ASSERT_TRUE(bus.run(&engine, &t));
+
+  ASSERT_EQ(BTR_DEV_ENOERR | 3U, t.status);
+  ASSERT_EQ(1U, bus.starts);
+  ASSERT_EQ(0x77, buff[0]);
+  ASSERT_EQ(0x88, buff[1]);
+  ASSERT_EQ(0x99, buff[2]);
+}
+
+TEST(I2CEngineTest, probe)
+{
+  FakeI2C bus;
+  Engine engine(&bus);
+  I2CTransaction t;
+
+  t.addr = 0x29;
+  engine.submit(&t);
+  ASSERT_TRUE(bus.run(&engine, &t));
+  ASSERT_EQ(BTR_DEV_ENOERR, t.status);
+
+  t.addr = 0x30;
+  engine.submit(&t);
+  ASSERT_TRUE(bus.run(&engine, &t));
+  ASSERT_EQ(BTR_DEV_ENOACK, t.status);
+  ASSERT_FALSE(engine.busy());
+}
+
+TEST(I2CEngineTest, queueInOrder)
+{
+  FakeI2C bus;
+  Engine engine(&bus);
+  std::vector<I2CTransaction*> done;
+  uint8_t data[3][2] = { { 1, 2 }, { 3, 4 }, { 5, 6 } };
+  uint8_t buff[6] = {};
+  I2CTransaction t[4];
+
+  // Three writes, one to a missing device in the middle, then a read back
+  for (int i = 0; i < 3; i++) {
+    t[i].addr = (i == 1 ? 0x50 : 0x29);
+    t[i].cmd[0] = uint8_t(0x20 + i * 2);
+    t[i].cmd_bytes = 1;
+    t[i].wr = data[i];
+    t[i].wr_bytes = 2;
+  }
+
+  t[3].addr = 0x29;
+  t[3].cmd[0] = 0x20;
+  t[3].cmd_bytes = 1;
+  t[3].rd = buff;
+  t[3].rd_bytes = sizeof(buff);
+
+  for (auto& x : t) {
+    x.callback = recordDone;
+    x.arg = &done;
+    ASSERT_EQ(BTR_DEV_ENOERR, engine.submit(&x));
+  }
+
+  // Only the first one is on the bus
+  ASSERT_EQ(0U, bus.starts);
+  ASSERT_TRUE(bus.start_req);
+
+  ASSERT_TRUE(bus.run(&engine, &t[3]));
+
+  ASSERT_EQ((std::vector<I2CTransaction*>{ &t[0], &t[1], &t[2], &t[3] }), done);
+  ASSERT_EQ(BTR_DEV_ENOERR | 3U, t[0].status);
+  ASSERT_EQ(BTR_DEV_ENOACK, t[1].status);
+  ASSERT_EQ(BTR_DEV_ENOERR | 3U, t[2].status);
+  ASSERT_EQ(BTR_DEV_ENOERR | 7U, t[3].status);
+
+  uint8_t expected[] = { 1, 2, 0, 0, 5, 6 };
+  ASSERT_EQ(0, memcmp(expected, buff, sizeof(buff)));
+  ASSERT_FALSE(engine.busy());
+}
+
+TEST(I2CEngineTest, dataNack)
+{
+  FakeI2C bus;
+  Engine engine(&bus);
+  uint8_t data[] = { 1, 2, 3, 4 };
+  I2CTransaction t;
+
+  // The slave refuses the second data byte
+  bus.nack_write_at = 2;
+  t.addr = 0x29;
+  t.cmd[0] = 0x10;
+  t.cmd_bytes = 1;
+  t.wr = data;
+  t.wr_bytes = sizeof(data);
+  engine.submit(&t);
+
+  ASSERT_TRUE(bus.run(&engine, &t));
+  ASSERT_EQ(BTR_DEV_ENOACK, t.status & 0xFFFF0000);
+  ASSERT_FALSE(bus.af);
+
+  bus.tick();
+  ASSERT_EQ(1U, bus.stops);
+}
+
+TEST(I2CEngineTest, abortStuckBus)
+{
+  FakeI2C bus;
+  Engine engine(&bus);
+  std::vector<I2CTransaction*> done;
+  uint8_t data[] = { 9 };
+  I2CTransaction t1;
+  I2CTransaction t2;
+  I2CTransaction t3;
+
+  for (I2CTransaction* t : { &t1, &t2, &t3 }) {
+    t->addr = 0x29;
+    t->cmd[0] = 0x30;
+    t->cmd_bytes = 1;
+    t->wr = data;
+    t->wr_bytes = 1;
+    t->callback = recordDone;
+    t->arg = &done;
+    engine.submit(t);
+  }
+
+  // The bus never moves: the caller times out and aborts, the queued one is removed too
+  ASSERT_TRUE(engine.abort(&t2));
+  ASSERT_EQ(BTR_DEV_ETIMEOUT, t2.status);
+  ASSERT_TRUE(t2.done);
+
+  ASSERT_TRUE(engine.abort(&t1));
+  ASSERT_EQ(BTR_DEV_ETIMEOUT, t1.status);
+  ASSERT_EQ(1U, bus.resets);
+  ASSERT_TRUE(done.empty());
+
+  // The next one starts on the reset peripheral
+  ASSERT_TRUE(bus.start_req);
+  ASSERT_TRUE(bus.run(&engine, &t3));
+  ASSERT_EQ(BTR_DEV_ENOERR | 2U, t3.status);
+  ASSERT_EQ(9, bus.mem[0x30]);
+  ASSERT_FALSE(engine.abort(&t3));
+}
+
+TEST(I2CEngineTest, repeatedStartBusTime)
+{
+  FakeI2C bus;
+  Engine engine(&bus);
+  uint8_t buff[2] = {};
+
+  bus.mem[0x14] = 0x12;
+  bus.mem[0x15] = 0x34;
+
+  // Register read with a stop in between: S addr+W reg P, S addr+R data P
+  I2CTransaction wr;
+  wr.addr = 0x29;
+  wr.cmd[0] = 0x14;
+  wr.cmd_bytes = 1;
+  engine.submit(&wr);
+  ASSERT_TRUE(bus.run(&engine, &wr));
+
+  I2CTransaction rd;
+  rd.addr = 0x29;
+  rd.rd = buff;
+  rd.rd_bytes = sizeof(buff);
+  engine.submit(&rd);
+  ASSERT_TRUE(bus.run(&engine, &rd));
+  bus.tick();
+
+  uint64_t split_ns = bus.bus_ns;
+  ASSERT_EQ(0x12, buff[0]);
+  ASSERT_EQ(0x34, buff[1]);
+  ASSERT_EQ(2U, bus.stops);
+
+  // One transaction: S addr+W reg Sr addr+R data P
+  I2CTransaction t;
+  t.addr = 0x29;
+  t.cmd[0] = 0x14;
+  t.cmd_bytes = 1;
+  t.rd = buff;
+  t.rd_bytes = sizeof(buff);
+  memset(buff, 0, sizeof(buff));
+  bus.bus_ns = 0;
+  engine.submit(&t);
+  ASSERT_TRUE(bus.run(&engine, &t));
+  bus.tick();
+
+  uint64_t combined_ns = bus.bus_ns;
+  ASSERT_EQ(0x12, buff[0]);
+  ASSERT_EQ(0x34, buff[1]);
+  ASSERT_EQ(3U, bus.stops);
+
+  // The stop and the bus free time before the second start are saved
+  ASSERT_EQ(split_ns - FakeI2C::STOP_NS, combined_ns);
+  TEST_MSG << "2-byte register read at 100 kHz: " << split_ns / 1000 << " us with stop, "
+    << combined_ns / 1000 << " us with repeated start" << std::endl;
+}
+
+TEST(I2CEngineTest, interruptsPerByte)
+{
+  FakeI2C bus;
+  Engine engine(&bus);
+  uint8_t buff[64] = {};
+  I2CTransaction t;
+
+  t.addr = 0x29;
+  t.cmd[0] = 0;
+  t.cmd_bytes = 1;
+  t.rd = buff;
+  t.rd_bytes = sizeof(buff);
+  engine.submit(&t);
+  ASSERT_TRUE(bus.run(&engine, &t));
+  ASSERT_EQ(BTR_DEV_ENOERR | 65U, t.status);
+
+  // Roughly one interrupt per byte, the task sleeps through all of them
+  ASSERT_GT(2 * 65U, bus.irqs);
+  TEST_MSG << "Interrupts for 1 + 64 bytes: " << bus.irqs << std::endl;
+}
+
+// } Tests
+
+} // namespace btr
@@ -0,0 +1,121 @@
+// Copyright (C) 2019 Sergey Kapustin <kapucin@gmail.com>
+
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+// SYSTEM INCLUDES
+#include <gtest/gtest.h>
+#include <string.h>
+
+// PROJECT INCLUDES
+#include "devices/i2c.hpp"
+#include "utility/test_helpers.hpp"
+
+#if BTR_I2C_LINUX_DEV_ENABLED == 0
+
+namespace btr
+{
+
+//------------------------------------------------------------------------------
+
+class I2CSimTest : public testing::Test
+{
+public:
+
+  I2CSimTest()
+    :
+      i2c_(I2C::instance(0, true))
+  {
+    i2c_->sim()->attach(0x50, &dev_);
+    i2c_->sim()->resetStats();
+  }
+
+  ~I2CSimTest()
+  {
+    i2c_->sim()->detach(0x50);
+  }
+
+protected:
+
+  I2C* i2c_;
+  I2CSimDevice dev_;
+};
+
+//------------------------------------------------------------------------------
+
+// Tests {
+
+TEST_F(I2CSimTest, registerAccess)
+{
+  ASSERT_TRUE(is_ok(i2c_->write(0x50, 0x10, uint16_t(0x1234))));
+  ASSERT_EQ(0x1234, dev_.reg16(0x10));
+
+  uint16_t val = 0;
+  ASSERT_TRUE(is_ok(i2c_->read(0x50, 0x10, &val)));
+  ASSERT_EQ(0x1234, val);
+
+  const uint8_t wbuff[] = { 1, 2, 3, 4, 5 };
+  uint8_t rbuff[sizeof(wbuff)] = { 0 };
+  ASSERT_TRUE(is_ok(i2c_->write(0x50, 0xFE, wbuff, sizeof(wbuff))));
+  ASSERT_EQ(1, dev_.reg(0xFE));
+  ASSERT_EQ(3, dev_.reg(0x00));
+  ASSERT_TRUE(is_ok(i2c_->read(0x50, 0xFE, rbuff, sizeof(rbuff))));
+  ASSERT_EQ(0, memcmp(wbuff, rbuff, sizeof(wbuff)));
+}
+
+TEST_F(I2CSimTest, absentDevice)
+{
+  ASSERT_EQ(BTR_DEV_ENOACK, i2c_->write(0x51, 0x10, uint8_t(1)) & 0xFFFF0000);
+
+  const I2CSim::Stats& stats = i2c_->sim()->stats();
+  ASSERT_EQ(1U, stats.starts);
+  ASSERT_EQ(1U, stats.stops);
+  ASSERT_EQ(1U, stats.nacks);
+}
+
+TEST_F(I2CSimTest, scan)
+{
+  I2CSimDevice other;
+  i2c_->sim()->attach(0x20, &other);
+
+  uint32_t rc = i2c_->scan();
+  i2c_->sim()->detach(0x20);
+
+  ASSERT_TRUE(is_ok(rc));
+  ASSERT_EQ(2U, rc & 0xFFFF);
+  ASSERT_EQ(uint32_t(BTR_I2C_SCAN_MAX), i2c_->sim()->stats().stops);
+}
+
+TEST_F(I2CSimTest, registerReadBusTime)
+{
+  uint8_t buff[2];
+  ASSERT_TRUE(is_ok(i2c_->read(0x50, 0x10, buff, sizeof(buff))));
+
+  // Address, register, repeated start, address, two data bytes.
+  const I2CSim::Stats& stats = i2c_->sim()->stats();
+  ASSERT_EQ(2U, stats.starts);
+  ASSERT_EQ(1U, stats.repeated_starts);
+  ASSERT_EQ(1U, stats.stops);
+  ASSERT_EQ(5U, stats.bytes);
+
+  // Standard mode: 9 bits of 10 us per byte, 8.7 us for a start and for a stop.
+  I2CSim sim(100000);
+  sim.attach(0x50, &dev_);
+  sim.start(0x50, false);
+  sim.write(0x10);
+  sim.start(0x50, true);
+  sim.read(true);
+  sim.read(false);
+  sim.stop();
+  ASSERT_EQ(5U * 90000 + 3 * 8700, sim.stats().bus_ns);
+
+  TEST_MSG << "2-byte register read at " << BTR_I2C_SPEED << " Hz: " << stats.bus_ns / 1000.0
+    << " us" << std::endl;
+}
+
+// } Tests
+
+} // namespace btr
+
+#endif // BTR_I2C_LINUX_DEV_ENABLED == 0
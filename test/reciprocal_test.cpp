@@ -0,0 +1,115 @@
+// Copyright (C) 2019 Sergey Kapustin <kapucin@gmail.com>
+
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+// SYSTEM INCLUDES
+#include <gtest/gtest.h>
+#include <chrono>
+#include <random>
+#include <vector>
+
+// PROJECT INCLUDES
+#include "devices/defines.hpp"
+#include "devices/reciprocal.hpp"
+#include "utility/test_helpers.hpp"
+
+using namespace std::chrono;
+
+namespace btr
+{
+
+//------------------------------------------------------------------------------
+
+/** Divisors of interest: small ones, powers of two and around them, the VL53L0X macro periods. */
+static const uint32_t DIVISORS[] = {
+  1, 2, 3, 5, 7, 10, 100, 641, 1000, 1024, 65535, 65536, 65537,
+  BTR_VL53L0X_CALC_PERIOD(8), BTR_VL53L0X_CALC_PERIOD(10), BTR_VL53L0X_CALC_PERIOD(12),
+  BTR_VL53L0X_CALC_PERIOD(14), BTR_VL53L0X_CALC_PERIOD(16), BTR_VL53L0X_CALC_PERIOD(18),
+  0x7FFFFFFF, 0x80000000, 0x80000001, 0xFFFFFFFE, 0xFFFFFFFF
+};
+
+//------------------------------------------------------------------------------
+
+// Tests {
+
+TEST(ReciprocalTest, boundaries)
+{
+  for (uint32_t d : DIVISORS) {
+    Reciprocal r = makeReciprocal(d);
+    std::vector<uint32_t> n = {0, 1, d - 1, d, UINT32_MAX - 1, UINT32_MAX};
+
+    // Both sides of quotient steps across the whole range.
+    for (uint64_t q = 1; q * d <= UINT32_MAX; q = q * 3 + 1) {
+      n.push_back(uint32_t(q * d - 1));
+      n.push_back(uint32_t(q * d));
+    }
+
+    for (uint32_t v : n) {
+      ASSERT_EQ(v / d, divide(v, r)) << " n: " << v << ", d: " << d;
+    }
+  }
+}
+
+TEST(ReciprocalTest, random)
+{
+  std::mt19937 gen(20190101);
+
+  for (uint32_t d : DIVISORS) {
+    Reciprocal r = makeReciprocal(d);
+
+    for (int i = 0; i < 100000; i++) {
+      uint32_t v = gen();
+      ASSERT_EQ(v / d, divide(v, r)) << " n: " << v << ", d: " << d;
+    }
+  }
+
+  for (int i = 0; i < 10000; i++) {
+    uint32_t d = gen() >> (gen() & 31);
+
+    if (0 == d) {
+      continue;
+    }
+
+    Reciprocal r = makeReciprocal(d);
+
+    for (int j = 0; j < 100; j++) {
+      uint32_t v = gen();
+      ASSERT_EQ(v / d, divide(v, r)) << " n: " << v << ", d: " << d;
+    }
+  }
+}
+
+TEST(ReciprocalTest, speed)
+{
+  const int rounds = 10000000;
+  // volatile keeps the compiler from turning the division into a multiplication by itself.
+  volatile uint32_t d = 1000;
+  Reciprocal r = makeReciprocal(d);
+  uint32_t div_sum = 0, rcp_sum = 0;
+
+  high_resolution_clock::time_point start = high_resolution_clock::now();
+
+  for (int i = 0; i < rounds; i++) {
+    div_sum += uint32_t(i * 2654435761U) / d;
+  }
+
+  int64_t div_us = duration_cast<microseconds>(high_resolution_clock::now() - start).count();
+  start = high_resolution_clock::now();
+
+  for (int i = 0; i < rounds; i++) {
+    rcp_sum += divide(uint32_t(i * 2654435761U), r);
+  }
+
+  int64_t rcp_us = duration_cast<microseconds>(high_resolution_clock::now() - start).count();
+
+  ASSERT_EQ(div_sum, rcp_sum);
+
+  TEST_MSG << "Division: " << (double(div_us) * 1000 / rounds) << " ns, reciprocal: "
+    << (double(rcp_us) * 1000 / rounds) << " ns" << std::endl;
+}
+
+// } Tests
+
+} // namespace btr
@@ -0,0 +1,350 @@
+// Copyright (C) 2019 Sergey Kapustin <kapucin@gmail.com>
+
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+// SYSTEM INCLUDES
+#include <gtest/gtest.h>
+#include <thread>
+#include <chrono>
+#include <vector>
+#include <mutex>
+#include <condition_variable>
+
+// PROJECT INCLUDES
+#include "devices/spsc_ring.hpp"
+#include "utility/test_helpers.hpp"
+
+using namespace std::chrono;
+
+namespace btr
+{
+
+//------------------------------------------------------------------------------
+
+/**
+ * Stream a sequence of bytes through the ring from a producer thread, standing in for an ISR, and
+ * check the order on the consumer side.
+ *
+ * @return elapsed microseconds, or -1 if the sequence broke
+ */
+template<size_t N>
+static int64_t streamBytes(size_t total, size_t chunk)
+{
+  SpscRing<uint8_t, N>* ring = new SpscRing<uint8_t, N>();
+
+  high_resolution_clock::time_point start = high_resolution_clock::now();
+
+  std::thread producer([ring, total, chunk]() {
+    std::vector<uint8_t> buff(chunk);
+    size_t sent = 0;
+
+    while (sent < total) {
+      size_t n = std::min(chunk, total - sent);
+
+      for (size_t i = 0; i < n; i++) {
+        buff[i] = uint8_t(sent + i);
+      }
+
+      size_t pushed = (chunk == 1 ? ring->push(buff[0]) : ring->pushN(buff.data(), n));
+
+      // Let the consumer run on a single-core host
+      if (pushed == 0) {
+        std::this_thread::yield();
+      }
+      sent += pushed;
+    }
+  });
+
+  std::vector<uint8_t> buff(chunk);
+  size_t received = 0;
+  bool ok = true;
+
+  while (received < total) {
+    size_t n = 0;
+
+    if (chunk == 1) {
+      n = ring->pop(buff.data());
+    } else {
+      n = ring->popN(buff.data(), std::min(chunk, total - received));
+    }
+
+    if (n == 0) {
+      std::this_thread::yield();
+    }
+
+    for (size_t i = 0; i < n; i++) {
+      ok = ok && (buff[i] == uint8_t(received + i));
+    }
+    received += n;
+  }
+
+  producer.join();
+  int64_t us = duration_cast<microseconds>(high_resolution_clock::now() - start).count();
+  delete ring;
+  return (ok ? us : -1);
+}
+
+/**
+ * Stand-in for an RX interrupt and a task notification. The ISR thread pushes one byte per gap and
+ * notifies the reader once the bytes it waits for are in, like Usart's onRecv on STM32.
+ */
+class IsrSim
+{
+public:
+
+  typedef SpscRing<uint8_t, 64> Ring;
+
+  void start(size_t bytes, uint32_t gap_us)
+  {
+    isr_ = std::thread([this, bytes, gap_us]() {
+      for (size_t i = 0; i < bytes; i++) {
+        std::this_thread::sleep_for(microseconds(gap_us));
+
+        while (false == ring_.push(uint8_t(i))) {
+          std::this_thread::yield();
+        }
+        last_push_ = high_resolution_clock::now();
+
+        if (ring_.size() >= __atomic_load_n(&wanted_, __ATOMIC_ACQUIRE) || ring_.full()) {
+          notify();
+        }
+      }
+    });
+  }
+
+  void join()
+  {
+    isr_.join();
+  }
+
+  /** The wait callable of SpscRing::popWait, like ulTaskNotifyTake. */
+  bool wait(size_t missing, uint32_t timeout_ms)
+  {
+    __atomic_store_n(&wanted_, std::min(missing, ring_.capacity()), __ATOMIC_RELEASE);
+
+    if (ring_.size() >= __atomic_load_n(&wanted_, __ATOMIC_ACQUIRE)) {
+      return true;
+    }
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    wakeups_++;
+    bool notified = cv_.wait_for(lock, milliseconds(timeout_ms), [this]() { return notified_; });
+    notified_ = false;
+    return notified;
+  }
+
+  Ring ring_;
+  size_t wanted_ = 1;
+  uint32_t wakeups_ = 0;
+  high_resolution_clock::time_point last_push_;
+
+private:
+
+  void notify()
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    notified_ = true;
+    cv_.notify_one();
+  }
+
+  std::thread isr_;
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  bool notified_ = false;
+};
+
+//------------------------------------------------------------------------------
+
+// Tests {
+
+TEST(SpscRingTest, pushPop)
+{
+  SpscRing<uint8_t, 8> ring;
+  uint8_t v = 0;
+
+  ASSERT_EQ(7U, ring.capacity());
+  ASSERT_TRUE(ring.empty());
+  ASSERT_FALSE(ring.pop(&v));
+
+  // Go around a few times
+  for (uint8_t round = 0; round < 3; round++) {
+    for (uint8_t i = 0; i < 7; i++) {
+      ASSERT_TRUE(ring.push(i + round));
+    }
+    ASSERT_TRUE(ring.full());
+    ASSERT_FALSE(ring.push(0xFF));
+    ASSERT_EQ(7U, ring.size());
+
+    for (uint8_t i = 0; i < 7; i++) {
+      ASSERT_TRUE(ring.pop(&v));
+      ASSERT_EQ(i + round, v);
+    }
+    ASSERT_TRUE(ring.empty());
+  }
+}
+
+TEST(SpscRingTest, bulkWrap)
+{
+  SpscRing<uint16_t, 16> ring;
+  uint16_t in[20];
+  uint16_t out[20] = {};
+
+  for (uint16_t i = 0; i < 20; i++) {
+    in[i] = 1000 + i;
+  }
+
+  // Move the indices to the middle so the bulk copies split
+  ASSERT_EQ(10U, ring.pushN(in, 10));
+  ASSERT_EQ(10U, ring.popN(out, 10));
+
+  ASSERT_EQ(15U, ring.pushN(in, 20));
+  ASSERT_EQ(0U, ring.pushN(in, 1));
+  ASSERT_EQ(15U, ring.size());
+  ASSERT_EQ(15U, ring.popN(out, 20));
+  ASSERT_EQ(0, memcmp(in, out, 15 * sizeof(uint16_t)));
+  ASSERT_EQ(0U, ring.popN(out, 1));
+}
+
+TEST(SpscRingTest, peekConsume)
+{
+  SpscRing<uint8_t, 16> ring;
+  uint8_t in[12];
+  const uint8_t* data = nullptr;
+
+  for (uint8_t i = 0; i < sizeof(in); i++) {
+    in[i] = i;
+  }
+
+  ASSERT_EQ(0U, ring.peek(&data));
+
+  // Start at slot 10, so 12 elements span slots 10-15 and 0-5
+  ASSERT_EQ(10U, ring.pushN(in, 10));
+  ring.consume(10);
+  ASSERT_EQ(12U, ring.pushN(in, 12));
+
+  ASSERT_EQ(6U, ring.peek(&data));
+  ASSERT_EQ(0, memcmp(in, data, 6));
+  ring.consume(6);
+
+  ASSERT_EQ(6U, ring.peek(&data));
+  ASSERT_EQ(0, memcmp(in + 6, data, 6));
+  ring.consume(6);
+
+  ASSERT_TRUE(ring.empty());
+
+  ring.pushN(in, 5);
+  ring.clear();
+  ASSERT_TRUE(ring.empty());
+}
+
+TEST(SpscRingTest, wideIndex)
+{
+  SpscRing<uint8_t, 1024> ring;
+  std::vector<uint8_t> in(1700);
+  std::vector<uint8_t> out(1700);
+
+  ASSERT_EQ(2U, sizeof(SpscRing<uint8_t, 1024>::IndexType));
+  ASSERT_EQ(1U, sizeof(SpscRing<uint8_t, 256>::IndexType));
+
+  for (size_t i = 0; i < in.size(); i++) {
+    in[i] = uint8_t(i * 7);
+  }
+
+  ASSERT_EQ(1023U, ring.pushN(in.data(), in.size()));
+  ASSERT_EQ(600U, ring.popN(out.data(), 600));
+  ASSERT_EQ(600U, ring.pushN(in.data() + 1023, 600));
+  ASSERT_EQ(1023U, ring.popN(out.data() + 600, 1100));
+  ASSERT_EQ(0, memcmp(in.data(), out.data(), 1623));
+}
+
+TEST(SpscRingTest, popWaitLatency)
+{
+  const size_t BYTES = 48;
+  const uint32_t TIMEOUT_MS = 100;
+  IsrSim sim;
+  uint8_t buff[BYTES] = {};
+
+  sim.start(BYTES, 200);
+
+  size_t n = sim.ring_.popWait(buff, BYTES,
+      [&sim](size_t missing) { return sim.wait(missing, TIMEOUT_MS); });
+  high_resolution_clock::time_point done = high_resolution_clock::now();
+
+  sim.join();
+  ASSERT_EQ(BYTES, n);
+
+  for (size_t i = 0; i < BYTES; i++) {
+    ASSERT_EQ(uint8_t(i), buff[i]);
+  }
+
+  // The reader is woken once the requested bytes are in, not on every byte or after a time-out.
+  auto latency = duration_cast<microseconds>(done - sim.last_push_).count();
+  ASSERT_GT(20000, latency);
+  ASSERT_GE(2U, sim.wakeups_);
+
+  TEST_MSG << "Latency after the last byte: " << latency << " us, wake-ups: " << sim.wakeups_
+    << " for " << BYTES << " bytes" << std::endl;
+}
+
+TEST(SpscRingTest, popWaitTimeout)
+{
+  const uint32_t TIMEOUT_MS = 30;
+  IsrSim sim;
+  uint8_t buff[20] = {};
+
+  // Fewer bytes arrive than requested
+  sim.start(10, 500);
+
+  high_resolution_clock::time_point start = high_resolution_clock::now();
+  size_t n = sim.ring_.popWait(buff, sizeof(buff),
+      [&sim](size_t missing) { return sim.wait(missing, TIMEOUT_MS); });
+  auto elapsed = duration_cast<milliseconds>(high_resolution_clock::now() - start).count();
+
+  sim.join();
+  ASSERT_EQ(10U, n);
+
+  for (size_t i = 0; i < n; i++) {
+    ASSERT_EQ(uint8_t(i), buff[i]);
+  }
+
+  // The call ends at the first time-out without new bytes.
+  auto idle = duration_cast<milliseconds>(high_resolution_clock::now() - sim.last_push_).count();
+  ASSERT_LE(TIMEOUT_MS, idle);
+  ASSERT_GT(TIMEOUT_MS * 4, elapsed);
+}
+
+TEST(SpscRingTest, producerThread)
+{
+  ASSERT_LE(0, (streamBytes<64>(1 << 20, 1)));
+  ASSERT_LE(0, (streamBytes<64>(1 << 20, 13)));
+  ASSERT_LE(0, (streamBytes<1024>(1 << 22, 100)));
+}
+
+TEST(SpscRingTest, benchmark)
+{
+  const size_t TOTAL = 1 << 24;
+
+  struct
+  {
+    const char* name;
+    int64_t (*fn)(size_t, size_t);
+    size_t chunk;
+  } cases[] = {
+    { "64 slots, push/pop", &streamBytes<64>, 1 },
+    { "64 slots, pushN/popN x 32", &streamBytes<64>, 32 },
+    { "1024 slots, push/pop", &streamBytes<1024>, 1 },
+    { "1024 slots, pushN/popN x 256", &streamBytes<1024>, 256 }
+  };
+
+  for (const auto& c : cases) {
+    int64_t us = c.fn(TOTAL, c.chunk);
+    ASSERT_LE(0, us) << c.name;
+    TEST_MSG << c.name << ": " << (double(TOTAL) / (us > 0 ? us : 1)) << " MB/s" << std::endl;
+  }
+}
+
+// } Tests
+
+} // namespace btr
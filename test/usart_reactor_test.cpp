@@ -0,0 +1,330 @@
+// Copyright (C) 2019 Sergey Kapustin <kapucin@gmail.com>
+
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+// SYSTEM INCLUDES
+#include <gtest/gtest.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+// PROJECT INCLUDES
+#include "devices/defines.hpp"
+#include "devices/x86/usart_reactor.hpp"
+#include "devices/x86/pseudo_tty.hpp"
+#include "utility/test_helpers.hpp"
+
+using namespace std::chrono;
+using namespace std::chrono_literals;
+
+namespace btr
+{
+
+#define BAUD 115200
+#define DATA_BITS 8
+#define PORTS 16
+#define FRAMES 100
+#define FRAME_SIZE 8
+
+//------------------------------------------------------------------------------
+
+class UsartReactorTest : public testing::Test
+{
+public:
+
+  /** A pseudo-TTY pair with a reader and a sender end. */
+  struct Link
+  {
+    std::unique_ptr<PseudoTTY> tty;
+    UsartTermios reader;
+    UsartTermios sender;
+    std::string tty0;
+    std::string tty1;
+    char tx[FRAME_SIZE];
+    char rx[FRAME_SIZE];
+    uint32_t rx_bytes;
+    uint32_t frames;
+    int error;
+  };
+
+  // LIFECYCLE
+
+  UsartReactorTest()
+    :
+      links_(PORTS),
+      reactor_()
+  {
+    for (uint32_t i = 0; i < PORTS; i++) {
+      Link& l = links_[i];
+      l.tty0 = std::string(TTY_SIM_0) + "_r" + std::to_string(i);
+      l.tty1 = std::string(TTY_SIM_1) + "_r" + std::to_string(i);
+      l.tty.reset(new PseudoTTY(l.tty0.c_str(), l.tty1.c_str()));
+    }
+
+    std::this_thread::sleep_for(20ms);
+
+    for (Link& l : links_) {
+      l.reader.configure(l.tty0.c_str(), BAUD, DATA_BITS, ParityType::NONE, BTR_USART_IO_TIMEOUT_MS);
+      l.sender.configure(l.tty1.c_str(), BAUD, DATA_BITS, ParityType::NONE, BTR_USART_IO_TIMEOUT_MS);
+      l.reader.open();
+      l.sender.open();
+      l.rx_bytes = 0;
+      l.frames = 0;
+      l.error = 0;
+    }
+    reactor_.open();
+  }
+
+  void sendNext(Link* l)
+  {
+    snprintf(l->tx, sizeof(l->tx), "%07u", l->frames);
+
+    if (l->sender.send(l->tx, (uint32_t) sizeof(l->tx)) != sizeof(l->tx)) {
+      l->error = errno;
+    }
+  }
+
+protected:
+
+  // ATTRIBUTES
+
+  std::vector<Link> links_;
+  UsartReactor reactor_;
+};
+
+//------------------------------------------------------------------------------
+
+// Tests {
+
+TEST_F(UsartReactorTest, readWriteOK)
+{
+  Link& l = links_[0];
+  uint32_t events = 0;
+  int rc = 0;
+
+  ASSERT_EQ(0, reactor_.add(&l.reader, UsartReactor::READABLE,
+        [&](UsartTermios* port, uint32_t ev) {
+          events |= ev;
+          rc = port->recv(l.rx, sizeof(l.rx));
+        }));
+  ASSERT_EQ(1, reactor_.size());
+
+  // Nothing to read, non-blocking recv must not wait for VTIME
+  ASSERT_EQ(-1, l.reader.recv(l.rx, sizeof(l.rx)));
+  ASSERT_EQ(EAGAIN, errno);
+
+  sendNext(&l);
+  ASSERT_EQ(0, l.error);
+  ASSERT_EQ(1, reactor_.poll(100));
+  ASSERT_EQ(UsartReactor::READABLE, events);
+  ASSERT_EQ(FRAME_SIZE, rc) << " Message: " << strerror(errno);
+  ASSERT_EQ(0, memcmp(l.tx, l.rx, sizeof(l.rx)));
+
+  ASSERT_EQ(0, reactor_.remove(&l.reader));
+  ASSERT_EQ(0, reactor_.size());
+  ASSERT_EQ(-1, reactor_.remove(&l.reader));
+}
+
+TEST_F(UsartReactorTest, deadline)
+{
+  Link& l = links_[0];
+  uint32_t events = 0;
+
+  ASSERT_EQ(0, reactor_.add(&l.reader, UsartReactor::READABLE,
+        [&events](UsartTermios*, uint32_t ev) { events |= ev; }));
+  ASSERT_EQ(0, reactor_.setDeadline(&l.reader, 5000));
+
+  high_resolution_clock::time_point start = high_resolution_clock::now();
+
+  ASSERT_EQ(1, reactor_.poll(100));
+
+  auto elapsed = duration_cast<microseconds>(high_resolution_clock::now() - start).count();
+
+  ASSERT_EQ(UsartReactor::DEADLINE, events);
+  ASSERT_LE(5000, elapsed);
+  ASSERT_GT(20000, elapsed);
+
+  // Disarmed deadline doesn't fire
+  events = 0;
+  ASSERT_EQ(0, reactor_.setDeadline(&l.reader, 5000));
+  ASSERT_EQ(0, reactor_.setDeadline(&l.reader, 0));
+  ASSERT_EQ(0, reactor_.poll(20));
+  ASSERT_EQ(0, events);
+}
+
+TEST_F(UsartReactorTest, removeFromHandler)
+{
+  for (Link& l : links_) {
+    ASSERT_EQ(0, reactor_.add(&l.reader, UsartReactor::READABLE,
+          [this](UsartTermios* port, uint32_t) {
+            for (Link& l : links_) {
+              reactor_.remove(&l.reader);
+            }
+            (void) port;
+          }));
+    sendNext(&l);
+  }
+
+  std::this_thread::sleep_for(20ms);
+
+  ASSERT_LT(0, reactor_.poll(100));
+  ASSERT_EQ(0, reactor_.size());
+}
+
+TEST_F(UsartReactorTest, closeFromHandler)
+{
+  uint32_t calls = 0;
+
+  for (Link& l : links_) {
+    ASSERT_EQ(0, reactor_.add(&l.reader, UsartReactor::READABLE,
+          [this, &calls](UsartTermios*, uint32_t) {
+            calls++;
+            reactor_.close();
+          }));
+    sendNext(&l);
+  }
+
+  std::this_thread::sleep_for(20ms);
+
+  // The events after the first refer to entries that close() has removed.
+  ASSERT_LT(1, reactor_.poll(100));
+  ASSERT_EQ(1U, calls);
+  ASSERT_EQ(0, reactor_.size());
+  ASSERT_EQ(-1, reactor_.add(&links_[0].reader, UsartReactor::READABLE, nullptr));
+
+  for (Link& l : links_) {
+    ASSERT_EQ(0, fcntl(l.reader.handle(), F_GETFL) & O_NONBLOCK);
+  }
+
+  ASSERT_EQ(0, reactor_.open());
+  ASSERT_EQ(0, reactor_.add(&links_[0].reader, UsartReactor::READABLE, nullptr));
+}
+
+TEST_F(UsartReactorTest, addFailureRestoresBlocking)
+{
+  UsartReactor reactor;
+
+  // The epoll instance gets the lowest free descriptor, replace it with one that isn't epoll.
+  int fd = dup(0);
+  ::close(fd);
+  ASSERT_EQ(0, reactor.open());
+
+  char link[64] = {};
+  ASSERT_LT(0, readlink(("/proc/self/fd/" + std::to_string(fd)).c_str(), link, sizeof(link) - 1));
+  ASSERT_STREQ("anon_inode:[eventpoll]", link);
+
+  int null_fd = ::open("/dev/null", O_RDONLY);
+  ASSERT_EQ(fd, dup2(null_fd, fd));
+  ::close(null_fd);
+
+  Link& l = links_[0];
+  ASSERT_EQ(-1, reactor.add(&l.reader, UsartReactor::READABLE, nullptr));
+  ASSERT_EQ(EINVAL, errno);
+  ASSERT_EQ(0, reactor.size());
+  ASSERT_EQ(0, fcntl(l.reader.handle(), F_GETFL) & O_NONBLOCK);
+}
+
+TEST_F(UsartReactorTest, benchmark)
+{
+  // Reactor: all ports on one thread
+  for (Link& l : links_) {
+    Link* lp = &l;
+
+    ASSERT_EQ(0, reactor_.add(&l.reader, UsartReactor::READABLE,
+          [this, lp](UsartTermios* port, uint32_t) {
+            int rc = port->recv(lp->rx + lp->rx_bytes, sizeof(lp->rx) - lp->rx_bytes);
+
+            if (rc < 0) {
+              lp->error = errno;
+              reactor_.remove(port);
+              return;
+            }
+
+            lp->rx_bytes += rc;
+
+            if (lp->rx_bytes == sizeof(lp->rx)) {
+              lp->rx_bytes = 0;
+
+              if (memcmp(lp->tx, lp->rx, sizeof(lp->rx)) != 0 || ++lp->frames == FRAMES) {
+                reactor_.remove(port);
+              } else {
+                sendNext(lp);
+              }
+            }
+          }));
+  }
+
+  high_resolution_clock::time_point start = high_resolution_clock::now();
+
+  for (Link& l : links_) {
+    sendNext(&l);
+  }
+
+  while (reactor_.size() > 0) {
+    ASSERT_LE(0, reactor_.poll(1000));
+  }
+
+  auto reactor_us = duration_cast<microseconds>(high_resolution_clock::now() - start).count();
+
+  for (Link& l : links_) {
+    ASSERT_EQ(0, l.error) << " Message: " << strerror(l.error);
+    ASSERT_EQ(FRAMES, l.frames);
+    l.frames = 0;
+  }
+
+  // Per-thread blocking recv bounded by VTIME
+  std::vector<std::thread> threads;
+  start = high_resolution_clock::now();
+
+  for (Link& l : links_) {
+    Link* lp = &l;
+
+    threads.emplace_back([this, lp] {
+      while (lp->frames < FRAMES && 0 == lp->error) {
+        sendNext(lp);
+
+        for (uint32_t n = 0; n < sizeof(lp->rx); ) {
+          int rc = lp->reader.recv(lp->rx + n, sizeof(lp->rx) - n);
+
+          if (rc <= 0) {
+            lp->error = (rc < 0 ? errno : ETIMEDOUT);
+            return;
+          }
+          n += rc;
+        }
+
+        if (memcmp(lp->tx, lp->rx, sizeof(lp->rx)) != 0) {
+          lp->error = EIO;
+          return;
+        }
+        lp->frames++;
+      }
+    });
+  }
+
+  for (std::thread& t : threads) {
+    t.join();
+  }
+
+  auto threads_us = duration_cast<microseconds>(high_resolution_clock::now() - start).count();
+
+  for (Link& l : links_) {
+    ASSERT_EQ(0, l.error) << " Message: " << strerror(l.error);
+    ASSERT_EQ(FRAMES, l.frames);
+  }
+
+  TEST_MSG << PORTS << " ports x " << FRAMES << " frames, reactor on one thread: "
+    << double(reactor_us) / (PORTS * FRAMES) << " us/frame" << std::endl;
+  TEST_MSG << PORTS << " ports x " << FRAMES << " frames, thread per port: "
+    << double(threads_us) / (PORTS * FRAMES) << " us/frame" << std::endl;
+}
+
+// } Tests
+
+} // namespace btr
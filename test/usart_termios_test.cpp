@@ -6,6 +6,9 @@
 
 // SYSTEM INCLUDES
 #include <gtest/gtest.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <unistd.h>
 #include <thread>
 #include <chrono>
 
@@ -151,6 +154,245 @@ TEST_F(UsartTermiosTest, setTimeout)
   ASSERT_EQ(0, rc) << " Message: " << strerror(errno);
 }
 
+TEST_F(UsartTermiosTest, recvTimedTotalDeadline)
+{
+  high_resolution_clock::time_point start = high_resolution_clock::now();
+
+  int rc = reader_.recvTimed((char*)rbuff_.write_ptr(), rbuff_.remaining(), 5000);
+
+  auto elapsed = duration_cast<microseconds>(high_resolution_clock::now() - start).count();
+
+  ASSERT_EQ(0, rc);
+  ASSERT_EQ(ETIMEDOUT, errno);
+  ASSERT_LE(5000, elapsed);
+  ASSERT_GT(15000, elapsed);
+}
+
+TEST_F(UsartTermiosTest, recvTimedInterByteDeadline)
+{
+  char rx[16];
+
+  ASSERT_EQ(5, sender_.send((char*)wbuff_.read_ptr(), wbuff_.available()));
+
+  // The peer stops after 5 bytes, the gap deadline fires long before the total one.
+  high_resolution_clock::time_point start = high_resolution_clock::now();
+
+  int rc = reader_.recvTimed(rx, sizeof(rx), 1000000, 5000);
+
+  auto elapsed = duration_cast<microseconds>(high_resolution_clock::now() - start).count();
+
+  ASSERT_EQ(5, rc);
+  ASSERT_EQ(ETIMEDOUT, errno);
+  ASSERT_EQ(0, memcmp(wbuff_.data(), rx, wbuff_.size()));
+  ASSERT_LE(5000, elapsed);
+  ASSERT_GT(15000, elapsed);
+
+  // All requested bytes arrive, no waiting for a deadline.
+  ASSERT_EQ(5, sender_.send((char*)wbuff_.read_ptr(), wbuff_.available()));
+  start = high_resolution_clock::now();
+
+  rc = reader_.recvTimed((char*)rbuff_.write_ptr(), rbuff_.remaining(), 1000000, 5000);
+
+  elapsed = duration_cast<microseconds>(high_resolution_clock::now() - start).count();
+
+  ASSERT_EQ(5, rc) << " Message: " << strerror(errno);
+  ASSERT_EQ(0, memcmp(wbuff_.data(), rbuff_.data(), wbuff_.size()));
+  ASSERT_GT(5000, elapsed);
+}
+
+TEST(UsartTermiosHangupTest, recvTimedPeerClosed)
+{
+  // A pseudo-terminal whose master end is closed mid-read, the slave end is hung up.
+  int master = posix_openpt(O_RDWR | O_NOCTTY);
+  ASSERT_LE(0, master);
+  ASSERT_EQ(0, grantpt(master));
+  ASSERT_EQ(0, unlockpt(master));
+
+  UsartTermios reader;
+  reader.configure(ptsname(master), BAUD, DATA_BITS, ParityType::NONE, BTR_USART_IO_TIMEOUT_MS);
+  ASSERT_EQ(0, reader.open());
+
+  std::thread peer([master]() {
+    ASSERT_EQ(5, write(master, "hello", 5));
+    std::this_thread::sleep_for(20ms);
+    close(master);
+  });
+
+  char rx[16];
+  high_resolution_clock::time_point start = high_resolution_clock::now();
+
+  // No deadlines, returns on the hang-up.
+  int rc = reader.recvTimed(rx, sizeof(rx), 0);
+
+  auto elapsed = duration_cast<milliseconds>(high_resolution_clock::now() - start).count();
+  peer.join();
+
+  ASSERT_EQ(5, rc);
+  ASSERT_EQ(EIO, errno);
+  ASSERT_EQ(0, memcmp("hello", rx, 5));
+  ASSERT_GT(200, elapsed);
+
+  rc = reader.recvTimed(rx, sizeof(rx), 1000000);
+  ASSERT_EQ(0, rc);
+  ASSERT_EQ(EIO, errno);
+}
+
+TEST_F(UsartTermiosTest, sendvReadWriteOK)
+{
+  char header[] = { 0x7e, 0x05 };
+  char crc[] = { 0x12, 0x34 };
+  struct iovec iov[] = {
+    { header, sizeof(header) },
+    { wbuff_.read_ptr(), wbuff_.available() },
+    { crc, sizeof(crc) }
+  };
+  char rx[9];
+
+  ssize_t rc = sender_.sendv(iov, 3);
+  ASSERT_EQ(9, rc) << " Message: " << strerror(errno);
+
+  for (rc = 0; rc < (ssize_t) sizeof(rx); ) {
+    int n = reader_.recv(rx + rc, sizeof(rx) - rc);
+    ASSERT_LT(0, n) << " Message: " << strerror(errno);
+    rc += n;
+  }
+
+  ASSERT_EQ(0, memcmp(header, rx, sizeof(header)));
+  ASSERT_EQ(0, memcmp(wbuff_.data(), rx + sizeof(header), wbuff_.size()));
+  ASSERT_EQ(0, memcmp(crc, rx + sizeof(header) + wbuff_.size(), sizeof(crc)));
+}
+
+TEST_F(UsartTermiosTest, sendvBenchmark)
+{
+  const uint32_t frames = 2000;
+  char header[4] = { 0x7e, 0x01, 0x00, 0x40 };
+  char payload[64];
+  char crc[2] = { 0x12, 0x34 };
+  char staging[sizeof(header) + sizeof(payload) + sizeof(crc)];
+  char rx[sizeof(staging)];
+
+  memset(payload, 0x55, sizeof(payload));
+
+  auto drain = [&]() {
+    for (uint32_t n = 0; n < sizeof(rx); ) {
+      int rc = reader_.recv(rx + n, sizeof(rx) - n);
+      ASSERT_LT(0, rc) << " Message: " << strerror(errno);
+      n += rc;
+    }
+  };
+
+  // 1 copy of the frame and 1 write per frame
+  high_resolution_clock::time_point start = high_resolution_clock::now();
+
+  for (uint32_t i = 0; i < frames; i++) {
+    memcpy(staging, header, sizeof(header));
+    memcpy(staging + sizeof(header), payload, sizeof(payload));
+    memcpy(staging + sizeof(header) + sizeof(payload), crc, sizeof(crc));
+    ASSERT_EQ((int) sizeof(staging), sender_.send(staging, (uint32_t) sizeof(staging)));
+    drain();
+  }
+
+  auto staging_us = duration_cast<microseconds>(high_resolution_clock::now() - start).count();
+
+  // 0 copies and 3 writes per frame
+  start = high_resolution_clock::now();
+
+  for (uint32_t i = 0; i < frames; i++) {
+    ASSERT_EQ((int) sizeof(header), sender_.send(header, (uint32_t) sizeof(header)));
+    ASSERT_EQ((int) sizeof(payload), sender_.send(payload, (uint32_t) sizeof(payload)));
+    ASSERT_EQ((int) sizeof(crc), sender_.send(crc, (uint32_t) sizeof(crc)));
+    drain();
+  }
+
+  auto pieces_us = duration_cast<microseconds>(high_resolution_clock::now() - start).count();
+
+  // 0 copies and 1 writev per frame
+  struct iovec iov[] = {
+    { header, sizeof(header) },
+    { payload, sizeof(payload) },
+    { crc, sizeof(crc) }
+  };
+  start = high_resolution_clock::now();
+
+  for (uint32_t i = 0; i < frames; i++) {
+    ASSERT_EQ((int) sizeof(staging), sender_.sendv(iov, 3));
+    drain();
+  }
+
+  auto sendv_us = duration_cast<microseconds>(high_resolution_clock::now() - start).count();
+
+  ASSERT_EQ(0, memcmp(header, rx, sizeof(header)));
+  ASSERT_EQ(0, memcmp(payload, rx + sizeof(header), sizeof(payload)));
+
+  TEST_MSG << "Staging copy (1 copy, 1 syscall): "
+    << double(staging_us) / frames << " us/frame" << std::endl;
+  TEST_MSG << "Write per piece (0 copies, 3 syscalls): "
+    << double(pieces_us) / frames << " us/frame" << std::endl;
+  TEST_MSG << "sendv (0 copies, 1 syscall): "
+    << double(sendv_us) / frames << " us/frame" << std::endl;
+}
+
+TEST_F(UsartTermiosTest, rejectBaud)
+{
+  reader_.close();
+  reader_.configure(TTY_SIM_0, 0, DATA_BITS, ParityType::NONE);
+  ASSERT_EQ(-1, reader_.open());
+  ASSERT_EQ(EINVAL, errno);
+  ASSERT_FALSE(reader_.isOpen());
+
+#if BTR_USART_ARBITRARY_BAUD == 0
+  reader_.configure(TTY_SIM_0, 250000, DATA_BITS, ParityType::NONE);
+  ASSERT_EQ(-1, reader_.open());
+  ASSERT_EQ(EINVAL, errno);
+#endif
+}
+
+TEST_F(UsartTermiosTest, throughputPerBaud)
+{
+  // A pseudo TTY doesn't pace data by baud rate, so this checks that each rate is accepted and
+  // data flows. On a real link, throughput scales with the rate.
+  const uint32_t rates[] = {
+    9600, 57600, 115200, 230400, 460800, 921600, 1000000, 2000000, 3000000, 4000000,
+#if BTR_USART_ARBITRARY_BAUD > 0
+    250000, 1843200,
+#endif
+  };
+  const uint32_t bytes = 16 * 1024;
+  char tx[1024];
+  char rx[1024];
+
+  for (uint32_t i = 0; i < sizeof(tx); i++) {
+    tx[i] = char(i);
+  }
+
+  for (uint32_t rate : rates) {
+    reader_.close();
+    sender_.close();
+    reader_.configure(TTY_SIM_0, rate, DATA_BITS, ParityType::NONE);
+    sender_.configure(TTY_SIM_1, rate, DATA_BITS, ParityType::NONE);
+    ASSERT_EQ(0, reader_.open()) << " Rate: " << rate << " Message: " << strerror(errno);
+    ASSERT_EQ(0, sender_.open()) << " Rate: " << rate << " Message: " << strerror(errno);
+
+    high_resolution_clock::time_point start = high_resolution_clock::now();
+
+    for (uint32_t sent = 0; sent < bytes; sent += sizeof(tx)) {
+      ASSERT_EQ((int) sizeof(tx), sender_.send(tx, (uint32_t) sizeof(tx)));
+
+      for (uint32_t n = 0; n < sizeof(rx); ) {
+        int rc = reader_.recv(rx + n, sizeof(rx) - n);
+        ASSERT_LT(0, rc) << " Rate: " << rate << " Message: " << strerror(errno);
+        n += rc;
+      }
+      ASSERT_EQ(0, memcmp(tx, rx, sizeof(rx)));
+    }
+
+    auto elapsed = duration_cast<microseconds>(high_resolution_clock::now() - start).count();
+
+    TEST_MSG << rate << " baud: " << (bytes * 1000000.0 / elapsed) << " B/s, link limit "
+      << rate / 10 << " B/s" << std::endl;
+  }
+}
+
 #if 0
 TEST_F(UsartTermiosTest, DISABLED_sendBreak)
 {
@@ -7,10 +7,15 @@
 // SYSTEM INCLUDES
 #include <gtest/gtest.h>
 #include <chrono>
+#include <future>
+#include <memory>
+#include <string>
+#include <vector>
 
 // PROJECT INCLUDES
 #include "devices/usart.hpp"
 #include "devices/x86/pseudo_tty.hpp"
+#include "devices/x86/usart_service.hpp"
 #include "devices/defines.hpp"
 #include "utility/buff.hpp"
 #include "utility/test_helpers.hpp"
@@ -143,6 +148,350 @@ TEST_F(UsartTest, setTimeout)
   ASSERT_EQ(0, rc) << " Message: " << strerror(errno);
 }
 
+TEST_F(UsartTest, sendvReadWriteOK)
+{
+  char header[] = { 0x7e, 0x05 };
+  char crc[] = { 0x12, 0x34 };
+  struct iovec iov[] = {
+    { header, sizeof(header) },
+    { wbuff_.read_ptr(), wbuff_.available() },
+    { crc, sizeof(crc) }
+  };
+  char rx[9];
+
+  uint32_t rc = sender_.sendv(iov, 3);
+  ASSERT_EQ(9U, rc) << " Message: " << strerror(errno);
+
+  rc = reader_.recv(rx, sizeof(rx));
+  ASSERT_EQ(9U, rc) << " Message: " << strerror(errno);
+  ASSERT_EQ(0, memcmp(header, rx, sizeof(header)));
+  ASSERT_EQ(0, memcmp(wbuff_.data(), rx + sizeof(header), wbuff_.size()));
+  ASSERT_EQ(0, memcmp(crc, rx + sizeof(header) + wbuff_.size(), sizeof(crc)));
+}
+
+TEST_F(UsartTest, bulkTransfer)
+{
+  // More than a 16-bit byte count can hold.
+  const size_t bytes = 256 * 1024 + 7;
+  std::vector<char> tx(bytes);
+  std::vector<char> rx(bytes);
+
+  for (size_t i = 0; i < bytes; i++) {
+    tx[i] = char(i * 31 + (i >> 8));
+  }
+
+  Usart::IoResult sent = {};
+  high_resolution_clock::time_point start = high_resolution_clock::now();
+
+  std::thread sender([&]() { sent = sender_.sendBulk(tx.data(), tx.size()); });
+  Usart::IoResult received = reader_.recvBulk(rx.data(), rx.size());
+  sender.join();
+
+  auto elapsed = duration_cast<microseconds>(high_resolution_clock::now() - start).count();
+
+  ASSERT_EQ(Usart::IO_OK, sent.error) << " Message: " << strerror(errno);
+  ASSERT_EQ(bytes, sent.bytes);
+  ASSERT_EQ(Usart::IO_OK, received.error) << " Message: " << strerror(errno);
+  ASSERT_EQ(bytes, received.bytes);
+  ASSERT_EQ(0, memcmp(tx.data(), rx.data(), bytes));
+
+  TEST_MSG << bytes << " bytes in one call: " << (bytes * 1000000.0 / elapsed) << " B/s"
+    << std::endl;
+}
+
+TEST_F(UsartTest, bulkRecvIdleTimeout)
+{
+  char rx[1024];
+
+  ASSERT_EQ(5U, sender_.send((char*)wbuff_.read_ptr(), wbuff_.available()));
+
+  high_resolution_clock::time_point start = high_resolution_clock::now();
+  Usart::IoResult result = reader_.recvBulk(rx, sizeof(rx), 50);
+  auto elapsed = duration_cast<milliseconds>(high_resolution_clock::now() - start).count();
+
+  ASSERT_EQ(Usart::IO_TIMEOUT, result.error);
+  ASSERT_EQ(5U, result.bytes);
+  ASSERT_EQ(0, memcmp(wbuff_.data(), rx, wbuff_.size()));
+  ASSERT_LE(50, elapsed);
+  ASSERT_GT(70, elapsed);
+
+  reader_.close();
+  result = reader_.recvBulk(rx, sizeof(rx), 50);
+  ASSERT_EQ(Usart::IO_NOT_OPEN, result.error);
+  ASSERT_EQ(0U, result.bytes);
+}
+
+TEST_F(UsartTest, sharedServiceReadWriteOK)
+{
+  Usart reader(UsartService::instance()->ioService());
+  Usart sender(UsartService::instance()->ioService());
+  ASSERT_EQ(0, reader.open(BAUD, DATA_BITS, StopBitsType::ONE, ParityType::NONE, TTY_SIM_0));
+  ASSERT_EQ(0, sender.open(BAUD, DATA_BITS, StopBitsType::ONE, ParityType::NONE, TTY_SIM_1));
+  reader_.close();
+  sender_.close();
+
+  ssize_t rc = sender.send((char*)wbuff_.read_ptr(), wbuff_.available());
+  ASSERT_EQ(5, rc) << " Message: " << strerror(errno);
+
+  rc = reader.recv((char*)rbuff_.write_ptr(), rbuff_.remaining(), BTR_USART_IO_TIMEOUT_MS);
+  ASSERT_EQ(5, rc) << " Message: " << strerror(errno);
+  ASSERT_EQ(0, memcmp(wbuff_.data(), rbuff_.data(), wbuff_.size()));
+
+  // Time-out on the shared loop.
+  high_resolution_clock::time_point start = high_resolution_clock::now();
+  rc = reader.recv((char*)rbuff_.write_ptr(), rbuff_.remaining(), BTR_USART_IO_TIMEOUT_MS);
+  auto elapsed = duration_cast<milliseconds>(high_resolution_clock::now() - start).count();
+
+  ASSERT_EQ(0, rc);
+  ASSERT_LE(BTR_USART_IO_TIMEOUT_MS, elapsed);
+  ASSERT_GT(BTR_USART_IO_TIMEOUT_MS + 20, elapsed);
+}
+
+TEST_F(UsartTest, sharedServiceBenchmark)
+{
+  const uint32_t frames = 500;
+  char frame[16] = "0123456789abcde";
+  char rx[sizeof(frame)];
+
+  auto pingPong = [&](Usart& sender, Usart& reader, int64_t* elapsed_us) {
+    high_resolution_clock::time_point start = high_resolution_clock::now();
+
+    for (uint32_t i = 0; i < frames; i++) {
+      ASSERT_EQ(sizeof(frame), sender.send(frame, sizeof(frame)));
+      ASSERT_EQ(sizeof(rx), reader.recv(rx, sizeof(rx)));
+    }
+    *elapsed_us = duration_cast<microseconds>(high_resolution_clock::now() - start).count();
+  };
+
+  int64_t per_call_us = 0;
+  int64_t shared_us = 0;
+
+  pingPong(sender_, reader_, &per_call_us);
+  reader_.close();
+  sender_.close();
+
+  Usart reader(UsartService::instance()->ioService());
+  Usart sender(UsartService::instance()->ioService());
+  ASSERT_EQ(0, reader.open(BAUD, DATA_BITS, StopBitsType::ONE, ParityType::NONE, TTY_SIM_0));
+  ASSERT_EQ(0, sender.open(BAUD, DATA_BITS, StopBitsType::ONE, ParityType::NONE, TTY_SIM_1));
+
+  pingPong(sender, reader, &shared_us);
+
+  TEST_MSG << "Per-call loop: " << double(per_call_us) / frames << " us/frame, "
+    << (frames * sizeof(frame) * 1000000.0 / per_call_us) << " B/s" << std::endl;
+  TEST_MSG << "Shared loop:   " << double(shared_us) / frames << " us/frame, "
+    << (frames * sizeof(frame) * 1000000.0 / shared_us) << " B/s" << std::endl;
+}
+
+TEST_F(UsartTest, asyncRecvTimeout)
+{
+  reader_.close();
+
+  bio::io_service io_service;
+  Usart reader(io_service);
+  ASSERT_EQ(0, reader.open(BAUD, DATA_BITS, StopBitsType::ONE, ParityType::NONE, TTY_SIM_0));
+
+  int error = 0;
+  size_t bytes = 1;
+
+  reader.asyncRecv((char*)rbuff_.write_ptr(), rbuff_.remaining(),
+      [&error, &bytes](int e, size_t n) {
+        error = e;
+        bytes = n;
+      }, 50);
+
+  high_resolution_clock::time_point start = high_resolution_clock::now();
+  io_service.run();
+  auto elapsed = duration_cast<milliseconds>(high_resolution_clock::now() - start).count();
+
+  ASSERT_EQ(ETIMEDOUT, error);
+  ASSERT_EQ(0U, bytes);
+  ASSERT_LE(50, elapsed);
+  ASSERT_GT(70, elapsed);
+}
+
+TEST_F(UsartTest, privateLoopRejectsAsync)
+{
+  // Nothing runs the private loop between blocking calls, so the handlers are called right away.
+  int error = 0;
+  reader_.asyncRecv((char*)rbuff_.write_ptr(), rbuff_.remaining(),
+      [&error](int e, size_t) { error = e; });
+  ASSERT_EQ(EOPNOTSUPP, error);
+
+  error = 0;
+  sender_.asyncSend((char*)wbuff_.read_ptr(), wbuff_.available(),
+      [&error](int e, size_t) { error = e; });
+  ASSERT_EQ(EOPNOTSUPP, error);
+
+  // The port still works with blocking calls
+  ssize_t rc = sender_.send((char*)wbuff_.read_ptr(), wbuff_.available());
+  ASSERT_EQ(5, rc) << " Message: " << strerror(errno);
+  rc = reader_.recv((char*)rbuff_.write_ptr(), rbuff_.remaining(), BTR_USART_IO_TIMEOUT_MS);
+  ASSERT_EQ(5, rc) << " Message: " << strerror(errno);
+}
+
+TEST_F(UsartTest, recvReturnsBeforeOtherWork)
+{
+  // Other work on the private loop, here a long timer, doesn't hold up a blocking call.
+  bool expired = false;
+  bio::deadline_timer timer(reader_.io_service_, boost::posix_time::seconds(2));
+  timer.async_wait([&expired](const boost::system::error_code& e) { expired = !e; });
+
+  ssize_t rc = sender_.send((char*)wbuff_.read_ptr(), wbuff_.available());
+  ASSERT_EQ(5, rc) << " Message: " << strerror(errno);
+
+  high_resolution_clock::time_point start = high_resolution_clock::now();
+  rc = reader_.recv((char*)rbuff_.write_ptr(), rbuff_.remaining(), BTR_USART_IO_TIMEOUT_MS);
+  auto elapsed = duration_cast<milliseconds>(high_resolution_clock::now() - start).count();
+
+  ASSERT_EQ(5, rc) << " Message: " << strerror(errno);
+  ASSERT_GT(BTR_USART_IO_TIMEOUT_MS, elapsed);
+  ASSERT_FALSE(expired);
+
+  // Run the timer's cancelled handler while it can still refer to expired
+  timer.cancel();
+  reader_.io_service_.reset();
+  reader_.io_service_.poll();
+}
+
+TEST_F(UsartTest, sharedServiceCloseWithPendingRecv)
+{
+  reader_.close();
+  sender_.close();
+
+  bio::io_service& io_service = UsartService::instance()->ioService();
+  std::unique_ptr<Usart> reader(new Usart(io_service));
+  ASSERT_EQ(0, reader->open(BAUD, DATA_BITS, StopBitsType::ONE, ParityType::NONE, TTY_SIM_0));
+
+  std::promise<void> started;
+  int error = 0;
+  bool called = false;
+
+  reader->asyncRecv((char*)rbuff_.write_ptr(), rbuff_.remaining(),
+      [&error, &called](int e, size_t) {
+        error = e;
+        called = true;
+      }, 10000);
+  bio::post(io_service, [&started]() { started.set_value(); });
+  started.get_future().wait();
+
+  // The cancelled receive and its timer complete on the loop thread before the port is gone.
+  reader.reset();
+  ASSERT_TRUE(called);
+  ASSERT_EQ(ECANCELED, error);
+}
+
+TEST_F(UsartTest, sharedServiceDestroyOnLoopThread)
+{
+  reader_.close();
+  sender_.close();
+
+  bio::io_service& io_service = UsartService::instance()->ioService();
+  Usart* reader = new Usart(io_service);
+  ASSERT_EQ(0, reader->open(BAUD, DATA_BITS, StopBitsType::ONE, ParityType::NONE, TTY_SIM_0));
+
+  std::promise<void> done;
+  bool called = false;
+
+  reader->asyncRecv((char*)rbuff_.write_ptr(), rbuff_.remaining(),
+      [&called](int, size_t) { called = true; }, 10000);
+
+  // The handlers of the cancelled receive run after the instance is gone and must not touch it.
+  bio::post(io_service, [reader]() { delete reader; });
+  bio::post(io_service, [&done]() { done.set_value(); });
+  done.get_future().wait();
+  ASSERT_FALSE(called);
+}
+
+TEST(UsartAsyncTest, pumpSeveralPorts)
+{
+  const uint32_t ports = 4;
+  const uint32_t frames = 100;
+
+  struct Link
+  {
+    std::unique_ptr<PseudoTTY> tty;
+    std::unique_ptr<Usart> reader;
+    std::unique_ptr<Usart> sender;
+    char tx[8];
+    char rx[8];
+    uint32_t sent;
+    uint32_t received;
+    int error;
+  };
+
+  bio::io_service io_service;
+  std::vector<Link> links(ports);
+
+  for (uint32_t i = 0; i < ports; i++) {
+    std::string tty0 = std::string(TTY_SIM_0) + "_" + std::to_string(i);
+    std::string tty1 = std::string(TTY_SIM_1) + "_" + std::to_string(i);
+    links[i].tty.reset(new PseudoTTY(tty0.c_str(), tty1.c_str()));
+  }
+
+  std::this_thread::sleep_for(20ms);
+
+  for (uint32_t i = 0; i < ports; i++) {
+    std::string tty0 = std::string(TTY_SIM_0) + "_" + std::to_string(i);
+    std::string tty1 = std::string(TTY_SIM_1) + "_" + std::to_string(i);
+    Link& l = links[i];
+
+    l.reader.reset(new Usart(io_service));
+    l.sender.reset(new Usart(io_service));
+    ASSERT_EQ(0, l.reader->open(BAUD, DATA_BITS, StopBitsType::ONE, ParityType::NONE,
+          tty0.c_str()));
+    ASSERT_EQ(0, l.sender->open(BAUD, DATA_BITS, StopBitsType::ONE, ParityType::NONE,
+          tty1.c_str()));
+    l.sent = l.received = 0;
+    l.error = 0;
+  }
+
+  // Each link receives a frame, checks it, and sends the next one. All links run on one thread.
+  std::function<void(Link*)> send_next;
+  std::function<void(Link*)> recv_next;
+
+  send_next = [&](Link* l) {
+    snprintf(l->tx, sizeof(l->tx), "%07u", l->sent);
+    l->sender->asyncSend(l->tx, sizeof(l->tx), [&, l](int e, size_t) {
+      l->error |= e;
+      l->sent++;
+    });
+  };
+
+  recv_next = [&](Link* l) {
+    l->reader->asyncRecv(l->rx, sizeof(l->rx), [&, l](int e, size_t n) {
+      l->error |= e;
+
+      if (0 == e && n == sizeof(l->rx) && 0 == memcmp(l->tx, l->rx, sizeof(l->rx))) {
+        if (++l->received < frames) {
+          recv_next(l);
+          send_next(l);
+        }
+      }
+    });
+  };
+
+  high_resolution_clock::time_point start = high_resolution_clock::now();
+
+  for (Link& l : links) {
+    recv_next(&l);
+    send_next(&l);
+  }
+
+  io_service.run();
+
+  auto elapsed = duration_cast<microseconds>(high_resolution_clock::now() - start).count();
+
+  for (Link& l : links) {
+    ASSERT_EQ(0, l.error) << " Message: " << strerror(l.error);
+    ASSERT_EQ(frames, l.sent);
+    ASSERT_EQ(frames, l.received);
+  }
+
+  TEST_MSG << ports << " ports x " << frames << " frames on one thread: "
+    << double(elapsed) / (ports * frames) << " us/frame" << std::endl;
+}
+
 TEST_F(UsartTest, DISABLED_writeTimeout)
 {
 #if 0
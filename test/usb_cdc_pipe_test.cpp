@@ -0,0 +1,326 @@
+// Copyright (C) 2019 Sergey Kapustin <kapucin@gmail.com>
+
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+// SYSTEM INCLUDES
+#include <gtest/gtest.h>
+#include <string>
+#include <vector>
+
+// PROJECT INCLUDES
+#include "devices/usb_cdc_pipe.hpp"
+#include "devices/spsc_ring.hpp"
+#include "utility/test_helpers.hpp"
+
+namespace btr
+{
+
+//------------------------------------------------------------------------------
+
+/** SpscRing that counts bulk copies. */
+struct CountingRing : public SpscRing<uint8_t, 256>
+{
+  size_t pushN(const uint8_t* src, size_t n)
+  {
+    pushes++;
+    return SpscRing<uint8_t, 256>::pushN(src, n);
+  }
+
+  size_t popN(uint8_t* dst, size_t n)
+  {
+    pops++;
+    return SpscRing<uint8_t, 256>::popN(dst, n);
+  }
+
+  uint32_t pushes = 0;
+  uint32_t pops = 0;
+};
+
+/**
+ * Bulk endpoint pair model, with the host on the other side. The host sends an OUT packet only
+ * while the endpoint is valid, the device reading it re-arms the endpoint unless NAK is set. An IN
+ * packet stays in the endpoint until the host takes it.
+ */
+struct FakeEndpoints
+{
+  bool writePacket(const uint8_t* data, uint16_t bytes)
+  {
+    if (in_busy || in_refuse > 0) {
+      in_refuse -= (in_refuse > 0 ? 1 : 0);
+      return false;
+    }
+
+    ops++;
+    in_busy = true;
+    in_packet.assign((const char*) data, bytes);
+    return true;
+  }
+
+  uint16_t readPacket(uint8_t* data, uint16_t bytes)
+  {
+    ops++;
+    uint16_t n = std::min<uint16_t>(bytes, out_packet.size());
+    memcpy(data, out_packet.data(), n);
+    out_packet.clear();
+    out_full = false;
+    return n;
+  }
+
+  void setOutNak(bool value)
+  {
+    nak = value;
+    naks += (value ? 1 : 0);
+  }
+
+  /** Host: send the next OUT packet if the endpoint takes it. */
+  template<typename Pipe>
+  bool hostSend(Pipe* pipe)
+  {
+    if (out_full || nak || host_out.empty()) {
+      return false;
+    }
+
+    out_packet = host_out.substr(0, 64);
+    host_out.erase(0, out_packet.size());
+    out_full = true;
+    pipe->onPacketReceived();
+    return true;
+  }
+
+  /** Host: take the IN packet if there is one. */
+  template<typename Pipe>
+  bool hostRecv(Pipe* pipe)
+  {
+    if (false == in_busy) {
+      return false;
+    }
+
+    host_in += in_packet;
+    packets.push_back(in_packet.size());
+    transfers += (in_packet.size() < 64 ? 1 : 0);
+    in_busy = false;
+    pipe->onPacketSent();
+    return true;
+  }
+
+  std::string host_out;
+  std::string out_packet;
+  bool out_full = false;
+  bool nak = false;
+  uint32_t naks = 0;
+
+  std::string host_in;
+  std::string in_packet;
+  bool in_busy = false;
+  uint32_t in_refuse = 0;
+  std::vector<size_t> packets;
+  uint32_t transfers = 0;
+
+  uint32_t ops = 0;
+};
+
+typedef UsbCdcPipe<FakeEndpoints, CountingRing, CountingRing, 64> Pipe;
+
+static std::string pattern(size_t bytes, uint8_t seed)
+{
+  std::string s(bytes, '\0');
+
+  for (size_t i = 0; i < bytes; i++) {
+    s[i] = char(seed + i * 11);
+  }
+  return s;
+}
+
+//------------------------------------------------------------------------------
+
+// Tests {
+
+TEST(UsbCdcPipeTest, rxBulk)
+{
+  FakeEndpoints ep;
+  CountingRing tx;
+  CountingRing rx;
+  Pipe pipe(&ep, &tx, &rx);
+  std::string data = pattern(4096, 1);
+  std::string got;
+
+  ep.host_out = data;
+
+  while (ep.hostSend(&pipe)) {
+    uint8_t buff[256];
+    got.append((const char*) buff, rx.popN(buff, sizeof(buff)));
+    pipe.poll();
+  }
+
+  ASSERT_EQ(data, got);
+  ASSERT_EQ(0U, ep.naks);
+
+  // One endpoint read and one ring copy per 64-byte packet, not one queue item per byte
+  double kb = data.size() / 1024.0;
+  ASSERT_EQ(64U, ep.ops);
+  ASSERT_EQ(64U, rx.pushes);
+  TEST_MSG << "RX per KB: " << ep.ops / kb << " endpoint reads, " << rx.pushes / kb
+    << " ring writes" << std::endl;
+}
+
+TEST(UsbCdcPipeTest, rxBackpressure)
+{
+  FakeEndpoints ep;
+  CountingRing tx;
+  CountingRing rx;
+  Pipe pipe(&ep, &tx, &rx);
+  std::string data = pattern(1000, 2);
+  std::string got;
+
+  ep.host_out = data;
+
+  // Nobody reads: the ring fills up and the endpoint NAKs instead of dropping data
+  for (int i = 0; i < 20; i++) {
+    ep.hostSend(&pipe);
+    pipe.poll();
+  }
+
+  ASSERT_TRUE(pipe.rxPaused());
+  ASSERT_TRUE(ep.nak);
+  ASSERT_EQ(rx.capacity(), rx.size());
+  ASSERT_FALSE(ep.host_out.empty());
+
+  // The reader drains, poll() releases the endpoint and the host carries on
+  while (got.size() < data.size()) {
+    uint8_t buff[100];
+    got.append((const char*) buff, rx.popN(buff, sizeof(buff)));
+    pipe.poll();
+    ep.hostSend(&pipe);
+  }
+
+  ASSERT_EQ(data, got);
+  ASSERT_FALSE(ep.nak);
+  ASSERT_LE(1U, ep.naks);
+}
+
+TEST(UsbCdcPipeTest, rxPollReportsDrained)
+{
+  FakeEndpoints ep;
+  CountingRing tx;
+  CountingRing rx;
+  Pipe pipe(&ep, &tx, &rx);
+
+  ep.host_out = pattern(1000, 4);
+
+  // Fill the ring until the last packet is only partly in it.
+  while (ep.hostSend(&pipe)) {
+  }
+
+  ASSERT_TRUE(pipe.rxPaused());
+  ASSERT_EQ(rx.capacity(), rx.size());
+  ASSERT_EQ(0, pipe.poll());
+
+  // The held bytes poll() moves into the ring are new data for a waiting reader.
+  uint8_t buff[10];
+  ASSERT_EQ(sizeof(buff), rx.popN(buff, sizeof(buff)));
+
+  size_t before = rx.size();
+  uint16_t drained = pipe.poll();
+
+  ASSERT_LT(0, drained);
+  ASSERT_EQ(before + drained, rx.size());
+  ASSERT_EQ(0, pipe.poll());
+}
+
+TEST(UsbCdcPipeTest, txZlp)
+{
+  FakeEndpoints ep;
+  CountingRing tx;
+  CountingRing rx;
+  Pipe pipe(&ep, &tx, &rx);
+
+  // Data that ends on a packet boundary is followed by a ZLP
+  std::string a = pattern(128, 3);
+  tx.pushN((const uint8_t*) a.data(), a.size());
+  pipe.poll();
+
+  while (ep.hostRecv(&pipe)) {
+  }
+
+  ASSERT_EQ(a, ep.host_in);
+  ASSERT_EQ((std::vector<size_t>{ 64, 64, 0 }), ep.packets);
+  ASSERT_EQ(1U, ep.transfers);
+
+  // A short packet ends the transfer itself
+  std::string b = pattern(100, 4);
+  tx.pushN((const uint8_t*) b.data(), b.size());
+  pipe.poll();
+
+  while (ep.hostRecv(&pipe)) {
+  }
+
+  ASSERT_EQ(a + b, ep.host_in);
+  ASSERT_EQ((std::vector<size_t>{ 64, 64, 0, 64, 36 }), ep.packets);
+  ASSERT_EQ(2U, ep.transfers);
+
+  // Nothing queued, nothing sent
+  pipe.poll();
+  ASSERT_FALSE(pipe.txBusy());
+  ASSERT_EQ(5U, ep.packets.size());
+}
+
+TEST(UsbCdcPipeTest, txBusyEndpoint)
+{
+  FakeEndpoints ep;
+  CountingRing tx;
+  CountingRing rx;
+  Pipe pipe(&ep, &tx, &rx);
+  std::string a = pattern(40, 5);
+
+  // The endpoint refuses the packet, it stays staged and goes out on the next poll()
+  ep.in_refuse = 1;
+  tx.pushN((const uint8_t*) a.data(), a.size());
+  pipe.poll();
+  ASSERT_FALSE(pipe.txBusy());
+  ASSERT_TRUE(tx.empty());
+
+  pipe.poll();
+  ASSERT_TRUE(pipe.txBusy());
+  ASSERT_TRUE(ep.hostRecv(&pipe));
+  ASSERT_EQ(a, ep.host_in);
+}
+
+TEST(UsbCdcPipeTest, txStream)
+{
+  FakeEndpoints ep;
+  CountingRing tx;
+  CountingRing rx;
+  Pipe pipe(&ep, &tx, &rx);
+  std::string sent;
+  uint32_t seed = 3;
+
+  // Random writes interleaved with the host taking packets
+  for (int i = 0; i < 2000; i++) {
+    seed = seed * 1103515245 + 12345;
+
+    if (seed % 3 != 0) {
+      std::string data = pattern((seed >> 8) % 100, uint8_t(i));
+      sent += data.substr(0, tx.pushN((const uint8_t*) data.data(), data.size()));
+      pipe.poll();
+    } else {
+      ep.hostRecv(&pipe);
+    }
+  }
+
+  while (ep.hostRecv(&pipe)) {
+  }
+
+  ASSERT_EQ(sent, ep.host_in);
+  ASSERT_LT(0U, ep.packets.size());
+  ASSERT_GT(64U, ep.packets.back());
+
+  double kb = sent.size() / 1024.0;
+  TEST_MSG << "TX per KB: " << ep.packets.size() / kb << " packets, " << tx.pops / kb
+    << " ring reads, " << ep.transfers / kb << " transfers" << std::endl;
+}
+
+// } Tests
+
+} // namespace btr
@@ -0,0 +1,756 @@
+// Copyright (C) 2019 Sergey Kapustin <kapucin@gmail.com>
+
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+// SYSTEM INCLUDES
+#include <gtest/gtest.h>
+#include <string.h>
+#include <random>
+#include <vector>
+
+// PROJECT INCLUDES
+#include "devices/i2c.hpp"
+#include "devices/vl53l0x.hpp"
+#include "devices/vl53l0x_array.hpp"
+#include "utility/test_helpers.hpp"
+
+#if BTR_I2C_LINUX_DEV_ENABLED == 0
+
+namespace btr
+{
+
+//------------------------------------------------------------------------------
+
+/**
+ * Register model of a VL53L0X. Writing 0xFF selects a register page, the registers of pages other
+ * than 0 are kept in a second bank. Reference calibrations set VHV settings and phase calibration.
+ * A range measurement completes as soon as it's started or, if bus is set, once the bus has been
+ * busy for the measurement's duration. If sim is set, writing I2C_SLAVE_DEVICE_ADDRESS moves the
+ * model to the new address on it.
+ */
+class VL53L0XSim : public I2CSimDevice
+{
+public:
+
+  VL53L0XSim()
+    :
+      paged_()
+  {
+    regs_[VL53L0X::IDENTIFICATION_MODEL_ID] = 0xEE;
+    regs_[VL53L0X::PRE_RANGE_CONFIG_VCSEL_PERIOD] = 0x06;
+    regs_[VL53L0X::FINAL_RANGE_CONFIG_VCSEL_PERIOD] = 0x04;
+
+    for (uint8_t i = 0; i < 6; i++) {
+      regs_[VL53L0X::GLOBAL_CONFIG_SPAD_ENABLES_REF_0 + i] = 0xFF;
+    }
+
+    // Stop variable, SPAD count 5 of the aperture type.
+    paged_[0x91] = 0x3C;
+    paged_[0x92] = 0x85;
+  }
+
+  /**
+   * Set the range of the next measurement.
+   */
+  void setRange(uint16_t mm)
+  {
+    setReg16(VL53L0X::RESULT_RANGE_STATUS + 10, mm);
+  }
+
+  /**
+   * @return register of the page other than 0
+   */
+  uint8_t pagedReg(uint8_t reg) const
+  {
+    return paged_[reg];
+  }
+
+  /**
+   * Complete the current measurement, as the sensor would before pulling GPIO1 low.
+   */
+  void complete()
+  {
+    pending_ = false;
+    regs_[VL53L0X::RESULT_INTERRUPT_STATUS] = 0x04;
+  }
+
+  uint32_t measurements = 0;
+  uint32_t calibrations = 0;
+  uint32_t spad_requests = 0;
+  /** Results of the reference calibrations. */
+  uint8_t vhv_settings = 0x1E;
+  uint8_t phase_cal = 0x0B;
+  /** Bus that measures time, see the class description. */
+  const I2CSim* bus = nullptr;
+  /** About the default timing budget. */
+  uint64_t budget_ns = 33000000;
+  /** Bus that the model is attached to. */
+  I2CSim* sim = nullptr;
+  uint8_t addr = BTR_VL53L0X_ADDR_DFLT;
+  /** Register of page 0 whose writes are NACKed and dropped, -1 for none. */
+  int nack_reg = -1;
+
+protected:
+
+  bool onRegWrite(uint8_t reg, uint8_t value) override
+  {
+    if (reg == nack_reg && 0 == regs_[0xFF]) {
+      return false;
+    }
+
+    if (0xFF == reg || 0 == regs_[0xFF]) {
+      regs_[reg] = value;
+    } else {
+      paged_[reg] = value;
+    }
+
+    if (0 != regs_[0xFF]) {
+      // SPAD info is ready once requested.
+      if (0x83 == reg && 0x00 == value) {
+        paged_[reg] = 0x10;
+        spad_requests++;
+      }
+    } else if (VL53L0X::SYSRANGE_START == reg && (value & 0x01)) {
+      // Single shot, it also stops continuous mode.
+      measurements++;
+      continuous_ = false;
+      regs_[reg] = (value & ~0x01);
+
+      if (0x01 == regs_[VL53L0X::SYSTEM_SEQUENCE_CONFIG] && (value & 0x40)) {
+        calibrations++;
+        regs_[0xCB] = vhv_settings;
+      } else if (0x02 == regs_[VL53L0X::SYSTEM_SEQUENCE_CONFIG]) {
+        calibrations++;
+        regs_[0xEE] = ((regs_[0xEE] & 0x80) | phase_cal);
+      }
+      measure();
+    } else if (VL53L0X::SYSRANGE_START == reg && (value & 0x06)) {
+      continuous_ = true;
+      measure();
+    } else if (VL53L0X::I2C_SLAVE_DEVICE_ADDRESS == reg && nullptr != sim) {
+      sim->detach(addr);
+      addr = (value & 0x7F);
+      sim->attach(addr, this);
+    } else if (VL53L0X::SYSTEM_INTERRUPT_CLEAR == reg) {
+      regs_[VL53L0X::RESULT_INTERRUPT_STATUS] = 0x00;
+
+      if (continuous_) {
+        measure();
+      }
+    }
+    return true;
+  }
+
+  uint8_t onRegRead(uint8_t reg) override
+  {
+    if (0xFF != reg && 0 != regs_[0xFF]) {
+      return paged_[reg];
+    }
+
+    if (VL53L0X::RESULT_INTERRUPT_STATUS == reg && pending_ && nullptr != bus) {
+      // Statistics may have been reset since the start.
+      uint64_t now = bus->stats().bus_ns;
+      start_ns_ = (now < start_ns_ ? 0 : start_ns_);
+
+      if (now - start_ns_ >= budget_ns) {
+        complete();
+      }
+    }
+    return regs_[reg];
+  }
+
+private:
+
+  void measure()
+  {
+    if (nullptr == bus) {
+      complete();
+    } else {
+      pending_ = true;
+      start_ns_ = bus->stats().bus_ns;
+    }
+  }
+
+  uint8_t paged_[256];
+  bool continuous_ = false;
+  bool pending_ = false;
+  uint64_t start_ns_ = 0;
+};
+
+/**
+ * Count data-ready callbacks.
+ */
+static void countReady(void* arg)
+{
+  (*static_cast<uint32_t*>(arg))++;
+}
+
+class VL53L0XTest : public testing::Test
+{
+public:
+
+  VL53L0XTest()
+    :
+      i2c_(I2C::instance(BTR_VL53L0X_PORT_I2C, true))
+  {
+    i2c_->sim()->attach(BTR_VL53L0X_ADDR_DFLT, &dev_);
+    i2c_->sim()->resetStats();
+  }
+
+  ~VL53L0XTest()
+  {
+    i2c_->sim()->detach(BTR_VL53L0X_ADDR_DFLT);
+  }
+
+protected:
+
+  I2C* i2c_;
+  VL53L0XSim dev_;
+  VL53L0X sensor_;
+};
+
+class VL53L0XArrayTest : public testing::Test
+{
+public:
+
+  VL53L0XArrayTest()
+    :
+      i2c_(I2C::instance(BTR_VL53L0X_PORT_I2C, true)),
+      devs_(BTR_VL53L0X_ARRAY_SIZE)
+  {
+    for (VL53L0XSim& dev : devs_) {
+      dev.sim = i2c_->sim();
+    }
+  }
+
+  ~VL53L0XArrayTest()
+  {
+    for (VL53L0XSim& dev : devs_) {
+      i2c_->sim()->detach(dev.addr);
+    }
+  }
+
+  /**
+   * Model XSHUT: a sensor in shutdown is off the bus and comes back at the default address.
+   */
+  static void xshut(uint8_t index, bool on, void* arg)
+  {
+    VL53L0XArrayTest* self = static_cast<VL53L0XArrayTest*>(arg);
+    VL53L0XSim& dev = self->devs_[index];
+
+    self->i2c_->sim()->detach(dev.addr);
+
+    if (on) {
+      dev.addr = BTR_VL53L0X_ADDR_DFLT;
+      self->i2c_->sim()->attach(dev.addr, &dev);
+    }
+  }
+
+protected:
+
+  I2C* i2c_;
+  std::vector<VL53L0XSim> devs_;
+  VL53L0XArray array_;
+};
+
+//------------------------------------------------------------------------------
+
+// Tests {
+
+TEST_F(VL53L0XTest, init)
+{
+  ASSERT_EQ(0, sensor_.init(true));
+  ASSERT_EQ(2U, dev_.measurements);
+  ASSERT_EQ(0x00, dev_.reg(VL53L0X::RESULT_INTERRUPT_STATUS));
+  ASSERT_EQ(0xE8, dev_.reg(VL53L0X::SYSTEM_SEQUENCE_CONFIG));
+
+  const I2CSim::Stats& stats = i2c_->sim()->stats();
+  // Each transfer ends with a stop.
+  ASSERT_EQ(stats.starts, stats.stops + stats.repeated_starts);
+
+  TEST_MSG << "init(): " << stats.starts << " starts, " << stats.bytes << " bytes, "
+    << stats.bus_ns / 1000.0 << " us at " << BTR_I2C_SPEED << " Hz" << std::endl;
+}
+
+#if BTR_VL53L0X_FIXED_POINT_ENABLED == 0
+
+TEST_F(VL53L0XTest, signalRateLimit)
+{
+  // Q9.7, most significant byte first.
+  ASSERT_TRUE(sensor_.setSignalRateLimit(0.5));
+  ASSERT_EQ(0x0040, dev_.reg16(VL53L0X::FINAL_RANGE_CONFIG_MIN_COUNT_RATE_RTN_LIMIT));
+  ASSERT_FLOAT_EQ(0.5, sensor_.getSignalRateLimit());
+
+  ASSERT_TRUE(sensor_.setSignalRateLimit(3.25));
+  ASSERT_EQ(0x01A0, dev_.reg16(VL53L0X::FINAL_RANGE_CONFIG_MIN_COUNT_RATE_RTN_LIMIT));
+  ASSERT_FLOAT_EQ(3.25, sensor_.getSignalRateLimit());
+}
+
+TEST_F(VL53L0XTest, signalRateLimitQ7EqualsFloat)
+{
+  const uint16_t reg = VL53L0X::FINAL_RANGE_CONFIG_MIN_COUNT_RATE_RTN_LIMIT;
+
+  // Every representable limit, and halfway between, which the float path truncates.
+  for (uint32_t q = 0; q <= 0xFFFF; q++) {
+    for (float f : {q / 128.f, (q + 0.5f) / 128.f}) {
+      dev_.setReg16(reg, 0x1234);
+      bool applied = sensor_.setSignalRateLimit(f);
+      uint16_t expected = dev_.reg16(reg);
+      dev_.setReg16(reg, 0x1234);
+
+      ASSERT_EQ(applied, sensor_.setSignalRateLimitQ7(uint16_t(f * (1 << 7)))) << " q: " << q;
+      ASSERT_EQ(expected, dev_.reg16(reg)) << " q: " << q;
+    }
+
+    dev_.setReg16(reg, uint16_t(q));
+    ASSERT_EQ(q / 128.f, sensor_.getSignalRateLimit());
+    ASSERT_EQ(q, sensor_.getSignalRateLimitQ7());
+  }
+}
+
+#endif // BTR_VL53L0X_FIXED_POINT_ENABLED == 0
+
+TEST_F(VL53L0XTest, signalRateLimitQ7)
+{
+  const uint16_t reg = VL53L0X::FINAL_RANGE_CONFIG_MIN_COUNT_RATE_RTN_LIMIT;
+
+  ASSERT_TRUE(sensor_.setSignalRateLimitQ7(0x0040));
+  ASSERT_EQ(0x0040, dev_.reg16(reg));
+  ASSERT_EQ(0x0040, sensor_.getSignalRateLimitQ7());
+
+  ASSERT_TRUE(sensor_.setSignalRateLimitQ7(0));
+  ASSERT_TRUE(sensor_.setSignalRateLimitQ7(uint16_t(BTR_VL53L0X_LIMIT_MCPS_MAX * (1 << 7))));
+  ASSERT_FALSE(sensor_.setSignalRateLimitQ7(uint16_t(BTR_VL53L0X_LIMIT_MCPS_MAX * (1 << 7)) + 1));
+  ASSERT_EQ(uint16_t(BTR_VL53L0X_LIMIT_MCPS_MAX * (1 << 7)), dev_.reg16(reg));
+}
+
+TEST_F(VL53L0XTest, timeoutConversions)
+{
+  // The division form the reciprocals replace.
+  auto mclks_to_us = [](uint16_t mclks, uint32_t period_ns) -> uint32_t {
+    return ((mclks * period_ns) + (period_ns / 2)) / 1000;
+  };
+  auto us_to_mclks = [](uint32_t us, uint32_t period_ns) -> uint32_t {
+    return ((us * 1000) + (period_ns / 2)) / period_ns;
+  };
+
+  std::mt19937 gen(20190101);
+
+  for (uint8_t pclks = 0; pclks < 32; pclks++) {
+    uint32_t period_ns = BTR_VL53L0X_CALC_PERIOD(pclks);
+
+    for (uint32_t mclks = 0; mclks <= 0xFFFF; mclks++) {
+      ASSERT_EQ(mclks_to_us(mclks, period_ns), VL53L0X::timeoutMclksToMicroseconds(mclks, pclks))
+        << " mclks: " << mclks << ", pclks: " << uint32_t(pclks);
+    }
+
+    if (0 == period_ns) {
+      continue;
+    }
+
+    // Timing budgets go up to seconds, past those at random.
+    for (uint32_t us = 0; us <= 0x3FFFFF; us++) {
+      ASSERT_EQ(us_to_mclks(us, period_ns), VL53L0X::timeoutMicrosecondsToMclks(us, pclks))
+        << " us: " << us << ", pclks: " << uint32_t(pclks);
+    }
+
+    for (int i = 0; i < 100000; i++) {
+      uint32_t us = gen();
+      ASSERT_EQ(us_to_mclks(us, period_ns), VL53L0X::timeoutMicrosecondsToMclks(us, pclks))
+        << " us: " << us << ", pclks: " << uint32_t(pclks);
+    }
+  }
+}
+
+TEST_F(VL53L0XTest, tuningOps)
+{
+  const uint8_t REF_ADDR = BTR_VL53L0X_ADDR_DFLT + 1;
+  const I2CSim::Stats& stats = i2c_->sim()->stats();
+  VL53L0XSim ref;
+  uint8_t page = 0;
+
+  // One transaction per register.
+  i2c_->sim()->attach(REF_ADDR, &ref);
+
+  for (uint16_t i = 0; i < VL53L0X::TUNING_OPS_COUNT; i++) {
+    const VL53L0X::RegOp& op = VL53L0X::TUNING_OPS[i];
+
+    if (op.page != page) {
+      page = op.page;
+      i2c_->write(REF_ADDR, 0xFF, page);
+    }
+    i2c_->write(REF_ADDR, op.reg, op.value);
+  }
+  i2c_->write(REF_ADDR, 0xFF, uint8_t(0));
+  i2c_->sim()->detach(REF_ADDR);
+
+  uint32_t ref_stops = stats.stops;
+  double ref_us = stats.bus_ns / 1000.0;
+
+  i2c_->sim()->resetStats();
+  sensor_.writeOps(VL53L0X::TUNING_OPS, VL53L0X::TUNING_OPS_COUNT);
+
+  for (uint16_t reg = 0; reg < 256; reg++) {
+    ASSERT_EQ(ref.reg(reg), dev_.reg(reg)) << "reg: " << reg;
+    ASSERT_EQ(ref.pagedReg(reg), dev_.pagedReg(reg)) << "paged reg: " << reg;
+  }
+  ASSERT_GT(ref_stops, stats.stops);
+
+  TEST_MSG << "Tuning settings at " << BTR_I2C_SPEED << " Hz: " << ref_stops << " transactions, "
+    << ref_us << " us one register at a time, " << stats.stops << " transactions, "
+    << stats.bus_ns / 1000.0 << " us in bursts" << std::endl;
+}
+
+TEST_F(VL53L0XTest, timingReconfiguration)
+{
+  const I2CSim::Stats& stats = i2c_->sim()->stats();
+
+  ASSERT_EQ(0, sensor_.init(true));
+  uint16_t final_timeout = dev_.reg16(VL53L0X::FINAL_RANGE_CONFIG_TIMEOUT_MACROP_HI);
+
+  i2c_->sim()->resetStats();
+  ASSERT_TRUE(sensor_.setMeasurementTimingBudget(50000));
+  ASSERT_LT(final_timeout, dev_.reg16(VL53L0X::FINAL_RANGE_CONFIG_TIMEOUT_MACROP_HI));
+  uint32_t budget_stops = stats.stops;
+
+  i2c_->sim()->resetStats();
+  ASSERT_NEAR(50000, sensor_.getMeasurementTimingBudget(), 2000);
+  uint32_t get_stops = stats.stops;
+
+  i2c_->sim()->resetStats();
+  ASSERT_TRUE(sensor_.setVcselPulsePeriod(VL53L0X::VcselPeriodFinalRange, 14));
+  ASSERT_EQ(BTR_VL53L0X_ENCODE_VCSEL(14), dev_.reg(VL53L0X::FINAL_RANGE_CONFIG_VCSEL_PERIOD));
+  ASSERT_EQ(14, sensor_.getVcselPulsePeriod(VL53L0X::VcselPeriodFinalRange));
+  uint32_t vcsel_stops = stats.stops;
+
+  // The budget stays the same with the longer period.
+  ASSERT_NEAR(50000, sensor_.getMeasurementTimingBudget(), 2000);
+
+  // The same as read from the registers.
+  VL53L0X other;
+  ASSERT_EQ(sensor_.getMeasurementTimingBudget(), other.getMeasurementTimingBudget());
+  ASSERT_EQ(14, other.getVcselPulsePeriod(VL53L0X::VcselPeriodFinalRange));
+
+  TEST_MSG << "I2C transactions: setMeasurementTimingBudget() " << budget_stops
+    << ", getMeasurementTimingBudget() " << get_stops << ", setVcselPulsePeriod() " << vcsel_stops
+    << std::endl;
+}
+
+TEST_F(VL53L0XTest, failedWriteInvalidatesShadow)
+{
+  ASSERT_EQ(0, sensor_.init(true));
+  ASSERT_TRUE(sensor_.setMeasurementTimingBudget(50000));
+  uint32_t budget = sensor_.getMeasurementTimingBudget();
+  uint16_t final_timeout = dev_.reg16(VL53L0X::FINAL_RANGE_CONFIG_TIMEOUT_MACROP_HI);
+
+  // The final range timeout doesn't reach the sensor.
+  dev_.nack_reg = VL53L0X::FINAL_RANGE_CONFIG_TIMEOUT_MACROP_HI;
+  sensor_.setMeasurementTimingBudget(80000);
+  ASSERT_EQ(final_timeout, dev_.reg16(VL53L0X::FINAL_RANGE_CONFIG_TIMEOUT_MACROP_HI));
+  ASSERT_LT(0U, i2c_->sim()->stats().nacks);
+
+  // The budget comes from the registers, not from what the sensor didn't get.
+  dev_.nack_reg = -1;
+  ASSERT_EQ(budget, sensor_.getMeasurementTimingBudget());
+
+  ASSERT_TRUE(sensor_.setMeasurementTimingBudget(80000));
+  ASSERT_NEAR(80000, sensor_.getMeasurementTimingBudget(), 2000);
+}
+
+TEST_F(VL53L0XTest, calibrationRestore)
+{
+  const I2CSim::Stats& stats = i2c_->sim()->stats();
+  VL53L0X::Calibration cal;
+
+  ASSERT_FALSE(sensor_.getCalibration(&cal));
+  ASSERT_EQ(0, sensor_.init(true));
+  ASSERT_EQ(2U, dev_.calibrations);
+  ASSERT_EQ(1U, dev_.spad_requests);
+
+  uint32_t cold_stops = stats.stops;
+  double cold_us = stats.bus_ns / 1000.0;
+
+  ASSERT_TRUE(sensor_.getCalibration(&cal));
+  ASSERT_TRUE(VL53L0X::isValid(cal));
+  ASSERT_EQ(0x3C, cal.stop_var);
+  ASSERT_EQ(0x85, cal.spad_info);
+  ASSERT_EQ(dev_.vhv_settings, cal.vhv_settings);
+  ASSERT_EQ(dev_.phase_cal, cal.phase_cal);
+
+  // The next boot.
+  VL53L0XSim warm;
+  VL53L0X other;
+  i2c_->sim()->attach(BTR_VL53L0X_ADDR_DFLT, &warm);
+  i2c_->sim()->resetStats();
+
+  ASSERT_EQ(0, other.init(cal));
+  ASSERT_EQ(0U, warm.calibrations);
+  ASSERT_EQ(0U, warm.spad_requests);
+
+  uint32_t warm_stops = stats.stops;
+  double warm_us = stats.bus_ns / 1000.0;
+
+  // The SPAD info readout registers aside, the sensor ends up the same.
+  for (uint16_t reg = 0; reg < 256; reg++) {
+    ASSERT_EQ(dev_.reg(reg), warm.reg(reg)) << "reg: " << reg;
+
+    if (0x80 != reg && 0x81 != reg && 0x83 != reg && 0x94 != reg) {
+      ASSERT_EQ(dev_.pagedReg(reg), warm.pagedReg(reg)) << "paged reg: " << reg;
+    }
+  }
+
+  VL53L0X::Calibration restored;
+  ASSERT_TRUE(other.getCalibration(&restored));
+  ASSERT_EQ(0, memcmp(&cal, &restored, sizeof(cal)));
+
+  // Corrupt data, full init.
+  VL53L0XSim cold;
+  i2c_->sim()->attach(BTR_VL53L0X_ADDR_DFLT, &cold);
+  cal.spad_map[0] ^= 0x01;
+  ASSERT_FALSE(VL53L0X::isValid(cal));
+  ASSERT_EQ(0, other.init(cal));
+  ASSERT_EQ(2U, cold.calibrations);
+  ASSERT_EQ(1U, cold.spad_requests);
+
+  TEST_MSG << "Startup at " << BTR_I2C_SPEED << " Hz: " << cold_stops << " transactions, "
+    << cold_us << " us on the bus with calibration, " << warm_stops << " transactions, "
+    << warm_us << " us restored, without the calibration and SPAD info wait times" << std::endl;
+}
+
+TEST_F(VL53L0XTest, initSteps)
+{
+  ASSERT_EQ(VL53L0X::INIT_ERROR, sensor_.initStep());
+
+  // The calibrations wait for the bus to be busy for budget_ns.
+  dev_.bus = i2c_->sim();
+  dev_.budget_ns = UINT64_MAX;
+  sensor_.startInit(true);
+
+  uint32_t steps = 0;
+
+  for (; steps < 10; steps++) {
+    ASSERT_EQ(VL53L0X::INIT_PENDING, sensor_.initStep());
+  }
+  ASSERT_EQ(1U, dev_.calibrations);
+
+  dev_.complete();
+  ASSERT_EQ(VL53L0X::INIT_PENDING, sensor_.initStep());
+  ASSERT_EQ(2U, dev_.calibrations);
+  dev_.complete();
+  ASSERT_EQ(VL53L0X::INIT_DONE, sensor_.initStep());
+  ASSERT_EQ(VL53L0X::INIT_DONE, sensor_.initStep());
+  ASSERT_EQ(0xE8, dev_.reg(VL53L0X::SYSTEM_SEQUENCE_CONFIG));
+
+  // Restoring calibration doesn't wait.
+  VL53L0X::Calibration cal;
+  ASSERT_TRUE(sensor_.getCalibration(&cal));
+  sensor_.startInit(cal);
+  ASSERT_EQ(VL53L0X::INIT_PENDING, sensor_.initStep());
+  ASSERT_EQ(VL53L0X::INIT_DONE, sensor_.initStep());
+  ASSERT_EQ(2U, dev_.calibrations);
+}
+
+TEST_F(VL53L0XTest, readRangeSingle)
+{
+  ASSERT_EQ(0, sensor_.init(true));
+  dev_.setRange(500);
+  i2c_->sim()->resetStats();
+
+  ASSERT_EQ(500 + BTR_VL53L0X_COMPENSATE_MM, sensor_.readRangeSingleMillimeters());
+  ASSERT_EQ(0x00, dev_.reg(VL53L0X::RESULT_INTERRUPT_STATUS));
+
+  const I2CSim::Stats& stats = i2c_->sim()->stats();
+  TEST_MSG << "readRangeSingleMillimeters(): " << stats.starts << " starts, " << stats.bytes
+    << " bytes, " << stats.bus_ns / 1000.0 << " us at " << BTR_I2C_SPEED << " Hz" << std::endl;
+}
+
+TEST_F(VL53L0XTest, rangeTransactions)
+{
+  const uint32_t SAMPLES = 10;
+  const I2CSim::Stats& stats = i2c_->sim()->stats();
+  uint16_t mm = 0;
+
+  ASSERT_EQ(0, sensor_.init(true));
+  dev_.setRange(300);
+
+  // Polling the interrupt status for the measurement's duration.
+  dev_.bus = i2c_->sim();
+  sensor_.startContinuous();
+  i2c_->sim()->resetStats();
+
+  for (uint32_t i = 0; i < SAMPLES; i++) {
+    ASSERT_EQ(300 + BTR_VL53L0X_COMPENSATE_MM, sensor_.readRangeContinuousMillimeters());
+  }
+
+  uint32_t polled = stats.stops;
+  double polled_ms = stats.bus_ns / 1e6;
+
+  // The GPIO1 interrupt: nothing on the bus until a sample is ready.
+  uint32_t irqs = 0;
+  dev_.budget_ns = UINT64_MAX;
+  sensor_.enableDataReadyIrq(countReady, &irqs);
+  i2c_->sim()->resetStats();
+
+  for (uint32_t i = 0; i < SAMPLES; i++) {
+    ASSERT_FALSE(sensor_.tryReadRange(&mm));
+    ASSERT_FALSE(sensor_.dataReady());
+
+    dev_.complete();
+    sensor_.onDataReady();
+    ASSERT_TRUE(sensor_.dataReady());
+    ASSERT_TRUE(sensor_.tryReadRange(&mm));
+    ASSERT_EQ(300 + BTR_VL53L0X_COMPENSATE_MM, mm);
+    ASSERT_EQ(0x00, dev_.reg(VL53L0X::RESULT_INTERRUPT_STATUS));
+  }
+
+  ASSERT_EQ(SAMPLES, irqs);
+  // Range read and interrupt clear.
+  ASSERT_EQ(2 * SAMPLES, stats.stops);
+
+  TEST_MSG << "I2C transactions per sample at " << BTR_I2C_SPEED << " Hz: "
+    << double(polled) / SAMPLES << " polling (" << polled_ms / SAMPLES << " ms on the bus), "
+    << double(stats.stops) / SAMPLES << " with GPIO1 (" << stats.bus_ns / 1e6 / SAMPLES
+    << " ms)" << std::endl;
+}
+
+TEST_F(VL53L0XArrayTest, init)
+{
+  ASSERT_EQ(-1, array_.init(2, nullptr, nullptr));
+  ASSERT_EQ(0, array_.init(3, xshut, this));
+  ASSERT_EQ(3, array_.count());
+
+  for (uint8_t i = 0; i < 3; i++) {
+    ASSERT_EQ(BTR_VL53L0X_ARRAY_ADDR + i, devs_[i].addr);
+    ASSERT_EQ(devs_[i].addr, array_.sensor(i)->getAddress());
+    ASSERT_EQ(&devs_[i], i2c_->sim()->device(devs_[i].addr));
+  }
+  ASSERT_EQ(nullptr, i2c_->sim()->device(BTR_VL53L0X_ADDR_DFLT));
+  ASSERT_EQ(nullptr, array_.sensor(3));
+}
+
+TEST_F(VL53L0XArrayTest, interleavedInit)
+{
+  const I2CSim::Stats& stats = i2c_->sim()->stats();
+  VL53L0X sensors[BTR_VL53L0X_ARRAY_SIZE];
+  VL53L0X::Calibration cal;
+
+  // Bus time of one init() without the waits for calibration.
+  ASSERT_EQ(0, array_.init(1, xshut, this));
+  i2c_->sim()->resetStats();
+  ASSERT_EQ(0, array_.sensor(0)->init(true));
+  double transfer_ms = stats.bus_ns / 1e6;
+
+  for (VL53L0XSim& dev : devs_) {
+    dev.bus = i2c_->sim();
+  }
+
+  double one_ms = 0;
+
+  for (uint8_t n = 1; n <= BTR_VL53L0X_ARRAY_SIZE; n *= 2) {
+    // One sensor after another.
+    for (uint8_t i = 0; i < n; i++) {
+      xshut(i, false, this);
+      xshut(i, true, this);
+      sensors[i].resetAddress();
+      sensors[i].setAddress(BTR_VL53L0X_ARRAY_ADDR + i);
+    }
+
+    i2c_->sim()->resetStats();
+
+    for (uint8_t i = 0; i < n; i++) {
+      ASSERT_EQ(0, sensors[i].init(true));
+    }
+
+    double serial_ms = stats.bus_ns / 1e6;
+
+    // Together.
+    for (uint8_t i = 0; i < n; i++) {
+      devs_[i].calibrations = 0;
+    }
+
+    i2c_->sim()->resetStats();
+    ASSERT_EQ(0, array_.init(n, xshut, this));
+    double together_ms = stats.bus_ns / 1e6;
+
+    for (uint8_t i = 0; i < n; i++) {
+      ASSERT_EQ(2U, devs_[i].calibrations);
+      ASSERT_TRUE(array_.sensor(i)->getCalibration(&cal));
+      ASSERT_EQ(devs_[i].vhv_settings, cal.vhv_settings);
+    }
+
+    one_ms = (1 == n ? together_ms : one_ms);
+    ASSERT_GE(one_ms + (n - 1) * transfer_ms, together_ms);
+
+    TEST_MSG << uint32_t(n) << " sensors at " << BTR_I2C_SPEED << " Hz: " << serial_ms
+      << " ms one after another, " << together_ms << " ms together, " << transfer_ms
+      << " ms of transfers per sensor" << std::endl;
+  }
+}
+
+TEST_F(VL53L0XArrayTest, snapshot)
+{
+  const uint32_t CYCLES = 5;
+  const I2CSim::Stats& stats = i2c_->sim()->stats();
+
+  for (uint8_t n = 1; n <= BTR_VL53L0X_ARRAY_SIZE; n *= 2) {
+    ASSERT_EQ(0, array_.init(n, xshut, this));
+
+    for (uint8_t i = 0; i < n; i++) {
+      devs_[i].setRange(100 + 10 * i);
+      devs_[i].bus = i2c_->sim();
+    }
+
+    // All sensors range at once, the bus is only busy reading the status and the results.
+    i2c_->sim()->resetStats();
+    array_.start();
+
+    uint32_t first = array_.snapshot().cycle;
+    uint32_t polls = 0;
+
+    while (array_.snapshot().cycle - first < CYCLES) {
+      ASSERT_GT(1000000U, polls++);
+
+      if (array_.poll()) {
+        const VL53L0XArray::Snapshot& snap = array_.snapshot();
+
+        for (uint8_t i = 0; i < n; i++) {
+          ASSERT_EQ(100 + 10 * i + BTR_VL53L0X_COMPENSATE_MM, snap.mm[i]);
+        }
+      }
+    }
+    array_.stop();
+
+    double array_hz = n * CYCLES / (stats.bus_ns / 1e9);
+
+    // One sensor after another.
+    i2c_->sim()->resetStats();
+
+    for (uint32_t c = 0; c < CYCLES; c++) {
+      for (uint8_t i = 0; i < n; i++) {
+        ASSERT_EQ(100 + 10 * i + BTR_VL53L0X_COMPENSATE_MM,
+            array_.sensor(i)->readRangeSingleMillimeters());
+      }
+    }
+
+    double single_hz = n * CYCLES / (stats.bus_ns / 1e9);
+
+    if (n > 1) {
+      ASSERT_LT(single_hz * n / 2, array_hz);
+    }
+
+    TEST_MSG << uint32_t(n) << " sensors at " << BTR_I2C_SPEED << " Hz: " << array_hz
+      << " samples/s staggered, " << single_hz << " samples/s one at a time" << std::endl;
+
+    for (uint8_t i = 0; i < n; i++) {
+      devs_[i].bus = nullptr;
+    }
+  }
+}
+
+// } Tests
+
+} // namespace btr
+
+#endif // BTR_I2C_LINUX_DEV_ENABLED == 0